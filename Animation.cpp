@@ -0,0 +1,306 @@
+#include <algorithm>
+#include <cmath>
+#include "Animation.h"
+#include "BatchTransform.h"
+#include "TaskSystem.h"
+
+namespace {
+    // the three smaller components of a unit quaternion are within +-1/sqrt(2)
+    const float SmallestThreeRange = 0.70710678f;
+    const float RotationScale = 32767.0f;
+    const float TranslationScale = 65535.0f;
+
+    // characters per task, a few microseconds of work each
+    const size_t CharacterGrain = 32;
+
+    const Gm::Quat IdentityRotation = {0.0f, 0.0f, 0.0f, 1.0f};
+
+    // the two poses AnimateCharacters blends, one pair per thread that runs its tasks, kept across frames
+    struct PoseScratch {
+        std::vector<Gm::JointPose> a, b;
+    };
+
+    thread_local PoseScratch t_poses;
+
+    float Dot(const Gm::Quat &a, const Gm::Quat &b) {
+        return a.x * b.x + a.y * b.y + a.z * b.z + a.w * b.w;
+    }
+
+    // normalized lerp, through the shorter arc
+    Gm::Quat Nlerp(const Gm::Quat &a, const Gm::Quat &b, float t) {
+        float weightB = Dot(a, b) < 0.0f ? -t : t;
+        float weightA = 1.0f - t;
+        Gm::Quat result = {weightA * a.x + weightB * b.x, weightA * a.y + weightB * b.y, weightA * a.z + weightB * b.z,
+                           weightA * a.w + weightB * b.w};
+        float scale = 1.0f / std::sqrt(Dot(result, result));
+        return {result.x * scale, result.y * scale, result.z * scale, result.w * scale};
+    }
+
+    Gm::Vec4 Lerp(const Gm::Vec4 &a, const Gm::Vec4 &b, float t) {
+        return {a.x + (b.x - a.x) * t, a.y + (b.y - a.y) * t, a.z + (b.z - a.z) * t, 0.0f};
+    }
+
+    float AngleBetween(const Gm::Quat &a, const Gm::Quat &b) {
+        return 2.0f * std::acos(std::min(std::fabs(Dot(a, b)), 1.0f));
+    }
+
+    float Distance(const Gm::Vec4 &a, const Gm::Vec4 &b) {
+        float x = a.x - b.x, y = a.y - b.y, z = a.z - b.z;
+        return std::sqrt(x * x + y * y + z * z);
+    }
+
+    uint16_t Quantize(float value, float scale) {
+        return (uint16_t) std::lround(std::min(std::max(value, 0.0f), 1.0f) * scale);
+    }
+
+    // the index of the dropped component goes into the top bits of the first two values
+    void EncodeRotation(const Gm::Quat &rotation, uint16_t values[3]) {
+        float components[4] = {rotation.x, rotation.y, rotation.z, rotation.w};
+        int largest = 0;
+        for (int i = 1; i < 4; ++i) {
+            if (std::fabs(components[i]) > std::fabs(components[largest])) {
+                largest = i;
+            }
+        }
+        // q and -q are the same rotation, make the dropped one positive
+        float sign = components[largest] < 0.0f ? -1.0f : 1.0f;
+        for (int i = 0, value = 0; i < 4; ++i) {
+            if (i != largest) {
+                values[value++] = Quantize(components[i] * sign / SmallestThreeRange * 0.5f + 0.5f, RotationScale);
+            }
+        }
+        values[0] |= (uint16_t) ((largest & 1) << 15);
+        values[1] |= (uint16_t) ((largest >> 1) << 15);
+    }
+
+    Gm::Quat DecodeRotation(const uint16_t values[3]) {
+        int largest = (values[0] >> 15) | ((values[1] >> 15) << 1);
+        float components[4];
+        float sum = 0.0f;
+        for (int i = 0, value = 0; i < 4; ++i) {
+            if (i != largest) {
+                float component = ((values[value++] & 0x7fff) / RotationScale * 2.0f - 1.0f) * SmallestThreeRange;
+                components[i] = component;
+                sum += component * component;
+            }
+        }
+        components[largest] = std::sqrt(std::max(1.0f - sum, 0.0f));
+        return {components[0], components[1], components[2], components[3]};
+    }
+
+    // Greedy linear key reduction: from each kept frame, reach as far as interpolating to the next kept frame
+    // keeps every frame in between within tolerance. `fits(first, last)` tests that for one span.
+    template<typename Fits>
+    void FitKeys(uint32_t frameCount, const Fits &fits, std::vector<uint32_t> &kept) {
+        kept.assign(1, 0);
+        uint32_t start = 0;
+        while (start + 1 < frameCount) {
+            uint32_t end = start + 1;
+            while (end + 1 < frameCount && fits(start, end + 1)) {
+                ++end;
+            }
+            kept.push_back(end);
+            start = end;
+        }
+    }
+}
+
+Gm::AnimationClip Gm::AnimationClip::Compress(const RawClip &raw, float rotationTolerance,
+                                              float translationTolerance) {
+    AnimationClip clip;
+    clip.m_sampleRate = raw.sampleRate;
+    clip.m_frameCount = (uint32_t) std::min<size_t>(raw.FrameCount(), 65536);
+    size_t joints = raw.jointCount;
+    uint32_t frames = clip.m_frameCount;
+
+    std::vector<Key> encoded(frames);
+    std::vector<Quat> rotations(frames);
+    std::vector<Vec4> translations(frames);
+    std::vector<uint32_t> kept;
+    for (size_t joint = 0; joint < joints; ++joint) {
+        // rotations, compared as they decode so quantization counts against the tolerance
+        for (uint32_t frame = 0; frame < frames; ++frame) {
+            encoded[frame].frame = (uint16_t) frame;
+            EncodeRotation(raw.frames[frame * joints + joint].rotation, encoded[frame].values);
+            rotations[frame] = DecodeRotation(encoded[frame].values);
+        }
+        FitKeys(frames, [&](uint32_t first, uint32_t last) {
+            for (uint32_t frame = first + 1; frame < last; ++frame) {
+                Quat interpolated = Nlerp(rotations[first], rotations[last], (float) (frame - first) / (last - first));
+                if (AngleBetween(interpolated, raw.frames[frame * joints + joint].rotation) > rotationTolerance) {
+                    return false;
+                }
+            }
+            return true;
+        }, kept);
+        Track rotationTrack = {(uint32_t) clip.m_keys.size(), frames > 0 ? (uint32_t) kept.size() : 0, {}, {}};
+        for (uint32_t k = 0; k < rotationTrack.keyCount; ++k) {
+            clip.m_keys.push_back(encoded[kept[k]]);
+        }
+        clip.m_rotationTracks.push_back(rotationTrack);
+
+        // translations, over the range the joint covers in this clip
+        Track translationTrack = {(uint32_t) clip.m_keys.size(), 0, {}, {}};
+        float maximum[3];
+        for (int axis = 0; axis < 3; ++axis) {
+            translationTrack.minimum[axis] = frames > 0 ? 1e30f : 0.0f;
+            maximum[axis] = frames > 0 ? -1e30f : 0.0f;
+        }
+        for (uint32_t frame = 0; frame < frames; ++frame) {
+            const float *value = &raw.frames[frame * joints + joint].translation.x;
+            for (int axis = 0; axis < 3; ++axis) {
+                translationTrack.minimum[axis] = std::min(translationTrack.minimum[axis], value[axis]);
+                maximum[axis] = std::max(maximum[axis], value[axis]);
+            }
+        }
+        for (int axis = 0; axis < 3; ++axis) {
+            translationTrack.extent[axis] = maximum[axis] - translationTrack.minimum[axis];
+        }
+        for (uint32_t frame = 0; frame < frames; ++frame) {
+            const float *value = &raw.frames[frame * joints + joint].translation.x;
+            float *decoded = &translations[frame].x;
+            encoded[frame].frame = (uint16_t) frame;
+            for (int axis = 0; axis < 3; ++axis) {
+                float extent = translationTrack.extent[axis];
+                uint16_t quantized = extent > 0.0f ? Quantize((value[axis] - translationTrack.minimum[axis]) / extent,
+                                                              TranslationScale) : 0;
+                encoded[frame].values[axis] = quantized;
+                decoded[axis] = translationTrack.minimum[axis] + quantized / TranslationScale * extent;
+            }
+        }
+        FitKeys(frames, [&](uint32_t first, uint32_t last) {
+            for (uint32_t frame = first + 1; frame < last; ++frame) {
+                Vec4 interpolated = Lerp(translations[first], translations[last],
+                                         (float) (frame - first) / (last - first));
+                if (Distance(interpolated, raw.frames[frame * joints + joint].translation) > translationTolerance) {
+                    return false;
+                }
+            }
+            return true;
+        }, kept);
+        translationTrack.keyCount = frames > 0 ? (uint32_t) kept.size() : 0;
+        for (uint32_t k = 0; k < translationTrack.keyCount; ++k) {
+            clip.m_keys.push_back(encoded[kept[k]]);
+        }
+        clip.m_translationTracks.push_back(translationTrack);
+    }
+    return clip;
+}
+
+size_t Gm::AnimationClip::ByteSize() const {
+    return m_keys.size() * sizeof(Key) + (m_rotationTracks.size() + m_translationTracks.size()) * sizeof(Track);
+}
+
+const Gm::AnimationClip::Key *Gm::AnimationClip::FindKeys(const Track &track, float frame, float &t) const {
+    t = 0.0f;
+    if (track.keyCount == 0) {
+        return nullptr;
+    }
+    const Key *first = &m_keys[track.firstKey];
+    const Key *last = first + track.keyCount;
+    // the first key past `frame`
+    const Key *next = std::upper_bound(first, last, frame, [](float value, const Key &key) {
+        return value < key.frame;
+    });
+    if (next == first || next == last) {
+        return next == first ? first : last - 1;
+    }
+    const Key *previous = next - 1;
+    t = (frame - previous->frame) / (float) (next->frame - previous->frame);
+    return previous;
+}
+
+void Gm::AnimationClip::Sample(float time, JointPose *pose) const {
+    float frame = 0.0f;
+    if (m_frameCount > 1) {
+        float duration = Duration();
+        float wrapped = std::fmod(time, duration);
+        if (wrapped < 0.0f) {
+            wrapped += duration;
+        }
+        frame = std::min(wrapped * m_sampleRate, (float) (m_frameCount - 1));
+    }
+    for (size_t joint = 0; joint < m_rotationTracks.size(); ++joint) {
+        float t;
+        const Key *key = FindKeys(m_rotationTracks[joint], frame, t);
+        if (key == nullptr) {
+            pose[joint].rotation = IdentityRotation;
+        } else if (t > 0.0f) {
+            pose[joint].rotation = Nlerp(DecodeRotation(key[0].values), DecodeRotation(key[1].values), t);
+        } else {
+            pose[joint].rotation = DecodeRotation(key[0].values);
+        }
+
+        const Track &track = m_translationTracks[joint];
+        key = FindKeys(track, frame, t);
+        Vec4 &translation = pose[joint].translation;
+        translation = {0.0f, 0.0f, 0.0f, 0.0f};
+        if (key != nullptr) {
+            float *value = &translation.x;
+            for (int axis = 0; axis < 3; ++axis) {
+                float quantized = key[0].values[axis];
+                if (t > 0.0f) {
+                    quantized += (key[1].values[axis] - quantized) * t;
+                }
+                value[axis] = track.minimum[axis] + quantized / TranslationScale * track.extent[axis];
+            }
+        }
+    }
+}
+
+void Gm::BlendPoses(const JointPose *a, const JointPose *b, float weight, size_t count, JointPose *result) {
+    for (size_t joint = 0; joint < count; ++joint) {
+        Quat rotation = Nlerp(a[joint].rotation, b[joint].rotation, weight);
+        result[joint].translation = Lerp(a[joint].translation, b[joint].translation, weight);
+        result[joint].rotation = rotation;
+    }
+}
+
+void Gm::BuildSkinningMatrices(const Skeleton &skeleton, const JointPose *pose, Mat4 *palette) {
+    size_t joints = skeleton.JointCount();
+    // model space joints first, parents are always done before their children
+    for (size_t joint = 0; joint < joints; ++joint) {
+        Mat4 local = RotationMatrix(pose[joint].rotation);
+        local.m[12] = pose[joint].translation.x;
+        local.m[13] = pose[joint].translation.y;
+        local.m[14] = pose[joint].translation.z;
+        int parent = skeleton.parents[joint];
+        palette[joint] = parent < 0 ? local : Multiply(palette[parent], local);
+    }
+    for (size_t joint = 0; joint < joints; ++joint) {
+        palette[joint] = Multiply(palette[joint], skeleton.inverseBindMatrices[joint]);
+    }
+}
+
+void Gm::AnimateCharacters(const Skeleton &skeleton, const std::vector<AnimationClip> &clips,
+                           const CharacterAnimation *characters, const Mat4 *worldMatrices, size_t count,
+                           float extraSeconds, Mat4 *palettes) {
+    size_t joints = skeleton.JointCount();
+    auto animate = [&](size_t begin, size_t end) {
+        PoseScratch &scratch = t_poses;
+        for (size_t i = begin; i < end; ++i) {
+            // taken again per character: MultiplyMatrices may help run other tasks, which can grow the scratch
+            if (scratch.a.size() < joints) {
+                scratch.a.resize(joints);
+                scratch.b.resize(joints);
+            }
+            JointPose *poseA = scratch.a.data(), *poseB = scratch.b.data();
+            const CharacterAnimation &character = characters[i];
+            clips[character.clipA].Sample(character.timeA + extraSeconds, poseA);
+            if (character.blend > 0.0f) {
+                clips[character.clipB].Sample(character.timeB + extraSeconds, poseB);
+                BlendPoses(poseA, poseB, character.blend, joints, poseA);
+            }
+            Mat4 *palette = palettes + i * joints;
+            BuildSkinningMatrices(skeleton, poseA, palette);
+            if (worldMatrices != nullptr) {
+                MultiplyMatrices(worldMatrices[i], palette, joints, palette);
+            }
+        }
+    };
+    if (count <= CharacterGrain * 2) {
+        animate(0, count);
+    } else {
+        TaskSystem::Instance().ParallelFor(0, count, CharacterGrain, animate);
+    }
+}
@@ -0,0 +1,101 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "SimdMath.h"
+
+namespace Gm {
+    // a joint relative to its parent, translation in xyz
+    struct JointPose {
+        Quat rotation;
+        Vec4 translation;
+    };
+
+    struct Skeleton {
+        // parent of each joint, -1 for a root; parents come before their children
+        std::vector<int> parents;
+        // model space to the joint's space in the bind pose
+        std::vector<Mat4> inverseBindMatrices;
+
+        size_t JointCount() const { return parents.size(); }
+    };
+
+    // a clip as authored or imported: every joint's pose at a fixed rate, frames[frame * jointCount + joint].
+    // Looping clips repeat their first frame at the end.
+    struct RawClip {
+        float sampleRate = 30.0f;
+        size_t jointCount = 0;
+        std::vector<JointPose> frames;
+
+        size_t FrameCount() const { return jointCount > 0 ? frames.size() / jointCount : 0; }
+    };
+
+    // Compressed clip. Per joint, a rotation and a translation track keep only the keys linear interpolation
+    // can't reproduce within the tolerances given to Compress, each 8 bytes: the frame number and three 16 bit
+    // values. Rotations store the smallest three quaternion components (the largest follows from unit length),
+    // translations are quantized over the range of their track. A raw joint pose takes 32 bytes per frame.
+    class AnimationClip {
+    public:
+        // `rotationTolerance` in radians, `translationTolerance` in model units; at most 65536 frames
+        static AnimationClip Compress(const RawClip &raw, float rotationTolerance = 1e-3f,
+                                      float translationTolerance = 1e-3f);
+
+        size_t JointCount() const { return m_rotationTracks.size(); }
+
+        float Duration() const { return m_frameCount > 1 ? (m_frameCount - 1) / m_sampleRate : 0.0f; }
+
+        // the pose at `time` seconds, wrapped into the clip's duration; `pose` has JointCount() entries
+        void Sample(float time, JointPose *pose) const;
+
+        size_t KeyCount() const { return m_keys.size(); }
+
+        size_t ByteSize() const;
+
+    private:
+        struct Key {
+            uint16_t frame;
+            uint16_t values[3];
+        };
+
+        struct Track {
+            uint32_t firstKey;
+            uint32_t keyCount;
+            // translation tracks only: value = minimum + quantized / 65535 * extent
+            float minimum[3];
+            float extent[3];
+        };
+
+        // the keys around `frame` and how far it is between them
+        const Key *FindKeys(const Track &track, float frame, float &t) const;
+
+        std::vector<Track> m_rotationTracks;
+        std::vector<Track> m_translationTracks;
+        std::vector<Key> m_keys;
+        float m_sampleRate = 30.0f;
+        uint32_t m_frameCount = 0;
+    };
+
+    // result = a moved towards b by `weight`, per joint; `result` may be `a` or `b`
+    void BlendPoses(const JointPose *a, const JointPose *b, float weight, size_t count, JointPose *result);
+
+    // model space joint matrices times the inverse bind matrices, what skinning multiplies vertices with
+    void BuildSkinningMatrices(const Skeleton &skeleton, const JointPose *pose, Mat4 *palette);
+
+    // two clips cross-faded, e.g. walking into running
+    struct CharacterAnimation {
+        uint32_t clipA = 0;
+        uint32_t clipB = 0;
+        float timeA = 0.0f;
+        float timeB = 0.0f;
+        // 0 plays clipA alone, 1 clipB alone
+        float blend = 0.0f;
+    };
+
+    // For each character: samples both clips `extraSeconds` past its times, blends them and writes the
+    // skeleton's JointCount() skinning matrices to palettes + i * JointCount(), premultiplied by
+    // worldMatrices[i] if given. Runs on TaskSystem::Instance() for more than a few dozen characters.
+    void AnimateCharacters(const Skeleton &skeleton, const std::vector<AnimationClip> &clips,
+                           const CharacterAnimation *characters, const Mat4 *worldMatrices, size_t count,
+                           float extraSeconds, Mat4 *palettes);
+}
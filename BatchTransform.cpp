@@ -0,0 +1,292 @@
+#include "BatchTransform.h"
+#include "CpuFeatures.h"
+#include "TaskSystem.h"
+
+#if GM_SIMD_X86
+#include <immintrin.h>
+#elif GM_SIMD_NEON
+#include <arm_neon.h>
+#endif
+
+namespace {
+    const size_t ParallelBatchSize = 16 * 1024;
+
+    typedef void (*MultiplyRange)(const Gm::Mat4 &left, const Gm::Mat4 *matrices, Gm::Mat4 *result, size_t begin,
+                                  size_t end);
+    typedef void (*TransformRange)(const Gm::Mat4 &matrix, const char *positions, size_t stride,
+                                   Gm::PointsSoA &result, size_t begin, size_t end);
+    typedef void (*NormalRange)(const Gm::Mat4 *matrices, Gm::Mat4 *result, size_t begin, size_t end);
+
+    // function(begin, end) over [0, count), on the workers when the batch is large enough to pay for it
+    template<typename Function>
+    void ForRanges(size_t count, const Function &function) {
+        if (count < ParallelBatchSize) {
+            function(0, count);
+        } else {
+            Gm::TaskSystem::Instance().ParallelFor(0, count, ParallelBatchSize / 4, function);
+        }
+    }
+
+    inline const float *PointAt(const char *positions, size_t stride, size_t index) {
+        return reinterpret_cast<const float *>(positions + index * stride);
+    }
+
+    void MultiplyRangeScalar(const Gm::Mat4 &left, const Gm::Mat4 *matrices, Gm::Mat4 *result, size_t begin,
+                             size_t end) {
+        const float *a = left.m;
+        for (size_t i = begin; i < end; ++i) {
+            const float *b = matrices[i].m;
+            Gm::Mat4 product;
+            for (int column = 0; column < 4; ++column) {
+                for (int row = 0; row < 4; ++row) {
+                    product.m[column * 4 + row] = a[row] * b[column * 4] + a[4 + row] * b[column * 4 + 1] +
+                                                  a[8 + row] * b[column * 4 + 2] + a[12 + row] * b[column * 4 + 3];
+                }
+            }
+            result[i] = product;
+        }
+    }
+
+    void TransformRangeScalar(const Gm::Mat4 &matrix, const char *positions, size_t stride, Gm::PointsSoA &result,
+                              size_t begin, size_t end) {
+        const float *m = matrix.m;
+        for (size_t i = begin; i < end; ++i) {
+            const float *point = PointAt(positions, stride, i);
+            result.x[i] = m[0] * point[0] + m[4] * point[1] + m[8] * point[2] + m[12];
+            result.y[i] = m[1] * point[0] + m[5] * point[1] + m[9] * point[2] + m[13];
+            result.z[i] = m[2] * point[0] + m[6] * point[1] + m[10] * point[2] + m[14];
+            result.w[i] = m[3] * point[0] + m[7] * point[1] + m[11] * point[2] + m[15];
+        }
+    }
+
+    // the cofactor matrix over the determinant, its columns are the cross products of the input's columns
+    void NormalRangeScalar(const Gm::Mat4 *matrices, Gm::Mat4 *result, size_t begin, size_t end) {
+        const Gm::Mat4 identity = Gm::Mat4::Identity();
+        for (size_t i = begin; i < end; ++i) {
+            const float *m = matrices[i].m;
+            float c0[3] = {m[5] * m[10] - m[6] * m[9], m[6] * m[8] - m[4] * m[10], m[4] * m[9] - m[5] * m[8]};
+            float c1[3] = {m[9] * m[2] - m[10] * m[1], m[10] * m[0] - m[8] * m[2], m[8] * m[1] - m[9] * m[0]};
+            float c2[3] = {m[1] * m[6] - m[2] * m[5], m[2] * m[4] - m[0] * m[6], m[0] * m[5] - m[1] * m[4]};
+            float inverseDeterminant = 1.0f / (m[0] * c0[0] + m[1] * c0[1] + m[2] * c0[2]);
+            Gm::Mat4 normal = identity;
+            for (int row = 0; row < 3; ++row) {
+                normal.m[row] = c0[row] * inverseDeterminant;
+                normal.m[4 + row] = c1[row] * inverseDeterminant;
+                normal.m[8 + row] = c2[row] * inverseDeterminant;
+            }
+            result[i] = normal;
+        }
+    }
+
+#if GM_SIMD_X86
+    void MultiplyRangeSse(const Gm::Mat4 &left, const Gm::Mat4 *matrices, Gm::Mat4 *result, size_t begin,
+                          size_t end) {
+        __m128 a0 = _mm_load_ps(left.m), a1 = _mm_load_ps(left.m + 4);
+        __m128 a2 = _mm_load_ps(left.m + 8), a3 = _mm_load_ps(left.m + 12);
+        for (size_t i = begin; i < end; ++i) {
+            __m128 columns[4];
+            for (int column = 0; column < 4; ++column) {
+                __m128 factors = _mm_load_ps(matrices[i].m + column * 4);
+                __m128 sum = _mm_mul_ps(a0, _mm_shuffle_ps(factors, factors, _MM_SHUFFLE(0, 0, 0, 0)));
+                sum = _mm_add_ps(sum, _mm_mul_ps(a1, _mm_shuffle_ps(factors, factors, _MM_SHUFFLE(1, 1, 1, 1))));
+                sum = _mm_add_ps(sum, _mm_mul_ps(a2, _mm_shuffle_ps(factors, factors, _MM_SHUFFLE(2, 2, 2, 2))));
+                columns[column] = _mm_add_ps(sum, _mm_mul_ps(a3, _mm_shuffle_ps(factors, factors,
+                                                                                _MM_SHUFFLE(3, 3, 3, 3))));
+            }
+            for (int column = 0; column < 4; ++column) {
+                _mm_store_ps(result[i].m + column * 4, columns[column]);
+            }
+        }
+    }
+
+    void TransformRangeSse(const Gm::Mat4 &matrix, const char *positions, size_t stride, Gm::PointsSoA &result,
+                           size_t begin, size_t end) {
+        const float *m = matrix.m;
+        size_t i = begin;
+        for (; i + 4 <= end; i += 4) {
+            const float *p0 = PointAt(positions, stride, i), *p1 = PointAt(positions, stride, i + 1);
+            const float *p2 = PointAt(positions, stride, i + 2), *p3 = PointAt(positions, stride, i + 3);
+            __m128 x = _mm_setr_ps(p0[0], p1[0], p2[0], p3[0]);
+            __m128 y = _mm_setr_ps(p0[1], p1[1], p2[1], p3[1]);
+            __m128 z = _mm_setr_ps(p0[2], p1[2], p2[2], p3[2]);
+            float *outputs[4] = {&result.x[i], &result.y[i], &result.z[i], &result.w[i]};
+            for (int row = 0; row < 4; ++row) {
+                __m128 sum = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(m[row]), x), _mm_set1_ps(m[12 + row]));
+                sum = _mm_add_ps(sum, _mm_mul_ps(_mm_set1_ps(m[4 + row]), y));
+                sum = _mm_add_ps(sum, _mm_mul_ps(_mm_set1_ps(m[8 + row]), z));
+                _mm_storeu_ps(outputs[row], sum);
+            }
+        }
+        TransformRangeScalar(matrix, positions, stride, result, i, end);
+    }
+
+    GM_TARGET_AVX2
+    void MultiplyRangeAvx2(const Gm::Mat4 &left, const Gm::Mat4 *matrices, Gm::Mat4 *result, size_t begin,
+                           size_t end) {
+        __m256 a0 = _mm256_broadcast_ps((const __m128 *) left.m);
+        __m256 a1 = _mm256_broadcast_ps((const __m128 *) (left.m + 4));
+        __m256 a2 = _mm256_broadcast_ps((const __m128 *) (left.m + 8));
+        __m256 a3 = _mm256_broadcast_ps((const __m128 *) (left.m + 12));
+        for (size_t i = begin; i < end; ++i) {
+            // both column pairs are loaded before storing, `result` may alias `matrices`
+            __m256 pairs[2] = {_mm256_loadu_ps(matrices[i].m), _mm256_loadu_ps(matrices[i].m + 8)};
+            for (__m256 &pair : pairs) {
+                __m256 sum = _mm256_mul_ps(a0, _mm256_shuffle_ps(pair, pair, _MM_SHUFFLE(0, 0, 0, 0)));
+                sum = _mm256_fmadd_ps(a1, _mm256_shuffle_ps(pair, pair, _MM_SHUFFLE(1, 1, 1, 1)), sum);
+                sum = _mm256_fmadd_ps(a2, _mm256_shuffle_ps(pair, pair, _MM_SHUFFLE(2, 2, 2, 2)), sum);
+                pair = _mm256_fmadd_ps(a3, _mm256_shuffle_ps(pair, pair, _MM_SHUFFLE(3, 3, 3, 3)), sum);
+            }
+            _mm256_storeu_ps(result[i].m, pairs[0]);
+            _mm256_storeu_ps(result[i].m + 8, pairs[1]);
+        }
+    }
+
+    GM_TARGET_AVX2
+    void TransformRangeAvx2(const Gm::Mat4 &matrix, const char *positions, size_t stride, Gm::PointsSoA &result,
+                            size_t begin, size_t end) {
+        const float *m = matrix.m;
+        __m256i offsets = _mm256_mullo_epi32(_mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7),
+                                             _mm256_set1_epi32((int) stride));
+        size_t i = begin;
+        for (; i + 8 <= end; i += 8) {
+            const float *base = PointAt(positions, stride, i);
+            __m256 x = _mm256_i32gather_ps(base, offsets, 1);
+            __m256 y = _mm256_i32gather_ps(base + 1, offsets, 1);
+            __m256 z = _mm256_i32gather_ps(base + 2, offsets, 1);
+            float *outputs[4] = {&result.x[i], &result.y[i], &result.z[i], &result.w[i]};
+            for (int row = 0; row < 4; ++row) {
+                __m256 sum = _mm256_fmadd_ps(_mm256_set1_ps(m[row]), x, _mm256_set1_ps(m[12 + row]));
+                sum = _mm256_fmadd_ps(_mm256_set1_ps(m[4 + row]), y, sum);
+                sum = _mm256_fmadd_ps(_mm256_set1_ps(m[8 + row]), z, sum);
+                _mm256_storeu_ps(outputs[row], sum);
+            }
+        }
+        TransformRangeScalar(matrix, positions, stride, result, i, end);
+    }
+
+    // 8 matrices per step, one per lane: the upper 3x3 is gathered element by element
+    GM_TARGET_AVX2
+    void NormalRangeAvx2(const Gm::Mat4 *matrices, Gm::Mat4 *result, size_t begin, size_t end) {
+        const __m256i lanes = _mm256_setr_epi32(0, 16, 32, 48, 64, 80, 96, 112);
+        const Gm::Mat4 identity = Gm::Mat4::Identity();
+        size_t i = begin;
+        for (; i + 8 <= end; i += 8) {
+            const float *base = matrices[i].m;
+            __m256 m[11];
+            for (int element : {0, 1, 2, 4, 5, 6, 8, 9, 10}) {
+                m[element] = _mm256_i32gather_ps(base + element, lanes, 4);
+            }
+            __m256 cofactors[9] = {
+                    _mm256_fmsub_ps(m[5], m[10], _mm256_mul_ps(m[6], m[9])),
+                    _mm256_fmsub_ps(m[6], m[8], _mm256_mul_ps(m[4], m[10])),
+                    _mm256_fmsub_ps(m[4], m[9], _mm256_mul_ps(m[5], m[8])),
+                    _mm256_fmsub_ps(m[9], m[2], _mm256_mul_ps(m[10], m[1])),
+                    _mm256_fmsub_ps(m[10], m[0], _mm256_mul_ps(m[8], m[2])),
+                    _mm256_fmsub_ps(m[8], m[1], _mm256_mul_ps(m[9], m[0])),
+                    _mm256_fmsub_ps(m[1], m[6], _mm256_mul_ps(m[2], m[5])),
+                    _mm256_fmsub_ps(m[2], m[4], _mm256_mul_ps(m[0], m[6])),
+                    _mm256_fmsub_ps(m[0], m[5], _mm256_mul_ps(m[1], m[4])),
+            };
+            __m256 determinant = _mm256_mul_ps(m[0], cofactors[0]);
+            determinant = _mm256_fmadd_ps(m[1], cofactors[1], determinant);
+            determinant = _mm256_fmadd_ps(m[2], cofactors[2], determinant);
+            __m256 inverseDeterminant = _mm256_div_ps(_mm256_set1_ps(1.0f), determinant);
+
+            alignas(32) float values[9][8];
+            for (int k = 0; k < 9; ++k) {
+                _mm256_store_ps(values[k], _mm256_mul_ps(cofactors[k], inverseDeterminant));
+            }
+            for (int lane = 0; lane < 8; ++lane) {
+                Gm::Mat4 &normal = result[i + lane];
+                normal = identity;
+                for (int row = 0; row < 3; ++row) {
+                    normal.m[row] = values[row][lane];
+                    normal.m[4 + row] = values[3 + row][lane];
+                    normal.m[8 + row] = values[6 + row][lane];
+                }
+            }
+        }
+        NormalRangeScalar(matrices, result, i, end);
+    }
+#elif GM_SIMD_NEON
+    void MultiplyRangeNeon(const Gm::Mat4 &left, const Gm::Mat4 *matrices, Gm::Mat4 *result, size_t begin,
+                           size_t end) {
+        float32x4_t a0 = vld1q_f32(left.m), a1 = vld1q_f32(left.m + 4);
+        float32x4_t a2 = vld1q_f32(left.m + 8), a3 = vld1q_f32(left.m + 12);
+        for (size_t i = begin; i < end; ++i) {
+            float32x4_t columns[4];
+            for (int column = 0; column < 4; ++column) {
+                const float *factors = matrices[i].m + column * 4;
+                float32x4_t sum = vmulq_n_f32(a0, factors[0]);
+                sum = vmlaq_n_f32(sum, a1, factors[1]);
+                sum = vmlaq_n_f32(sum, a2, factors[2]);
+                columns[column] = vmlaq_n_f32(sum, a3, factors[3]);
+            }
+            for (int column = 0; column < 4; ++column) {
+                vst1q_f32(result[i].m + column * 4, columns[column]);
+            }
+        }
+    }
+
+    void TransformRangeNeon(const Gm::Mat4 &matrix, const char *positions, size_t stride, Gm::PointsSoA &result,
+                            size_t begin, size_t end) {
+        const float *m = matrix.m;
+        size_t i = begin;
+        for (; i + 4 <= end; i += 4) {
+            float x[4], y[4], z[4];
+            for (int lane = 0; lane < 4; ++lane) {
+                const float *point = PointAt(positions, stride, i + lane);
+                x[lane] = point[0];
+                y[lane] = point[1];
+                z[lane] = point[2];
+            }
+            float32x4_t vx = vld1q_f32(x), vy = vld1q_f32(y), vz = vld1q_f32(z);
+            float *outputs[4] = {&result.x[i], &result.y[i], &result.z[i], &result.w[i]};
+            for (int row = 0; row < 4; ++row) {
+                float32x4_t sum = vmlaq_n_f32(vdupq_n_f32(m[12 + row]), vx, m[row]);
+                sum = vmlaq_n_f32(sum, vy, m[4 + row]);
+                sum = vmlaq_n_f32(sum, vz, m[8 + row]);
+                vst1q_f32(outputs[row], sum);
+            }
+        }
+        TransformRangeScalar(matrix, positions, stride, result, i, end);
+    }
+#endif
+}
+
+void Gm::MultiplyMatrices(const Mat4 &left, const Mat4 *matrices, size_t count, Mat4 *result) {
+    MultiplyRange kernel = MultiplyRangeScalar;
+#if GM_SIMD_X86
+    kernel = Cpu::HasAvx2() ? MultiplyRangeAvx2 : MultiplyRangeSse;
+#elif GM_SIMD_NEON
+    kernel = MultiplyRangeNeon;
+#endif
+    ForRanges(count, [&](size_t begin, size_t end) {
+        kernel(left, matrices, result, begin, end);
+    });
+}
+
+void Gm::TransformPoints(const Mat4 &matrix, const void *positions, size_t stride, size_t count, PointsSoA &result) {
+    TransformRange kernel = TransformRangeScalar;
+#if GM_SIMD_X86
+    kernel = Cpu::HasAvx2() ? TransformRangeAvx2 : TransformRangeSse;
+#elif GM_SIMD_NEON
+    kernel = TransformRangeNeon;
+#endif
+    result.Resize(count);
+    ForRanges(count, [&](size_t begin, size_t end) {
+        kernel(matrix, static_cast<const char *>(positions), stride, result, begin, end);
+    });
+}
+
+void Gm::NormalMatrices(const Mat4 *matrices, size_t count, Mat4 *result) {
+    NormalRange kernel = NormalRangeScalar;
+#if GM_SIMD_X86
+    if (Cpu::HasAvx2()) {
+        kernel = NormalRangeAvx2;
+    }
+#endif
+    ForRanges(count, [&](size_t begin, size_t end) {
+        kernel(matrices, result, begin, end);
+    });
+}
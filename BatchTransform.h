@@ -0,0 +1,36 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+#include "SimdMath.h"
+
+// Throughput versions of the SimdMath operations, for instancing, culling and skinning on the CPU.
+// The kernel is picked once per call rather than per item: AVX2 handles 8 points or normal matrices
+// per step, SSE2 and NEON 4 points. Batches of 16k items and more are split over TaskSystem::Instance().
+
+namespace Gm {
+    // transformed positions, one array per component
+    struct PointsSoA {
+        std::vector<float> x, y, z, w;
+
+        void Resize(size_t count) {
+            x.resize(count);
+            y.resize(count);
+            z.resize(count);
+            w.resize(count);
+        }
+
+        size_t Size() const { return x.size(); }
+    };
+
+    // result[i] = left * matrices[i], e.g. the view-projection times each world matrix;
+    // `result` may be `matrices`
+    void MultiplyMatrices(const Mat4 &left, const Mat4 *matrices, size_t count, Mat4 *result);
+
+    // matrix * (x, y, z, 1) for `count` positions of three floats, `stride` bytes apart
+    void TransformPoints(const Mat4 &matrix, const void *positions, size_t stride, size_t count, PointsSoA &result);
+
+    // inverse-transpose of the upper 3x3 of each matrix, for transforming normals, the rest of each result is
+    // identity. Only vectorized with AVX2, 8 matrices per step, the others run the scalar loop.
+    void NormalMatrices(const Mat4 *matrices, size_t count, Mat4 *result);
+}
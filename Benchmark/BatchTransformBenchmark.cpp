@@ -0,0 +1,138 @@
+#include <random>
+#include <vector>
+#include "BatchTransform.h"
+#include "Benchmark.h"
+#include "CpuFeatures.h"
+#include "Eigen/Geometry"
+
+namespace {
+    typedef std::vector<Eigen::Matrix4f, Eigen::aligned_allocator<Eigen::Matrix4f>> EigenMatrices;
+
+    // rotated, scaled and translated instances, all invertible
+    std::vector<Gm::Mat4> RandomWorldMatrices(size_t count) {
+        std::mt19937 generator(7);
+        std::uniform_real_distribution<float> angle(-3.0f, 3.0f), offset(-100.0f, 100.0f), scale(0.5f, 2.0f);
+        std::vector<Gm::Mat4> matrices(count);
+        for (size_t i = 0; i < count; ++i) {
+            Eigen::Affine3f transform = Eigen::Affine3f::Identity();
+            transform.translate(Eigen::Vector3f(offset(generator), offset(generator), offset(generator)));
+            transform.rotate(Eigen::AngleAxisf(angle(generator), Eigen::Vector3f::UnitY()));
+            transform.scale(Eigen::Vector3f(scale(generator), scale(generator), scale(generator)));
+            matrices[i] = Gm::FromEigen(transform.matrix());
+        }
+        return matrices;
+    }
+
+    EigenMatrices ToEigen(const std::vector<Gm::Mat4> &matrices) {
+        EigenMatrices result(matrices.size());
+        for (size_t i = 0; i < matrices.size(); ++i) {
+            result[i] = Gm::ToEigen(matrices[i]);
+        }
+        return result;
+    }
+
+    Gm::Mat4 DefaultViewProjection() {
+        Gm::Mat4 view = Gm::LookAtLH({0.0f, 0.0f, -10.0f, 1.0f}, {0.0f, 0.0f, 0.0f, 1.0f}, {0.0f, 1.0f, 0.0f, 0.0f});
+        return Gm::Multiply(Gm::PerspectiveFovLH((float) M_PI / 4.0f, 960.0f / 540.0f, 0.1f, 1000.0f), view);
+    }
+
+    // interleaved like VertexType: a position followed by a color
+    std::vector<float> RandomVertices(size_t count) {
+        std::mt19937 generator(11);
+        std::uniform_real_distribution<float> position(-10.0f, 10.0f);
+        std::vector<float> vertices(count * 6);
+        for (float &value : vertices) {
+            value = position(generator);
+        }
+        return vertices;
+    }
+
+    void ReportBatch(Bench::State &state, size_t count, float checksum) {
+        state.SetItemsProcessed(state.Iterations() * count);
+        state.SetCounter("ms_per_million", state.ElapsedSeconds() * 1e3 / state.Iterations() * 1e6 / count);
+        // keeps the results alive
+        state.SetCounter("checksum", checksum);
+    }
+}
+
+static void BM_EigenMultiplyMatrices(Bench::State &state) {
+    size_t count = (size_t) state.Argument();
+    Eigen::Matrix4f viewProjection = Gm::ToEigen(DefaultViewProjection());
+    EigenMatrices worlds = ToEigen(RandomWorldMatrices(count)), result(count);
+    while (state.KeepRunning()) {
+        for (size_t i = 0; i < count; ++i) {
+            result[i].noalias() = viewProjection * worlds[i];
+        }
+    }
+    ReportBatch(state, count, result[count / 2](0, 3));
+}
+
+static void BM_MultiplyMatrices(Bench::State &state) {
+    size_t count = (size_t) state.Argument();
+    Gm::Mat4 viewProjection = DefaultViewProjection();
+    std::vector<Gm::Mat4> worlds = RandomWorldMatrices(count), result(count);
+    while (state.KeepRunning()) {
+        Gm::MultiplyMatrices(viewProjection, worlds.data(), count, result.data());
+    }
+    ReportBatch(state, count, result[count / 2](0, 3));
+    state.SetCounter(Gm::Cpu::SimdLevelName(), 1);
+}
+
+static void BM_EigenTransformPoints(Bench::State &state) {
+    size_t count = (size_t) state.Argument();
+    Eigen::Matrix4f viewProjection = Gm::ToEigen(DefaultViewProjection());
+    std::vector<float> vertices = RandomVertices(count);
+    Gm::PointsSoA result;
+    result.Resize(count);
+    while (state.KeepRunning()) {
+        for (size_t i = 0; i < count; ++i) {
+            Eigen::Vector4f clip = viewProjection * Eigen::Map<const Eigen::Vector3f>(&vertices[i * 6]).homogeneous();
+            result.x[i] = clip[0];
+            result.y[i] = clip[1];
+            result.z[i] = clip[2];
+            result.w[i] = clip[3];
+        }
+    }
+    ReportBatch(state, count, result.w[count / 2]);
+}
+
+static void BM_TransformPoints(Bench::State &state) {
+    size_t count = (size_t) state.Argument();
+    Gm::Mat4 viewProjection = DefaultViewProjection();
+    std::vector<float> vertices = RandomVertices(count);
+    Gm::PointsSoA result;
+    while (state.KeepRunning()) {
+        Gm::TransformPoints(viewProjection, vertices.data(), 6 * sizeof(float), count, result);
+    }
+    ReportBatch(state, count, result.w[count / 2]);
+    state.SetCounter(Gm::Cpu::SimdLevelName(), 1);
+}
+
+static void BM_EigenNormalMatrices(Bench::State &state) {
+    size_t count = (size_t) state.Argument();
+    EigenMatrices worlds = ToEigen(RandomWorldMatrices(count)), result(count);
+    while (state.KeepRunning()) {
+        for (size_t i = 0; i < count; ++i) {
+            result[i].setIdentity();
+            result[i].topLeftCorner<3, 3>() = worlds[i].topLeftCorner<3, 3>().inverse().transpose();
+        }
+    }
+    ReportBatch(state, count, result[count / 2](0, 2));
+}
+
+static void BM_NormalMatrices(Bench::State &state) {
+    size_t count = (size_t) state.Argument();
+    std::vector<Gm::Mat4> worlds = RandomWorldMatrices(count), result(count);
+    while (state.KeepRunning()) {
+        Gm::NormalMatrices(worlds.data(), count, result.data());
+    }
+    ReportBatch(state, count, result[count / 2](0, 2));
+    state.SetCounter(Gm::Cpu::SimdLevelName(), 1);
+}
+
+BENCHMARK_CASE(BM_EigenMultiplyMatrices, 1000, 100000);
+BENCHMARK_CASE(BM_MultiplyMatrices, 1000, 100000);
+BENCHMARK_CASE(BM_EigenTransformPoints, 1000, 100000);
+BENCHMARK_CASE(BM_TransformPoints, 1000, 100000);
+BENCHMARK_CASE(BM_EigenNormalMatrices, 1000, 100000);
+BENCHMARK_CASE(BM_NormalMatrices, 1000, 100000);
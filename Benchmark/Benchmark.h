@@ -0,0 +1,76 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <vector>
+
+namespace Bench {
+    // Passed to every benchmark case. The harness picks the iteration count,
+    // the case runs its timed body once per `KeepRunning()`.
+    class State {
+    public:
+        State(int64_t argument, uint64_t iterations) : m_argument(argument), m_iterations(iterations) {}
+
+        bool KeepRunning() {
+            if (m_done == 0) {
+                m_start = std::chrono::steady_clock::now();
+            }
+            if (m_done++ < m_iterations) {
+                return true;
+            }
+            m_elapsed += std::chrono::steady_clock::now() - m_start;
+            return false;
+        }
+
+        // exclude setup work inside the loop from the measurement
+        void PauseTiming() { m_elapsed += std::chrono::steady_clock::now() - m_start; }
+
+        void ResumeTiming() { m_start = std::chrono::steady_clock::now(); }
+
+        int64_t Argument() const { return m_argument; }
+
+        uint64_t Iterations() const { return m_iterations; }
+
+        void SetItemsProcessed(uint64_t items) { m_items = items; }
+
+        uint64_t ItemsProcessed() const { return m_items; }
+
+        // report a named value next to the timing, e.g. the number of culled objects
+        void SetCounter(const char *name, double value) { m_counters.push_back({name, value}); }
+
+        double ElapsedSeconds() const { return std::chrono::duration<double>(m_elapsed).count(); }
+
+        struct Counter {
+            const char *name;
+            double value;
+        };
+
+        const std::vector<Counter> &Counters() const { return m_counters; }
+
+        // set by the case when the environment cannot run it, e.g. no GL context
+        void SkipWithError(const char *message) {
+            m_error = message;
+            m_done = m_iterations + 1;
+        }
+
+        const char *Error() const { return m_error; }
+
+    private:
+        int64_t m_argument;
+        uint64_t m_iterations;
+        uint64_t m_done = 0;
+        uint64_t m_items = 0;
+        std::chrono::steady_clock::time_point m_start;
+        std::chrono::steady_clock::duration m_elapsed{0};
+        std::vector<Counter> m_counters;
+        const char *m_error = nullptr;
+    };
+
+    typedef void (*Function)(State &state);
+
+    bool Register(const char *name, Function function, std::vector<int64_t> arguments);
+}
+
+// BENCHMARK_CASE(BM_Name, 1000, 10000) runs BM_Name once per argument
+#define BENCHMARK_CASE(function, ...) \
+    static const bool function##_registered = Bench::Register(#function, function, {__VA_ARGS__})
@@ -0,0 +1,281 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <string>
+#include <thread>
+#include "Benchmark.h"
+#include "CpuFeatures.h"
+
+#ifndef GM_BENCHMARK_VERSION
+#define GM_BENCHMARK_VERSION "unknown"
+#endif
+
+namespace {
+    struct Case {
+        const char *name;
+        Bench::Function function;
+        std::vector<int64_t> arguments;
+    };
+
+    std::vector<Case> &Registry() {
+        static std::vector<Case> cases;
+        return cases;
+    }
+
+    const double MinTime = 0.5;
+    const uint64_t MaxIterations = 1000000000;
+
+    // Grow the iteration count until a run lasts at least MinTime seconds.
+    Bench::State Run(const Case &benchmarkCase, int64_t argument) {
+        uint64_t iterations = 1;
+        while (true) {
+            Bench::State state(argument, iterations);
+            benchmarkCase.function(state);
+            double elapsed = state.ElapsedSeconds();
+            if (state.Error() != nullptr || elapsed >= MinTime || iterations >= MaxIterations) {
+                return state;
+            }
+            double multiplier = elapsed > 0.0 ? MinTime * 1.4 / elapsed : 10.0;
+            if (multiplier > 10.0) {
+                multiplier = 10.0;
+            }
+            uint64_t next = (uint64_t) (iterations * multiplier);
+            iterations = next > iterations ? next : iterations + 1;
+        }
+    }
+
+    // one repetition of a case and argument
+    struct Sample {
+        uint64_t iterations;
+        double nanosecondsPerIteration;
+        double itemsPerSecond;
+        std::vector<Bench::State::Counter> counters;
+    };
+
+    struct Result {
+        std::string name;
+        std::string error;
+        std::vector<Sample> samples;
+    };
+
+    struct Summary {
+        double mean, median, stddev, min;
+    };
+
+    Summary Summarize(std::vector<double> values) {
+        Summary summary = {0.0, 0.0, 0.0, 0.0};
+        if (values.empty()) {
+            return summary;
+        }
+        std::sort(values.begin(), values.end());
+        size_t n = values.size();
+        for (double value : values) {
+            summary.mean += value / n;
+        }
+        summary.median = n % 2 ? values[n / 2] : 0.5 * (values[n / 2 - 1] + values[n / 2]);
+        double squares = 0.0;
+        for (double value : values) {
+            squares += (value - summary.mean) * (value - summary.mean);
+        }
+        // sample standard deviation, 0 for a single repetition
+        summary.stddev = n > 1 ? std::sqrt(squares / (n - 1)) : 0.0;
+        summary.min = values[0];
+        return summary;
+    }
+
+    Sample ToSample(const Bench::State &state) {
+        double seconds = state.ElapsedSeconds();
+        Sample sample;
+        sample.iterations = state.Iterations();
+        sample.nanosecondsPerIteration = seconds * 1e9 / state.Iterations();
+        sample.itemsPerSecond = seconds > 0.0 ? state.ItemsProcessed() / seconds : 0.0;
+        sample.counters = state.Counters();
+        return sample;
+    }
+
+    void AppendJsonString(std::string &json, const std::string &text) {
+        json += '"';
+        for (char c : text) {
+            if (c == '"' || c == '\\') {
+                json += '\\';
+            }
+            json += c;
+        }
+        json += '"';
+    }
+
+    void AppendJsonNumber(std::string &json, const char *key, double value) {
+        char number[64];
+        // JSON has no infinities or NaNs
+        snprintf(number, sizeof(number), "\"%s\":%.9g", key, std::isfinite(value) ? value : 0.0);
+        json += number;
+    }
+
+    void AppendSummary(std::string &json, const char *key, const Summary &summary) {
+        json += "\"";
+        json += key;
+        json += "\":{";
+        AppendJsonNumber(json, "mean", summary.mean);
+        json += ",";
+        AppendJsonNumber(json, "median", summary.median);
+        json += ",";
+        AppendJsonNumber(json, "stddev", summary.stddev);
+        json += ",";
+        AppendJsonNumber(json, "min", summary.min);
+        json += "}";
+    }
+
+    // every repetition, and over them the mean, median, standard deviation and minimum of the time per
+    // iteration, the items per second and each counter
+    bool WriteJson(const char *path, const std::vector<Result> &results, int repetitions) {
+        std::string json = "{\"context\":{";
+        char date[64];
+        time_t now = time(nullptr);
+        strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%SZ", gmtime(&now));
+        json += "\"date\":\"" + std::string(date) + "\",\"version\":";
+        AppendJsonString(json, GM_BENCHMARK_VERSION);
+#ifdef NDEBUG
+        json += ",\"build_type\":\"release\"";
+#else
+        json += ",\"build_type\":\"debug\"";
+#endif
+        json += ",\"simd\":\"" + std::string(Gm::Cpu::SimdLevelName()) + "\"";
+        json += ",\"threads\":" + std::to_string(std::thread::hardware_concurrency());
+        json += ",\"repetitions\":" + std::to_string(repetitions) + "},\"benchmarks\":[";
+        for (size_t i = 0; i < results.size(); ++i) {
+            const Result &result = results[i];
+            json += i == 0 ? "{\"name\":" : ",{\"name\":";
+            AppendJsonString(json, result.name);
+            if (!result.error.empty()) {
+                json += ",\"error\":";
+                AppendJsonString(json, result.error);
+                json += "}";
+                continue;
+            }
+            std::vector<double> times, rates;
+            json += ",\"repetitions\":[";
+            for (size_t s = 0; s < result.samples.size(); ++s) {
+                const Sample &sample = result.samples[s];
+                json += s == 0 ? "{" : ",{";
+                AppendJsonNumber(json, "iterations", (double) sample.iterations);
+                json += ",";
+                AppendJsonNumber(json, "ns_per_iteration", sample.nanosecondsPerIteration);
+                json += ",";
+                AppendJsonNumber(json, "items_per_second", sample.itemsPerSecond);
+                for (const Bench::State::Counter &counter : sample.counters) {
+                    json += ",";
+                    AppendJsonNumber(json, counter.name, counter.value);
+                }
+                json += "}";
+                times.push_back(sample.nanosecondsPerIteration);
+                rates.push_back(sample.itemsPerSecond);
+            }
+            json += "],";
+            AppendSummary(json, "ns_per_iteration", Summarize(times));
+            json += ",";
+            AppendSummary(json, "items_per_second", Summarize(rates));
+            // counters by name, a case reports the same ones every run
+            json += ",\"counters\":{";
+            const std::vector<Bench::State::Counter> &names = result.samples[0].counters;
+            for (size_t c = 0; c < names.size(); ++c) {
+                std::vector<double> values;
+                for (const Sample &sample : result.samples) {
+                    if (c < sample.counters.size()) {
+                        values.push_back(sample.counters[c].value);
+                    }
+                }
+                json += c == 0 ? "" : ",";
+                AppendSummary(json, names[c].name, Summarize(values));
+            }
+            json += "}}";
+        }
+        json += "]}\n";
+
+        FILE *file = fopen(path, "wb");
+        if (file == nullptr) {
+            fprintf(stderr, "can't write %s\n", path);
+            return false;
+        }
+        bool ok = fwrite(json.data(), 1, json.size(), file) == json.size();
+        return fclose(file) == 0 && ok;
+    }
+}
+
+bool Bench::Register(const char *name, Function function, std::vector<int64_t> arguments) {
+    if (arguments.empty()) {
+        arguments.push_back(0);
+    }
+    Registry().push_back({name, function, arguments});
+    return true;
+}
+
+int main(int argc, const char *argv[]) {
+    // an optional argument filters cases by substring, --repetitions=N runs each N times (the first finds the
+    // iteration count, the others reuse it) and --json=path also writes the results there
+    const char *filter = nullptr;
+    const char *jsonPath = nullptr;
+    int repetitions = 1;
+    for (int i = 1; i < argc; ++i) {
+        if (strncmp(argv[i], "--repetitions=", 14) == 0) {
+            repetitions = std::max(1, atoi(argv[i] + 14));
+        } else if (strncmp(argv[i], "--json=", 7) == 0) {
+            jsonPath = argv[i] + 7;
+        } else if (strncmp(argv[i], "--", 2) == 0) {
+            fprintf(stderr, "usage: %s [filter] [--repetitions=N] [--json=path]\n", argv[0]);
+            return 1;
+        } else {
+            filter = argv[i];
+        }
+    }
+
+    std::vector<Result> results;
+    printf("%-48s %16s %12s %16s\n", "Benchmark", "Time/iter (ns)", "Iterations", "Items/s");
+    for (const Case &benchmarkCase : Registry()) {
+        if (filter != nullptr && strstr(benchmarkCase.name, filter) == nullptr) {
+            continue;
+        }
+        for (int64_t argument : benchmarkCase.arguments) {
+            Result result;
+            result.name = std::string(benchmarkCase.name) + "/" + std::to_string(argument);
+            Bench::State state = Run(benchmarkCase, argument);
+            uint64_t iterations = state.Iterations();
+            for (int repetition = 0; repetition < repetitions; ++repetition) {
+                if (repetition > 0) {
+                    state = Bench::State(argument, iterations);
+                    benchmarkCase.function(state);
+                }
+                if (state.Error() != nullptr) {
+                    printf("%-48s ERROR: %s\n", result.name.c_str(), state.Error());
+                    result.error = state.Error();
+                    break;
+                }
+                Sample sample = ToSample(state);
+                printf("%-48s %16.1f %12llu %16.0f", result.name.c_str(), sample.nanosecondsPerIteration,
+                       (unsigned long long) sample.iterations, sample.itemsPerSecond);
+                for (const Bench::State::Counter &counter : sample.counters) {
+                    printf("  %s=%g", counter.name, counter.value);
+                }
+                printf("\n");
+                result.samples.push_back(sample);
+            }
+            if (repetitions > 1 && result.error.empty()) {
+                std::vector<double> times;
+                for (const Sample &sample : result.samples) {
+                    times.push_back(sample.nanosecondsPerIteration);
+                }
+                Summary summary = Summarize(times);
+                printf("%-48s %16.1f %12s %16s  median=%.1f  stddev=%.1f  cv=%.2f%%\n",
+                       (result.name + "_mean").c_str(), summary.mean, "", "", summary.median, summary.stddev,
+                       summary.mean > 0.0 ? summary.stddev / summary.mean * 100.0 : 0.0);
+            }
+            results.push_back(std::move(result));
+        }
+    }
+    if (jsonPath != nullptr && !WriteJson(jsonPath, results, repetitions)) {
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,23 @@
+#include <cmath>
+#include "BenchmarkScene.h"
+
+Gm::HeadlessContext *Bench::SharedHeadlessContext() {
+    static Gm::HeadlessContext context;
+    static bool created = context.Create(960, 540);
+    return created ? &context : nullptr;
+}
+
+Gm::InstanceArray Bench::MakeGridInstances(size_t count) {
+    Gm::InstanceArray instances(count);
+    size_t side = (size_t) std::ceil(std::cbrt((double) count));
+    float spacing = 3.0f;
+    float origin = -0.5f * spacing * (side - 1);
+    for (size_t i = 0; i < count; ++i) {
+        size_t x = i % side, y = (i / side) % side, z = i / (side * side);
+        Eigen::Affine3f transform = Eigen::Affine3f::Identity();
+        transform.translate(Eigen::Vector3f(origin + spacing * x, origin + spacing * y, spacing * z));
+        instances[i].worldMatrix = transform.matrix();
+        instances[i].color = Eigen::Vector4f((float) x / side, (float) y / side, (float) z / side, 1.0f);
+    }
+    return instances;
+}
@@ -0,0 +1,12 @@
+#pragma once
+
+#include "GraphicsManager.h"
+#include "HeadlessContext.h"
+
+namespace Bench {
+    // Lazily created offscreen context shared by every GL benchmark, nullptr if unavailable.
+    Gm::HeadlessContext *SharedHeadlessContext();
+
+    // `count` cube instances on a roughly cubic grid in front of the default camera.
+    Gm::InstanceArray MakeGridInstances(size_t count);
+}
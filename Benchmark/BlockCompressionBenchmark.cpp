@@ -0,0 +1,75 @@
+#include <cmath>
+#include <vector>
+#include "Benchmark.h"
+#include "BlockCompression.h"
+#include "ImageImport.h"
+
+namespace {
+    const char *const SamplePath = GM_SOURCE_DIR "/img.png";
+
+    // level 0 of img.png in `format` at the quality of the argument (0 Fast, 1 Normal, 2 High)
+    void CompressSample(Bench::State &state, Gm::TextureFormat format, int channels,
+                        Gm::CompressionOptions options) {
+        Gm::ImportOptions importOptions;
+        importOptions.mipFilter = Gm::MipFilter::None;
+        Gm::Image image;
+        if (!Gm::ImportImage(SamplePath, importOptions, image)) {
+            state.SkipWithError("img.png not found");
+            return;
+        }
+        options.quality = (Gm::CompressionQuality) state.Argument();
+        std::vector<uint8_t> blocks(Gm::TextureLevelBytes(format, image.width, image.height));
+        double error = 0.0;
+        while (state.KeepRunning()) {
+            error = Gm::CompressLevel(image.texels.data(), image.width, image.height, format, options, blocks.data());
+        }
+        uint64_t pixels = (uint64_t) image.width * image.height;
+        double meanError = error / (pixels * channels);
+        state.SetItemsProcessed(state.Iterations() * pixels);
+        state.SetCounter("mpixels_per_s", state.Iterations() * pixels / state.ElapsedSeconds() / 1e6);
+        state.SetCounter("psnr_db", meanError > 0.0 ? 10.0 * std::log10(255.0 * 255.0 / meanError) : 99.0);
+    }
+
+    Gm::CompressionOptions SingleThreadScalar() {
+        Gm::CompressionOptions options;
+        options.parallel = false;
+        options.simd = false;
+        return options;
+    }
+}
+
+static void BM_CompressBc1(Bench::State &state) {
+    CompressSample(state, Gm::TextureFormat::Bc1, 3, Gm::CompressionOptions());
+}
+
+static void BM_CompressBc3(Bench::State &state) {
+    CompressSample(state, Gm::TextureFormat::Bc3, 4, Gm::CompressionOptions());
+}
+
+static void BM_CompressBc5(Bench::State &state) {
+    CompressSample(state, Gm::TextureFormat::Bc5, 2, Gm::CompressionOptions());
+}
+
+static void BM_CompressBc7(Bench::State &state) {
+    CompressSample(state, Gm::TextureFormat::Bc7, 4, Gm::CompressionOptions());
+}
+
+static void BM_CompressBc7SingleThreadScalar(Bench::State &state) {
+    CompressSample(state, Gm::TextureFormat::Bc7, 4, SingleThreadScalar());
+}
+
+static void BM_CompressEtc2Rgb(Bench::State &state) {
+    CompressSample(state, Gm::TextureFormat::Etc2Rgb, 3, Gm::CompressionOptions());
+}
+
+static void BM_CompressEtc2Rgba(Bench::State &state) {
+    CompressSample(state, Gm::TextureFormat::Etc2Rgba, 4, Gm::CompressionOptions());
+}
+
+BENCHMARK_CASE(BM_CompressBc1, 0, 1, 2);
+BENCHMARK_CASE(BM_CompressBc3, 0, 1, 2);
+BENCHMARK_CASE(BM_CompressBc5, 0, 1, 2);
+BENCHMARK_CASE(BM_CompressBc7, 0, 1, 2);
+BENCHMARK_CASE(BM_CompressBc7SingleThreadScalar, 0, 1, 2);
+BENCHMARK_CASE(BM_CompressEtc2Rgb, 0, 1, 2);
+BENCHMARK_CASE(BM_CompressEtc2Rgba, 0, 1, 2);
@@ -0,0 +1,74 @@
+#include <random>
+#include "Benchmark.h"
+#include "Bvh.h"
+#include "TaskSystem.h"
+
+namespace {
+    // small random triangles filling a cube, as boxes, the only thing the builder looks at
+    std::vector<Gm::Aabb> RandomTriangleBounds(size_t count) {
+        std::mt19937 generator(7);
+        std::uniform_real_distribution<float> position(-100.0f, 100.0f), offset(-0.5f, 0.5f);
+        std::vector<Gm::Aabb> bounds(count);
+        for (Gm::Aabb &box : bounds) {
+            Eigen::Vector3f corner(position(generator), position(generator), position(generator));
+            box.Grow(corner);
+            for (int vertex = 0; vertex < 2; ++vertex) {
+                box.Grow(corner + Eigen::Vector3f(offset(generator), offset(generator), offset(generator)));
+            }
+        }
+        return bounds;
+    }
+}
+
+static void BM_BvhBuild(Bench::State &state) {
+    std::vector<Gm::Aabb> bounds = RandomTriangleBounds((size_t) state.Argument());
+    Gm::Bvh bvh;
+    while (state.KeepRunning()) {
+        bvh.Build(bounds.data(), bounds.size());
+    }
+    state.SetItemsProcessed(state.Iterations() * bounds.size());
+    state.SetCounter("nodes", (double) bvh.GetBuildStats().nodeCount);
+    state.SetCounter("wide_nodes", (double) bvh.WideNodes().size());
+    state.SetCounter("threads", Gm::TaskSystem::Instance().WorkerCount() + 1);
+}
+
+static void BM_BvhBuildSingleThread(Bench::State &state) {
+    std::vector<Gm::Aabb> bounds = RandomTriangleBounds((size_t) state.Argument());
+    Gm::Bvh bvh;
+    while (state.KeepRunning()) {
+        // no TaskSystem at all: a pool of one worker would still have the caller helping out
+        bvh.Build(bounds.data(), bounds.size(), nullptr);
+    }
+    state.SetItemsProcessed(state.Iterations() * bounds.size());
+    state.SetCounter("threads", 1);
+}
+
+static void BM_BvhRayClosestBox(Bench::State &state) {
+    std::vector<Gm::Aabb> bounds = RandomTriangleBounds((size_t) state.Argument());
+    Gm::Bvh bvh;
+    bvh.Build(bounds.data(), bounds.size());
+    std::mt19937 generator(11);
+    std::uniform_real_distribution<float> position(-100.0f, 100.0f);
+    size_t hits = 0;
+    while (state.KeepRunning()) {
+        Gm::Ray ray;
+        ray.origin = Eigen::Vector3f(position(generator), position(generator), -200.0f);
+        ray.direction = Eigen::Vector3f(0.0f, 0.0f, 1.0f);
+        hits += bvh.Intersect(ray, [&bounds](uint32_t primitive, Gm::Ray &ray) {
+            // the box itself stands in for the primitive
+            const Gm::Aabb &box = bounds[primitive];
+            if (ray.origin[0] < box.min[0] || ray.origin[0] > box.max[0] ||
+                ray.origin[1] < box.min[1] || ray.origin[1] > box.max[1] || box.min[2] - ray.origin[2] >= ray.tMax) {
+                return false;
+            }
+            ray.tMax = box.min[2] - ray.origin[2];
+            return true;
+        });
+    }
+    state.SetItemsProcessed(state.Iterations());
+    state.SetCounter("hit_rate", (double) hits / state.Iterations());
+}
+
+BENCHMARK_CASE(BM_BvhBuild, 1000000, 10000000);
+BENCHMARK_CASE(BM_BvhBuildSingleThread, 1000000, 10000000);
+BENCHMARK_CASE(BM_BvhRayClosestBox, 1000000);
@@ -0,0 +1,50 @@
+#include <vector>
+#include "Benchmark.h"
+#include "CommandBuffer.h"
+#include "IndirectBatcher.h"
+#include "TaskSystem.h"
+
+namespace {
+    // `draws` meshes over 8 programs recorded as one draw call each, like the GL 4.1 path without
+    // multi draw indirect or base instance. `buffers` == 1 records everything on the calling thread.
+    void RunRecordDraws(Bench::State &state, size_t buffers) {
+        size_t draws = (size_t) state.Argument();
+        Gm::IndirectBatcher batcher;
+        std::vector<Gm::CommandBuffer> commands(buffers);
+        float matrix[16] = {};
+        while (state.KeepRunning()) {
+            batcher.Begin();
+            for (size_t i = 0; i < draws; ++i) {
+                GLuint program = 1 + (GLuint) (i % 8);
+                batcher.Add(program, program, {(GLuint) (i * 36), 36, 0}, 10, (GLuint) (i * 10));
+            }
+            batcher.Record(commands, Gm::TaskSystem::Instance(), [&matrix](Gm::CommandBuffer &buffer, GLuint program) {
+                buffer.UseProgram(program);
+                buffer.UniformMatrix4(0, matrix);
+            }, [](Gm::CommandBuffer &buffer, GLuint baseInstance) {
+                buffer.BindBuffer(GL_ARRAY_BUFFER, 1);
+                for (GLuint column = 0; column < 5; ++column) {
+                    buffer.VertexAttribPointer(2 + column, 4, 80, baseInstance * 80 + column * 16);
+                }
+            });
+        }
+        size_t bytes = 0;
+        for (const Gm::CommandBuffer &buffer : commands) {
+            bytes += buffer.ByteSize();
+        }
+        state.SetItemsProcessed(state.Iterations() * draws);
+        state.SetCounter("KB", bytes / 1024.0);
+    }
+}
+
+static void BM_RecordDrawsSerial(Bench::State &state) {
+    RunRecordDraws(state, 1);
+}
+
+// one command buffer per worker plus the calling thread, replayed in order afterwards
+static void BM_RecordDrawsParallel(Bench::State &state) {
+    RunRecordDraws(state, Gm::TaskSystem::Instance().WorkerCount() + 1);
+}
+
+BENCHMARK_CASE(BM_RecordDrawsSerial, 1000, 10000, 100000);
+BENCHMARK_CASE(BM_RecordDrawsParallel, 1000, 10000, 100000);
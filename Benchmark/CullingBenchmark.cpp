@@ -0,0 +1,69 @@
+#include <cmath>
+#include <random>
+#include "Benchmark.h"
+#include "CpuFeatures.h"
+#include "FrustumCulling.h"
+
+namespace {
+    // the default camera: 45 degree fov, 16:9, looking down +z from z = -10
+    Gm::Frustum DefaultFrustum() {
+        float fieldOfView = (float) M_PI / 4.0f, aspect = 960.0f / 540.0f, nearZ = 0.1f, farZ = 1000.0f;
+        Eigen::Matrix4f projection;
+        projection << 1.0f / (aspect * tanf(fieldOfView * 0.5f)), 0.0f, 0.0f, 0.0f,
+                0.0f, 1.0f / tanf(fieldOfView * 0.5f), 0.0f, 0.0f,
+                0.0f, 0.0f, farZ / (farZ - nearZ), -nearZ * farZ / (farZ - nearZ),
+                0.0f, 0.0f, 1.0f, 0.0f;
+        Eigen::Matrix4f view = Eigen::Matrix4f::Identity();
+        view(2, 3) = 10.0f;
+        return Gm::ExtractFrustumPlanes(projection * view);
+    }
+
+    // spheres scattered around the camera so that roughly a tenth of them are visible
+    Gm::BoundingSpheres RandomSpheres(size_t count) {
+        std::mt19937 generator(42);
+        std::uniform_real_distribution<float> position(-200.0f, 200.0f), radius(0.5f, 2.0f);
+        Gm::BoundingSpheres spheres;
+        spheres.Resize(count);
+        for (size_t i = 0; i < count; ++i) {
+            spheres.x[i] = position(generator);
+            spheres.y[i] = position(generator);
+            spheres.z[i] = position(generator);
+            spheres.radius[i] = radius(generator);
+        }
+        return spheres;
+    }
+
+    void ReportCulling(Bench::State &state, size_t count, size_t visible) {
+        state.SetItemsProcessed(state.Iterations() * count);
+        state.SetCounter("culled", (double) (count - visible));
+        state.SetCounter("ms_per_million", state.ElapsedSeconds() * 1e3 / state.Iterations() * 1e6 / count);
+    }
+}
+
+static void BM_FrustumCullSpheres(Bench::State &state) {
+    Gm::Frustum frustum = DefaultFrustum();
+    Gm::BoundingSpheres spheres = RandomSpheres((size_t) state.Argument());
+    std::vector<uint32_t> visible;
+    visible.reserve(spheres.Size() + 8);
+    while (state.KeepRunning()) {
+        visible.clear();
+        Gm::CullSpheres(frustum, spheres, visible);
+    }
+    ReportCulling(state, spheres.Size(), visible.size());
+    state.SetCounter(Gm::Cpu::SimdLevelName(), 1);
+}
+
+static void BM_FrustumCullSpheresScalar(Bench::State &state) {
+    Gm::Frustum frustum = DefaultFrustum();
+    Gm::BoundingSpheres spheres = RandomSpheres((size_t) state.Argument());
+    std::vector<uint32_t> visible;
+    visible.reserve(spheres.Size());
+    while (state.KeepRunning()) {
+        visible.clear();
+        Gm::CullSpheresScalar(frustum, spheres, visible);
+    }
+    ReportCulling(state, spheres.Size(), visible.size());
+}
+
+BENCHMARK_CASE(BM_FrustumCullSpheres, 100000, 1000000);
+BENCHMARK_CASE(BM_FrustumCullSpheresScalar, 100000, 1000000);
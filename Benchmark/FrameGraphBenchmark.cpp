@@ -0,0 +1,66 @@
+#include <string>
+#include "Benchmark.h"
+#include "BenchmarkScene.h"
+#include "FrameGraph.h"
+
+namespace {
+    // A post processing style chain: every pass reads the previous pass's target and writes a new transient
+    // one, every fourth pass writes a target no one reads (culled). Only neighbours are alive at once, so
+    // aliasing should back the whole chain with two textures.
+    void AddChain(Gm::FrameGraph &graph, Gm::FrameResource backbuffer, size_t length) {
+        static std::vector<std::string> names;
+        while (names.size() < length) {
+            names.push_back("Pass" + std::to_string(names.size()));
+        }
+        Gm::FrameResource previous = 0;
+        bool first = true;
+        for (size_t i = 0; i < length; ++i) {
+            bool last = i + 1 == length;
+            bool unused = i % 4 == 3 && !last;
+            Gm::FrameResource output = 0;
+            graph.AddPass(names[i].c_str(), [&](Gm::FrameGraph::Builder &builder) {
+                if (!first) {
+                    builder.Read(previous, Gm::FrameAccess::Sampled);
+                }
+                if (last) {
+                    builder.Write(backbuffer, Gm::FrameAccess::ColorTarget);
+                } else {
+                    output = builder.CreateTexture(names[i].c_str(), {512, 512, GL_RGBA16F});
+                    builder.Write(output, Gm::FrameAccess::Storage);
+                }
+            }, [](const Gm::FrameGraph &) {});
+            if (!unused) {
+                previous = output;
+                first = false;
+            }
+        }
+    }
+}
+
+// building and compiling the graph every frame, what the graph costs on top of the passes themselves
+static void BM_FrameGraphCompile(Bench::State &state) {
+    Gm::HeadlessContext *context = Bench::SharedHeadlessContext();
+    if (context == nullptr) {
+        state.SkipWithError("no headless OpenGL context");
+        return;
+    }
+    Gm::FrameGraph graph;
+    while (state.KeepRunning()) {
+        graph.Reset();
+        // the passes draw nothing, only the graph's own work is measured
+        Gm::FrameResource backbuffer = graph.ImportFramebuffer("Backbuffer", 0);
+        AddChain(graph, backbuffer, (size_t) state.Argument());
+        graph.Compile();
+        graph.Execute();
+    }
+    context->Finish();
+    const Gm::FrameGraphStats &stats = graph.GetStats();
+    state.SetItemsProcessed(state.Iterations() * stats.passes);
+    state.SetCounter("culled", (double) stats.culledPasses);
+    state.SetCounter("barriers", (double) stats.barriers);
+    state.SetCounter("transient_MB", stats.transientBytes / (1024.0 * 1024.0));
+    state.SetCounter("allocated_MB", stats.allocatedBytes / (1024.0 * 1024.0));
+    graph.Finalize();
+}
+
+BENCHMARK_CASE(BM_FrameGraphCompile, 8, 64, 512);
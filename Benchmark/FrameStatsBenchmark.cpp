@@ -0,0 +1,71 @@
+#include <cstdio>
+#include <random>
+#include <vector>
+#include "Benchmark.h"
+#include "BenchmarkScene.h"
+#include "FrameStats.h"
+
+// what recording a frame costs, frame times around 16 ms with a hitch now and then
+static void BM_FrameStatsRecord(Bench::State &state) {
+    Gm::FrameStats stats;
+    std::mt19937 generator(1);
+    std::lognormal_distribution<double> frameTime(2.8, 0.25);
+    std::vector<double> times(4096);
+    for (double &time : times) {
+        time = frameTime(generator);
+    }
+    size_t next = 0;
+    while (state.KeepRunning()) {
+        stats.Record(Gm::FrameSeries::Cpu, times[next]);
+        next = (next + 1) % times.size();
+    }
+    Gm::FrameTimeSummary summary = stats.Summary(Gm::FrameSeries::Cpu);
+    Gm::FrameTimeSummary window = stats.WindowSummary(Gm::FrameSeries::Cpu);
+    state.SetItemsProcessed(state.Iterations());
+    state.SetCounter("p99_ms", summary.p99);
+    // the histogram's p99 next to the exact one of the window, they agree to within a bucket
+    state.SetCounter("window_p99_ms", window.p99);
+    state.SetCounter("hitches", (double) summary.hitches);
+}
+
+// Full headless frames of `argument` instances: the CPU and GPU frame time percentiles of the run, and the
+// dump written every 100 ms while it runs.
+static void BM_FrameTimeStats(Bench::State &state) {
+    Gm::HeadlessContext *context = Bench::SharedHeadlessContext();
+    if (context == nullptr) {
+        state.SkipWithError("no headless OpenGL context");
+        return;
+    }
+    Gm::InstanceArray instances = Bench::MakeGridInstances((size_t) state.Argument());
+    Gm::GraphicsManager graphicsManager;
+    graphicsManager.SetInstances(instances.data(), instances.size());
+    graphicsManager.Initialize();
+    graphicsManager.Draw();
+    context->Finish();
+
+    Gm::FrameStats &stats = graphicsManager.GetFrameStats();
+    stats.Reset();
+    const char *path = "frame_stats.csv";
+    remove(path);
+    stats.StartDumping(path, Gm::FrameStatsFormat::Csv, 0.1);
+    while (state.KeepRunning()) {
+        graphicsManager.Clear();
+        graphicsManager.Draw();
+        context->Finish();
+    }
+    stats.StopDumping();
+    graphicsManager.Finalize();
+    Gm::FrameTimeSummary cpu = stats.Summary(Gm::FrameSeries::Cpu);
+    Gm::FrameTimeSummary gpu = stats.Summary(Gm::FrameSeries::Gpu);
+    state.SetItemsProcessed(state.Iterations());
+    state.SetCounter("cpu_p50_ms", cpu.p50);
+    state.SetCounter("cpu_p99_ms", cpu.p99);
+    state.SetCounter("cpu_max_ms", cpu.max);
+    state.SetCounter("gpu_p50_ms", gpu.p50);
+    state.SetCounter("gpu_p99_ms", gpu.p99);
+    state.SetCounter("gpu_frames", (double) gpu.frames);
+    state.SetCounter("hitches", (double) cpu.hitches);
+}
+
+BENCHMARK_CASE(BM_FrameStatsRecord);
+BENCHMARK_CASE(BM_FrameTimeStats, 1000, 100000);
@@ -0,0 +1,51 @@
+#include "Benchmark.h"
+#include "BenchmarkScene.h"
+#include "GlLoader.h"
+
+// Loading GL the way GraphicsManager::Initialize does, argument 0 every entry point (gladLoadGL), 1 lazily.
+static void BM_GlLoad(Bench::State &state) {
+    if (Bench::SharedHeadlessContext() == nullptr) {
+        state.SkipWithError("no headless OpenGL context");
+        return;
+    }
+    Gm::GlLoadMode mode = state.Argument() == 0 ? Gm::GlLoadMode::All : Gm::GlLoadMode::Lazy;
+    while (state.KeepRunning()) {
+        if (!Gm::GlLoader::Load(mode)) {
+            state.SkipWithError("GL load failed");
+            return;
+        }
+    }
+    state.SetItemsProcessed(state.Iterations());
+    state.SetCounter("resolved", Gm::GlLoader::Stats().resolved);
+    state.SetCounter("deferred", Gm::GlLoader::Stats().deferred);
+}
+
+// From Initialize to the first frame of 10000 instances finished on the GPU, with each load mode; load_ms is
+// the part GL loading takes.
+static void BM_TimeToFirstFrame(Bench::State &state) {
+    Gm::HeadlessContext *context = Bench::SharedHeadlessContext();
+    if (context == nullptr) {
+        state.SkipWithError("no headless OpenGL context");
+        return;
+    }
+    Gm::GlLoadMode mode = state.Argument() == 0 ? Gm::GlLoadMode::All : Gm::GlLoadMode::Lazy;
+    Gm::InstanceArray instances = Bench::MakeGridInstances(10000);
+    double loadMilliseconds = 0.0;
+    while (state.KeepRunning()) {
+        Gm::GraphicsManager graphicsManager;
+        graphicsManager.SetInstances(instances.data(), instances.size());
+        graphicsManager.SetGlLoadMode(mode);
+        graphicsManager.Initialize();
+        graphicsManager.Clear();
+        graphicsManager.Draw();
+        context->Finish();
+        loadMilliseconds += Gm::GlLoader::Stats().milliseconds;
+        graphicsManager.Finalize();
+    }
+    state.SetItemsProcessed(state.Iterations());
+    state.SetCounter("load_ms", loadMilliseconds / state.Iterations());
+    state.SetCounter("resolved_on_first_call", Gm::GlLoader::Stats().resolvedOnFirstCall);
+}
+
+BENCHMARK_CASE(BM_GlLoad, 0, 1);
+BENCHMARK_CASE(BM_TimeToFirstFrame, 0, 1);
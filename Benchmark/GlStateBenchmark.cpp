@@ -0,0 +1,66 @@
+#include <algorithm>
+#include "Benchmark.h"
+#include "BenchmarkScene.h"
+#include "GlState.h"
+
+namespace {
+    // What a naive draw loop does: program, VAO and instance buffer set again for each of `draws` draws,
+    // switching to a second program every 16th. `cached` routes the calls through GlState.
+    void RunStateChanges(Bench::State &state, bool cached) {
+        Gm::HeadlessContext *context = Bench::SharedHeadlessContext();
+        if (context == nullptr) {
+            state.SkipWithError("no headless OpenGL context");
+            return;
+        }
+        GLuint programs[2] = {glCreateProgram(), glCreateProgram()};
+        GLuint vertexArray = 0, buffer = 0;
+        glGenVertexArrays(1, &vertexArray);
+        glGenBuffers(1, &buffer);
+        Gm::GlState &glState = Gm::GlState::Current();
+        glState.Invalidate();
+        glState.ResetStats();
+
+        size_t draws = (size_t) state.Argument();
+        while (state.KeepRunning()) {
+            for (size_t i = 0; i < draws; ++i) {
+                GLuint program = programs[(i / 16) & 1];
+                if (cached) {
+                    glState.UseProgram(program);
+                    glState.BindVertexArray(vertexArray);
+                    glState.BindBuffer(GL_ARRAY_BUFFER, buffer);
+                    glState.Enable(GL_DEPTH_TEST);
+                } else {
+                    glUseProgram(program);
+                    glBindVertexArray(vertexArray);
+                    glBindBuffer(GL_ARRAY_BUFFER, buffer);
+                    glEnable(GL_DEPTH_TEST);
+                }
+            }
+        }
+        context->Finish();
+        state.SetItemsProcessed(state.Iterations() * draws * 4);
+        if (cached) {
+            const Gm::GlStateStats &stats = glState.GetStats();
+            uint64_t calls = std::max<uint64_t>(stats.issued + stats.filtered, 1);
+            state.SetCounter("filtered_pct", 100.0 * stats.filtered / calls);
+        }
+
+        glState.UseProgram(0);
+        glState.BindVertexArray(0);
+        glState.DeleteBuffers(1, &buffer);
+        glState.DeleteVertexArrays(1, &vertexArray);
+        glState.DeleteProgram(programs[0]);
+        glState.DeleteProgram(programs[1]);
+    }
+}
+
+static void BM_DirectStateChanges(Bench::State &state) {
+    RunStateChanges(state, false);
+}
+
+static void BM_CachedStateChanges(Bench::State &state) {
+    RunStateChanges(state, true);
+}
+
+BENCHMARK_CASE(BM_DirectStateChanges, 1000, 100000);
+BENCHMARK_CASE(BM_CachedStateChanges, 1000, 100000);
@@ -0,0 +1,99 @@
+#include <cstdio>
+#include "Benchmark.h"
+#include "BenchmarkScene.h"
+#include "GlState.h"
+#include "GlTrace.h"
+
+namespace {
+    const char *TracePath = "benchmark.gltrace";
+    const size_t TracedInstances = 10000;
+    const int TracedFrames = 30;
+
+    // a few frames of the benchmark scene, once per run of the benchmarks
+    bool CaptureScene(Gm::HeadlessContext *context) {
+        static bool captured = false;
+        if (captured) {
+            return true;
+        }
+        if (!Gm::GlTraceRecorder::Instance().Start(TracePath)) {
+            return false;
+        }
+        Gm::InstanceArray instances = Bench::MakeGridInstances(TracedInstances);
+        Gm::GraphicsManager graphicsManager;
+        graphicsManager.SetInstances(instances.data(), instances.size());
+        graphicsManager.Initialize();
+        for (int i = 0; i < TracedFrames; ++i) {
+            graphicsManager.Clear();
+            graphicsManager.Draw();
+            context->Finish();
+        }
+        // stops the capture too
+        graphicsManager.Finalize();
+        captured = true;
+        return true;
+    }
+}
+
+// Full headless frames of 10000 instances, argument 0 plain, 1 captured to a trace: what capturing costs.
+static void BM_CapturedFrame(Bench::State &state) {
+    Gm::HeadlessContext *context = Bench::SharedHeadlessContext();
+    if (context == nullptr) {
+        state.SkipWithError("no headless OpenGL context");
+        return;
+    }
+    Gm::GlTraceRecorder &recorder = Gm::GlTraceRecorder::Instance();
+    if (state.Argument() != 0 && !recorder.Start("captured.gltrace")) {
+        state.SkipWithError("can't write the trace");
+        return;
+    }
+    Gm::InstanceArray instances = Bench::MakeGridInstances(TracedInstances);
+    Gm::GraphicsManager graphicsManager;
+    graphicsManager.SetInstances(instances.data(), instances.size());
+    graphicsManager.Initialize();
+    graphicsManager.Draw();
+    context->Finish();
+    while (state.KeepRunning()) {
+        graphicsManager.Clear();
+        graphicsManager.Draw();
+        context->Finish();
+    }
+    Gm::GlTraceStats stats = recorder.GetStats();
+    graphicsManager.Finalize();
+    remove("captured.gltrace");
+    state.SetItemsProcessed(state.Iterations());
+    if (state.Argument() != 0) {
+        state.SetCounter("calls_per_frame", (double) stats.calls / (state.Iterations() + 1));
+        state.SetCounter("kb_per_frame", stats.bytesWritten / 1024.0 / (state.Iterations() + 1));
+        state.SetCounter("deduped", stats.dataBytes ? (double) stats.dedupedBytes / stats.dataBytes : 0.0);
+    }
+}
+
+// The frames of a captured trace replayed one after the other: the driver's side of the scene, without
+// culling, sorting or recording on the CPU.
+static void BM_ReplayTraceFrame(Bench::State &state) {
+    Gm::HeadlessContext *context = Bench::SharedHeadlessContext();
+    if (context == nullptr) {
+        state.SkipWithError("no headless OpenGL context");
+        return;
+    }
+    Gm::GlTraceReplayer replayer;
+    if (!CaptureScene(context) || !replayer.Load(TracePath) || replayer.FrameCount() == 0) {
+        state.SkipWithError("no trace to replay");
+        return;
+    }
+    replayer.ReplaySetup();
+    context->Finish();
+    size_t frame = 0;
+    while (state.KeepRunning()) {
+        replayer.ReplayFrame(frame);
+        context->Finish();
+        frame = (frame + 1) % replayer.FrameCount();
+    }
+    // the replay went around the cache
+    Gm::GlState::Current().Invalidate();
+    state.SetItemsProcessed(state.Iterations());
+    state.SetCounter("calls_per_frame", (double) replayer.CallsReplayed() / state.Iterations());
+}
+
+BENCHMARK_CASE(BM_CapturedFrame, 0, 1);
+BENCHMARK_CASE(BM_ReplayTraceFrame);
@@ -0,0 +1,71 @@
+#include <vector>
+#include "Benchmark.h"
+#include "BenchmarkScene.h"
+#include "GlState.h"
+
+// the per frame camera update of Draw, from the camera position and rotation to the view matrix
+static void BM_UpdateCameraViewMatrix(Bench::State &state) {
+    Gm::GraphicsManager graphicsManager;
+    // rotating a little every update, so no call sees the previous one's input
+    while (state.KeepRunning()) {
+        graphicsManager.UpdateCameraRotationXY(0.01f, 0.02f);
+        graphicsManager.UpdateCameraViewMatrix();
+    }
+    state.SetItemsProcessed(state.Iterations());
+}
+
+// the per frame model update of Draw, interpolating between the last two simulated rotations
+static void BM_UpdateModelMatrix(Bench::State &state) {
+    Gm::GraphicsManager graphicsManager;
+    graphicsManager.SetModelSpin(30.0f, 45.0f, 0.0f);
+    while (state.KeepRunning()) {
+        graphicsManager.UpdateModelMatrix();
+    }
+    state.SetItemsProcessed(state.Iterations());
+}
+
+// Initialize and Finalize with `argument` instances: the program, the shared vertex and index buffers, the
+// instance buffer layout and everything else InitializeBuffers sets up
+static void BM_GraphicsInitialize(Bench::State &state) {
+    Gm::HeadlessContext *context = Bench::SharedHeadlessContext();
+    if (context == nullptr) {
+        state.SkipWithError("no headless OpenGL context");
+        return;
+    }
+    Gm::InstanceArray instances = Bench::MakeGridInstances((size_t) state.Argument());
+    while (state.KeepRunning()) {
+        Gm::GraphicsManager graphicsManager;
+        graphicsManager.SetInstances(instances.data(), instances.size());
+        graphicsManager.Initialize();
+        graphicsManager.Finalize();
+        context->Finish();
+    }
+    state.SetItemsProcessed(state.Iterations());
+}
+
+// a new instance buffer filled with `argument` instances, as InitializeBuffers creates it and the first
+// Draw uploads it
+static void BM_CreateInstanceBuffer(Bench::State &state) {
+    Gm::HeadlessContext *context = Bench::SharedHeadlessContext();
+    if (context == nullptr) {
+        state.SkipWithError("no headless OpenGL context");
+        return;
+    }
+    Gm::InstanceArray instances = Bench::MakeGridInstances((size_t) state.Argument());
+    size_t bytes = instances.size() * sizeof(Gm::InstanceType);
+    while (state.KeepRunning()) {
+        GLuint buffer;
+        glGenBuffers(1, &buffer);
+        Gm::GlState::Current().BindBuffer(GL_ARRAY_BUFFER, buffer);
+        glBufferData(GL_ARRAY_BUFFER, bytes, instances.data(), GL_DYNAMIC_DRAW);
+        Gm::GlState::Current().DeleteBuffers(1, &buffer);
+        context->Finish();
+    }
+    state.SetItemsProcessed(state.Iterations() * instances.size());
+    state.SetCounter("mb_per_second", state.Iterations() * bytes / 1e6 / state.ElapsedSeconds());
+}
+
+BENCHMARK_CASE(BM_UpdateCameraViewMatrix);
+BENCHMARK_CASE(BM_UpdateModelMatrix);
+BENCHMARK_CASE(BM_GraphicsInitialize, 1000, 100000);
+BENCHMARK_CASE(BM_CreateInstanceBuffer, 1000, 100000, 1000000);
@@ -0,0 +1,55 @@
+#include "Benchmark.h"
+#include "BenchmarkScene.h"
+
+namespace {
+    // Full headless frames over the cube grid with frustum culling on, the grid's front layers hide most
+    // of the cubes behind them. `gpu` picks the Hi-Z compute path over CPU frustum + occlusion culling.
+    void RunCulledFrames(Bench::State &state, bool gpu) {
+        Gm::HeadlessContext *context = Bench::SharedHeadlessContext();
+        if (context == nullptr) {
+            state.SkipWithError("no headless OpenGL context");
+            return;
+        }
+        Gm::InstanceArray instances = Bench::MakeGridInstances((size_t) state.Argument());
+        Gm::GraphicsManager graphicsManager;
+        graphicsManager.SetInstances(instances.data(), instances.size());
+        graphicsManager.SetGpuCullingEnabled(gpu);
+        graphicsManager.Initialize();
+        if (gpu && !graphicsManager.IsGpuCullingActive()) {
+            graphicsManager.Finalize();
+            state.SkipWithError("compute shaders (GL 4.3) unavailable");
+            return;
+        }
+        // the first frames upload the instances and fill the depth pyramid
+        for (int i = 0; i < 3; ++i) {
+            graphicsManager.Clear();
+            graphicsManager.Draw();
+        }
+        context->Finish();
+
+        while (state.KeepRunning()) {
+            graphicsManager.Clear();
+            graphicsManager.Draw();
+            context->Finish();
+        }
+        state.SetItemsProcessed(state.Iterations() * instances.size());
+        if (gpu) {
+            state.SetCounter("gpu_cull_us", graphicsManager.GetGpuCullMicroseconds());
+        } else {
+            state.SetCounter("visible", (double) graphicsManager.GetCullStats().visible);
+            state.SetCounter("cpu_cull_us", graphicsManager.GetCullStats().microseconds);
+        }
+        graphicsManager.Finalize();
+    }
+}
+
+static void BM_CpuCulledFrame(Bench::State &state) {
+    RunCulledFrames(state, false);
+}
+
+static void BM_HiZCulledFrame(Bench::State &state) {
+    RunCulledFrames(state, true);
+}
+
+BENCHMARK_CASE(BM_CpuCulledFrame, 10000, 100000, 1000000);
+BENCHMARK_CASE(BM_HiZCulledFrame, 10000, 100000, 1000000);
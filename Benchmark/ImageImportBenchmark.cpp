@@ -0,0 +1,123 @@
+#include <cstdio>
+#include <string>
+#include <vector>
+#include "Benchmark.h"
+#include "ImageImport.h"
+
+namespace {
+    // the screenshot in the README, 960x562 RGBA in 4 IDAT chunks
+    const char *const SamplePath = GM_SOURCE_DIR "/img.png";
+
+    bool ReadSample(std::vector<uint8_t> &contents) {
+        FILE *file = fopen(SamplePath, "rb");
+        if (file == nullptr) {
+            return false;
+        }
+        fseek(file, 0, SEEK_END);
+        contents.resize((size_t) ftell(file));
+        fseek(file, 0, SEEK_SET);
+        bool ok = fread(contents.data(), 1, contents.size(), file) == contents.size();
+        fclose(file);
+        return ok;
+    }
+
+    void DecodeSample(Bench::State &state, const Gm::ImportOptions &options) {
+        std::vector<uint8_t> contents;
+        if (!ReadSample(contents)) {
+            state.SkipWithError("img.png not found");
+            return;
+        }
+        Gm::Image image;
+        uint64_t checksum = 0;
+        while (state.KeepRunning()) {
+            if (!Gm::DecodeImage(contents.data(), contents.size(), options, image)) {
+                state.SkipWithError("decoding failed");
+                return;
+            }
+            checksum += image.texels[image.texels.size() / 2];
+        }
+        uint64_t pixels = (uint64_t) image.width * image.height;
+        state.SetItemsProcessed(state.Iterations() * pixels);
+        state.SetCounter("mpixels_per_s", state.Iterations() * pixels / state.ElapsedSeconds() / 1e6);
+        state.SetCounter("checksum", (double) checksum);
+    }
+
+    // argument 0 is the box filter, 1 Kaiser
+    void GenerateSampleMips(Bench::State &state, Gm::ImportOptions options) {
+        options.mipFilter = state.Argument() == 0 ? Gm::MipFilter::Box : Gm::MipFilter::Kaiser;
+        Gm::Image source;
+        if (!Gm::ImportImage(SamplePath, Gm::ImportOptions{Gm::MipFilter::None}, source)) {
+            state.SkipWithError("img.png not found");
+            return;
+        }
+        Gm::Image image;
+        uint64_t checksum = 0;
+        while (state.KeepRunning()) {
+            state.PauseTiming();
+            image = source;
+            state.ResumeTiming();
+            Gm::GenerateMips(image, options);
+            checksum += image.texels.back();
+        }
+        uint64_t pixels = (uint64_t) source.width * source.height;
+        state.SetItemsProcessed(state.Iterations() * pixels);
+        state.SetCounter("levels", (double) image.LevelCount());
+        state.SetCounter("checksum", (double) checksum);
+    }
+
+    // `argument` copies of the sample, decoded and mipmapped
+    void ImportSamples(Bench::State &state, const Gm::ImportOptions &options) {
+        std::vector<std::string> paths((size_t) state.Argument(), SamplePath);
+        std::vector<Gm::Image> images;
+        uint64_t checksum = 0;
+        while (state.KeepRunning()) {
+            if (!Gm::ImportImages(paths, options, images)) {
+                state.SkipWithError("import failed");
+                return;
+            }
+            checksum += images.back().texels.back();
+        }
+        state.SetItemsProcessed(state.Iterations() * paths.size());
+        state.SetCounter("images_per_s", state.Iterations() * paths.size() / state.ElapsedSeconds());
+        state.SetCounter("checksum", (double) checksum);
+    }
+
+    Gm::ImportOptions SingleThreadScalar() {
+        Gm::ImportOptions options;
+        options.parallel = false;
+        options.simd = false;
+        return options;
+    }
+}
+
+// inflate, SSE2 unfiltering and the RGBA conversion in parallel bands
+static void BM_DecodePng(Bench::State &state) {
+    DecodeSample(state, Gm::ImportOptions());
+}
+
+static void BM_DecodePngSingleThreadScalar(Bench::State &state) {
+    DecodeSample(state, SingleThreadScalar());
+}
+
+static void BM_GenerateMips(Bench::State &state) {
+    GenerateSampleMips(state, Gm::ImportOptions());
+}
+
+static void BM_GenerateMipsSingleThreadScalar(Bench::State &state) {
+    GenerateSampleMips(state, SingleThreadScalar());
+}
+
+static void BM_ImportImages(Bench::State &state) {
+    ImportSamples(state, Gm::ImportOptions());
+}
+
+static void BM_ImportImagesSingleThreadScalar(Bench::State &state) {
+    ImportSamples(state, SingleThreadScalar());
+}
+
+BENCHMARK_CASE(BM_DecodePng);
+BENCHMARK_CASE(BM_DecodePngSingleThreadScalar);
+BENCHMARK_CASE(BM_GenerateMips, 0, 1);
+BENCHMARK_CASE(BM_GenerateMipsSingleThreadScalar, 0, 1);
+BENCHMARK_CASE(BM_ImportImages, 16);
+BENCHMARK_CASE(BM_ImportImagesSingleThreadScalar, 16);
@@ -0,0 +1,32 @@
+#include "Benchmark.h"
+#include "BenchmarkScene.h"
+#include "GlState.h"
+
+// Full headless frames drawing `argument` cube instances with a single instanced draw call.
+static void BM_InstancedFrame(Bench::State &state) {
+    Gm::HeadlessContext *context = Bench::SharedHeadlessContext();
+    if (context == nullptr) {
+        state.SkipWithError("no headless OpenGL context");
+        return;
+    }
+    Gm::InstanceArray instances = Bench::MakeGridInstances((size_t) state.Argument());
+    Gm::GraphicsManager graphicsManager;
+    graphicsManager.SetInstances(instances.data(), instances.size());
+    graphicsManager.Initialize();
+    // upload the instance buffer outside of the measured loop
+    graphicsManager.Draw();
+    context->Finish();
+
+    Gm::GlState::Current().ResetStats();
+    while (state.KeepRunning()) {
+        graphicsManager.Clear();
+        graphicsManager.Draw();
+        context->Finish();
+    }
+    graphicsManager.Finalize();
+    state.SetItemsProcessed(state.Iterations() * instances.size());
+    // state changes the cache kept from the driver each frame
+    state.SetCounter("gl_filtered", (double) Gm::GlState::Current().GetStats().filtered / state.Iterations());
+}
+
+BENCHMARK_CASE(BM_InstancedFrame, 1000, 10000, 100000, 1000000);
@@ -0,0 +1,171 @@
+#include <random>
+#include <vector>
+#include "Benchmark.h"
+#include "Eigen/Geometry"
+#include "SimdMath.h"
+
+namespace {
+    typedef std::vector<Eigen::Matrix4f, Eigen::aligned_allocator<Eigen::Matrix4f>> EigenMatrices;
+
+    // invertible: a random rotation and translation with some scale on the diagonal
+    EigenMatrices RandomMatrices(size_t count, unsigned seed) {
+        std::mt19937 generator(seed);
+        std::uniform_real_distribution<float> angle(-3.0f, 3.0f), offset(-50.0f, 50.0f), scale(0.5f, 2.0f);
+        EigenMatrices matrices(count);
+        for (size_t i = 0; i < count; ++i) {
+            Eigen::Affine3f transform = Eigen::Affine3f::Identity();
+            transform.translate(Eigen::Vector3f(offset(generator), offset(generator), offset(generator)));
+            transform.rotate(Eigen::AngleAxisf(angle(generator), Eigen::Vector3f::UnitX()));
+            transform.rotate(Eigen::AngleAxisf(angle(generator), Eigen::Vector3f::UnitY()));
+            transform.scale(Eigen::Vector3f(scale(generator), scale(generator), scale(generator)));
+            matrices[i] = transform.matrix();
+        }
+        return matrices;
+    }
+
+    std::vector<Gm::Mat4> ToSimd(const EigenMatrices &matrices) {
+        std::vector<Gm::Mat4> result(matrices.size());
+        for (size_t i = 0; i < matrices.size(); ++i) {
+            result[i] = Gm::FromEigen(matrices[i]);
+        }
+        return result;
+    }
+
+    // what GraphicsManager did before SimdMath: AngleAxis composition and a transposed look-at
+    Eigen::Matrix4f EigenCameraView(const Eigen::Vector3f &position, float pitch, float yaw, float roll) {
+        Eigen::Affine3f rotation;
+        rotation = Eigen::AngleAxisf(pitch, Eigen::Vector3f::UnitX()) * Eigen::AngleAxisf(yaw, Eigen::Vector3f::UnitY()) *
+                   Eigen::AngleAxisf(roll, Eigen::Vector3f::UnitZ());
+        Eigen::Vector3f lookAt = position + rotation * Eigen::Vector3f(0.0f, 0.0f, 1.0f);
+        Eigen::Vector3f up = rotation * Eigen::Vector3f(0.0f, 1.0f, 0.0f);
+        Eigen::Vector3f zAxis = (lookAt - position).normalized();
+        Eigen::Vector3f xAxis = up.cross(zAxis).normalized();
+        Eigen::Vector3f yAxis = zAxis.cross(xAxis);
+        Eigen::Matrix4f result;
+        result << xAxis[0], yAxis[0], zAxis[0], 0.0f,
+                xAxis[1], yAxis[1], zAxis[1], 0.0f,
+                xAxis[2], yAxis[2], zAxis[2], 0.0f,
+                -xAxis.dot(position), -yAxis.dot(position), -zAxis.dot(position), 1.0f;
+        result.transposeInPlace();
+        return result;
+    }
+
+    Gm::Mat4 SimdCameraView(const Gm::Vec4 &position, float pitch, float yaw, float roll) {
+        Gm::Quat rotation = Gm::QuatFromEuler(pitch, yaw, roll);
+        Gm::Vec4 lookAt = Gm::Rotate(rotation, {0.0f, 0.0f, 1.0f, 0.0f});
+        Gm::Vec4 up = Gm::Rotate(rotation, {0.0f, 1.0f, 0.0f, 0.0f});
+        lookAt = {position.x + lookAt.x, position.y + lookAt.y, position.z + lookAt.z, 1.0f};
+        return Gm::LookAtLH(position, lookAt, up);
+    }
+
+    void ReportMath(Bench::State &state, size_t count, float checksum) {
+        state.SetItemsProcessed(state.Iterations() * count);
+        state.SetCounter("ms_per_million", state.ElapsedSeconds() * 1e3 / state.Iterations() * 1e6 / count);
+        // keeps the results alive
+        state.SetCounter("checksum", checksum);
+    }
+}
+
+static void BM_EigenMultiply(Bench::State &state) {
+    size_t count = (size_t) state.Argument();
+    EigenMatrices a = RandomMatrices(count, 1), b = RandomMatrices(count, 2), result(count);
+    while (state.KeepRunning()) {
+        for (size_t i = 0; i < count; ++i) {
+            result[i].noalias() = a[i] * b[i];
+        }
+    }
+    ReportMath(state, count, result[count - 1](0, 3));
+}
+
+static void BM_SimdMultiply(Bench::State &state) {
+    size_t count = (size_t) state.Argument();
+    std::vector<Gm::Mat4> a = ToSimd(RandomMatrices(count, 1)), b = ToSimd(RandomMatrices(count, 2)), result(count);
+    while (state.KeepRunning()) {
+        for (size_t i = 0; i < count; ++i) {
+            result[i] = Gm::Multiply(a[i], b[i]);
+        }
+    }
+    ReportMath(state, count, result[count - 1](0, 3));
+    state.SetCounter(Gm::Math::KernelName(), 1);
+}
+
+static void BM_EigenInverse(Bench::State &state) {
+    size_t count = (size_t) state.Argument();
+    EigenMatrices matrices = RandomMatrices(count, 1), result(count);
+    while (state.KeepRunning()) {
+        for (size_t i = 0; i < count; ++i) {
+            result[i] = matrices[i].inverse();
+        }
+    }
+    ReportMath(state, count, result[count - 1](0, 3));
+}
+
+static void BM_SimdInverse(Bench::State &state) {
+    size_t count = (size_t) state.Argument();
+    std::vector<Gm::Mat4> matrices = ToSimd(RandomMatrices(count, 1)), result(count);
+    while (state.KeepRunning()) {
+        for (size_t i = 0; i < count; ++i) {
+            result[i] = Gm::Inverse(matrices[i]);
+        }
+    }
+    ReportMath(state, count, result[count - 1](0, 3));
+    state.SetCounter(Gm::Math::KernelName(), 1);
+}
+
+static void BM_EigenCameraUpdate(Bench::State &state) {
+    size_t count = (size_t) state.Argument();
+    EigenMatrices result(count);
+    while (state.KeepRunning()) {
+        for (size_t i = 0; i < count; ++i) {
+            float angle = (float) i * 0.001f;
+            result[i] = EigenCameraView(Eigen::Vector3f(0.0f, 0.0f, -10.0f), angle, angle * 0.5f, 0.0f);
+        }
+    }
+    ReportMath(state, count, result[count - 1](0, 3));
+}
+
+static void BM_SimdCameraUpdate(Bench::State &state) {
+    size_t count = (size_t) state.Argument();
+    std::vector<Gm::Mat4> result(count);
+    while (state.KeepRunning()) {
+        for (size_t i = 0; i < count; ++i) {
+            float angle = (float) i * 0.001f;
+            result[i] = SimdCameraView({0.0f, 0.0f, -10.0f, 1.0f}, angle, angle * 0.5f, 0.0f);
+        }
+    }
+    ReportMath(state, count, result[count - 1](0, 3));
+}
+
+// the projection builder, as the window size or field of view changes
+static void BM_PerspectiveFovLH(Bench::State &state) {
+    size_t count = (size_t) state.Argument();
+    std::vector<Gm::Mat4> result(count);
+    while (state.KeepRunning()) {
+        for (size_t i = 0; i < count; ++i) {
+            result[i] = Gm::PerspectiveFovLH(0.5f + (float) i * 1e-6f, 1.5f, 0.1f, 1000.0f);
+        }
+    }
+    ReportMath(state, count, result[count - 1](0, 0));
+}
+
+// the view matrix builder alone, BM_SimdCameraUpdate adds the rotation of the camera axes
+static void BM_LookAtLH(Bench::State &state) {
+    size_t count = (size_t) state.Argument();
+    std::vector<Gm::Mat4> result(count);
+    while (state.KeepRunning()) {
+        for (size_t i = 0; i < count; ++i) {
+            float x = (float) i * 0.001f;
+            result[i] = Gm::LookAtLH({x, 0.0f, -10.0f, 1.0f}, {0.0f, x, 0.0f, 1.0f}, {0.0f, 1.0f, 0.0f, 0.0f});
+        }
+    }
+    ReportMath(state, count, result[count - 1](0, 3));
+}
+
+BENCHMARK_CASE(BM_EigenMultiply, 1000, 100000);
+BENCHMARK_CASE(BM_SimdMultiply, 1000, 100000);
+BENCHMARK_CASE(BM_EigenInverse, 1000, 100000);
+BENCHMARK_CASE(BM_SimdInverse, 1000, 100000);
+BENCHMARK_CASE(BM_EigenCameraUpdate, 1000, 100000);
+BENCHMARK_CASE(BM_SimdCameraUpdate, 1000, 100000);
+BENCHMARK_CASE(BM_PerspectiveFovLH, 1000, 100000);
+BENCHMARK_CASE(BM_LookAtLH, 1000, 100000);
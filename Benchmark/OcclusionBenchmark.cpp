@@ -0,0 +1,86 @@
+#include <cmath>
+#include <numeric>
+#include <random>
+#include "Eigen/Geometry"
+#include "Benchmark.h"
+#include "OcclusionCuller.h"
+
+namespace {
+    const Eigen::Vector3f CubeCorners[8] = {
+            {-1.0f, -1.0f, -1.0f}, {1.0f, -1.0f, -1.0f}, {1.0f, 1.0f, -1.0f}, {-1.0f, 1.0f, -1.0f},
+            {-1.0f, -1.0f, 1.0f}, {1.0f, -1.0f, 1.0f}, {1.0f, 1.0f, 1.0f}, {-1.0f, 1.0f, 1.0f},
+    };
+    const uint32_t CubeIndices[36] = {0, 1, 2, 0, 2, 3, 4, 6, 5, 4, 7, 6, 0, 4, 5, 0, 5, 1,
+                                      3, 2, 6, 3, 6, 7, 0, 3, 7, 0, 7, 4, 1, 5, 6, 1, 6, 2};
+
+    Eigen::Matrix4f DefaultViewProjection() {
+        float fieldOfView = (float) M_PI / 4.0f, aspect = 960.0f / 540.0f, nearZ = 0.1f, farZ = 1000.0f;
+        Eigen::Matrix4f projection;
+        projection << 1.0f / (aspect * tanf(fieldOfView * 0.5f)), 0.0f, 0.0f, 0.0f,
+                0.0f, 1.0f / tanf(fieldOfView * 0.5f), 0.0f, 0.0f,
+                0.0f, 0.0f, farZ / (farZ - nearZ), -nearZ * farZ / (farZ - nearZ),
+                0.0f, 0.0f, 1.0f, 0.0f;
+        Eigen::Matrix4f view = Eigen::Matrix4f::Identity();
+        view(2, 3) = 10.0f;
+        return projection * view;
+    }
+
+    // a row of 16 wide boxes close to the camera, standing in front of the candidates
+    void AddWallOccluders(Gm::OcclusionCuller &culler) {
+        for (int i = 0; i < 16; ++i) {
+            Eigen::Affine3f transform = Eigen::Affine3f::Identity();
+            transform.translate(Eigen::Vector3f(-7.5f + i, 0.0f, 5.0f));
+            transform.scale(Eigen::Vector3f(0.5f, 6.0f, 0.5f));
+            culler.AddOccluder(transform.matrix(), CubeCorners, sizeof(Eigen::Vector3f), CubeIndices, 36);
+        }
+    }
+}
+
+static void BM_OcclusionRaster(Bench::State &state) {
+    Gm::OcclusionCuller culler;
+    while (state.KeepRunning()) {
+        culler.BeginFrame(DefaultViewProjection());
+        AddWallOccluders(culler);
+        culler.RasterizeAsync(Gm::TaskSystem::Instance());
+        culler.Wait();
+    }
+    state.SetItemsProcessed(state.Iterations() * culler.GetStats().triangles);
+    state.SetCounter("worker_us", culler.GetStats().rasterMicroseconds);
+}
+
+// candidates behind the wall, argument is the number of candidates
+static void BM_OcclusionFilter(Bench::State &state) {
+    size_t count = (size_t) state.Argument();
+    Gm::BoundingSpheres spheres;
+    spheres.Resize(count);
+    std::mt19937 generator(3);
+    std::uniform_real_distribution<float> x(-12.0f, 12.0f), y(-6.0f, 6.0f), z(10.0f, 60.0f);
+    for (size_t i = 0; i < count; ++i) {
+        spheres.x[i] = x(generator);
+        spheres.y[i] = y(generator);
+        spheres.z[i] = z(generator);
+        spheres.radius[i] = 0.5f;
+    }
+    Gm::OcclusionCuller culler;
+    culler.BeginFrame(DefaultViewProjection());
+    AddWallOccluders(culler);
+    culler.RasterizeAsync(Gm::TaskSystem::Instance());
+    culler.Wait();
+
+    std::vector<uint32_t> indices(count);
+    size_t occluded = 0;
+    while (state.KeepRunning()) {
+        state.PauseTiming();
+        indices.resize(count);
+        std::iota(indices.begin(), indices.end(), 0u);
+        state.ResumeTiming();
+        culler.Filter(spheres, indices);
+        occluded = count - indices.size();
+    }
+    state.SetItemsProcessed(state.Iterations() * count);
+    state.SetCounter("occluded", (double) occluded);
+    state.SetCounter("ms_per_million", state.ElapsedSeconds() * 1e3 / state.Iterations() * 1e6 / count);
+}
+
+BENCHMARK_CASE(BM_OcclusionRaster);
+BENCHMARK_CASE(BM_OcclusionFilter, 100000, 1000000);
@@ -0,0 +1,85 @@
+#include <random>
+#include "Benchmark.h"
+#include "BenchmarkScene.h"
+#include "Picking.h"
+
+namespace {
+    // a bumpy height field of 2 * side * side triangles
+    Gm::MeshId AddHeightField(Gm::GeometryArena &geometry, uint32_t side) {
+        std::vector<Gm::VertexType> vertices((side + 1) * (side + 1));
+        for (uint32_t y = 0; y <= side; ++y) {
+            for (uint32_t x = 0; x <= side; ++x) {
+                Gm::VertexType &vertex = vertices[y * (side + 1) + x];
+                float u = (float) x / side, v = (float) y / side;
+                float height = 0.05f * sinf(u * 40.0f) * cosf(v * 40.0f);
+                vertex.position = Eigen::Vector3f(u * 2.0f - 1.0f, v * 2.0f - 1.0f, height);
+                vertex.color = Eigen::Vector3f::Ones();
+            }
+        }
+        std::vector<uint32_t> indices;
+        indices.reserve(side * side * 6);
+        for (uint32_t y = 0; y < side; ++y) {
+            for (uint32_t x = 0; x < side; ++x) {
+                uint32_t corner = y * (side + 1) + x;
+                uint32_t quad[6] = {corner, corner + 1, corner + side + 1,
+                                    corner + 1, corner + side + 2, corner + side + 1};
+                indices.insert(indices.end(), quad, quad + 6);
+            }
+        }
+        return geometry.AddMesh(vertices.data(), vertices.size(), indices.data(), indices.size());
+    }
+}
+
+// single mesh, argument is the triangle count
+static void BM_PickTriangleMesh(Bench::State &state) {
+    Gm::GeometryArena geometry;
+    uint32_t side = (uint32_t) sqrt((double) state.Argument() / 2.0);
+    Gm::MeshId mesh = AddHeightField(geometry, side);
+    Gm::TriangleMeshBvh bvh;
+    bvh.Build(geometry, mesh);
+
+    std::mt19937 generator(5);
+    std::uniform_real_distribution<float> position(-1.0f, 1.0f);
+    size_t hits = 0;
+    while (state.KeepRunning()) {
+        Gm::Ray ray;
+        ray.origin = Eigen::Vector3f(position(generator), position(generator), -5.0f);
+        ray.direction = Eigen::Vector3f(position(generator) * 0.1f, position(generator) * 0.1f, 1.0f);
+        uint32_t triangle;
+        hits += bvh.Intersect(ray, triangle);
+    }
+    state.SetItemsProcessed(state.Iterations());
+    state.SetCounter("triangles", 2.0 * side * side);
+    state.SetCounter("hit_rate", (double) hits / state.Iterations());
+}
+
+// the full two level pick through GraphicsManager, argument is the number of cube instances
+static void BM_PickInstancedScene(Bench::State &state) {
+    Gm::HeadlessContext *context = Bench::SharedHeadlessContext();
+    if (context == nullptr) {
+        state.SkipWithError("no headless OpenGL context");
+        return;
+    }
+    Gm::InstanceArray instances = Bench::MakeGridInstances((size_t) state.Argument());
+    Gm::GraphicsManager graphicsManager;
+    graphicsManager.SetInstances(instances.data(), instances.size());
+    graphicsManager.Initialize();
+    graphicsManager.Draw();
+    // build the hierarchies outside of the measurement
+    Gm::PickResult result;
+    graphicsManager.Pick(480.0f, 270.0f, 960.0f, 540.0f, result);
+
+    std::mt19937 generator(9);
+    std::uniform_real_distribution<float> x(0.0f, 960.0f), y(0.0f, 540.0f);
+    size_t hits = 0;
+    while (state.KeepRunning()) {
+        hits += graphicsManager.Pick(x(generator), y(generator), 960.0f, 540.0f, result);
+    }
+    graphicsManager.Finalize();
+    state.SetItemsProcessed(state.Iterations());
+    state.SetCounter("triangles", 12.0 * instances.size());
+    state.SetCounter("hit_rate", (double) hits / state.Iterations());
+}
+
+BENCHMARK_CASE(BM_PickTriangleMesh, 2000000, 8000000);
+BENCHMARK_CASE(BM_PickInstancedScene, 100000, 1000000);
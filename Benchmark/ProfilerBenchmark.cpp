@@ -0,0 +1,64 @@
+#include <string>
+#include <vector>
+#include "Benchmark.h"
+#include "BenchmarkScene.h"
+#include "Profiler.h"
+
+// what a CPU scope costs, argument 0 with the profiler off, 1 on
+static void BM_ProfileScope(Bench::State &state) {
+    Gm::Profiler &profiler = Gm::Profiler::Instance();
+    profiler.SetEnabled(state.Argument() != 0);
+    uint64_t scopes = 0;
+    while (state.KeepRunning()) {
+        for (int i = 0; i < 1000; ++i) {
+            GM_PROFILE_SCOPE("Scope");
+            ++scopes;
+        }
+    }
+    profiler.SetEnabled(true);
+    state.SetItemsProcessed(state.Iterations() * 1000);
+    state.SetCounter("ns_per_scope", state.ElapsedSeconds() * 1e9 / (double) scopes);
+}
+
+// Full headless frames of 10000 instances, argument 0 with the profiler off, 1 on: the overhead of the CPU
+// scopes and GPU timestamps of Draw and its passes. The trace of the last frames is exported once.
+static void BM_ProfiledFrame(Bench::State &state) {
+    Gm::HeadlessContext *context = Bench::SharedHeadlessContext();
+    if (context == nullptr) {
+        state.SkipWithError("no headless OpenGL context");
+        return;
+    }
+    Gm::Profiler &profiler = Gm::Profiler::Instance();
+    Gm::InstanceArray instances = Bench::MakeGridInstances(10000);
+    Gm::GraphicsManager graphicsManager;
+    graphicsManager.SetInstances(instances.data(), instances.size());
+    graphicsManager.Initialize();
+    graphicsManager.Draw();
+    context->Finish();
+
+    profiler.SetEnabled(state.Argument() != 0);
+    profiler.Clear();
+    while (state.KeepRunning()) {
+        graphicsManager.Clear();
+        graphicsManager.Draw();
+        context->Finish();
+    }
+    std::vector<Gm::ProfileTimeline> timelines;
+    profiler.Collect(timelines);
+    size_t cpuEvents = 0, gpuEvents = 0;
+    for (const Gm::ProfileTimeline &timeline : timelines) {
+        (timeline.name == "GPU" ? gpuEvents : cpuEvents) += timeline.events.size();
+    }
+    std::string json;
+    profiler.ChromeTrace(json);
+    graphicsManager.Finalize();
+    profiler.SetEnabled(true);
+    state.SetItemsProcessed(state.Iterations());
+    state.SetCounter("cpu_events", (double) cpuEvents);
+    state.SetCounter("gpu_events", (double) gpuEvents);
+    state.SetCounter("trace_kb", json.size() / 1024.0);
+    state.SetCounter("dropped_gpu_frames", (double) profiler.GetStats().droppedGpuFrames);
+}
+
+BENCHMARK_CASE(BM_ProfileScope, 0, 1);
+BENCHMARK_CASE(BM_ProfiledFrame, 0, 1);
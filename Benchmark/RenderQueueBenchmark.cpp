@@ -0,0 +1,51 @@
+#include <algorithm>
+#include <random>
+#include "Benchmark.h"
+#include "RenderQueue.h"
+
+namespace {
+    // opaque draws over a handful of programs and materials at random depths, one in ten transparent
+    std::vector<Gm::SortItem> RandomDrawKeys(size_t count) {
+        std::mt19937 generator(7);
+        std::uniform_int_distribution<uint32_t> program(1, 8), material(0, 63), vao(1, 4), transparent(0, 9);
+        std::uniform_real_distribution<float> depth(0.1f, 1000.0f);
+        std::vector<Gm::SortItem> items(count);
+        for (size_t i = 0; i < count; ++i) {
+            Gm::RenderPass pass = transparent(generator) == 0 ? Gm::RenderPass::Transparent : Gm::RenderPass::Opaque;
+            items[i].key = Gm::MakeSortKey(pass, program(generator), material(generator), vao(generator),
+                                           depth(generator));
+            items[i].value = (uint32_t) i;
+        }
+        return items;
+    }
+}
+
+static void BM_RadixSortDrawKeys(Bench::State &state) {
+    std::vector<Gm::SortItem> source = RandomDrawKeys((size_t) state.Argument());
+    std::vector<Gm::SortItem> items, scratch;
+    while (state.KeepRunning()) {
+        state.PauseTiming();
+        items = source;
+        state.ResumeTiming();
+        Gm::RadixSort(items, scratch);
+    }
+    state.SetItemsProcessed(state.Iterations() * source.size());
+}
+
+// the comparison sort the queue replaces
+static void BM_StdSortDrawKeys(Bench::State &state) {
+    std::vector<Gm::SortItem> source = RandomDrawKeys((size_t) state.Argument());
+    std::vector<Gm::SortItem> items;
+    while (state.KeepRunning()) {
+        state.PauseTiming();
+        items = source;
+        state.ResumeTiming();
+        std::stable_sort(items.begin(), items.end(), [](const Gm::SortItem &a, const Gm::SortItem &b) {
+            return a.key < b.key;
+        });
+    }
+    state.SetItemsProcessed(state.Iterations() * source.size());
+}
+
+BENCHMARK_CASE(BM_RadixSortDrawKeys, 10000, 100000, 1000000);
+BENCHMARK_CASE(BM_StdSortDrawKeys, 10000, 100000, 1000000);
@@ -0,0 +1,220 @@
+#include <cmath>
+#include <vector>
+#include "Animation.h"
+#include "Benchmark.h"
+#include "BenchmarkScene.h"
+#include "Skinning.h"
+
+namespace {
+    const size_t WormJoints = 16;
+    const size_t ClipFrames = 60;
+
+    // the cube of GraphicsManager, wound the same way
+    const float CubeCorners[8][3] = {{1, 1, 1}, {1, 1, -1}, {-1, 1, -1}, {-1, 1, 1},
+                                     {1, -1, 1}, {1, -1, -1}, {-1, -1, -1}, {-1, -1, 1}};
+    const uint32_t CubeIndices[] = {1, 2, 3, 3, 2, 6, 6, 7, 3, 3, 0, 1, 0, 3, 7, 7, 6, 4, 4, 6, 5, 0, 7, 4, 1, 0, 4,
+                                    1, 4, 5, 2, 1, 5, 2, 5, 6};
+
+    // a chain of joints one unit apart along +y, each the parent of the next
+    Gm::Skeleton MakeWormSkeleton(size_t joints) {
+        Gm::Skeleton skeleton;
+        for (size_t j = 0; j < joints; ++j) {
+            skeleton.parents.push_back((int) j - 1);
+            Gm::Mat4 inverseBind = Gm::Mat4::Identity();
+            inverseBind.m[13] = -(float) j;
+            skeleton.inverseBindMatrices.push_back(inverseBind);
+        }
+        return skeleton;
+    }
+
+    // one box per joint, its top half shared with the next joint so the worm bends smoothly
+    void MakeWormMesh(size_t joints, std::vector<Gm::SkinnedVertex> &vertices, std::vector<uint32_t> &indices) {
+        for (size_t j = 0; j < joints; ++j) {
+            uint32_t first = (uint32_t) vertices.size();
+            for (const float *corner : CubeCorners) {
+                Gm::SkinnedVertex vertex = {};
+                vertex.position[0] = 0.3f * corner[0];
+                vertex.position[1] = j + 0.5f + 0.5f * corner[1];
+                vertex.position[2] = 0.3f * corner[2];
+                vertex.color[0] = (float) j / joints;
+                vertex.color[1] = 0.5f + 0.5f * corner[1];
+                vertex.color[2] = 1.0f - (float) j / joints;
+                vertex.joints[0] = (uint8_t) j;
+                vertex.weights[0] = 1.0f;
+                if (corner[1] > 0.0f && j + 1 < joints) {
+                    vertex.joints[1] = (uint8_t) (j + 1);
+                    vertex.weights[0] = vertex.weights[1] = 0.5f;
+                }
+                vertices.push_back(vertex);
+            }
+            for (uint32_t index : CubeIndices) {
+                indices.push_back(first + index);
+            }
+        }
+    }
+
+    // a two second loop waving every joint about `axis` (0 for x, 2 for z), a wave travelling up the chain
+    Gm::RawClip MakeWaveClip(size_t joints, int axis, float amplitude) {
+        Gm::RawClip clip;
+        clip.jointCount = joints;
+        for (size_t frame = 0; frame <= ClipFrames; ++frame) {
+            float phase = 2.0f * (float) M_PI * (frame % ClipFrames) / ClipFrames;
+            for (size_t j = 0; j < joints; ++j) {
+                float angle = amplitude * std::sin(phase + 0.4f * j);
+                Gm::JointPose pose;
+                pose.rotation = Gm::QuatFromAxisAngle({axis == 0 ? 1.0f : 0.0f, 0.0f, axis == 2 ? 1.0f : 0.0f, 0.0f},
+                                                      angle);
+                pose.translation = {0.0f, j == 0 ? 0.0f : 1.0f, 0.0f, 0.0f};
+                clip.frames.push_back(pose);
+            }
+        }
+        return clip;
+    }
+
+    struct Crowd {
+        Gm::Skeleton skeleton;
+        std::vector<Gm::SkinnedVertex> vertices;
+        std::vector<uint32_t> indices;
+        std::vector<Gm::AnimationClip> clips;
+        std::vector<Gm::CharacterAnimation> characters;
+        std::vector<Gm::Mat4> worldMatrices;
+    };
+
+    // `count` worms on a grid in front of the default camera, each at its own point of a sway / bend blend
+    Crowd MakeCrowd(size_t count) {
+        Crowd crowd;
+        crowd.skeleton = MakeWormSkeleton(WormJoints);
+        MakeWormMesh(WormJoints, crowd.vertices, crowd.indices);
+        crowd.clips.push_back(Gm::AnimationClip::Compress(MakeWaveClip(WormJoints, 2, 0.15f)));
+        crowd.clips.push_back(Gm::AnimationClip::Compress(MakeWaveClip(WormJoints, 0, 0.25f)));
+        size_t side = (size_t) std::ceil(std::sqrt((double) count));
+        float spacing = 0.8f;
+        for (size_t i = 0; i < count; ++i) {
+            Gm::CharacterAnimation character;
+            character.clipA = 0;
+            character.clipB = 1;
+            character.timeA = std::fmod(0.37f * i, crowd.clips[0].Duration());
+            character.timeB = std::fmod(0.61f * i, crowd.clips[1].Duration());
+            character.blend = (float) (i % 5) / 4.0f;
+            crowd.characters.push_back(character);
+            // a tenth of the size, 1.6 units tall
+            Gm::Mat4 world = Gm::Mat4::Identity();
+            world.m[0] = world.m[5] = world.m[10] = 0.1f;
+            world.m[12] = spacing * ((float) (i % side) - 0.5f * (side - 1));
+            world.m[13] = -2.0f;
+            world.m[14] = spacing * (float) (i / side);
+            crowd.worldMatrices.push_back(world);
+        }
+        return crowd;
+    }
+}
+
+// Compressing one clip of `argument` joints, reports how much smaller than the raw frames it got.
+static void BM_CompressClip(Bench::State &state) {
+    Gm::RawClip raw = MakeWaveClip((size_t) state.Argument(), 2, 0.15f);
+    Gm::AnimationClip clip;
+    while (state.KeepRunning()) {
+        clip = Gm::AnimationClip::Compress(raw);
+    }
+    state.SetItemsProcessed(state.Iterations() * raw.frames.size());
+    state.SetCounter("ratio", (double) (raw.frames.size() * sizeof(Gm::JointPose)) / clip.ByteSize());
+    state.SetCounter("keys", (double) clip.KeyCount());
+}
+
+// Sampling, blending and building the world space palettes of `argument` characters.
+static void BM_AnimateCharacters(Bench::State &state) {
+    Crowd crowd = MakeCrowd((size_t) state.Argument());
+    std::vector<Gm::Mat4> palettes(crowd.characters.size() * WormJoints);
+    float time = 0.0f;
+    while (state.KeepRunning()) {
+        time += 1.0f / 60.0f;
+        Gm::AnimateCharacters(crowd.skeleton, crowd.clips, crowd.characters.data(), crowd.worldMatrices.data(),
+                              crowd.characters.size(), time, palettes.data());
+    }
+    state.SetItemsProcessed(state.Iterations() * crowd.characters.size());
+    state.SetCounter("checksum", palettes[palettes.size() / 2].m[13]);
+}
+
+static void SkinCharacters(Bench::State &state, bool vectorized) {
+    Crowd crowd = MakeCrowd((size_t) state.Argument());
+    std::vector<Gm::Mat4> palettes(crowd.characters.size() * WormJoints);
+    Gm::AnimateCharacters(crowd.skeleton, crowd.clips, crowd.characters.data(), crowd.worldMatrices.data(),
+                          crowd.characters.size(), 0.0f, palettes.data());
+    size_t vertexCount = crowd.vertices.size();
+    std::vector<float> positions(crowd.characters.size() * vertexCount * 3);
+    while (state.KeepRunning()) {
+        for (size_t c = 0; c < crowd.characters.size(); ++c) {
+            float *output = positions.data() + c * vertexCount * 3;
+            if (vectorized) {
+                Gm::SkinPositions(palettes.data() + c * WormJoints, crowd.vertices.data(), vertexCount, output,
+                                  3 * sizeof(float));
+            } else {
+                Gm::SkinPositionsScalar(palettes.data() + c * WormJoints, crowd.vertices.data(), vertexCount, output,
+                                        3 * sizeof(float));
+            }
+        }
+    }
+    state.SetItemsProcessed(state.Iterations() * crowd.characters.size() * vertexCount);
+    state.SetCounter("checksum", positions[positions.size() / 2]);
+}
+
+// Linear blend skinning of every vertex of `argument` characters on one thread.
+static void BM_SkinCharacters(Bench::State &state) {
+    SkinCharacters(state, true);
+}
+
+static void BM_SkinCharactersScalar(Bench::State &state) {
+    SkinCharacters(state, false);
+}
+
+static void SkinnedFrame(Bench::State &state, Gm::SkinnedMeshRenderer::SkinningPath path) {
+    Gm::HeadlessContext *context = Bench::SharedHeadlessContext();
+    if (context == nullptr) {
+        state.SkipWithError("no headless OpenGL context");
+        return;
+    }
+    Crowd crowd = MakeCrowd((size_t) state.Argument());
+    Gm::GraphicsManager graphicsManager;
+    graphicsManager.Initialize();
+    Gm::SkinnedMeshRenderer &renderer = graphicsManager.GetSkinnedMeshRenderer();
+    renderer.SetMesh(crowd.skeleton, crowd.vertices.data(), crowd.vertices.size(), crowd.indices.data(),
+                     crowd.indices.size());
+    for (Gm::AnimationClip &clip : crowd.clips) {
+        renderer.AddClip(clip);
+    }
+    renderer.SetCharacters(crowd.characters.data(), crowd.worldMatrices.data(), crowd.characters.size());
+    renderer.SetSkinningPath(path);
+    graphicsManager.Draw();
+    context->Finish();
+
+    double animate = 0.0, skin = 0.0;
+    while (state.KeepRunning()) {
+        graphicsManager.Clear();
+        graphicsManager.Draw();
+        context->Finish();
+        animate += renderer.GetStats().animateMicroseconds;
+        skin += renderer.GetStats().skinMicroseconds;
+    }
+    state.SetItemsProcessed(state.Iterations() * crowd.characters.size());
+    state.SetCounter("animate_us", animate / state.Iterations());
+    state.SetCounter("skin_us", skin / state.Iterations());
+    state.SetCounter("upload_kb", renderer.GetStats().uploadBytes / 1024.0);
+    graphicsManager.Finalize();
+}
+
+// Full headless frames of `argument` animated characters, skinned in the vertex shader.
+static void BM_SkinnedFrameGpu(Bench::State &state) {
+    SkinnedFrame(state, Gm::SkinnedMeshRenderer::SkinningPath::Gpu);
+}
+
+// The same frames skinned on the workers and streamed to GL.
+static void BM_SkinnedFrameCpu(Bench::State &state) {
+    SkinnedFrame(state, Gm::SkinnedMeshRenderer::SkinningPath::Cpu);
+}
+
+BENCHMARK_CASE(BM_CompressClip, 16, 64);
+BENCHMARK_CASE(BM_AnimateCharacters, 1000, 10000);
+BENCHMARK_CASE(BM_SkinCharacters, 10000);
+BENCHMARK_CASE(BM_SkinCharactersScalar, 10000);
+BENCHMARK_CASE(BM_SkinnedFrameGpu, 1000, 10000);
+BENCHMARK_CASE(BM_SkinnedFrameCpu, 1000, 10000);
@@ -0,0 +1,59 @@
+#include <random>
+#include <vector>
+#include "Benchmark.h"
+#include "TextureAtlas.h"
+
+namespace {
+    // `count` small textures, most of a random size between 8 and 256 texels a side, every fourth one 64x64 so
+    // that those end up in an array; RGBA8 with their mips
+    std::vector<Gm::Image> SmallTextures(size_t count) {
+        std::mt19937 random(7);
+        std::uniform_int_distribution<uint32_t> side(8, 256);
+        Gm::ImportOptions options;
+        options.mipFilter = Gm::MipFilter::Box;
+        std::vector<Gm::Image> images(count);
+        for (size_t i = 0; i < count; ++i) {
+            Gm::Image &image = images[i];
+            image.width = i % 4 == 0 ? 64 : side(random);
+            image.height = i % 4 == 0 ? 64 : side(random);
+            image.texels.resize((size_t) image.width * image.height * 4);
+            image.levels.assign(1, Gm::ImageLevel{0, image.width, image.height});
+            for (size_t texel = 0; texel < image.texels.size(); ++texel) {
+                image.texels[texel] = (uint8_t) (i * 31 + texel / 4 * 7);
+            }
+            Gm::GenerateMips(image, options);
+        }
+        return images;
+    }
+
+    void PackSmallTextures(Bench::State &state, Gm::AtlasPacking packing) {
+        std::vector<Gm::Image> images = SmallTextures((size_t) state.Argument());
+        std::vector<Gm::AtlasSource> sources(images.size());
+        for (size_t i = 0; i < images.size(); ++i) {
+            sources[i].image = &images[i];
+        }
+        Gm::AtlasOptions options;
+        options.packing = packing;
+        Gm::TexturePack pack;
+        while (state.KeepRunning()) {
+            Gm::PackTextures(sources, options, pack);
+        }
+        state.SetItemsProcessed(state.Iterations() * sources.size());
+        state.SetCounter("efficiency", pack.stats.packingEfficiency);
+        state.SetCounter("pages", (double) pack.stats.pages);
+        state.SetCounter("binds_before", (double) pack.stats.bindsBefore);
+        state.SetCounter("binds_after", (double) pack.stats.bindsAfter);
+    }
+}
+
+// the whole of PackTextures, the pages' copies included, with RGBA8 pages
+static void BM_PackTexturesSkyline(Bench::State &state) {
+    PackSmallTextures(state, Gm::AtlasPacking::Skyline);
+}
+
+static void BM_PackTexturesMaxRects(Bench::State &state) {
+    PackSmallTextures(state, Gm::AtlasPacking::MaxRects);
+}
+
+BENCHMARK_CASE(BM_PackTexturesSkyline, 64, 512);
+BENCHMARK_CASE(BM_PackTexturesMaxRects, 64, 512);
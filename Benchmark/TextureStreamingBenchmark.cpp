@@ -0,0 +1,77 @@
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <thread>
+#include "Benchmark.h"
+#include "BenchmarkScene.h"
+#include "TextureStreamer.h"
+
+namespace {
+    const uint32_t TextureSize = 1024;
+
+    // a checkerboard tinted per texture and level, cheap enough that the loads don't dominate
+    Gm::MipLoader CheckerLoader(uint32_t seed) {
+        return [seed](uint32_t level, uint32_t width, uint32_t height, std::vector<uint8_t> &texels) {
+            texels.resize((size_t) width * height * 4);
+            uint8_t light[4] = {(uint8_t) (seed * 37), (uint8_t) (level * 29), 200, 255};
+            uint8_t dark[4] = {(uint8_t) (seed * 11), 40, (uint8_t) (level * 53), 255};
+            for (uint32_t y = 0; y < height; ++y) {
+                uint8_t *row = texels.data() + (size_t) y * width * 4;
+                for (uint32_t x = 0; x < width; ++x) {
+                    std::memcpy(row + x * 4, ((x ^ y) & 8) ? light : dark, 4);
+                }
+            }
+            return true;
+        };
+    }
+}
+
+// A camera flying along a row of `argument` 1024x1024 textures, each drawn with a size falling off with its
+// distance. The textures reference far more texels than the 64 MB budget holds, the frames measure Update.
+static void BM_TextureStreaming(Bench::State &state) {
+    Gm::HeadlessContext *context = Bench::SharedHeadlessContext();
+    if (context == nullptr) {
+        state.SkipWithError("no headless OpenGL context");
+        return;
+    }
+    size_t count = (size_t) state.Argument();
+    Gm::TextureStreamer streamer;
+    streamer.Initialize(64 << 20);
+    for (size_t i = 0; i < count; ++i) {
+        streamer.AddTexture(TextureSize, TextureSize, CheckerLoader((uint32_t) i));
+    }
+    // the mip tails, outside of the measurement
+    while (streamer.GetStats().loadsInFlight > 0) {
+        streamer.Update();
+        std::this_thread::yield();
+    }
+    uint64_t tailLevels = streamer.GetStats().loadedLevels;
+
+    float camera = 0.0f;
+    size_t frames = 0;
+    double requestedBytes = 0.0, residentBytes = 0.0;
+    while (state.KeepRunning()) {
+        // the nearest textures cover most of the screen, those 64 further on no more than their tail
+        for (size_t i = 0; i < count; ++i) {
+            float distance = std::fabs((float) i - camera);
+            if (distance < 64.0f) {
+                streamer.Request((Gm::TextureId) i, 2048.0f / (1.0f + distance));
+            }
+        }
+        streamer.Update();
+        camera = std::fmod(camera + 0.25f, (float) count);
+        ++frames;
+        requestedBytes += streamer.GetStats().requestedBytes;
+        residentBytes += streamer.GetStats().residentBytes;
+    }
+    const Gm::TextureStreamingStats &stats = streamer.GetStats();
+    state.SetItemsProcessed(state.Iterations() * count);
+    state.SetCounter("requested_mb", requestedBytes / frames / (1 << 20));
+    state.SetCounter("resident_mb", residentBytes / frames / (1 << 20));
+    state.SetCounter("loads_per_frame", (double) (stats.loadedLevels - tailLevels) / frames);
+    state.SetCounter("evictions_per_frame", (double) stats.evictedLevels / frames);
+    streamer.Finalize();
+    context->Finish();
+}
+
+BENCHMARK_CASE(BM_TextureStreaming, 256, 1024);
@@ -0,0 +1,1153 @@
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+#include <vector>
+#include "BlockCompression.h"
+#include "CpuFeatures.h"
+#include "TaskSystem.h"
+
+#if GM_SIMD_X86
+#include <emmintrin.h>
+#elif GM_SIMD_NEON
+#include <arm_neon.h>
+#endif
+
+namespace {
+    // blocks coded per task
+    const size_t TileBlocks = 64;
+
+    // passes of the High quality endpoint search
+    const int SearchPasses = 4;
+
+    // texels of a block, or of half an ETC block, as floats one array per channel; count is 8 or 16
+    struct Texels {
+        alignas(16) float c[4][16];
+        int count = 16;
+    };
+
+    // the colors a block's indices pick from
+    struct Palette {
+        float c[16][4];
+        int count = 0;
+    };
+
+    inline int Clamp(int value, int low, int high) {
+        return value < low ? low : value > high ? high : value;
+    }
+
+    inline int Round(float value) {
+        return (int) std::floor(value + 0.5f);
+    }
+
+    float BestIndicesScalar(const Texels &texels, const Palette &palette, uint8_t *indices) {
+        float total = 0.0f;
+        for (int i = 0; i < texels.count; ++i) {
+            float best = FLT_MAX;
+            int bestIndex = 0;
+            for (int entry = 0; entry < palette.count; ++entry) {
+                float error = 0.0f;
+                for (int channel = 0; channel < 4; ++channel) {
+                    float d = texels.c[channel][i] - palette.c[entry][channel];
+                    error += d * d;
+                }
+                if (error < best) {
+                    best = error;
+                    bestIndex = entry;
+                }
+            }
+            indices[i] = (uint8_t) bestIndex;
+            total += best;
+        }
+        return total;
+    }
+
+#if GM_SIMD_X86
+    // four texels against one palette entry at a time
+    float BestIndicesSimd(const Texels &texels, const Palette &palette, uint8_t *indices) {
+        __m128 total = _mm_setzero_ps();
+        for (int i = 0; i < texels.count; i += 4) {
+            __m128 r = _mm_load_ps(texels.c[0] + i), g = _mm_load_ps(texels.c[1] + i);
+            __m128 b = _mm_load_ps(texels.c[2] + i), a = _mm_load_ps(texels.c[3] + i);
+            __m128 best = _mm_set1_ps(FLT_MAX);
+            __m128i bestIndex = _mm_setzero_si128();
+            for (int entry = 0; entry < palette.count; ++entry) {
+                const float *color = palette.c[entry];
+                __m128 dr = _mm_sub_ps(r, _mm_set1_ps(color[0])), dg = _mm_sub_ps(g, _mm_set1_ps(color[1]));
+                __m128 db = _mm_sub_ps(b, _mm_set1_ps(color[2])), da = _mm_sub_ps(a, _mm_set1_ps(color[3]));
+                __m128 error = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dr, dr), _mm_mul_ps(dg, dg)),
+                                          _mm_add_ps(_mm_mul_ps(db, db), _mm_mul_ps(da, da)));
+                __m128i less = _mm_castps_si128(_mm_cmplt_ps(error, best));
+                best = _mm_min_ps(error, best);
+                bestIndex = _mm_or_si128(_mm_and_si128(less, _mm_set1_epi32(entry)),
+                                         _mm_andnot_si128(less, bestIndex));
+            }
+            total = _mm_add_ps(total, best);
+            alignas(16) int32_t lanes[4];
+            _mm_store_si128((__m128i *) lanes, bestIndex);
+            for (int lane = 0; lane < 4; ++lane) {
+                indices[i + lane] = (uint8_t) lanes[lane];
+            }
+        }
+        alignas(16) float sums[4];
+        _mm_store_ps(sums, total);
+        return sums[0] + sums[1] + sums[2] + sums[3];
+    }
+#elif GM_SIMD_NEON
+    float BestIndicesSimd(const Texels &texels, const Palette &palette, uint8_t *indices) {
+        float32x4_t total = vdupq_n_f32(0.0f);
+        for (int i = 0; i < texels.count; i += 4) {
+            float32x4_t r = vld1q_f32(texels.c[0] + i), g = vld1q_f32(texels.c[1] + i);
+            float32x4_t b = vld1q_f32(texels.c[2] + i), a = vld1q_f32(texels.c[3] + i);
+            float32x4_t best = vdupq_n_f32(FLT_MAX);
+            uint32x4_t bestIndex = vdupq_n_u32(0);
+            for (int entry = 0; entry < palette.count; ++entry) {
+                const float *color = palette.c[entry];
+                float32x4_t dr = vsubq_f32(r, vdupq_n_f32(color[0])), dg = vsubq_f32(g, vdupq_n_f32(color[1]));
+                float32x4_t db = vsubq_f32(b, vdupq_n_f32(color[2])), da = vsubq_f32(a, vdupq_n_f32(color[3]));
+                float32x4_t error = vmlaq_f32(vmlaq_f32(vmlaq_f32(vmulq_f32(dr, dr), dg, dg), db, db), da, da);
+                uint32x4_t less = vcltq_f32(error, best);
+                best = vminq_f32(error, best);
+                bestIndex = vbslq_u32(less, vdupq_n_u32((uint32_t) entry), bestIndex);
+            }
+            total = vaddq_f32(total, best);
+            uint32_t lanes[4];
+            vst1q_u32(lanes, bestIndex);
+            for (int lane = 0; lane < 4; ++lane) {
+                indices[i + lane] = (uint8_t) lanes[lane];
+            }
+        }
+        float sums[4];
+        vst1q_f32(sums, total);
+        return sums[0] + sums[1] + sums[2] + sums[3];
+    }
+#else
+    float BestIndicesSimd(const Texels &texels, const Palette &palette, uint8_t *indices) {
+        return BestIndicesScalar(texels, palette, indices);
+    }
+#endif
+
+    // the nearest palette entry of every texel, returns the summed squared error
+    inline float BestIndices(const Texels &texels, const Palette &palette, uint8_t *indices, bool simd) {
+        return simd ? BestIndicesSimd(texels, palette, indices) : BestIndicesScalar(texels, palette, indices);
+    }
+
+    // Mean and the direction of largest variance of the first `channels` channels, by power iteration on
+    // the covariance matrix starting from the bounding box diagonal.
+    void PrincipalAxis(const Texels &texels, int channels, float mean[4], float axis[4]) {
+        float low[4], high[4];
+        for (int channel = 0; channel < 4; ++channel) {
+            mean[channel] = 0.0f;
+            low[channel] = FLT_MAX;
+            high[channel] = -FLT_MAX;
+            for (int i = 0; i < texels.count; ++i) {
+                float value = texels.c[channel][i];
+                mean[channel] += value;
+                low[channel] = std::min(low[channel], value);
+                high[channel] = std::max(high[channel], value);
+            }
+            mean[channel] /= texels.count;
+        }
+        float covariance[4][4] = {};
+        for (int i = 0; i < texels.count; ++i) {
+            for (int row = 0; row < channels; ++row) {
+                for (int column = row; column < channels; ++column) {
+                    covariance[row][column] += (texels.c[row][i] - mean[row]) * (texels.c[column][i] - mean[column]);
+                }
+            }
+        }
+        for (int row = 0; row < channels; ++row) {
+            for (int column = 0; column < row; ++column) {
+                covariance[row][column] = covariance[column][row];
+            }
+        }
+        float v[4] = {};
+        for (int channel = 0; channel < channels; ++channel) {
+            v[channel] = high[channel] - low[channel];
+        }
+        for (int iteration = 0; iteration < 8; ++iteration) {
+            float next[4] = {}, largest = 0.0f;
+            for (int row = 0; row < channels; ++row) {
+                for (int column = 0; column < channels; ++column) {
+                    next[row] += covariance[row][column] * v[column];
+                }
+                largest = std::max(largest, std::fabs(next[row]));
+            }
+            if (largest < 1e-6f) {
+                break;
+            }
+            for (int channel = 0; channel < 4; ++channel) {
+                v[channel] = next[channel] / largest;
+            }
+        }
+        float length = 0.0f;
+        for (int channel = 0; channel < 4; ++channel) {
+            length += v[channel] * v[channel];
+        }
+        length = std::sqrt(length);
+        for (int channel = 0; channel < 4; ++channel) {
+            axis[channel] = length > 0.0f ? v[channel] / length : (channel < channels ? 1.0f : 0.0f);
+        }
+    }
+
+    // endpoints at the extremes of the texels along the principal axis, pulled in by `inset` of their range
+    void AxisEndpoints(const Texels &texels, int channels, float inset, float low[4], float high[4]) {
+        float mean[4], axis[4];
+        PrincipalAxis(texels, channels, mean, axis);
+        float minimum = FLT_MAX, maximum = -FLT_MAX;
+        for (int i = 0; i < texels.count; ++i) {
+            float t = 0.0f;
+            for (int channel = 0; channel < channels; ++channel) {
+                t += (texels.c[channel][i] - mean[channel]) * axis[channel];
+            }
+            minimum = std::min(minimum, t);
+            maximum = std::max(maximum, t);
+        }
+        float shrink = (maximum - minimum) * inset;
+        minimum += shrink;
+        maximum -= shrink;
+        for (int channel = 0; channel < 4; ++channel) {
+            low[channel] = mean[channel] + axis[channel] * minimum;
+            high[channel] = mean[channel] + axis[channel] * maximum;
+        }
+    }
+
+    // Endpoints a and b that best reproduce the texels when texel i is a + weights[indices[i]] * (b - a),
+    // false when the indices all weigh the same.
+    bool LeastSquaresEndpoints(const Texels &texels, const uint8_t *indices, const float *weights, float a[4],
+                               float b[4]) {
+        float aa = 0.0f, ab = 0.0f, bb = 0.0f, ax[4] = {}, bx[4] = {};
+        for (int i = 0; i < texels.count; ++i) {
+            float t = weights[indices[i]], s = 1.0f - t;
+            aa += s * s;
+            ab += s * t;
+            bb += t * t;
+            for (int channel = 0; channel < 4; ++channel) {
+                ax[channel] += s * texels.c[channel][i];
+                bx[channel] += t * texels.c[channel][i];
+            }
+        }
+        float determinant = aa * bb - ab * ab;
+        if (std::fabs(determinant) < 1e-6f) {
+            return false;
+        }
+        float inverse = 1.0f / determinant;
+        for (int channel = 0; channel < 4; ++channel) {
+            a[channel] = (bb * ax[channel] - ab * bx[channel]) * inverse;
+            b[channel] = (aa * bx[channel] - ab * ax[channel]) * inverse;
+        }
+        return true;
+    }
+
+    // BC1 --------------------------------------------------------------------------------------------------
+
+    const float Bc1Weights[4] = {0.0f, 1.0f, 1.0f / 3.0f, 2.0f / 3.0f};
+    // bit offset and maximum of the 565 fields, red first
+    const int Bc1Shift[3] = {11, 5, 0};
+    const int Bc1Max[3] = {31, 63, 31};
+
+    uint16_t To565(const float color[3]) {
+        uint16_t packed = 0;
+        for (int channel = 0; channel < 3; ++channel) {
+            int value = Clamp(Round(color[channel] * Bc1Max[channel] / 255.0f), 0, Bc1Max[channel]);
+            packed |= (uint16_t) (value << Bc1Shift[channel]);
+        }
+        return packed;
+    }
+
+    void From565(uint16_t packed, float color[4]) {
+        int r = packed >> 11, g = (packed >> 5) & 63, b = packed & 31;
+        color[0] = (float) (r << 3 | r >> 2);
+        color[1] = (float) (g << 2 | g >> 4);
+        color[2] = (float) (b << 3 | b >> 2);
+        color[3] = 0.0f;
+    }
+
+    // keeps color0 > color1, the four color mode; equal endpoints leave one color
+    float EvaluateBc1(const Texels &texels, uint16_t &color0, uint16_t &color1, uint8_t *indices, bool simd) {
+        if (color0 < color1) {
+            std::swap(color0, color1);
+        }
+        Palette palette;
+        From565(color0, palette.c[0]);
+        From565(color1, palette.c[1]);
+        palette.count = color0 == color1 ? 1 : 4;
+        for (int channel = 0; channel < 4; ++channel) {
+            palette.c[2][channel] = (2.0f * palette.c[0][channel] + palette.c[1][channel]) / 3.0f;
+            palette.c[3][channel] = (palette.c[0][channel] + 2.0f * palette.c[1][channel]) / 3.0f;
+        }
+        return BestIndices(texels, palette, indices, simd);
+    }
+
+    bool Step565(uint16_t &packed, int channel, int step) {
+        int value = (packed >> Bc1Shift[channel]) & Bc1Max[channel];
+        if (value + step < 0 || value + step > Bc1Max[channel]) {
+            return false;
+        }
+        packed = (uint16_t) ((packed & ~(Bc1Max[channel] << Bc1Shift[channel])) |
+                             (value + step) << Bc1Shift[channel]);
+        return true;
+    }
+
+    // the RGB of `texels`, alpha zeroed
+    float EncodeBc1(const Texels &texels, Gm::CompressionQuality quality, bool simd, uint8_t *out) {
+        float low[4], high[4];
+        AxisEndpoints(texels, 3, 1.0f / 16.0f, low, high);
+        uint16_t color0 = To565(high), color1 = To565(low);
+        uint8_t indices[16];
+        float error = EvaluateBc1(texels, color0, color1, indices, simd);
+
+        if (quality != Gm::CompressionQuality::Fast) {
+            for (int iteration = 0; iteration < 2 && color0 != color1; ++iteration) {
+                float a[4], b[4];
+                if (!LeastSquaresEndpoints(texels, indices, Bc1Weights, a, b)) {
+                    break;
+                }
+                uint16_t refit0 = To565(a), refit1 = To565(b);
+                uint8_t refitIndices[16];
+                float refitError = EvaluateBc1(texels, refit0, refit1, refitIndices, simd);
+                if (refitError >= error) {
+                    break;
+                }
+                error = refitError;
+                color0 = refit0;
+                color1 = refit1;
+                std::memcpy(indices, refitIndices, 16);
+            }
+        }
+        if (quality == Gm::CompressionQuality::High) {
+            bool improved = true;
+            for (int pass = 0; pass < SearchPasses && improved; ++pass) {
+                improved = false;
+                for (int endpoint = 0; endpoint < 2; ++endpoint) {
+                    for (int channel = 0; channel < 3; ++channel) {
+                        for (int step = -1; step <= 1; step += 2) {
+                            uint16_t candidate[2] = {color0, color1};
+                            if (!Step565(candidate[endpoint], channel, step)) {
+                                continue;
+                            }
+                            uint8_t candidateIndices[16];
+                            float candidateError = EvaluateBc1(texels, candidate[0], candidate[1], candidateIndices,
+                                                               simd);
+                            if (candidateError < error) {
+                                error = candidateError;
+                                color0 = candidate[0];
+                                color1 = candidate[1];
+                                std::memcpy(indices, candidateIndices, 16);
+                                improved = true;
+                            }
+                        }
+                    }
+                }
+            }
+        }
+
+        uint64_t bits = (uint64_t) color0 | (uint64_t) color1 << 16;
+        for (int i = 0; i < 16; ++i) {
+            bits |= (uint64_t) indices[i] << (32 + i * 2);
+        }
+        std::memcpy(out, &bits, 8);
+        return error;
+    }
+
+    // BC4 --------------------------------------------------------------------------------------------------
+
+    const float Bc4Weights[8] = {0.0f, 1.0f, 1.0f / 7.0f, 2.0f / 7.0f, 3.0f / 7.0f, 4.0f / 7.0f, 5.0f / 7.0f,
+                                 6.0f / 7.0f};
+
+    // eight interpolated values when value0 > value1, else six plus 0 and 255
+    float EvaluateBc4(const Texels &texels, int value0, int value1, uint8_t *indices, bool simd) {
+        Palette palette;
+        std::memset(palette.c, 0, sizeof(palette.c));
+        palette.count = 8;
+        palette.c[0][0] = (float) value0;
+        palette.c[1][0] = (float) value1;
+        if (value0 > value1) {
+            for (int i = 2; i < 8; ++i) {
+                palette.c[i][0] = ((8 - i) * value0 + (i - 1) * value1) / 7.0f;
+            }
+        } else {
+            for (int i = 2; i < 6; ++i) {
+                palette.c[i][0] = ((6 - i) * value0 + (i - 1) * value1) / 5.0f;
+            }
+            palette.c[6][0] = 0.0f;
+            palette.c[7][0] = 255.0f;
+        }
+        return BestIndices(texels, palette, indices, simd);
+    }
+
+    // a single channel, in channel 0 of `texels` with the others zeroed
+    float EncodeBc4(const Texels &texels, Gm::CompressionQuality quality, bool simd, uint8_t *out) {
+        float minimum = 255.0f, maximum = 0.0f;
+        // the six value mode has 0 and 255 for free, its endpoints span the rest
+        float innerMinimum = 255.0f, innerMaximum = 0.0f;
+        for (int i = 0; i < 16; ++i) {
+            float value = texels.c[0][i];
+            minimum = std::min(minimum, value);
+            maximum = std::max(maximum, value);
+            if (value > 0.0f && value < 255.0f) {
+                innerMinimum = std::min(innerMinimum, value);
+                innerMaximum = std::max(innerMaximum, value);
+            }
+        }
+        int value0 = Round(maximum), value1 = Round(minimum);
+        uint8_t indices[16];
+        float error = EvaluateBc4(texels, value0, value1, indices, simd);
+        auto consider = [&](int candidate0, int candidate1) {
+            candidate0 = Clamp(candidate0, 0, 255);
+            candidate1 = Clamp(candidate1, 0, 255);
+            uint8_t candidateIndices[16];
+            float candidateError = EvaluateBc4(texels, candidate0, candidate1, candidateIndices, simd);
+            if (candidateError < error) {
+                error = candidateError;
+                value0 = candidate0;
+                value1 = candidate1;
+                std::memcpy(indices, candidateIndices, 16);
+            }
+        };
+
+        if (quality != Gm::CompressionQuality::Fast && error > 0.0f) {
+            if (innerMinimum <= innerMaximum) {
+                consider(Round(innerMinimum), Round(innerMaximum));
+            }
+            if (value0 > value1) {
+                float a[4], b[4];
+                if (LeastSquaresEndpoints(texels, indices, Bc4Weights, a, b)) {
+                    int refit0 = Round(a[0]), refit1 = Round(b[0]);
+                    if (refit0 > refit1) {
+                        consider(refit0, refit1);
+                    }
+                }
+            }
+        }
+        if (quality == Gm::CompressionQuality::High && error > 0.0f && value0 > value1) {
+            int center0 = value0, center1 = value1;
+            for (int d0 = -2; d0 <= 2; ++d0) {
+                for (int d1 = -2; d1 <= 2; ++d1) {
+                    if (center0 + d0 > center1 + d1) {
+                        consider(center0 + d0, center1 + d1);
+                    }
+                }
+            }
+        }
+
+        uint64_t bits = (uint64_t) value0 | (uint64_t) value1 << 8;
+        for (int i = 0; i < 16; ++i) {
+            bits |= (uint64_t) indices[i] << (16 + i * 3);
+        }
+        std::memcpy(out, &bits, 8);
+        return error;
+    }
+
+    // BC7 --------------------------------------------------------------------------------------------------
+
+    const int Bc7Weights4[16] = {0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64};
+
+    // mode 6 endpoints: 7 bits per channel plus a parity bit shared by the endpoint's channels
+    struct Bc7Endpoints {
+        int q[2][4];
+        int p[2];
+    };
+
+    void QuantizeBc7(const float color[4], int endpoint, Bc7Endpoints &endpoints) {
+        float bestError = FLT_MAX;
+        for (int parity = 0; parity < 2; ++parity) {
+            int q[4];
+            float error = 0.0f;
+            for (int channel = 0; channel < 4; ++channel) {
+                q[channel] = Clamp(Round((color[channel] - parity) * 0.5f), 0, 127);
+                float d = (float) (q[channel] * 2 + parity) - color[channel];
+                error += d * d;
+            }
+            if (error < bestError) {
+                bestError = error;
+                std::memcpy(endpoints.q[endpoint], q, sizeof(q));
+                endpoints.p[endpoint] = parity;
+            }
+        }
+    }
+
+    float EvaluateBc7(const Texels &texels, const Bc7Endpoints &endpoints, uint8_t *indices, bool simd) {
+        Palette palette;
+        palette.count = 16;
+        for (int channel = 0; channel < 4; ++channel) {
+            int e0 = endpoints.q[0][channel] * 2 + endpoints.p[0], e1 = endpoints.q[1][channel] * 2 + endpoints.p[1];
+            for (int i = 0; i < 16; ++i) {
+                int w = Bc7Weights4[i];
+                palette.c[i][channel] = (float) (((64 - w) * e0 + w * e1 + 32) >> 6);
+            }
+        }
+        return BestIndices(texels, palette, indices, simd);
+    }
+
+    // least significant bit first
+    struct BitWriter {
+        uint64_t words[2] = {};
+        int position = 0;
+
+        void Write(uint32_t value, int count) {
+            for (int bit = 0; bit < count; ++bit, ++position) {
+                words[position >> 6] |= (uint64_t) ((value >> bit) & 1) << (position & 63);
+            }
+        }
+    };
+
+    // Mode 6 only: one subset, RGBA endpoints and 4 bit indices. It is the mode fast BC7 encoders rely on;
+    // blocks of two or three distinct color clusters would do better with the partitioned modes.
+    float EncodeBc7(const Texels &texels, Gm::CompressionQuality quality, bool simd, uint8_t *out) {
+        float low[4], high[4];
+        AxisEndpoints(texels, 4, 0.0f, low, high);
+        Bc7Endpoints endpoints;
+        QuantizeBc7(low, 0, endpoints);
+        QuantizeBc7(high, 1, endpoints);
+        uint8_t indices[16];
+        float error = EvaluateBc7(texels, endpoints, indices, simd);
+        auto consider = [&](const Bc7Endpoints &candidate) {
+            uint8_t candidateIndices[16];
+            float candidateError = EvaluateBc7(texels, candidate, candidateIndices, simd);
+            if (candidateError < error) {
+                error = candidateError;
+                endpoints = candidate;
+                std::memcpy(indices, candidateIndices, 16);
+                return true;
+            }
+            return false;
+        };
+
+        if (quality != Gm::CompressionQuality::Fast) {
+            float weights[16];
+            for (int i = 0; i < 16; ++i) {
+                weights[i] = Bc7Weights4[i] / 64.0f;
+            }
+            for (int iteration = 0; iteration < 2 && error > 0.0f; ++iteration) {
+                float a[4], b[4];
+                if (!LeastSquaresEndpoints(texels, indices, weights, a, b)) {
+                    break;
+                }
+                Bc7Endpoints refit;
+                QuantizeBc7(a, 0, refit);
+                QuantizeBc7(b, 1, refit);
+                if (!consider(refit)) {
+                    break;
+                }
+            }
+        }
+        if (quality == Gm::CompressionQuality::High) {
+            bool improved = true;
+            for (int pass = 0; pass < SearchPasses && improved && error > 0.0f; ++pass) {
+                improved = false;
+                for (int endpoint = 0; endpoint < 2; ++endpoint) {
+                    Bc7Endpoints candidate = endpoints;
+                    candidate.p[endpoint] ^= 1;
+                    improved |= consider(candidate);
+                    for (int channel = 0; channel < 4; ++channel) {
+                        for (int step = -1; step <= 1; step += 2) {
+                            candidate = endpoints;
+                            int &value = candidate.q[endpoint][channel];
+                            if (value + step >= 0 && value + step <= 127) {
+                                value += step;
+                                improved |= consider(candidate);
+                            }
+                        }
+                    }
+                }
+            }
+        }
+
+        // the first index is stored without its top bit, which has to be 0
+        if (indices[0] & 8) {
+            std::swap(endpoints.q[0], endpoints.q[1]);
+            std::swap(endpoints.p[0], endpoints.p[1]);
+            for (uint8_t &index : indices) {
+                index = (uint8_t) (15 - index);
+            }
+        }
+        BitWriter writer;
+        writer.Write(1 << 6, 7);
+        for (int channel = 0; channel < 4; ++channel) {
+            writer.Write((uint32_t) endpoints.q[0][channel], 7);
+            writer.Write((uint32_t) endpoints.q[1][channel], 7);
+        }
+        writer.Write((uint32_t) endpoints.p[0], 1);
+        writer.Write((uint32_t) endpoints.p[1], 1);
+        writer.Write(indices[0], 3);
+        for (int i = 1; i < 16; ++i) {
+            writer.Write(indices[i], 4);
+        }
+        std::memcpy(out, writer.words, 16);
+        return error;
+    }
+
+    // ETC2 -------------------------------------------------------------------------------------------------
+
+    // small and large modifier of each table; index codes 0 to 3 pick +small, +large, -small, -large
+    const int EtcModifiers[8][2] = {{2, 8}, {5, 17}, {9, 29}, {13, 42}, {18, 60}, {24, 80}, {33, 106}, {47, 183}};
+
+    // texels (y * 4 + x) of the two halves of a block, side by side (flip 0) or stacked (flip 1)
+    const uint8_t EtcHalves[2][2][8] = {
+            {{0, 1, 4, 5, 8, 9, 12, 13}, {2, 3, 6, 7, 10, 11, 14, 15}},
+            {{0, 1, 2, 3, 4, 5, 6, 7}, {8, 9, 10, 11, 12, 13, 14, 15}},
+    };
+
+    struct EtcHalf {
+        // quantized base color, 4 or 5 bits
+        int q[3];
+        int table;
+        uint8_t indices[8];
+        float error;
+    };
+
+    inline int ExpandEtc(int q, bool differential) {
+        return differential ? (q << 3 | q >> 2) : (q << 4 | q);
+    }
+
+    float FitEtcHalf(const Texels &half, EtcHalf &fit, bool differential, bool simd) {
+        int base[3];
+        for (int channel = 0; channel < 3; ++channel) {
+            base[channel] = ExpandEtc(fit.q[channel], differential);
+        }
+        fit.error = FLT_MAX;
+        for (int table = 0; table < 8; ++table) {
+            Palette palette;
+            palette.count = 4;
+            int modifiers[4] = {EtcModifiers[table][0], EtcModifiers[table][1], -EtcModifiers[table][0],
+                                -EtcModifiers[table][1]};
+            for (int code = 0; code < 4; ++code) {
+                for (int channel = 0; channel < 3; ++channel) {
+                    palette.c[code][channel] = (float) Clamp(base[channel] + modifiers[code], 0, 255);
+                }
+                palette.c[code][3] = 0.0f;
+            }
+            uint8_t indices[8];
+            float error = BestIndices(half, palette, indices, simd);
+            if (error < fit.error) {
+                fit.error = error;
+                fit.table = table;
+                std::memcpy(fit.indices, indices, 8);
+            }
+        }
+        return fit.error;
+    }
+
+    // the base color that, with the chosen modifiers, reproduces the half best
+    void RefitEtcBase(const Texels &half, const EtcHalf &fit, float color[3]) {
+        int modifiers[4] = {EtcModifiers[fit.table][0], EtcModifiers[fit.table][1], -EtcModifiers[fit.table][0],
+                            -EtcModifiers[fit.table][1]};
+        for (int channel = 0; channel < 3; ++channel) {
+            float sum = 0.0f;
+            for (int i = 0; i < 8; ++i) {
+                sum += half.c[channel][i] - modifiers[fit.indices[i]];
+            }
+            color[channel] = sum / 8.0f;
+        }
+    }
+
+    void QuantizeEtc(const float color[3], bool differential, int q[3]) {
+        int maximum = differential ? 31 : 15;
+        for (int channel = 0; channel < 3; ++channel) {
+            q[channel] = Clamp(Round(color[channel] * maximum / 255.0f), 0, maximum);
+        }
+    }
+
+    // the second base of differential mode is stored as a 3 bit offset from the first
+    bool ValidDifferential(const int q0[3], const int q1[3]) {
+        for (int channel = 0; channel < 3; ++channel) {
+            int d = q1[channel] - q0[channel];
+            if (d < -4 || d > 3) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    struct EtcBlock {
+        bool differential;
+        bool flip;
+        EtcHalf halves[2];
+
+        float Error() const { return halves[0].error + halves[1].error; }
+    };
+
+    void MakeHalves(const Texels &texels, bool flip, Texels halves[2]) {
+        for (int h = 0; h < 2; ++h) {
+            halves[h].count = 8;
+            for (int i = 0; i < 8; ++i) {
+                for (int channel = 0; channel < 4; ++channel) {
+                    halves[h].c[channel][i] = texels.c[channel][EtcHalves[flip][h][i]];
+                }
+            }
+        }
+    }
+
+    // the individual or differential block for one orientation, searched according to `quality`
+    EtcBlock FitEtcBlock(const Texels halves[2], bool flip, bool differential, Gm::CompressionQuality quality,
+                         bool simd) {
+        EtcBlock block;
+        block.flip = flip;
+        block.differential = differential;
+        float means[2][3];
+        for (int h = 0; h < 2; ++h) {
+            for (int channel = 0; channel < 3; ++channel) {
+                float sum = 0.0f;
+                for (int i = 0; i < 8; ++i) {
+                    sum += halves[h].c[channel][i];
+                }
+                means[h][channel] = sum / 8.0f;
+            }
+            QuantizeEtc(means[h], differential, block.halves[h].q);
+        }
+        if (differential) {
+            for (int channel = 0; channel < 3; ++channel) {
+                block.halves[1].q[channel] = Clamp(block.halves[1].q[channel], block.halves[0].q[channel] - 4,
+                                                   block.halves[0].q[channel] + 3);
+            }
+        }
+        for (int h = 0; h < 2; ++h) {
+            FitEtcHalf(halves[h], block.halves[h], differential, simd);
+        }
+        auto valid = [&](const EtcBlock &candidate) {
+            return !differential || ValidDifferential(candidate.halves[0].q, candidate.halves[1].q);
+        };
+        auto consider = [&](EtcBlock &candidate, int h) {
+            if (!valid(candidate)) {
+                return false;
+            }
+            FitEtcHalf(halves[h], candidate.halves[h], differential, simd);
+            if (candidate.halves[h].error < block.halves[h].error) {
+                block.halves[h] = candidate.halves[h];
+                return true;
+            }
+            return false;
+        };
+
+        if (quality != Gm::CompressionQuality::Fast) {
+            for (int h = 0; h < 2; ++h) {
+                float color[3];
+                RefitEtcBase(halves[h], block.halves[h], color);
+                EtcBlock candidate = block;
+                QuantizeEtc(color, differential, candidate.halves[h].q);
+                consider(candidate, h);
+            }
+        }
+        if (quality == Gm::CompressionQuality::High) {
+            int maximum = differential ? 31 : 15;
+            bool improved = true;
+            for (int pass = 0; pass < SearchPasses && improved; ++pass) {
+                improved = false;
+                for (int h = 0; h < 2; ++h) {
+                    for (int channel = 0; channel < 3; ++channel) {
+                        for (int step = -1; step <= 1; step += 2) {
+                            EtcBlock candidate = block;
+                            int &value = candidate.halves[h].q[channel];
+                            if (value + step >= 0 && value + step <= maximum) {
+                                value += step;
+                                improved |= consider(candidate, h);
+                            }
+                        }
+                    }
+                }
+            }
+        }
+        return block;
+    }
+
+    uint64_t PackEtcBlock(const EtcBlock &block) {
+        const EtcHalf &first = block.halves[0], &second = block.halves[1];
+        uint64_t bits = 0;
+        for (int channel = 0; channel < 3; ++channel) {
+            uint64_t field;
+            if (block.differential) {
+                field = (uint64_t) (first.q[channel] << 3 | ((second.q[channel] - first.q[channel]) & 7));
+            } else {
+                field = (uint64_t) (first.q[channel] << 4 | second.q[channel]);
+            }
+            bits |= field << (56 - channel * 8);
+        }
+        bits |= (uint64_t) first.table << 37 | (uint64_t) second.table << 34;
+        bits |= (uint64_t) block.differential << 33 | (uint64_t) block.flip << 32;
+        for (int h = 0; h < 2; ++h) {
+            for (int i = 0; i < 8; ++i) {
+                int texel = EtcHalves[block.flip][h][i];
+                // index bits go column by column
+                int position = (texel & 3) * 4 + (texel >> 2);
+                int code = block.halves[h].indices[i];
+                bits |= (uint64_t) (code & 1) << position | (uint64_t) (code >> 1) << (16 + position);
+            }
+        }
+        return bits;
+    }
+
+    // ETC2 planar mode: a color at the top left corner (O), one step right of the top right (H) and one below
+    // the bottom left (V), blended bilinearly; what smooth gradients need.
+    struct EtcPlanar {
+        int o[3], h[3], v[3];
+    };
+
+    const int PlanarBits[3] = {6, 7, 6};
+
+    inline int ExpandPlanar(int value, int channel) {
+        return PlanarBits[channel] == 6 ? (value << 2 | value >> 4) : (value << 1 | value >> 6);
+    }
+
+    float EvaluatePlanar(const Texels &texels, const EtcPlanar &planar) {
+        float error = 0.0f;
+        for (int channel = 0; channel < 3; ++channel) {
+            int o = ExpandPlanar(planar.o[channel], channel), h = ExpandPlanar(planar.h[channel], channel);
+            int v = ExpandPlanar(planar.v[channel], channel);
+            for (int i = 0; i < 16; ++i) {
+                int x = i & 3, y = i >> 2;
+                float d = (float) Clamp((x * (h - o) + y * (v - o) + 4 * o + 2) >> 2, 0, 255) - texels.c[channel][i];
+                error += d * d;
+            }
+        }
+        return error;
+    }
+
+    // least squares plane through the texels, its corners quantized
+    EtcPlanar FitPlanar(const Texels &texels) {
+        EtcPlanar planar;
+        for (int channel = 0; channel < 3; ++channel) {
+            float mean = 0.0f, slopeX = 0.0f, slopeY = 0.0f;
+            for (int i = 0; i < 16; ++i) {
+                float value = texels.c[channel][i];
+                mean += value;
+                slopeX += ((i & 3) - 1.5f) * value;
+                slopeY += ((i >> 2) - 1.5f) * value;
+            }
+            // each offset from the center appears four times: 4 * (2.25 + 0.25 + 0.25 + 2.25)
+            mean /= 16.0f;
+            slopeX /= 20.0f;
+            slopeY /= 20.0f;
+            float o = mean - 1.5f * (slopeX + slopeY);
+            int maximum = (1 << PlanarBits[channel]) - 1;
+            planar.o[channel] = Clamp(Round(o * maximum / 255.0f), 0, maximum);
+            planar.h[channel] = Clamp(Round((o + 4.0f * slopeX) * maximum / 255.0f), 0, maximum);
+            planar.v[channel] = Clamp(Round((o + 4.0f * slopeY) * maximum / 255.0f), 0, maximum);
+        }
+        return planar;
+    }
+
+    // Planar blocks look like differential ones whose blue overflows; the spare bits are set so red and
+    // green don't overflow and blue does.
+    uint64_t PackPlanar(const EtcPlanar &planar) {
+        uint64_t bits = 0;
+        auto put = [&bits](uint64_t value, int high, int count) {
+            bits |= (value & ((1u << count) - 1)) << (high - count + 1);
+        };
+        put((uint64_t) planar.o[0], 62, 6);
+        put((uint64_t) planar.o[1] >> 6, 56, 1);
+        put((uint64_t) planar.o[1], 54, 6);
+        put((uint64_t) planar.o[2] >> 5, 48, 1);
+        put((uint64_t) planar.o[2] >> 3, 44, 2);
+        put((uint64_t) planar.o[2], 41, 3);
+        put((uint64_t) planar.h[0] >> 1, 38, 5);
+        put((uint64_t) planar.h[0], 32, 1);
+        put((uint64_t) planar.h[1], 31, 7);
+        put((uint64_t) planar.h[2], 24, 6);
+        put((uint64_t) planar.v[0], 18, 6);
+        put((uint64_t) planar.v[1], 12, 7);
+        put((uint64_t) planar.v[2], 5, 6);
+        bits |= uint64_t(1) << 33;
+
+        auto field = [&bits](int high, int count) {
+            return (int) ((bits >> (high - count + 1)) & ((1u << count) - 1));
+        };
+        auto signed3 = [](int value) { return value >= 4 ? value - 8 : value; };
+        // red: bit 63 over R = bits 63..59, dR = bits 58..56
+        int red = field(62, 4) + signed3(field(58, 3));
+        if (red < 0) {
+            bits |= uint64_t(1) << 63;
+        }
+        // green: bit 55 over G = bits 55..51, dG = bits 50..48
+        int green = field(54, 4) + signed3(field(50, 3));
+        if (green < 0) {
+            bits |= uint64_t(1) << 55;
+        }
+        // blue: B = bits 47..43 and dB = bits 42..40 with bits 47..45 and 42 spare; B in 28..31 with a
+        // positive offset overflows above, B in 0..3 with a negative one below
+        if (field(44, 2) + field(41, 2) >= 4) {
+            bits |= uint64_t(7) << 45;
+        } else {
+            bits |= uint64_t(1) << 42;
+        }
+        return bits;
+    }
+
+    // RGB of `texels`, alpha zeroed: the ETC1 compatible modes and planar, written big endian
+    float EncodeEtc2(const Texels &texels, Gm::CompressionQuality quality, bool simd, uint8_t *out) {
+        float error = FLT_MAX;
+        uint64_t bits = 0;
+        for (int flip = 0; flip < 2; ++flip) {
+            Texels halves[2];
+            MakeHalves(texels, flip != 0, halves);
+            for (int differential = 0; differential < 2; ++differential) {
+                EtcBlock block = FitEtcBlock(halves, flip != 0, differential != 0, quality, simd);
+                if (block.Error() < error) {
+                    error = block.Error();
+                    bits = PackEtcBlock(block);
+                }
+            }
+        }
+        if (quality != Gm::CompressionQuality::Fast && error > 0.0f) {
+            EtcPlanar planar = FitPlanar(texels);
+            float planarError = EvaluatePlanar(texels, planar);
+            if (planarError < error) {
+                error = planarError;
+                bits = PackPlanar(planar);
+            }
+        }
+        for (int i = 0; i < 8; ++i) {
+            out[i] = (uint8_t) (bits >> (56 - i * 8));
+        }
+        return error;
+    }
+
+    const int EacModifiers[16][8] = {
+            {-3, -6, -9, -15, 2, 5, 8, 14}, {-3, -7, -10, -13, 2, 6, 9, 12}, {-2, -5, -8, -13, 1, 4, 7, 12},
+            {-2, -4, -6, -13, 1, 3, 5, 12}, {-3, -6, -8, -12, 2, 5, 7, 11}, {-3, -7, -9, -11, 2, 6, 8, 10},
+            {-4, -7, -8, -11, 3, 6, 7, 10}, {-3, -5, -8, -11, 2, 4, 7, 10}, {-2, -6, -8, -10, 1, 5, 7, 9},
+            {-2, -5, -8, -10, 1, 4, 7, 9}, {-2, -4, -8, -10, 1, 3, 7, 9}, {-2, -5, -7, -10, 1, 4, 6, 9},
+            {-3, -4, -7, -10, 2, 3, 6, 9}, {-1, -2, -3, -10, 0, 1, 2, 9}, {-4, -6, -8, -9, 3, 5, 7, 8},
+            {-3, -5, -7, -9, 2, 4, 6, 8},
+    };
+
+    float EvaluateEac(const Texels &texels, int base, int table, int multiplier, uint8_t *indices, bool simd) {
+        Palette palette;
+        std::memset(palette.c, 0, sizeof(palette.c));
+        palette.count = 8;
+        for (int i = 0; i < 8; ++i) {
+            palette.c[i][0] = (float) Clamp(base + EacModifiers[table][i] * multiplier, 0, 255);
+        }
+        return BestIndices(texels, palette, indices, simd);
+    }
+
+    // EAC alpha, channel 0 of `texels`: a base value plus a table of offsets scaled by a multiplier
+    float EncodeEac(const Texels &texels, Gm::CompressionQuality quality, bool simd, uint8_t *out) {
+        float minimum = 255.0f, maximum = 0.0f;
+        for (int i = 0; i < 16; ++i) {
+            minimum = std::min(minimum, texels.c[0][i]);
+            maximum = std::max(maximum, texels.c[0][i]);
+        }
+        int spread = quality == Gm::CompressionQuality::Fast ? 0 : quality == Gm::CompressionQuality::Normal ? 1 : 3;
+        float error = FLT_MAX;
+        int bestBase = 0, bestTable = 0, bestMultiplier = 1;
+        uint8_t indices[16];
+        for (int table = 0; table < 16 && error > 0.0f; ++table) {
+            int low = EacModifiers[table][3], high = EacModifiers[table][7];
+            int multiplier = Clamp(Round((maximum - minimum) / (high - low)), 1, 15);
+            int base = Round((maximum + minimum) * 0.5f - (low + high) * multiplier * 0.5f);
+            for (int m = std::max(1, multiplier - spread); m <= std::min(15, multiplier + spread); ++m) {
+                for (int b = base - spread; b <= base + spread; ++b) {
+                    int clamped = Clamp(b, 0, 255);
+                    uint8_t candidate[16];
+                    float candidateError = EvaluateEac(texels, clamped, table, m, candidate, simd);
+                    if (candidateError < error) {
+                        error = candidateError;
+                        bestBase = clamped;
+                        bestTable = table;
+                        bestMultiplier = m;
+                        std::memcpy(indices, candidate, 16);
+                    }
+                }
+            }
+        }
+        uint64_t bits = (uint64_t) bestBase << 56 | (uint64_t) bestMultiplier << 52 | (uint64_t) bestTable << 48;
+        for (int i = 0; i < 16; ++i) {
+            // column by column, the first texel in the highest bits
+            int position = (i & 3) * 4 + (i >> 2);
+            bits |= (uint64_t) indices[i] << (45 - position * 3);
+        }
+        for (int i = 0; i < 8; ++i) {
+            out[i] = (uint8_t) (bits >> (56 - i * 8));
+        }
+        return error;
+    }
+
+    // ------------------------------------------------------------------------------------------------------
+
+    // the 4x4 block at (blockX, blockY), edge texels repeated where it hangs over the level
+    void LoadBlock(const uint8_t *texels, uint32_t width, uint32_t height, size_t blockX, size_t blockY,
+                   Texels &block) {
+        for (int i = 0; i < 16; ++i) {
+            size_t x = std::min<size_t>(blockX * 4 + (i & 3), width - 1);
+            size_t y = std::min<size_t>(blockY * 4 + (i >> 2), height - 1);
+            const uint8_t *texel = texels + (y * width + x) * 4;
+            for (int channel = 0; channel < 4; ++channel) {
+                block.c[channel][i] = texel[channel];
+            }
+        }
+    }
+
+    // `channel` of `block` in channel 0 of `out`, the others zeroed
+    void ExtractChannel(const Texels &block, int channel, Texels &out) {
+        std::memset(out.c, 0, sizeof(out.c));
+        std::memcpy(out.c[0], block.c[channel], sizeof(out.c[0]));
+    }
+
+    float EncodeBlock(Texels &block, Gm::TextureFormat format, const Gm::CompressionOptions &options,
+                      uint8_t *out) {
+        Gm::CompressionQuality quality = options.quality;
+        bool simd = options.simd;
+        Texels channel;
+        float error = 0.0f;
+        switch (format) {
+            case Gm::TextureFormat::Bc1:
+                std::memset(block.c[3], 0, sizeof(block.c[3]));
+                return EncodeBc1(block, quality, simd, out);
+            case Gm::TextureFormat::Bc3:
+                ExtractChannel(block, 3, channel);
+                error = EncodeBc4(channel, quality, simd, out);
+                std::memset(block.c[3], 0, sizeof(block.c[3]));
+                return error + EncodeBc1(block, quality, simd, out + 8);
+            case Gm::TextureFormat::Bc5:
+                ExtractChannel(block, 0, channel);
+                error = EncodeBc4(channel, quality, simd, out);
+                ExtractChannel(block, 1, channel);
+                return error + EncodeBc4(channel, quality, simd, out + 8);
+            case Gm::TextureFormat::Bc7:
+                return EncodeBc7(block, quality, simd, out);
+            case Gm::TextureFormat::Etc2Rgb:
+                std::memset(block.c[3], 0, sizeof(block.c[3]));
+                return EncodeEtc2(block, quality, simd, out);
+            case Gm::TextureFormat::Etc2Rgba:
+                ExtractChannel(block, 3, channel);
+                error = EncodeEac(channel, quality, simd, out);
+                std::memset(block.c[3], 0, sizeof(block.c[3]));
+                return error + EncodeEtc2(block, quality, simd, out + 8);
+            default:
+                return 0.0f;
+        }
+    }
+}
+
+size_t Gm::BlockBytes(TextureFormat format) {
+    switch (format) {
+        case TextureFormat::Bc1:
+        case TextureFormat::Etc2Rgb:
+            return 8;
+        case TextureFormat::Bc3:
+        case TextureFormat::Bc5:
+        case TextureFormat::Bc7:
+        case TextureFormat::Etc2Rgba:
+            return 16;
+        default:
+            return 0;
+    }
+}
+
+size_t Gm::TextureLevelBytes(TextureFormat format, uint32_t width, uint32_t height) {
+    if (format == TextureFormat::Rgba8) {
+        return (size_t) width * height * 4;
+    }
+    return (size_t) ((width + 3) / 4) * ((height + 3) / 4) * BlockBytes(format);
+}
+
+GLenum Gm::TextureInternalFormat(TextureFormat format, bool srgb) {
+    switch (format) {
+        case TextureFormat::Bc1:
+            return srgb ? GL_COMPRESSED_SRGB_S3TC_DXT1_EXT : GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+        case TextureFormat::Bc3:
+            return srgb ? GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT : GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+        case TextureFormat::Bc5:
+            return GL_COMPRESSED_RG_RGTC2;
+        case TextureFormat::Bc7:
+            return srgb ? GL_COMPRESSED_SRGB_ALPHA_BPTC_UNORM : GL_COMPRESSED_RGBA_BPTC_UNORM;
+        case TextureFormat::Etc2Rgb:
+            return srgb ? GL_COMPRESSED_SRGB8_ETC2 : GL_COMPRESSED_RGB8_ETC2;
+        case TextureFormat::Etc2Rgba:
+            return srgb ? GL_COMPRESSED_SRGB8_ALPHA8_ETC2_EAC : GL_COMPRESSED_RGBA8_ETC2_EAC;
+        default:
+            return srgb ? GL_SRGB8_ALPHA8 : GL_RGBA8;
+    }
+}
+
+bool Gm::InternalFormatSupported(GLenum internalFormat) {
+    switch (internalFormat) {
+        case GL_COMPRESSED_RGB_S3TC_DXT1_EXT:
+        case GL_COMPRESSED_RGBA_S3TC_DXT1_EXT:
+        case GL_COMPRESSED_SRGB_S3TC_DXT1_EXT:
+        case GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT1_EXT:
+        case GL_COMPRESSED_RGBA_S3TC_DXT5_EXT:
+        case GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT:
+            return GLAD_GL_EXT_texture_compression_s3tc != 0;
+        case GL_COMPRESSED_RG_RGTC2:
+            return GLAD_GL_VERSION_3_0 || GLAD_GL_ARB_texture_compression_rgtc || GLAD_GL_EXT_texture_compression_rgtc;
+        case GL_COMPRESSED_RGBA_BPTC_UNORM:
+        case GL_COMPRESSED_SRGB_ALPHA_BPTC_UNORM:
+            return GLAD_GL_VERSION_4_2 || GLAD_GL_ARB_texture_compression_bptc;
+        case GL_COMPRESSED_RGB8_ETC2:
+        case GL_COMPRESSED_SRGB8_ETC2:
+        case GL_COMPRESSED_RGBA8_ETC2_EAC:
+        case GL_COMPRESSED_SRGB8_ALPHA8_ETC2_EAC:
+            return GLAD_GL_VERSION_4_3 || GLAD_GL_ARB_ES3_compatibility;
+        default:
+            return true;
+    }
+}
+
+Gm::TextureFormat Gm::SupportedTextureFormat(TextureFormat format, bool srgb) {
+    if (GLVersion.major == 0 || InternalFormatSupported(TextureInternalFormat(format, srgb))) {
+        return format;
+    }
+    // BC3 keeps every channel, a BC5 normal map's red and green included
+    if (InternalFormatSupported(TextureInternalFormat(TextureFormat::Bc3, srgb))) {
+        return TextureFormat::Bc3;
+    }
+    return TextureFormat::Rgba8;
+}
+
+size_t Gm::CompressedLevelBytes(GLenum internalFormat, uint32_t width, uint32_t height) {
+    size_t blocks = (size_t) ((width + 3) / 4) * ((height + 3) / 4);
+    switch (internalFormat) {
+        case GL_COMPRESSED_RGB_S3TC_DXT1_EXT:
+        case GL_COMPRESSED_RGBA_S3TC_DXT1_EXT:
+        case GL_COMPRESSED_SRGB_S3TC_DXT1_EXT:
+        case GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT1_EXT:
+        case GL_COMPRESSED_RGB8_ETC2:
+        case GL_COMPRESSED_SRGB8_ETC2:
+            return blocks * 8;
+        case GL_COMPRESSED_RGBA_S3TC_DXT5_EXT:
+        case GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT:
+        case GL_COMPRESSED_RG_RGTC2:
+        case GL_COMPRESSED_RGBA_BPTC_UNORM:
+        case GL_COMPRESSED_SRGB_ALPHA_BPTC_UNORM:
+        case GL_COMPRESSED_RGBA8_ETC2_EAC:
+        case GL_COMPRESSED_SRGB8_ALPHA8_ETC2_EAC:
+            return blocks * 16;
+        default:
+            return 0;
+    }
+}
+
+double Gm::CompressLevel(const uint8_t *texels, uint32_t width, uint32_t height, TextureFormat format,
+                         const CompressionOptions &options, uint8_t *blocks) {
+    size_t blocksX = (width + 3) / 4, blocksY = (height + 3) / 4;
+    size_t blockBytes = BlockBytes(format);
+    if (blockBytes == 0) {
+        std::memcpy(blocks, texels, TextureLevelBytes(format, width, height));
+        return 0.0;
+    }
+    // summed per row, in the same order whatever the threads did
+    std::vector<double> rowErrors(blocksY, 0.0);
+    auto encodeRows = [&](size_t begin, size_t end) {
+        Texels block;
+        for (size_t y = begin; y < end; ++y) {
+            uint8_t *out = blocks + y * blocksX * blockBytes;
+            for (size_t x = 0; x < blocksX; ++x, out += blockBytes) {
+                LoadBlock(texels, width, height, x, y, block);
+                rowErrors[y] += EncodeBlock(block, format, options, out);
+            }
+        }
+    };
+    size_t grain = std::max<size_t>(1, TileBlocks / blocksX);
+    if (options.parallel && blocksY > grain * 2) {
+        TaskSystem::Instance().ParallelFor(0, blocksY, grain, encodeRows);
+    } else {
+        encodeRows(0, blocksY);
+    }
+    double error = 0.0;
+    for (double rowError : rowErrors) {
+        error += rowError;
+    }
+    return error;
+}
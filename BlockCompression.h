@@ -0,0 +1,69 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include "glad/glad.h"
+
+namespace Gm {
+    // How the texels of a level are stored. The compressed formats code every 4x4 block in 8 or 16 bytes,
+    // blocks row by row; levels not a multiple of 4 wide or high still take whole blocks.
+    enum class TextureFormat {
+        // uncompressed, 4 bytes per texel
+        Rgba8,
+        // DXT1: RGB at 4 bits per texel, alpha dropped
+        Bc1,
+        // DXT5: BC1 color with a BC4 alpha block, 8 bits per texel
+        Bc3,
+        // two BC4 channels, red and green at 8 bits per texel, for normal maps
+        Bc5,
+        // BPTC, RGBA at 8 bits per texel with far less banding than BC1 / BC3
+        Bc7,
+        // ETC2 RGB, 4 bits per texel, the format of GL ES 3 and GL 4.3
+        Etc2Rgb,
+        // ETC2 RGB with an EAC alpha block, 8 bits per texel
+        Etc2Rgba,
+    };
+
+    enum class CompressionQuality {
+        // endpoints from the principal axis of the block's colors
+        Fast,
+        // then refit to the chosen indices by least squares
+        Normal,
+        // then searched around for the lowest error
+        High,
+    };
+
+    struct CompressionOptions {
+        CompressionQuality quality = CompressionQuality::Normal;
+        // split the block rows over the TaskSystem
+        bool parallel = true;
+        // SSE2 / NEON palette searches, off only to compare against the scalar code
+        bool simd = true;
+    };
+
+    // 8 or 16, 0 for Rgba8
+    size_t BlockBytes(TextureFormat format);
+
+    size_t TextureLevelBytes(TextureFormat format, uint32_t width, uint32_t height);
+
+    // the internal format glCompressedTexImage2D takes; BC5 has no sRGB variant
+    GLenum TextureInternalFormat(TextureFormat format, bool srgb);
+
+    // bytes of a level of a compressed internal format, 0 for the formats that aren't compressed
+    size_t CompressedLevelBytes(GLenum internalFormat, uint32_t width, uint32_t height);
+
+    // whether the loaded context takes `internalFormat`, from the GLAD_GL_* flags: BPTC needs GL 4.2 or
+    // ARB_texture_compression_bptc, ETC2 GL 4.3 or ARB_ES3_compatibility, S3TC its extension and RGTC GL 3.0 or
+    // its extension. Always true for the formats that aren't compressed.
+    bool InternalFormatSupported(GLenum internalFormat);
+
+    // `format` if the loaded context takes it, else BC3, else RGBA8; unchanged while no context is loaded, the
+    // levels are then compressed for whichever machine uploads them
+    TextureFormat SupportedTextureFormat(TextureFormat format, bool srgb);
+
+    // Codes `width` x `height` RGBA8 texels, rows top to bottom, into TextureLevelBytes(format, ...) bytes of
+    // blocks. Returns the summed squared error over the channels the format keeps, edge texels repeated to
+    // fill partial blocks counted again.
+    double CompressLevel(const uint8_t *texels, uint32_t width, uint32_t height, TextureFormat format,
+                         const CompressionOptions &options, uint8_t *blocks);
+}
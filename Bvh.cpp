@@ -0,0 +1,489 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <mutex>
+#include "Bvh.h"
+#include "CpuFeatures.h"
+#include "TaskSystem.h"
+
+#if GM_SIMD_X86
+#include <immintrin.h>
+#endif
+
+namespace {
+    const int BinCount = 16;
+    // subtrees with more primitives than this are handed to another worker
+    const uint32_t ParallelSubtreeSize = 16 * 1024;
+    // nodes with more primitives than this bin their primitives in parallel
+    const uint32_t ParallelBinningSize = 256 * 1024;
+    const uint32_t BinningGrain = 64 * 1024;
+
+    struct Bin {
+        Gm::Aabb bounds;
+        uint32_t count = 0;
+    };
+
+    struct Binning {
+        Bin bins[3][BinCount];
+    };
+
+    // how a node's centroid range maps to bins along each axis
+    struct BinMapping {
+        Eigen::Vector3f origin;
+        Eigen::Vector3f scale;
+
+        int BinOf(const Eigen::Vector3f &centroid, int axis) const {
+            int bin = (int) ((centroid[axis] - origin[axis]) * scale[axis]);
+            return std::min(std::max(bin, 0), BinCount - 1);
+        }
+    };
+
+    struct Builder {
+        const Gm::Aabb *bounds;
+        std::vector<Eigen::Vector3f> centroids;
+        std::vector<uint32_t> &indices;
+        std::vector<Gm::BvhNode> &nodes;
+        // null when building serially
+        Gm::TaskSystem *tasks;
+        Gm::TaskSystem::TaskGroup group;
+        std::atomic<uint32_t> nodeCount{1};
+        std::atomic<uint32_t> leafCount{0};
+
+        Builder(const Gm::Aabb *bounds, std::vector<uint32_t> &indices, std::vector<Gm::BvhNode> &nodes,
+                Gm::TaskSystem *tasks) : bounds(bounds), indices(indices), nodes(nodes), tasks(tasks) {}
+
+        void MakeLeaf(Gm::BvhNode &node, uint32_t first, uint32_t count) {
+            node.leftOrFirst = first;
+            node.count = count;
+            leafCount.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        // runs `function(begin, end)` over the primitive range, in parallel when it is large
+        template<typename Function>
+        void ForRange(uint32_t first, uint32_t count, Function function) {
+            if (tasks == nullptr || count < ParallelBinningSize) {
+                function(first, first + count);
+                return;
+            }
+            tasks->ParallelFor(first, first + count, BinningGrain, [&function](size_t begin, size_t end) {
+                function((uint32_t) begin, (uint32_t) end);
+            });
+        }
+
+        Gm::Aabb CentroidBounds(uint32_t first, uint32_t count) {
+            Gm::Aabb result;
+            std::mutex mutex;
+            ForRange(first, count, [&](uint32_t begin, uint32_t end) {
+                Gm::Aabb local;
+                for (uint32_t i = begin; i < end; ++i) {
+                    local.Grow(centroids[indices[i]]);
+                }
+                std::lock_guard<std::mutex> lock(mutex);
+                result.Grow(local);
+            });
+            return result;
+        }
+
+        void BinPrimitives(uint32_t first, uint32_t count, const BinMapping &mapping, Binning &binning) {
+            std::mutex mutex;
+            ForRange(first, count, [&](uint32_t begin, uint32_t end) {
+                Binning local;
+                for (uint32_t i = begin; i < end; ++i) {
+                    uint32_t primitive = indices[i];
+                    for (int axis = 0; axis < 3; ++axis) {
+                        Bin &bin = local.bins[axis][mapping.BinOf(centroids[primitive], axis)];
+                        bin.bounds.Grow(bounds[primitive]);
+                        bin.count++;
+                    }
+                }
+                std::lock_guard<std::mutex> lock(mutex);
+                for (int axis = 0; axis < 3; ++axis) {
+                    for (int b = 0; b < BinCount; ++b) {
+                        binning.bins[axis][b].bounds.Grow(local.bins[axis][b].bounds);
+                        binning.bins[axis][b].count += local.bins[axis][b].count;
+                    }
+                }
+            });
+        }
+
+        // a node still to be split, with its primitive range
+        struct Range {
+            uint32_t node = 0;
+            uint32_t first = 0;
+            uint32_t count = 0;
+            Gm::Aabb bounds;
+        };
+
+        // builds the subtree under `root` from a work stack rather than by recursion: SAH splits aren't depth
+        // limited and a chain of lopsided ones would overflow the call stack
+        void Subdivide(const Range &root) {
+            Gm::TraversalStack<Range, 64> work;
+            work.Push(root);
+            while (!work.Empty()) {
+                Range subtree = work.Pop();
+                Range left, right;
+                if (!Split(subtree, left, right)) {
+                    continue;
+                }
+                // the right child is taken next, a large left one goes to another worker
+                if (tasks != nullptr && subtree.count > ParallelSubtreeSize) {
+                    tasks->Run(group, [this, left] { Subdivide(left); });
+                } else {
+                    work.Push(left);
+                }
+                work.Push(right);
+            }
+        }
+
+        // fills in the node of `subtree`, returns false for a leaf and the two child ranges otherwise
+        bool Split(const Range &subtree, Range &leftRange, Range &rightRange) {
+            uint32_t first = subtree.first, count = subtree.count;
+            const Gm::Aabb &nodeBounds = subtree.bounds;
+            Gm::BvhNode &node = nodes[subtree.node];
+            for (int axis = 0; axis < 3; ++axis) {
+                node.boundsMin[axis] = nodeBounds.min[axis];
+                node.boundsMax[axis] = nodeBounds.max[axis];
+            }
+            if (count <= 2) {
+                MakeLeaf(node, first, count);
+                return false;
+            }
+
+            Gm::Aabb centroidBounds = CentroidBounds(first, count);
+            Eigen::Vector3f extent = centroidBounds.max - centroidBounds.min;
+            BinMapping mapping;
+            mapping.origin = centroidBounds.min;
+            for (int axis = 0; axis < 3; ++axis) {
+                mapping.scale[axis] = extent[axis] > 0.0f ? BinCount / extent[axis] * 0.9999f : 0.0f;
+            }
+
+            // sweep the bins of every axis for the split with the lowest SAH cost
+            Binning binning;
+            BinPrimitives(first, count, mapping, binning);
+            float bestCost = std::numeric_limits<float>::infinity();
+            int bestAxis = -1, bestBin = 0;
+            uint32_t bestLeftCount = 0;
+            Gm::Aabb bestLeft, bestRight;
+            for (int axis = 0; axis < 3; ++axis) {
+                if (extent[axis] <= 0.0f) {
+                    continue;
+                }
+                const Bin *bins = binning.bins[axis];
+                Gm::Aabb rightBounds[BinCount];
+                uint32_t rightCounts[BinCount];
+                Gm::Aabb accumulated;
+                uint32_t accumulatedCount = 0;
+                for (int b = BinCount - 1; b > 0; --b) {
+                    accumulated.Grow(bins[b].bounds);
+                    accumulatedCount += bins[b].count;
+                    rightBounds[b] = accumulated;
+                    rightCounts[b] = accumulatedCount;
+                }
+                Gm::Aabb left;
+                uint32_t leftCount = 0;
+                for (int b = 0; b < BinCount - 1; ++b) {
+                    left.Grow(bins[b].bounds);
+                    leftCount += bins[b].count;
+                    uint32_t rightCount = rightCounts[b + 1];
+                    if (leftCount == 0 || rightCount == 0) {
+                        continue;
+                    }
+                    float cost = left.HalfArea() * leftCount + rightBounds[b + 1].HalfArea() * rightCount;
+                    if (cost < bestCost) {
+                        bestCost = cost;
+                        bestAxis = axis;
+                        bestBin = b;
+                        bestLeftCount = leftCount;
+                        bestLeft = left;
+                        bestRight = rightBounds[b + 1];
+                    }
+                }
+            }
+
+            // traversal and intersection cost are both 1, relative to the parent's area
+            float leafCost = (float) count;
+            float splitCost = 1.0f + bestCost / std::max(nodeBounds.HalfArea(), 1e-20f);
+            uint32_t *range = indices.data() + first;
+            if (bestAxis < 0 || splitCost >= leafCost) {
+                if (count <= Gm::Bvh::MaxLeafSize) {
+                    MakeLeaf(node, first, count);
+                    return false;
+                }
+                // no useful split (e.g. identical centroids) but too many primitives for a leaf: halve the list
+                bestLeftCount = count / 2;
+                bestLeft = Gm::Aabb();
+                bestRight = Gm::Aabb();
+                for (uint32_t i = 0; i < count; ++i) {
+                    (i < bestLeftCount ? bestLeft : bestRight).Grow(bounds[range[i]]);
+                }
+            } else {
+                std::partition(range, range + count, [&](uint32_t primitive) {
+                    return mapping.BinOf(centroids[primitive], bestAxis) <= bestBin;
+                });
+            }
+
+            uint32_t children = nodeCount.fetch_add(2, std::memory_order_relaxed);
+            node.leftOrFirst = children;
+            node.count = 0;
+            leftRange.node = children;
+            leftRange.first = first;
+            leftRange.count = bestLeftCount;
+            leftRange.bounds = bestLeft;
+            rightRange.node = children + 1;
+            rightRange.first = first + bestLeftCount;
+            rightRange.count = count - bestLeftCount;
+            rightRange.bounds = bestRight;
+            return true;
+        }
+    };
+
+    Gm::Aabb NodeBounds(const Gm::BvhNode &node) {
+        Gm::Aabb box;
+        box.min = Eigen::Vector3f(node.boundsMin[0], node.boundsMin[1], node.boundsMin[2]);
+        box.max = Eigen::Vector3f(node.boundsMax[0], node.boundsMax[1], node.boundsMax[2]);
+        return box;
+    }
+}
+
+void Gm::Bvh::Build(const Aabb *bounds, size_t count) {
+    Build(bounds, count, &TaskSystem::Instance());
+}
+
+void Gm::Bvh::Build(const Aabb *bounds, size_t count, TaskSystem *tasks) {
+    auto start = std::chrono::steady_clock::now();
+    m_nodes.clear();
+    m_wideNodes.clear();
+    m_indices.resize(count);
+    m_buildStats = BuildStats();
+    if (count == 0) {
+        return;
+    }
+    // a binary tree with single primitive leaves has at most 2n - 1 nodes
+    m_nodes.resize(2 * count);
+
+    Builder builder(bounds, m_indices, m_nodes, tasks);
+    builder.centroids.resize(count);
+    std::mutex mutex;
+    Aabb rootBounds;
+    builder.ForRange(0, (uint32_t) count, [&](uint32_t begin, uint32_t end) {
+        Aabb local;
+        for (uint32_t i = begin; i < end; ++i) {
+            m_indices[i] = i;
+            builder.centroids[i] = bounds[i].Center();
+            local.Grow(bounds[i]);
+        }
+        std::lock_guard<std::mutex> lock(mutex);
+        rootBounds.Grow(local);
+    });
+
+    Builder::Range root;
+    root.count = (uint32_t) count;
+    root.bounds = rootBounds;
+    builder.Subdivide(root);
+    if (tasks != nullptr) {
+        tasks->Wait(builder.group);
+    }
+    m_nodes.resize(builder.nodeCount.load());
+
+    BuildWide();
+
+    m_buildStats.nodeCount = m_nodes.size();
+    m_buildStats.leafCount = builder.leafCount.load();
+    m_buildStats.milliseconds = std::chrono::duration<double, std::milli>(
+            std::chrono::steady_clock::now() - start).count();
+}
+
+void Gm::Bvh::BuildWide() {
+    m_wideNodes.clear();
+    m_wideNodes.reserve(m_nodes.size() / 2 + 1);
+
+    // collapse up to two binary levels into one 4 wide node, always opening the largest interior child; from a
+    // work stack, like the binary build, so a deep tree can't overflow the call stack
+    struct Pending {
+        uint32_t binaryIndex;
+        // the wide node and slot that point at this one, InvalidChild for the root
+        uint32_t parent;
+        int slot;
+    };
+    TraversalStack<Pending, 64> work;
+    work.Push({0, Bvh4Node::InvalidChild, 0});
+    while (!work.Empty()) {
+        Pending pending = work.Pop();
+        uint32_t wideIndex = (uint32_t) m_wideNodes.size();
+        m_wideNodes.emplace_back();
+        if (pending.parent != Bvh4Node::InvalidChild) {
+            m_wideNodes[pending.parent].child[pending.slot] = wideIndex;
+        }
+
+        uint32_t slots[4];
+        int slotCount = 0;
+        const BvhNode &root = m_nodes[pending.binaryIndex];
+        if (root.IsLeaf()) {
+            slots[slotCount++] = pending.binaryIndex;
+        } else {
+            slots[slotCount++] = root.leftOrFirst;
+            slots[slotCount++] = root.leftOrFirst + 1;
+        }
+        while (slotCount < 4) {
+            int largest = -1;
+            float largestArea = -1.0f;
+            for (int s = 0; s < slotCount; ++s) {
+                const BvhNode &node = m_nodes[slots[s]];
+                float area = NodeBounds(node).HalfArea();
+                if (!node.IsLeaf() && area > largestArea) {
+                    largest = s;
+                    largestArea = area;
+                }
+            }
+            if (largest < 0) {
+                break;
+            }
+            uint32_t left = m_nodes[slots[largest]].leftOrFirst;
+            slots[largest] = left;
+            slots[slotCount++] = left + 1;
+        }
+
+        Bvh4Node &wide = m_wideNodes[wideIndex];
+        for (int s = 0; s < 4; ++s) {
+            float inf = std::numeric_limits<float>::infinity();
+            uint32_t child = Bvh4Node::InvalidChild, count = 0;
+            Aabb box;
+            box.min = Eigen::Vector3f::Constant(inf);
+            box.max = Eigen::Vector3f::Constant(-inf);
+            if (s < slotCount) {
+                const BvhNode &node = m_nodes[slots[s]];
+                box = NodeBounds(node);
+                // pad by a few ulps so rays running exactly along a face still enter the box
+                Eigen::Vector3f padding = (box.min.cwiseAbs().cwiseMax(box.max.cwiseAbs()) +
+                                           (box.max - box.min)) * 1e-6f;
+                box.min -= padding;
+                box.max += padding;
+                if (node.IsLeaf()) {
+                    child = node.leftOrFirst;
+                    count = node.count;
+                }
+                // an interior child gets its index once its wide node is appended
+            }
+            wide.minX[s] = box.min[0];
+            wide.minY[s] = box.min[1];
+            wide.minZ[s] = box.min[2];
+            wide.maxX[s] = box.max[0];
+            wide.maxY[s] = box.max[1];
+            wide.maxZ[s] = box.max[2];
+            wide.child[s] = child;
+            wide.count[s] = count;
+        }
+        // pushed in reverse, the wide nodes come out in the same depth first order as before
+        for (int s = slotCount - 1; s >= 0; --s) {
+            if (!m_nodes[slots[s]].IsLeaf()) {
+                work.Push({slots[s], wideIndex, s});
+            }
+        }
+    }
+}
+
+void Gm::Bvh::Cull(const Frustum &frustum, std::vector<uint32_t> &primitives) const {
+    if (m_nodes.empty()) {
+        return;
+    }
+    struct Entry {
+        uint32_t node;
+        bool inside;
+    };
+    TraversalStack<Entry, 128> stack;
+    stack.Push({0, false});
+    while (!stack.Empty()) {
+        Entry entry = stack.Pop();
+        const BvhNode &node = m_nodes[entry.node];
+        bool inside = entry.inside;
+        if (!inside) {
+            inside = true;
+            bool outside = false;
+            for (const Eigen::Vector4f &plane : frustum.planes) {
+                // the box corner furthest along the plane normal, and the one furthest against it
+                float farthest = plane[3], nearest = plane[3];
+                for (int axis = 0; axis < 3; ++axis) {
+                    float a = plane[axis] * node.boundsMin[axis], b = plane[axis] * node.boundsMax[axis];
+                    farthest += std::max(a, b);
+                    nearest += std::min(a, b);
+                }
+                if (farthest < 0.0f) {
+                    outside = true;
+                    break;
+                }
+                if (nearest < 0.0f) {
+                    inside = false;
+                }
+            }
+            if (outside) {
+                continue;
+            }
+        }
+        if (node.IsLeaf()) {
+            primitives.insert(primitives.end(), m_indices.begin() + node.leftOrFirst,
+                              m_indices.begin() + node.leftOrFirst + node.count);
+        } else {
+            // fully inside subtrees are still walked, but without any plane test
+            stack.Push({node.leftOrFirst + 1, inside});
+            stack.Push({node.leftOrFirst, inside});
+        }
+    }
+}
+
+Gm::RayTraversal::RayTraversal(const Ray &ray) {
+    for (int axis = 0; axis < 3; ++axis) {
+        origin[axis] = ray.origin[axis];
+        // an axis parallel ray would give 0 * inf = NaN on boxes touching its origin plane
+        float direction = ray.direction[axis];
+        if (std::fabs(direction) < 1e-30f) {
+            direction = std::copysign(1e-30f, direction);
+        }
+        inverseDirection[axis] = 1.0f / direction;
+    }
+}
+
+int Gm::IntersectBvh4Node(const Bvh4Node &node, const RayTraversal &traversal, float tMin, float tMax,
+                          float distances[4]) {
+#if GM_SIMD_X86
+    __m128 originX = _mm_set1_ps(traversal.origin[0]);
+    __m128 originY = _mm_set1_ps(traversal.origin[1]);
+    __m128 originZ = _mm_set1_ps(traversal.origin[2]);
+    __m128 inverseX = _mm_set1_ps(traversal.inverseDirection[0]);
+    __m128 inverseY = _mm_set1_ps(traversal.inverseDirection[1]);
+    __m128 inverseZ = _mm_set1_ps(traversal.inverseDirection[2]);
+
+    __m128 t0x = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(node.minX), originX), inverseX);
+    __m128 t1x = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(node.maxX), originX), inverseX);
+    __m128 t0y = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(node.minY), originY), inverseY);
+    __m128 t1y = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(node.maxY), originY), inverseY);
+    __m128 t0z = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(node.minZ), originZ), inverseZ);
+    __m128 t1z = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(node.maxZ), originZ), inverseZ);
+
+    __m128 nearT = _mm_max_ps(_mm_max_ps(_mm_min_ps(t0x, t1x), _mm_min_ps(t0y, t1y)),
+                              _mm_max_ps(_mm_min_ps(t0z, t1z), _mm_set1_ps(tMin)));
+    __m128 farT = _mm_min_ps(_mm_min_ps(_mm_max_ps(t0x, t1x), _mm_max_ps(t0y, t1y)),
+                             _mm_min_ps(_mm_max_ps(t0z, t1z), _mm_set1_ps(tMax)));
+    __m128i invalid = _mm_cmpeq_epi32(_mm_load_si128((const __m128i *) node.child),
+                                      _mm_set1_epi32((int) Bvh4Node::InvalidChild));
+    __m128 hit = _mm_andnot_ps(_mm_castsi128_ps(invalid), _mm_cmple_ps(nearT, farT));
+    _mm_storeu_ps(distances, nearT);
+    return _mm_movemask_ps(hit);
+#else
+    int mask = 0;
+    for (int slot = 0; slot < 4; ++slot) {
+        float t0x = (node.minX[slot] - traversal.origin[0]) * traversal.inverseDirection[0];
+        float t1x = (node.maxX[slot] - traversal.origin[0]) * traversal.inverseDirection[0];
+        float t0y = (node.minY[slot] - traversal.origin[1]) * traversal.inverseDirection[1];
+        float t1y = (node.maxY[slot] - traversal.origin[1]) * traversal.inverseDirection[1];
+        float t0z = (node.minZ[slot] - traversal.origin[2]) * traversal.inverseDirection[2];
+        float t1z = (node.maxZ[slot] - traversal.origin[2]) * traversal.inverseDirection[2];
+        float nearT = std::max(std::max(std::min(t0x, t1x), std::min(t0y, t1y)), std::max(std::min(t0z, t1z), tMin));
+        float farT = std::min(std::min(std::max(t0x, t1x), std::max(t0y, t1y)), std::min(std::max(t0z, t1z), tMax));
+        distances[slot] = nearT;
+        if (node.child[slot] != Bvh4Node::InvalidChild && nearT <= farT) {
+            mask |= 1 << slot;
+        }
+    }
+    return mask;
+#endif
+}
@@ -0,0 +1,205 @@
+#pragma once
+
+#include <cstdint>
+#include <limits>
+#include <vector>
+#include "Eigen/Core"
+#include "FrustumCulling.h"
+
+namespace Gm {
+    class TaskSystem;
+
+    struct Aabb {
+        Eigen::Vector3f min = Eigen::Vector3f::Constant(std::numeric_limits<float>::infinity());
+        Eigen::Vector3f max = Eigen::Vector3f::Constant(-std::numeric_limits<float>::infinity());
+
+        void Grow(const Eigen::Vector3f &point) {
+            min = min.cwiseMin(point);
+            max = max.cwiseMax(point);
+        }
+
+        void Grow(const Aabb &box) {
+            min = min.cwiseMin(box.min);
+            max = max.cwiseMax(box.max);
+        }
+
+        Eigen::Vector3f Center() const { return (min + max) * 0.5f; }
+
+        // half the surface area, all the SAH needs is the ratio
+        float HalfArea() const {
+            Eigen::Vector3f extent = (max - min).cwiseMax(0.0f);
+            return extent[0] * extent[1] + extent[1] * extent[2] + extent[2] * extent[0];
+        }
+    };
+
+    struct Ray {
+        Eigen::Vector3f origin;
+        Eigen::Vector3f direction;
+        float tMin = 0.0f;
+        // shrunk by the primitive test on every closer hit
+        float tMax = std::numeric_limits<float>::infinity();
+    };
+
+    // 32 bytes, two per cache line. Interior nodes store the index of their left child,
+    // the right one follows it. Leaves store their first entry in the primitive index list.
+    struct BvhNode {
+        float boundsMin[3];
+        uint32_t leftOrFirst;
+        float boundsMax[3];
+        uint32_t count;
+
+        bool IsLeaf() const { return count != 0; }
+    };
+
+    static_assert(sizeof(BvhNode) == 32, "BvhNode must stay 32 bytes");
+
+    // Four children per node with their bounds in SoA so one SIMD test covers all of them.
+    // A slot with count > 0 is a leaf whose primitives start at `child`, count == 0 is an
+    // interior node unless `child` is InvalidChild.
+    struct alignas(16) Bvh4Node {
+        float minX[4], minY[4], minZ[4];
+        float maxX[4], maxY[4], maxZ[4];
+        uint32_t child[4];
+        uint32_t count[4];
+
+        static const uint32_t InvalidChild = 0xffffffffu;
+    };
+
+    // ray data shared by every node test of one traversal
+    struct RayTraversal {
+        explicit RayTraversal(const Ray &ray);
+
+        float origin[3];
+        float inverseDirection[3];
+    };
+
+    // SIMD test of a ray against the four children of `node`, returns a bit mask of the hit
+    // slots and writes their entry distances.
+    int IntersectBvh4Node(const Bvh4Node &node, const RayTraversal &traversal, float tMin, float tMax,
+                          float distances[4]);
+
+    // Node stack of a traversal or a build. SAH splits aren't depth limited, a chain of lopsided ones (exponentially
+    // spaced objects) makes a tree deeper than the fixed part, the rest spills to the heap.
+    template<typename T, int Capacity>
+    class TraversalStack {
+    public:
+        bool Empty() const { return m_top == 0 && m_overflow.empty(); }
+
+        void Push(const T &value) {
+            if (m_top < Capacity) {
+                m_fixed[m_top++] = value;
+            } else {
+                m_overflow.push_back(value);
+            }
+        }
+
+        // what spilled was pushed last
+        T Pop() {
+            if (!m_overflow.empty()) {
+                T value = m_overflow.back();
+                m_overflow.pop_back();
+                return value;
+            }
+            return m_fixed[--m_top];
+        }
+
+    private:
+        T m_fixed[Capacity];
+        int m_top = 0;
+        std::vector<T> m_overflow;
+    };
+
+    // Bounding volume hierarchy over arbitrary boxes: scene objects or triangles.
+    // Built top down with binned SAH, large subtrees are built in parallel on the TaskSystem.
+    class Bvh {
+    public:
+        struct BuildStats {
+            double milliseconds = 0.0;
+            size_t nodeCount = 0;
+            size_t leafCount = 0;
+        };
+
+        void Build(const Aabb *bounds, size_t count);
+
+        // `tasks` null builds on the calling thread alone, e.g. as the baseline of the parallel build
+        void Build(const Aabb *bounds, size_t count, TaskSystem *tasks);
+
+        bool Empty() const { return m_nodes.empty(); }
+
+        const BuildStats &GetBuildStats() const { return m_buildStats; }
+
+        const std::vector<BvhNode> &Nodes() const { return m_nodes; }
+
+        const std::vector<Bvh4Node> &WideNodes() const { return m_wideNodes; }
+
+        // leaves reference ranges of this list, which holds the caller's primitive indices
+        const std::vector<uint32_t> &PrimitiveIndices() const { return m_indices; }
+
+        // Closest hit query. `intersect(primitive, ray)` tests one primitive, shrinks ray.tMax
+        // when it finds a closer hit and returns whether it did.
+        template<typename Intersector>
+        bool Intersect(Ray &ray, Intersector &&intersect) const;
+
+        // Appends the primitives of every leaf whose box is not fully outside the frustum. Conservative at leaf
+        // granularity: a leaf straddling a plane is appended whole, its primitives aren't tested one by one.
+        void Cull(const Frustum &frustum, std::vector<uint32_t> &primitives) const;
+
+        static const uint32_t MaxLeafSize = 8;
+
+    private:
+        void BuildWide();
+
+        std::vector<BvhNode> m_nodes;
+        std::vector<Bvh4Node> m_wideNodes;
+        std::vector<uint32_t> m_indices;
+        BuildStats m_buildStats;
+    };
+
+    template<typename Intersector>
+    bool Bvh::Intersect(Ray &ray, Intersector &&intersect) const {
+        if (m_wideNodes.empty()) {
+            return false;
+        }
+        RayTraversal traversal(ray);
+        TraversalStack<uint32_t, 256> stack;
+        stack.Push(0);
+        bool hit = false;
+        while (!stack.Empty()) {
+            const Bvh4Node &node = m_wideNodes[stack.Pop()];
+            float distances[4];
+            int mask = IntersectBvh4Node(node, traversal, ray.tMin, ray.tMax, distances);
+            if (mask == 0) {
+                continue;
+            }
+            // sort the hit slots near to far
+            int order[4], hits = 0;
+            for (int slot = 0; slot < 4; ++slot) {
+                if (mask & (1 << slot)) {
+                    int i = hits++;
+                    while (i > 0 && distances[order[i - 1]] > distances[slot]) {
+                        order[i] = order[i - 1];
+                        --i;
+                    }
+                    order[i] = slot;
+                }
+            }
+            // leaves first, near to far, so tMax shrinks before the interior nodes are visited
+            for (int i = 0; i < hits; ++i) {
+                int slot = order[i];
+                if (node.count[slot] != 0 && distances[slot] <= ray.tMax) {
+                    for (uint32_t p = node.child[slot]; p < node.child[slot] + node.count[slot]; ++p) {
+                        hit |= intersect(m_indices[p], ray);
+                    }
+                }
+            }
+            // interior nodes far to near, the nearest is popped next
+            for (int i = hits - 1; i >= 0; --i) {
+                int slot = order[i];
+                if (node.count[slot] == 0 && distances[slot] <= ray.tMax) {
+                    stack.Push(node.child[slot]);
+                }
+            }
+        }
+        return hit;
+    }
+}
@@ -0,0 +1,39 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include "Clock.h"
+
+double Gm::Clock::Now() {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+Gm::FixedTimestep::FixedTimestep(double stepSeconds, int maxStepsPerFrame)
+        : m_stepSeconds(stepSeconds), m_maxStepsPerFrame(maxStepsPerFrame), m_lastTime(Clock::Now()) {
+}
+
+void Gm::FixedTimestep::Reset() {
+    m_lastTime = Clock::Now();
+    m_accumulator = 0.0;
+}
+
+int Gm::FixedTimestep::Tick() {
+    double now = Clock::Now();
+    double frameSeconds = now - m_lastTime;
+    m_lastTime = now;
+    return Advance(frameSeconds);
+}
+
+int Gm::FixedTimestep::Advance(double frameSeconds) {
+    m_accumulator += std::max(frameSeconds, 0.0);
+    int steps = (int) std::min(m_accumulator / m_stepSeconds, (double) m_maxStepsPerFrame);
+    // rounding may leave a hair below zero
+    m_accumulator = std::max(m_accumulator - steps * m_stepSeconds, 0.0);
+    if (m_accumulator >= m_stepSeconds) {
+        // behind by more than the limit, catch up by skipping time instead of simulating it
+        double kept = std::fmod(m_accumulator, m_stepSeconds);
+        m_droppedSeconds += m_accumulator - kept;
+        m_accumulator = kept;
+    }
+    m_stepCount += steps;
+    return steps;
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <cstdint>
+
+namespace Gm {
+    // monotonic time, unaffected by changes of the wall clock
+    class Clock {
+    public:
+        // seconds since an arbitrary fixed point, nanosecond resolution where the platform has it
+        static double Now();
+    };
+
+    // Runs a simulation at a fixed rate whatever the frame rate is. The time of each frame goes into an
+    // accumulator that is spent in whole steps; what remains says how far rendering is between the last two
+    // simulated states (Alpha), to interpolate them. After a very slow frame at most `maxStepsPerFrame` steps
+    // run and the rest of the time is dropped, so a slow renderer doesn't also get slower to simulate.
+    class FixedTimestep {
+    public:
+        explicit FixedTimestep(double stepSeconds = 1.0 / 60.0, int maxStepsPerFrame = 5);
+
+        // measure from now on and forget the time accumulated so far
+        void Reset();
+
+        // adds the time since the last Tick (or Reset) and returns the number of steps to simulate now
+        int Tick();
+
+        // Tick with the frame time given, for replays and fixed rate tools
+        int Advance(double frameSeconds);
+
+        // in [0, 1): 0 renders the last simulated state, values close to 1 are nearly at the next one
+        float Alpha() const { return (float) (m_accumulator / m_stepSeconds); }
+
+        double StepSeconds() const { return m_stepSeconds; }
+
+        uint64_t StepCount() const { return m_stepCount; }
+
+        // time the step limit threw away
+        double DroppedSeconds() const { return m_droppedSeconds; }
+
+    private:
+        double m_stepSeconds;
+        int m_maxStepsPerFrame;
+        double m_lastTime;
+        double m_accumulator = 0.0;
+        uint64_t m_stepCount = 0;
+        double m_droppedSeconds = 0.0;
+    };
+}
@@ -0,0 +1,249 @@
+#include <cstring>
+#include "CommandBuffer.h"
+#include "GlState.h"
+
+namespace {
+    struct NameCommand {
+        GLuint name;
+    };
+
+    struct BindBufferCommand {
+        GLenum target;
+        GLuint buffer;
+    };
+
+    // the data, if any, follows the command
+    struct BufferDataCommand {
+        GLenum target;
+        GLenum usage;
+        uint64_t size;
+        uint64_t hasData;
+    };
+
+    struct BufferSubDataCommand {
+        GLenum target;
+        uint64_t offset;
+        uint64_t size;
+    };
+
+    struct VertexAttribPointerCommand {
+        GLuint index;
+        GLint size;
+        GLsizei stride;
+        uint64_t offset;
+    };
+
+    struct UniformMatrix4Command {
+        GLint location;
+        float matrix[16];
+    };
+
+    struct UniformMatrix4PointerCommand {
+        GLint location;
+        const float *matrix;
+    };
+
+    struct ClearCommand {
+        GLbitfield mask;
+        float color[4];
+    };
+
+    struct DrawElementsInstancedCommand {
+        GLenum indexType;
+        Gm::DrawElementsIndirectCommand command;
+    };
+
+    struct MultiDrawElementsIndirectCommand {
+        GLenum indexType;
+        GLsizei drawCount;
+        uint64_t offset;
+    };
+
+    struct BarrierCommand {
+        GLbitfield barriers;
+    };
+
+    struct CallCommand {
+        void (*function)(void *context);
+        void *context;
+    };
+
+    size_t WordsOf(size_t bytes) {
+        return (bytes + sizeof(uint64_t) - 1) / sizeof(uint64_t);
+    }
+}
+
+template<typename T>
+T *Gm::CommandBuffer::Push(Type type, size_t extraBytes) {
+    static_assert(sizeof(Header) == sizeof(uint64_t), "the header takes one word");
+    size_t words = 1 + WordsOf(sizeof(T) + extraBytes);
+    size_t start = m_words.size();
+    m_words.resize(start + words);
+    Header header = {type, (uint32_t) words};
+    memcpy(&m_words[start], &header, sizeof(header));
+    m_commandCount++;
+    return reinterpret_cast<T *>(&m_words[start + 1]);
+}
+
+void Gm::CommandBuffer::Reset() {
+    // keeps the capacity, recording the next frame allocates nothing
+    m_words.clear();
+    m_commandCount = 0;
+}
+
+void Gm::CommandBuffer::UseProgram(GLuint program) {
+    Push<NameCommand>(Type::UseProgram)->name = program;
+}
+
+void Gm::CommandBuffer::BindVertexArray(GLuint vertexArray) {
+    Push<NameCommand>(Type::BindVertexArray)->name = vertexArray;
+}
+
+void Gm::CommandBuffer::BindBuffer(GLenum target, GLuint buffer) {
+    *Push<BindBufferCommand>(Type::BindBuffer) = {target, buffer};
+}
+
+void Gm::CommandBuffer::BufferData(GLenum target, size_t size, const void *data, GLenum usage) {
+    BufferDataCommand *command = Push<BufferDataCommand>(Type::BufferData, data != nullptr ? size : 0);
+    *command = {target, usage, size, data != nullptr};
+    if (data != nullptr) {
+        memcpy(command + 1, data, size);
+    }
+}
+
+void Gm::CommandBuffer::BufferSubData(GLenum target, size_t offset, size_t size, const void *data) {
+    BufferSubDataCommand *command = Push<BufferSubDataCommand>(Type::BufferSubData, size);
+    *command = {target, offset, size};
+    memcpy(command + 1, data, size);
+}
+
+void Gm::CommandBuffer::VertexAttribPointer(GLuint index, GLint size, GLsizei stride, size_t offset) {
+    *Push<VertexAttribPointerCommand>(Type::VertexAttribPointer) = {index, size, stride, offset};
+}
+
+void Gm::CommandBuffer::UniformMatrix4(GLint location, const float *matrix) {
+    UniformMatrix4Command *command = Push<UniformMatrix4Command>(Type::UniformMatrix4);
+    command->location = location;
+    memcpy(command->matrix, matrix, sizeof(command->matrix));
+}
+
+void Gm::CommandBuffer::UniformMatrix4Pointer(GLint location, const float *matrix) {
+    *Push<UniformMatrix4PointerCommand>(Type::UniformMatrix4Pointer) = {location, matrix};
+}
+
+void Gm::CommandBuffer::Clear(GLbitfield mask, float red, float green, float blue, float alpha) {
+    *Push<ClearCommand>(Type::Clear) = {mask, {red, green, blue, alpha}};
+}
+
+void Gm::CommandBuffer::DrawElementsInstanced(GLenum indexType, const DrawElementsIndirectCommand &command) {
+    *Push<DrawElementsInstancedCommand>(Type::DrawElementsInstanced) = {indexType, command};
+}
+
+void Gm::CommandBuffer::MultiDrawElementsIndirect(GLenum indexType, size_t offset, GLsizei drawCount) {
+    *Push<MultiDrawElementsIndirectCommand>(Type::MultiDrawElementsIndirect) = {indexType, drawCount, offset};
+}
+
+void Gm::CommandBuffer::Barrier(GLbitfield barriers) {
+    Push<BarrierCommand>(Type::Barrier)->barriers = barriers;
+}
+
+void Gm::CommandBuffer::Call(void (*function)(void *), void *context) {
+    *Push<CallCommand>(Type::Call) = {function, context};
+}
+
+void Gm::CommandBuffer::Append(const CommandBuffer &other) {
+    m_words.insert(m_words.end(), other.m_words.begin(), other.m_words.end());
+    m_commandCount += other.m_commandCount;
+}
+
+void Gm::CommandBuffer::Execute() const {
+    GlState &state = GlState::Current();
+    bool baseInstance = GLAD_GL_VERSION_4_2 || GLAD_GL_ARB_base_instance;
+    const uint64_t *word = m_words.data();
+    const uint64_t *end = word + m_words.size();
+    while (word < end) {
+        Header header;
+        memcpy(&header, word, sizeof(header));
+        const void *payload = word + 1;
+        switch (header.type) {
+            case Type::UseProgram:
+                state.UseProgram(static_cast<const NameCommand *>(payload)->name);
+                break;
+            case Type::BindVertexArray:
+                state.BindVertexArray(static_cast<const NameCommand *>(payload)->name);
+                break;
+            case Type::BindBuffer: {
+                const BindBufferCommand *command = static_cast<const BindBufferCommand *>(payload);
+                state.BindBuffer(command->target, command->buffer);
+                break;
+            }
+            case Type::BufferData: {
+                const BufferDataCommand *command = static_cast<const BufferDataCommand *>(payload);
+                glBufferData(command->target, (GLsizeiptr) command->size, command->hasData ? command + 1 : NULL,
+                             command->usage);
+                break;
+            }
+            case Type::BufferSubData: {
+                const BufferSubDataCommand *command = static_cast<const BufferSubDataCommand *>(payload);
+                glBufferSubData(command->target, (GLintptr) command->offset, (GLsizeiptr) command->size, command + 1);
+                break;
+            }
+            case Type::VertexAttribPointer: {
+                const VertexAttribPointerCommand *command = static_cast<const VertexAttribPointerCommand *>(payload);
+                glVertexAttribPointer(command->index, command->size, GL_FLOAT, GL_FALSE, command->stride,
+                                      (const char *) NULL + command->offset);
+                break;
+            }
+            case Type::UniformMatrix4: {
+                const UniformMatrix4Command *command = static_cast<const UniformMatrix4Command *>(payload);
+                glUniformMatrix4fv(command->location, 1, GL_FALSE, command->matrix);
+                break;
+            }
+            case Type::UniformMatrix4Pointer: {
+                const UniformMatrix4PointerCommand *command =
+                        static_cast<const UniformMatrix4PointerCommand *>(payload);
+                glUniformMatrix4fv(command->location, 1, GL_FALSE, command->matrix);
+                break;
+            }
+            case Type::Clear: {
+                const ClearCommand *command = static_cast<const ClearCommand *>(payload);
+                glClearColor(command->color[0], command->color[1], command->color[2], command->color[3]);
+                glClear(command->mask);
+                break;
+            }
+            case Type::DrawElementsInstanced: {
+                const DrawElementsInstancedCommand *command =
+                        static_cast<const DrawElementsInstancedCommand *>(payload);
+                const DrawElementsIndirectCommand &draw = command->command;
+                size_t indexSize = command->indexType == GL_UNSIGNED_SHORT ? sizeof(GLushort) : sizeof(GLuint);
+                const char *indices = (const char *) NULL + draw.firstIndex * indexSize;
+                if (baseInstance) {
+                    glDrawElementsInstancedBaseVertexBaseInstance(GL_TRIANGLES, draw.count, command->indexType, indices,
+                                                                  draw.instanceCount, draw.baseVertex,
+                                                                  draw.baseInstance);
+                } else {
+                    // the recorder re-pointed the instanced attributes at baseInstance instead
+                    glDrawElementsInstancedBaseVertex(GL_TRIANGLES, draw.count, command->indexType, indices,
+                                                      draw.instanceCount, draw.baseVertex);
+                }
+                break;
+            }
+            case Type::MultiDrawElementsIndirect: {
+                const MultiDrawElementsIndirectCommand *command =
+                        static_cast<const MultiDrawElementsIndirectCommand *>(payload);
+                glMultiDrawElementsIndirect(GL_TRIANGLES, command->indexType, (const char *) NULL + command->offset,
+                                            command->drawCount, 0);
+                break;
+            }
+            case Type::Barrier:
+                glMemoryBarrier(static_cast<const BarrierCommand *>(payload)->barriers);
+                break;
+            case Type::Call: {
+                const CallCommand *command = static_cast<const CallCommand *>(payload);
+                command->function(command->context);
+                break;
+            }
+        }
+        word += header.words;
+    }
+}
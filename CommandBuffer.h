@@ -0,0 +1,99 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "glad/glad.h"
+
+namespace Gm {
+    // layout mandated by glMultiDrawElementsIndirect
+    struct DrawElementsIndirectCommand {
+        GLuint count;
+        GLuint instanceCount;
+        GLuint firstIndex;
+        GLint baseVertex;
+        GLuint baseInstance;
+    };
+
+    // Rendering commands written into one linear block of memory instead of being sent to GL right away.
+    // Recording touches no GL state, so any thread can fill a buffer of its own; Execute replays the
+    // commands on the GL thread through GlState. A buffer that is not Reset replays the same commands
+    // every frame, values that change between frames can be passed by pointer (read when executed).
+    class CommandBuffer {
+    public:
+        void Reset();
+
+        bool Empty() const { return m_words.empty(); }
+
+        size_t CommandCount() const { return m_commandCount; }
+
+        size_t ByteSize() const { return m_words.size() * sizeof(uint64_t); }
+
+        void UseProgram(GLuint program);
+
+        void BindVertexArray(GLuint vertexArray);
+
+        void BindBuffer(GLenum target, GLuint buffer);
+
+        // `data` is copied into the command buffer, nullptr only (re)allocates
+        void BufferData(GLenum target, size_t size, const void *data, GLenum usage);
+
+        void BufferSubData(GLenum target, size_t offset, size_t size, const void *data);
+
+        // float attribute `index` reading `size` components from the bound GL_ARRAY_BUFFER
+        void VertexAttribPointer(GLuint index, GLint size, GLsizei stride, size_t offset);
+
+        void UniformMatrix4(GLint location, const float *matrix);
+
+        // `matrix` must stay alive as long as the command is replayed
+        void UniformMatrix4Pointer(GLint location, const float *matrix);
+
+        void Clear(GLbitfield mask, float red, float green, float blue, float alpha);
+
+        void DrawElementsInstanced(GLenum indexType, const DrawElementsIndirectCommand &command);
+
+        // commands are read from the bound GL_DRAW_INDIRECT_BUFFER, `offset` bytes in
+        void MultiDrawElementsIndirect(GLenum indexType, size_t offset, GLsizei drawCount);
+
+        void Barrier(GLbitfield barriers);
+
+        // calls function(context) in order with the other commands, for work they don't cover
+        void Call(void (*function)(void *context), void *context);
+
+        // copy the commands of `other` to the end
+        void Append(const CommandBuffer &other);
+
+        // GL thread only
+        void Execute() const;
+
+    private:
+        enum class Type : uint32_t {
+            UseProgram,
+            BindVertexArray,
+            BindBuffer,
+            BufferData,
+            BufferSubData,
+            VertexAttribPointer,
+            UniformMatrix4,
+            UniformMatrix4Pointer,
+            Clear,
+            DrawElementsInstanced,
+            MultiDrawElementsIndirect,
+            Barrier,
+            Call,
+        };
+
+        // every command starts on a word boundary with its type and its length in words, header included
+        struct Header {
+            Type type;
+            uint32_t words;
+        };
+
+        // appends a command with `extraBytes` of trailing data and returns its payload
+        template<typename T>
+        T *Push(Type type, size_t extraBytes = 0);
+
+        std::vector<uint64_t> m_words;
+        size_t m_commandCount = 0;
+    };
+}
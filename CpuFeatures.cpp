@@ -0,0 +1,29 @@
+#include "CpuFeatures.h"
+
+bool Gm::Cpu::HasAvx2() {
+#if GM_SIMD_X86
+    static const bool supported = __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+    return supported;
+#else
+    return false;
+#endif
+}
+
+bool Gm::Cpu::HasNeon() {
+#if GM_SIMD_NEON
+    return true;
+#else
+    return false;
+#endif
+}
+
+const char *Gm::Cpu::SimdLevelName() {
+    if (HasAvx2()) {
+        return "avx2";
+    }
+#if GM_SIMD_X86
+    return "sse2";
+#else
+    return HasNeon() ? "neon" : "scalar";
+#endif
+}
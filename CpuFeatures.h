@@ -0,0 +1,23 @@
+#pragma once
+
+// Compile time architecture switches and run time feature queries for the SIMD kernels.
+// AVX2 code is compiled per function with `GM_TARGET_AVX2` so the rest of the build keeps
+// the default instruction set, and is only called when `Gm::Cpu::HasAvx2()` is true.
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__)
+#define GM_SIMD_X86 1
+#define GM_TARGET_AVX2 __attribute__((target("avx2,fma")))
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define GM_SIMD_NEON 1
+#endif
+
+namespace Gm {
+    namespace Cpu {
+        bool HasAvx2();
+
+        bool HasNeon();
+
+        // name of the widest kernel set that will be used, for logs and benchmark output
+        const char *SimdLevelName();
+    }
+}
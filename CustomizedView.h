@@ -14,6 +14,8 @@
 
 - (void)mouseDown:(NSEvent *)event;
 
+- (void)mouseMoved:(NSEvent *)event;
+
 - (void)mouseDragged:(NSEvent *)event;
 
 - (void)scrollWheel:(NSEvent *)event;
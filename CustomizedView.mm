@@ -21,9 +21,31 @@ namespace Gm {
     [_openGLContext flushBuffer];
 }
 
+- (BOOL)pickAt:(NSEvent *)event result:(Gm::PickResult &)result {
+    NSPoint location = [self convertPoint:[event locationInWindow] fromView:nil];
+    NSSize size = [self bounds].size;
+    return Gm::g_pGraphicsManager->Pick(location.x, location.y, size.width, size.height, result);
+}
+
 - (void)mouseDown:(NSEvent *)event {
     if ([event clickCount] == 2) {
         Gm::g_pGraphicsManager->Reset();
+        return;
+    }
+    Gm::PickResult result;
+    if ([self pickAt:event result:result]) {
+        NSLog(@"Picked mesh %u instance %u at (%f, %f, %f)", result.mesh, result.instance,
+              result.hitPoint[0], result.hitPoint[1], result.hitPoint[2]);
+    }
+}
+
+- (void)mouseMoved:(NSEvent *)event {
+    // hover highlighting
+    Gm::PickResult result;
+    if ([self pickAt:event result:result]) {
+        Gm::g_pGraphicsManager->SetHighlightedInstance(result.mesh, result.instance);
+    } else {
+        Gm::g_pGraphicsManager->ClearHighlightedInstance();
     }
 }
 
@@ -47,6 +69,15 @@ namespace Gm {
                                                  selector:@selector(_surfaceNeedsUpdate:)
                                                      name:NSViewGlobalFrameDidChangeNotification
                                                    object:self];
+        // deliver mouseMoved while the cursor is over the view
+        NSTrackingArea *trackingArea = [[NSTrackingArea alloc] initWithRect:NSZeroRect
+                                                                    options:NSTrackingMouseMoved |
+                                                                            NSTrackingActiveInKeyWindow |
+                                                                            NSTrackingInVisibleRect
+                                                                      owner:self
+                                                                   userInfo:nil];
+        [self addTrackingArea:trackingArea];
+        [trackingArea release];
     }
     return self;
 }
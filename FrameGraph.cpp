@@ -0,0 +1,439 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <functional>
+#include <queue>
+#include "FrameGraph.h"
+#include "GlState.h"
+#include "Profiler.h"
+
+namespace {
+    struct TextureFormat {
+        GLenum internalFormat;
+        GLenum format;
+        GLenum type;
+        size_t bytesPerPixel;
+    };
+
+    // what transient textures can be created as, the pixel transfer pair is only used without texture storage
+    const TextureFormat TextureFormats[] = {
+            {GL_RGBA8, GL_RGBA, GL_UNSIGNED_BYTE, 4},
+            {GL_RGBA16F, GL_RGBA, GL_HALF_FLOAT, 8},
+            {GL_RGBA32F, GL_RGBA, GL_FLOAT, 16},
+            {GL_RG16F, GL_RG, GL_HALF_FLOAT, 4},
+            {GL_R8, GL_RED, GL_UNSIGNED_BYTE, 1},
+            {GL_R32F, GL_RED, GL_FLOAT, 4},
+            {GL_DEPTH_COMPONENT24, GL_DEPTH_COMPONENT, GL_UNSIGNED_INT, 4},
+            {GL_DEPTH_COMPONENT32F, GL_DEPTH_COMPONENT, GL_FLOAT, 4},
+            {GL_DEPTH24_STENCIL8, GL_DEPTH_STENCIL, GL_UNSIGNED_INT_24_8, 4},
+    };
+
+    const TextureFormat *FindTextureFormat(GLenum internalFormat) {
+        for (const TextureFormat &format : TextureFormats) {
+            if (format.internalFormat == internalFormat) {
+                return &format;
+            }
+        }
+        return nullptr;
+    }
+
+    size_t TextureBytes(const Gm::FrameTextureDesc &desc) {
+        const TextureFormat *format = FindTextureFormat(desc.format);
+        return (size_t) desc.width * desc.height * (format != nullptr ? format->bytesPerPixel : 4);
+    }
+
+    // what a reader has to wait for after an incoherent (shader storage or image) write
+    GLbitfield BarrierBits(Gm::FrameAccess access) {
+        switch (access) {
+            case Gm::FrameAccess::Cpu:
+            case Gm::FrameAccess::Transfer:
+                return GL_BUFFER_UPDATE_BARRIER_BIT | GL_TEXTURE_UPDATE_BARRIER_BIT | GL_PIXEL_BUFFER_BARRIER_BIT;
+            case Gm::FrameAccess::ColorTarget:
+            case Gm::FrameAccess::DepthTarget:
+                return GL_FRAMEBUFFER_BARRIER_BIT;
+            case Gm::FrameAccess::Sampled:
+                return GL_TEXTURE_FETCH_BARRIER_BIT;
+            case Gm::FrameAccess::Storage:
+                return GL_SHADER_STORAGE_BARRIER_BIT | GL_SHADER_IMAGE_ACCESS_BARRIER_BIT;
+            case Gm::FrameAccess::VertexInput:
+                return GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT | GL_ELEMENT_ARRAY_BARRIER_BIT;
+            case Gm::FrameAccess::IndirectInput:
+                return GL_COMMAND_BARRIER_BIT;
+        }
+        return 0;
+    }
+}
+
+void Gm::FrameGraph::Builder::Read(FrameResource resource, FrameAccess access) {
+    Resource &target = m_graph.m_resources[resource];
+    Pass &pass = m_graph.m_passes[m_pass];
+    pass.reads.push_back({resource, access, target.lastWriter, target.lastWriteAccess});
+    if (target.lastWriter >= 0 && target.lastWriter != (int) m_pass) {
+        pass.dependencies.push_back((uint32_t) target.lastWriter);
+    }
+    target.readers.push_back(m_pass);
+}
+
+void Gm::FrameGraph::Builder::Write(FrameResource resource, FrameAccess access) {
+    Resource &target = m_graph.m_resources[resource];
+    Pass &pass = m_graph.m_passes[m_pass];
+    // after the previous write and after everyone who still had to see it
+    if (target.lastWriter >= 0 && target.lastWriter != (int) m_pass) {
+        pass.dependencies.push_back((uint32_t) target.lastWriter);
+    }
+    for (uint32_t reader : target.readers) {
+        if (reader != m_pass) {
+            pass.dependencies.push_back(reader);
+        }
+    }
+    target.readers.clear();
+    target.lastWriter = (int) m_pass;
+    target.lastWriteAccess = access;
+    pass.writes.push_back({resource, access, -1, access});
+    if (target.imported) {
+        pass.sideEffect = true;
+    }
+}
+
+Gm::FrameResource Gm::FrameGraph::Builder::CreateTexture(const char *name, const FrameTextureDesc &desc) {
+    FrameResource resource = m_graph.AddResource(name, Kind::Texture, false, 0);
+    m_graph.m_resources[resource].desc = desc;
+    m_graph.m_resources[resource].size = TextureBytes(desc);
+    Write(resource, desc.format == GL_DEPTH_COMPONENT24 || desc.format == GL_DEPTH_COMPONENT32F ||
+                    desc.format == GL_DEPTH24_STENCIL8 ? FrameAccess::DepthTarget : FrameAccess::ColorTarget);
+    return resource;
+}
+
+Gm::FrameResource Gm::FrameGraph::Builder::CreateBuffer(const char *name, size_t size) {
+    FrameResource resource = m_graph.AddResource(name, Kind::Buffer, false, 0);
+    m_graph.m_resources[resource].size = size;
+    Write(resource, FrameAccess::Storage);
+    return resource;
+}
+
+void Gm::FrameGraph::Builder::SetSideEffect() {
+    m_graph.m_passes[m_pass].sideEffect = true;
+}
+
+void Gm::FrameGraph::Reset() {
+    m_resources.clear();
+    m_passes.clear();
+    m_order.clear();
+    m_compiled = false;
+}
+
+Gm::FrameResource Gm::FrameGraph::AddResource(const char *name, Kind kind, bool imported, GLuint object) {
+    Resource resource;
+    resource.name = name;
+    resource.kind = kind;
+    resource.imported = imported;
+    resource.object = object;
+    resource.desc = FrameTextureDesc{0, 0, GL_NONE};
+    resource.size = 0;
+    resource.lastWriter = -1;
+    resource.lastWriteAccess = FrameAccess::Cpu;
+    resource.firstUse = -1;
+    resource.lastUse = -1;
+    resource.physical = -1;
+    m_resources.push_back(resource);
+    return (FrameResource) (m_resources.size() - 1);
+}
+
+Gm::FrameResource Gm::FrameGraph::ImportTexture(const char *name, GLuint texture) {
+    return AddResource(name, Kind::Texture, true, texture);
+}
+
+Gm::FrameResource Gm::FrameGraph::ImportBuffer(const char *name, GLuint buffer) {
+    return AddResource(name, Kind::Buffer, true, buffer);
+}
+
+Gm::FrameResource Gm::FrameGraph::ImportFramebuffer(const char *name, GLuint framebuffer) {
+    return AddResource(name, Kind::Framebuffer, true, framebuffer);
+}
+
+Gm::FrameResource Gm::FrameGraph::ImportCpu(const char *name) {
+    return AddResource(name, Kind::Cpu, true, 0);
+}
+
+void Gm::FrameGraph::AddPass(const char *name, const SetupCallback &setup, const ExecuteCallback &execute) {
+    Pass pass;
+    pass.name = name;
+    pass.execute = execute;
+    pass.sideEffect = false;
+    pass.alive = false;
+    pass.barriers = 0;
+    m_passes.push_back(pass);
+    m_compiled = false;
+
+    uint32_t index = (uint32_t) (m_passes.size() - 1);
+    Builder builder(*this, index);
+    setup(builder);
+    std::vector<uint32_t> &dependencies = m_passes[index].dependencies;
+    std::sort(dependencies.begin(), dependencies.end());
+    dependencies.erase(std::unique(dependencies.begin(), dependencies.end()), dependencies.end());
+}
+
+bool Gm::FrameGraph::Compile() {
+    m_stats = FrameGraphStats();
+
+    // Cull: producers only point backwards, so one sweep from the last pass marks everything a kept pass needs.
+    for (size_t i = m_passes.size(); i-- > 0;) {
+        Pass &pass = m_passes[i];
+        pass.alive = pass.alive || pass.sideEffect;
+        if (!pass.alive) {
+            continue;
+        }
+        for (const Use &read : pass.reads) {
+            if (read.producer >= 0) {
+                m_passes[read.producer].alive = true;
+            }
+        }
+    }
+
+    if (!Schedule()) {
+        return false;
+    }
+
+    // barriers: only shader storage and image writes are incoherent, everything else GL orders by itself
+    for (uint32_t index : m_order) {
+        Pass &pass = m_passes[index];
+        pass.barriers = 0;
+        for (const Use &read : pass.reads) {
+            if (read.producer >= 0 && read.producerAccess == FrameAccess::Storage) {
+                pass.barriers |= BarrierBits(read.access);
+            }
+        }
+        m_stats.barriers += pass.barriers != 0 ? 1 : 0;
+    }
+
+    AllocateTransients();
+    m_stats.passes = m_order.size();
+    m_stats.culledPasses = m_passes.size() - m_order.size();
+    m_compiled = true;
+    return true;
+}
+
+bool Gm::FrameGraph::Schedule() {
+    // Kahn's algorithm over the kept passes, lowest declaration index first among the ready ones
+    std::vector<uint32_t> pending(m_passes.size(), 0);
+    std::vector<std::vector<uint32_t>> dependents(m_passes.size());
+    size_t alive = 0;
+    for (uint32_t i = 0; i < m_passes.size(); ++i) {
+        if (!m_passes[i].alive) {
+            continue;
+        }
+        alive++;
+        for (uint32_t dependency : m_passes[i].dependencies) {
+            if (m_passes[dependency].alive) {
+                pending[i]++;
+                dependents[dependency].push_back(i);
+            }
+        }
+    }
+    std::priority_queue<uint32_t, std::vector<uint32_t>, std::greater<uint32_t>> ready;
+    for (uint32_t i = 0; i < m_passes.size(); ++i) {
+        if (m_passes[i].alive && pending[i] == 0) {
+            ready.push(i);
+        }
+    }
+    m_order.clear();
+    while (!ready.empty()) {
+        uint32_t index = ready.top();
+        ready.pop();
+        m_order.push_back(index);
+        for (uint32_t dependent : dependents[index]) {
+            if (--pending[dependent] == 0) {
+                ready.push(dependent);
+            }
+        }
+    }
+    if (m_order.size() != alive) {
+        fprintf(stderr, "Frame graph has a dependency cycle\n");
+        m_order.clear();
+        return false;
+    }
+    return true;
+}
+
+void Gm::FrameGraph::AllocateTransients() {
+    // lifetimes as positions in the schedule
+    for (int position = 0; position < (int) m_order.size(); ++position) {
+        const Pass &pass = m_passes[m_order[position]];
+        for (const std::vector<Use> *uses : {&pass.reads, &pass.writes}) {
+            for (const Use &use : *uses) {
+                Resource &resource = m_resources[use.resource];
+                if (resource.imported) {
+                    continue;
+                }
+                if (resource.firstUse < 0) {
+                    resource.firstUse = position;
+                }
+                resource.lastUse = position;
+            }
+        }
+    }
+
+    for (Physical &physical : m_physical) {
+        physical.inUse = false;
+    }
+    std::vector<bool> touched(m_physical.size(), false);
+    for (int position = 0; position < (int) m_order.size(); ++position) {
+        for (Resource &resource : m_resources) {
+            if (!resource.imported && resource.firstUse == position) {
+                resource.physical = AcquirePhysical(resource);
+                touched.resize(m_physical.size(), false);
+                touched[resource.physical] = true;
+                m_stats.transientResources++;
+                m_stats.transientBytes += resource.size;
+            }
+        }
+        // free after the pass, a resource born in the next one may take the same object
+        for (Resource &resource : m_resources) {
+            if (!resource.imported && resource.lastUse == position) {
+                m_physical[resource.physical].inUse = false;
+            }
+        }
+    }
+    for (size_t i = 0; i < m_physical.size(); ++i) {
+        if (touched[i]) {
+            m_stats.physicalResources++;
+            m_stats.allocatedBytes += m_physical[i].size;
+        }
+    }
+}
+
+int Gm::FrameGraph::AcquirePhysical(const Resource &resource) {
+    for (size_t i = 0; i < m_physical.size(); ++i) {
+        Physical &physical = m_physical[i];
+        if (physical.inUse || physical.kind != resource.kind) {
+            continue;
+        }
+        bool fits = resource.kind == Kind::Buffer
+                    ? physical.size >= resource.size
+                    : physical.desc.width == resource.desc.width && physical.desc.height == resource.desc.height &&
+                      physical.desc.format == resource.desc.format;
+        if (fits) {
+            physical.inUse = true;
+            return (int) i;
+        }
+    }
+
+    Physical physical;
+    physical.kind = resource.kind;
+    physical.desc = resource.desc;
+    physical.size = resource.size;
+    physical.object = 0;
+    physical.inUse = true;
+    if (resource.kind == Kind::Buffer) {
+        glGenBuffers(1, &physical.object);
+        GlState::Current().BindBuffer(GL_COPY_WRITE_BUFFER, physical.object);
+        glBufferData(GL_COPY_WRITE_BUFFER, resource.size, NULL, GL_DYNAMIC_COPY);
+    } else {
+        const TextureFormat *format = FindTextureFormat(resource.desc.format);
+        if (format == nullptr) {
+            fprintf(stderr, "Frame graph: unsupported format 0x%x for %s\n", resource.desc.format, resource.name);
+        } else {
+            glGenTextures(1, &physical.object);
+            GlState::Current().BindTexture(GL_TEXTURE_2D, physical.object);
+            if (GLAD_GL_VERSION_4_2 || GLAD_GL_ARB_texture_storage) {
+                glTexStorage2D(GL_TEXTURE_2D, 1, format->internalFormat, resource.desc.width, resource.desc.height);
+            } else {
+                glTexImage2D(GL_TEXTURE_2D, 0, format->internalFormat, resource.desc.width, resource.desc.height, 0,
+                             format->format, format->type, NULL);
+            }
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        }
+    }
+    m_physical.push_back(physical);
+    return (int) (m_physical.size() - 1);
+}
+
+void Gm::FrameGraph::Execute() {
+    if (!m_compiled) {
+        return;
+    }
+    Profiler &profiler = Profiler::Instance();
+    bool timers = profiler.IsTimingGpu();
+    uint64_t gpuFrame = profiler.CurrentGpuFrame();
+    // the profiler reads a frame back GpuFrames frames later, right before its slot comes round again
+    TimerFrame &timer = m_timerFrames[gpuFrame % TimerFrames];
+    ResolveTimers(timer);
+    timer.gpuFrame = timers ? gpuFrame : 0;
+    timer.passes.clear();
+    timer.scopes.clear();
+
+    for (size_t i = 0; i < m_order.size(); ++i) {
+        Pass &pass = m_passes[m_order[i]];
+        if (pass.barriers != 0) {
+            glMemoryBarrier(pass.barriers);
+        }
+        auto start = std::chrono::steady_clock::now();
+        {
+            GM_PROFILE_SCOPE(pass.name);
+            // not the macro: the pass timings need the scope, with or without GM_PROFILER
+            GpuProfileScope gpuScope(pass.name);
+            timer.scopes.push_back(gpuScope.Index());
+            pass.execute(*this);
+        }
+        double cpu = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+        timer.passes.push_back({pass.name, cpu, 0.0});
+    }
+    if (!timers) {
+        m_timings = timer.passes;
+    }
+}
+
+void Gm::FrameGraph::ResolveTimers(TimerFrame &frame) {
+    // a frame the profiler dropped, or one recorded without GPU timers, is never resolved
+    if (frame.gpuFrame == 0 || frame.gpuFrame != Profiler::Instance().ResolvedGpuFrame()) {
+        return;
+    }
+    frame.gpuFrame = 0;
+    for (size_t i = 0; i < frame.passes.size(); ++i) {
+        double microseconds = Profiler::Instance().ResolvedGpuMicroseconds(frame.scopes[i]);
+        frame.passes[i].gpuMicroseconds = std::max(microseconds, 0.0);
+    }
+    m_timings = frame.passes;
+    ++m_resolvedGpuFrames;
+}
+
+void Gm::FrameGraph::Finalize() {
+    for (const Physical &physical : m_physical) {
+        if (physical.object == 0) {
+            continue;
+        }
+        if (physical.kind == Kind::Buffer) {
+            GlState::Current().DeleteBuffers(1, &physical.object);
+        } else {
+            GlState::Current().DeleteTextures(1, &physical.object);
+        }
+    }
+    m_physical.clear();
+    for (TimerFrame &frame : m_timerFrames) {
+        frame = TimerFrame();
+    }
+    m_timings.clear();
+    Reset();
+}
+
+GLuint Gm::FrameGraph::Texture(FrameResource resource) const {
+    const Resource &target = m_resources[resource];
+    if (target.kind != Kind::Texture) {
+        return 0;
+    }
+    return target.imported ? target.object : target.physical >= 0 ? m_physical[target.physical].object : 0;
+}
+
+GLuint Gm::FrameGraph::Buffer(FrameResource resource) const {
+    const Resource &target = m_resources[resource];
+    if (target.kind != Kind::Buffer) {
+        return 0;
+    }
+    return target.imported ? target.object : target.physical >= 0 ? m_physical[target.physical].object : 0;
+}
+
+GLuint Gm::FrameGraph::Framebuffer(FrameResource resource) const {
+    const Resource &target = m_resources[resource];
+    return target.kind == Kind::Framebuffer ? target.object : 0;
+}
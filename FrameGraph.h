@@ -0,0 +1,214 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <vector>
+#include "glad/glad.h"
+#include "Profiler.h"
+
+namespace Gm {
+    // handle of a resource for the frame being built, invalid after the next Reset
+    typedef uint32_t FrameResource;
+
+    // how a pass touches a resource, decides the barriers between passes
+    enum class FrameAccess {
+        // CPU side data, e.g. the software occlusion depth buffer
+        Cpu,
+        // buffer uploads, copies and blits
+        Transfer,
+        ColorTarget,
+        DepthTarget,
+        // texture fetches in a shader
+        Sampled,
+        // shader storage buffers and images, incoherent: readers need a glMemoryBarrier
+        Storage,
+        VertexInput,
+        IndirectInput,
+    };
+
+    struct FrameTextureDesc {
+        int width;
+        int height;
+        GLenum format;
+    };
+
+    struct FramePassTiming {
+        const char *name;
+        double cpuMicroseconds;
+        // the pass's GPU profiler scope, resolved a few frames late; 0 until then or while the profiler is off
+        double gpuMicroseconds;
+    };
+
+    struct FrameGraphStats {
+        size_t passes = 0;
+        size_t culledPasses = 0;
+        size_t barriers = 0;
+        size_t transientResources = 0;
+        // GL objects backing the transient resources after aliasing
+        size_t physicalResources = 0;
+        // what the transient resources would take without aliasing, and what they take with it
+        size_t transientBytes = 0;
+        size_t allocatedBytes = 0;
+    };
+
+    // Rebuilt every frame: passes declare what they read and write, Compile drops the passes nothing depends
+    // on, orders the rest by their dependencies, works out the memory barriers between them and lets
+    // transient resources whose lifetimes don't overlap share one GL object. Execute then runs the passes.
+    //
+    // A read sees the last write declared before it, so declaration order is the tie-break of the schedule.
+    // Writes to imported resources are what the frame is for: those passes are never culled.
+    class FrameGraph {
+    public:
+        class Builder {
+        public:
+            void Read(FrameResource resource, FrameAccess access);
+
+            // a pass drawing over existing contents should Read them as well, or an earlier writer may be culled
+            void Write(FrameResource resource, FrameAccess access);
+
+            // transient texture or buffer, lives from its first to its last use in this frame
+            FrameResource CreateTexture(const char *name, const FrameTextureDesc &desc);
+
+            FrameResource CreateBuffer(const char *name, size_t size);
+
+            // keep the pass even if nothing reads what it writes
+            void SetSideEffect();
+
+        private:
+            friend class FrameGraph;
+
+            Builder(FrameGraph &graph, uint32_t pass) : m_graph(graph), m_pass(pass) {}
+
+            FrameGraph &m_graph;
+            uint32_t m_pass;
+        };
+
+        typedef std::function<void(Builder &builder)> SetupCallback;
+        typedef std::function<void(const FrameGraph &graph)> ExecuteCallback;
+
+        // forget the passes and resources of the previous frame, the transient pool is kept
+        void Reset();
+
+        FrameResource ImportTexture(const char *name, GLuint texture);
+
+        FrameResource ImportBuffer(const char *name, GLuint buffer);
+
+        // a render target owned elsewhere, e.g. the window's framebuffer (0)
+        FrameResource ImportFramebuffer(const char *name, GLuint framebuffer);
+
+        // state living outside of GL that passes hand to each other
+        FrameResource ImportCpu(const char *name);
+
+        // `setup` runs right away, `execute` during Execute if the pass survives Compile
+        void AddPass(const char *name, const SetupCallback &setup, const ExecuteCallback &execute);
+
+        // false if the dependencies have a cycle
+        bool Compile();
+
+        void Execute();
+
+        // release the transient pool
+        void Finalize();
+
+        GLuint Texture(FrameResource resource) const;
+
+        GLuint Buffer(FrameResource resource) const;
+
+        GLuint Framebuffer(FrameResource resource) const;
+
+        const FrameGraphStats &GetStats() const { return m_stats; }
+
+        // passes of the last frame whose GPU times are resolved, in execution order
+        const std::vector<FramePassTiming> &GetTimings() const { return m_timings; }
+
+        // frames whose GPU times were resolved so far, GetTimings holds a new one whenever this changes
+        uint64_t ResolvedGpuFrames() const { return m_resolvedGpuFrames; }
+
+    private:
+        enum class Kind {
+            Texture,
+            Buffer,
+            Framebuffer,
+            Cpu,
+        };
+
+        struct Resource {
+            const char *name;
+            Kind kind;
+            bool imported;
+            GLuint object;
+            FrameTextureDesc desc;
+            size_t size;
+            // declaration state, the pass that wrote last (or -1) and the passes reading that write
+            int lastWriter;
+            FrameAccess lastWriteAccess;
+            std::vector<uint32_t> readers;
+            // execution state of transients: first and last position in the schedule, backing object
+            int firstUse;
+            int lastUse;
+            int physical;
+        };
+
+        struct Use {
+            FrameResource resource;
+            FrameAccess access;
+            // pass whose write a read sees, -1 for what the resource held when the frame began
+            int producer;
+            FrameAccess producerAccess;
+        };
+
+        struct Pass {
+            const char *name;
+            ExecuteCallback execute;
+            std::vector<Use> reads;
+            std::vector<Use> writes;
+            std::vector<uint32_t> dependencies;
+            bool sideEffect;
+            bool alive;
+            GLbitfield barriers;
+        };
+
+        // GL object a transient can be placed in, reused across frames
+        struct Physical {
+            Kind kind;
+            FrameTextureDesc desc;
+            size_t size;
+            GLuint object;
+            bool inUse;
+        };
+
+        struct TimerFrame {
+            // Profiler::CurrentGpuFrame of the Execute, 0 once resolved
+            uint64_t gpuFrame = 0;
+            std::vector<FramePassTiming> passes;
+            // the profiler's GPU scope of every pass
+            std::vector<int> scopes;
+        };
+
+        FrameResource AddResource(const char *name, Kind kind, bool imported, GLuint object);
+
+        bool Schedule();
+
+        void AllocateTransients();
+
+        int AcquirePhysical(const Resource &resource);
+
+        void ResolveTimers(TimerFrame &frame);
+
+        std::vector<Resource> m_resources;
+        std::vector<Pass> m_passes;
+        std::vector<uint32_t> m_order;
+        bool m_compiled = false;
+
+        std::vector<Physical> m_physical;
+
+        // the passes of the frames the profiler hasn't read back yet, by their profiler frame
+        static const int TimerFrames = Profiler::GpuFrames;
+        TimerFrame m_timerFrames[TimerFrames];
+        std::vector<FramePassTiming> m_timings;
+        uint64_t m_resolvedGpuFrames = 0;
+
+        FrameGraphStats m_stats;
+    };
+}
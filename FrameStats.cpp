@@ -0,0 +1,244 @@
+#include <algorithm>
+#include <cmath>
+#include "Clock.h"
+#include "FrameStats.h"
+
+namespace {
+    int Log2Floor(uint64_t value) {
+        int log = 0;
+        while (value >>= 1) {
+            ++log;
+        }
+        return log;
+    }
+
+    // nearest rank, as the histogram counts it
+    size_t Rank(double percentile, size_t count) {
+        double rank = std::ceil(std::min(std::max(percentile, 0.0), 100.0) / 100.0 * count);
+        return (size_t) std::max(rank, 1.0) - 1;
+    }
+
+    const char *SeriesName(int series) {
+        return series == (int) Gm::FrameSeries::Cpu ? "cpu" : "gpu";
+    }
+
+    void WriteCsvRow(FILE *file, double time, const char *series, const char *scope,
+                     const Gm::FrameTimeSummary &summary) {
+        fprintf(file, "%.3f,%s,%s,%llu,%.3f,%.3f,%.3f,%.3f,%.3f,%llu\n", time, series, scope,
+                (unsigned long long) summary.frames, summary.mean, summary.p50, summary.p95, summary.p99,
+                summary.max, (unsigned long long) summary.hitches);
+    }
+
+    void WriteJsonSummary(FILE *file, const char *scope, const Gm::FrameTimeSummary &summary) {
+        fprintf(file, "\"%s\":{\"frames\":%llu,\"mean\":%.3f,\"p50\":%.3f,\"p95\":%.3f,\"p99\":%.3f,\"max\":%.3f,"
+                      "\"hitches\":%llu}", scope, (unsigned long long) summary.frames, summary.mean, summary.p50,
+                summary.p95, summary.p99, summary.max, (unsigned long long) summary.hitches);
+    }
+}
+
+const uint64_t Gm::FrameTimeHistogram::MaxMicroseconds;
+
+size_t Gm::FrameTimeHistogram::Index(uint64_t value) {
+    // values below SubBucketCount land in bucket 0 one to one, every bucket after doubles the range and halves
+    // the resolution, and only its upper half is new
+    int bucket = Log2Floor(value | (SubBucketCount - 1)) + 1 - (SubBucketHalfMagnitude + 1);
+    uint64_t subBucket = value >> bucket;
+    return ((size_t) (bucket + 1) << SubBucketHalfMagnitude) + (size_t) (subBucket - SubBucketHalfCount);
+}
+
+uint64_t Gm::FrameTimeHistogram::HighestValueAt(size_t index) {
+    int bucket = (int) (index >> SubBucketHalfMagnitude) - 1;
+    uint64_t subBucket = (index & (SubBucketHalfCount - 1)) + SubBucketHalfCount;
+    if (bucket < 0) {
+        subBucket -= SubBucketHalfCount;
+        bucket = 0;
+    }
+    return (subBucket << bucket) + (1ull << bucket) - 1;
+}
+
+void Gm::FrameTimeHistogram::Record(uint64_t microseconds) {
+    microseconds = std::min(microseconds, MaxMicroseconds);
+    ++m_counts[Index(microseconds)];
+    ++m_count;
+    m_sum += microseconds;
+    m_max = std::max(m_max, microseconds);
+}
+
+void Gm::FrameTimeHistogram::Reset() {
+    std::fill(m_counts, m_counts + CountsLength, 0u);
+    m_count = 0;
+    m_sum = 0;
+    m_max = 0;
+}
+
+uint64_t Gm::FrameTimeHistogram::ValueAtPercentile(double percentile) const {
+    if (m_count == 0) {
+        return 0;
+    }
+    uint64_t rank = Rank(percentile, (size_t) m_count);
+    uint64_t seen = 0;
+    for (size_t i = 0; i < CountsLength; ++i) {
+        seen += m_counts[i];
+        if (seen > rank) {
+            // the top of the bucket, but never above what was recorded
+            return std::min(HighestValueAt(i), m_max);
+        }
+    }
+    return m_max;
+}
+
+uint64_t Gm::FrameTimeHistogram::CountAbove(uint64_t microseconds) const {
+    if (microseconds >= MaxMicroseconds) {
+        return 0;
+    }
+    // the bucket of `microseconds` may hold values on both sides of it, it counts as not above
+    uint64_t above = 0;
+    for (size_t i = Index(microseconds) + 1; i < CountsLength; ++i) {
+        above += m_counts[i];
+    }
+    return above;
+}
+
+Gm::FrameStats::FrameStats(const FrameStatsOptions &options) {
+    SetOptions(options);
+}
+
+Gm::FrameStats::~FrameStats() {
+    StopDumping();
+}
+
+void Gm::FrameStats::SetOptions(const FrameStatsOptions &options) {
+    m_options = options;
+    m_options.windowFrames = std::max<size_t>(m_options.windowFrames, 1);
+    for (Series &series : m_series) {
+        series.window.assign(m_options.windowFrames, 0.0f);
+    }
+    m_scratch.resize(m_options.windowFrames);
+    Reset();
+}
+
+void Gm::FrameStats::Record(FrameSeries which, double milliseconds) {
+    Series &series = Get(which);
+    milliseconds = std::max(milliseconds, 0.0);
+    series.histogram.Record((uint64_t) (milliseconds * 1000.0 + 0.5));
+    if (milliseconds > m_options.hitchMilliseconds) {
+        ++series.hitches;
+    }
+    series.window[series.windowNext] = (float) milliseconds;
+    series.windowNext = (series.windowNext + 1) % series.window.size();
+    series.windowCount = std::min(series.windowCount + 1, series.window.size());
+
+    if (which == FrameSeries::Cpu && m_dumpFile != nullptr) {
+        double now = Clock::Now();
+        if (now >= m_nextDump) {
+            Dump();
+            m_nextDump += m_dumpInterval;
+            // after a stall, one dump and not one per interval missed
+            if (m_nextDump <= now) {
+                m_nextDump = now + m_dumpInterval;
+            }
+        }
+    }
+}
+
+Gm::FrameTimeSummary Gm::FrameStats::Summary(FrameSeries which) const {
+    const Series &series = Get(which);
+    const FrameTimeHistogram &histogram = series.histogram;
+    FrameTimeSummary summary;
+    summary.frames = histogram.Count();
+    summary.mean = histogram.Mean() / 1000.0;
+    summary.p50 = histogram.ValueAtPercentile(50.0) / 1000.0;
+    summary.p95 = histogram.ValueAtPercentile(95.0) / 1000.0;
+    summary.p99 = histogram.ValueAtPercentile(99.0) / 1000.0;
+    summary.max = histogram.Max() / 1000.0;
+    summary.hitches = series.hitches;
+    return summary;
+}
+
+Gm::FrameTimeSummary Gm::FrameStats::WindowSummary(FrameSeries which) const {
+    const Series &series = Get(which);
+    FrameTimeSummary summary;
+    size_t count = series.windowCount;
+    if (count == 0) {
+        return summary;
+    }
+    // until the ring wraps the frames are its first `count` entries, after that all of them
+    std::copy(series.window.begin(), series.window.begin() + count, m_scratch.begin());
+    std::sort(m_scratch.begin(), m_scratch.begin() + count);
+    double sum = 0.0;
+    for (size_t i = 0; i < count; ++i) {
+        sum += m_scratch[i];
+        summary.hitches += m_scratch[i] > m_options.hitchMilliseconds ? 1 : 0;
+    }
+    summary.frames = count;
+    summary.mean = sum / count;
+    summary.p50 = m_scratch[Rank(50.0, count)];
+    summary.p95 = m_scratch[Rank(95.0, count)];
+    summary.p99 = m_scratch[Rank(99.0, count)];
+    summary.max = m_scratch[count - 1];
+    return summary;
+}
+
+const Gm::FrameTimeHistogram &Gm::FrameStats::Histogram(FrameSeries series) const {
+    return Get(series).histogram;
+}
+
+void Gm::FrameStats::Reset() {
+    for (Series &series : m_series) {
+        series.histogram.Reset();
+        series.hitches = 0;
+        series.windowNext = 0;
+        series.windowCount = 0;
+    }
+}
+
+bool Gm::FrameStats::StartDumping(const char *path, FrameStatsFormat format, double intervalSeconds) {
+    StopDumping();
+    m_dumpFile = fopen(path, "a");
+    if (m_dumpFile == nullptr) {
+        fprintf(stderr, "can't write %s\n", path);
+        return false;
+    }
+    m_dumpFormat = format;
+    m_dumpInterval = std::max(intervalSeconds, 0.001);
+    m_dumpStart = Clock::Now();
+    m_nextDump = m_dumpStart + m_dumpInterval;
+    // a new file gets the column names, appending to an old one continues its table
+    fseek(m_dumpFile, 0, SEEK_END);
+    if (format == FrameStatsFormat::Csv && ftell(m_dumpFile) == 0) {
+        fprintf(m_dumpFile, "time_s,series,scope,frames,mean_ms,p50_ms,p95_ms,p99_ms,max_ms,hitches\n");
+    }
+    return true;
+}
+
+void Gm::FrameStats::StopDumping() {
+    if (m_dumpFile != nullptr) {
+        fclose(m_dumpFile);
+        m_dumpFile = nullptr;
+    }
+}
+
+bool Gm::FrameStats::Dump() {
+    if (m_dumpFile == nullptr) {
+        return false;
+    }
+    double time = Clock::Now() - m_dumpStart;
+    if (m_dumpFormat == FrameStatsFormat::Csv) {
+        for (int series = 0; series < 2; ++series) {
+            WriteCsvRow(m_dumpFile, time, SeriesName(series), "total", Summary((FrameSeries) series));
+            WriteCsvRow(m_dumpFile, time, SeriesName(series), "window", WindowSummary((FrameSeries) series));
+        }
+    } else {
+        fprintf(m_dumpFile, "{\"time_s\":%.3f,\"hitch_ms\":%.3f", time, m_options.hitchMilliseconds);
+        for (int series = 0; series < 2; ++series) {
+            fprintf(m_dumpFile, ",\"%s\":{", SeriesName(series));
+            WriteJsonSummary(m_dumpFile, "total", Summary((FrameSeries) series));
+            fprintf(m_dumpFile, ",");
+            WriteJsonSummary(m_dumpFile, "window", WindowSummary((FrameSeries) series));
+            fprintf(m_dumpFile, "}");
+        }
+        fprintf(m_dumpFile, "}\n");
+    }
+    // readable while the app is still running
+    return fflush(m_dumpFile) == 0 && !ferror(m_dumpFile);
+}
@@ -0,0 +1,149 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+
+namespace Gm {
+    // Frame times in microseconds, counted into log-linear buckets the way HdrHistogram does: every power of two
+    // range is split into 128 buckets, so a value comes back within 1/128 (0.8%) of what was recorded whatever
+    // its magnitude. The counts are a fixed array, recording never allocates.
+    class FrameTimeHistogram {
+    public:
+        // about 67 seconds, longer frames count as this
+        static const uint64_t MaxMicroseconds = (1ull << 26) - 1;
+
+        void Record(uint64_t microseconds);
+
+        void Reset();
+
+        uint64_t Count() const { return m_count; }
+
+        uint64_t Max() const { return m_max; }
+
+        double Mean() const { return m_count ? (double) m_sum / m_count : 0.0; }
+
+        // the smallest value at or below which `percentile` percent of the frames are, 0 when empty
+        uint64_t ValueAtPercentile(double percentile) const;
+
+        // the number of frames recorded as more than `microseconds`
+        uint64_t CountAbove(uint64_t microseconds) const;
+
+    private:
+        static const int SubBucketHalfMagnitude = 7;
+        static const uint64_t SubBucketHalfCount = 1ull << SubBucketHalfMagnitude;
+        static const uint64_t SubBucketCount = SubBucketHalfCount * 2;
+        // (26 bits - log2(SubBucketCount) + 2) half sized bucket runs
+        static const size_t CountsLength = (26 - SubBucketHalfMagnitude - 1 + 2) * SubBucketHalfCount;
+
+        static size_t Index(uint64_t value);
+
+        // the largest value that counts into `index`
+        static uint64_t HighestValueAt(size_t index);
+
+        uint32_t m_counts[CountsLength] = {};
+        uint64_t m_count = 0;
+        uint64_t m_sum = 0;
+        uint64_t m_max = 0;
+    };
+
+    enum class FrameSeries {
+        // Draw on the calling thread
+        Cpu,
+        // the frame graph's passes on the GPU, resolved a few frames late
+        Gpu,
+    };
+
+    enum class FrameStatsFormat {
+        // a header, then one row per series and scope at every dump
+        Csv,
+        // one JSON object per line at every dump
+        Json,
+    };
+
+    // in milliseconds
+    struct FrameTimeSummary {
+        uint64_t frames = 0;
+        double mean = 0.0;
+        double p50 = 0.0;
+        double p95 = 0.0;
+        double p99 = 0.0;
+        double max = 0.0;
+        // frames slower than FrameStatsOptions::hitchMilliseconds
+        uint64_t hitches = 0;
+    };
+
+    struct FrameStatsOptions {
+        double hitchMilliseconds = 1000.0 / 30.0;
+        // the rolling window covers this many of the last frames of each series
+        size_t windowFrames = 300;
+    };
+
+    // Every frame's CPU and GPU time, summed up as percentiles rather than an average that hides the hitches:
+    // a histogram since the last Reset and an exact rolling window of the last frames. Recording costs a few
+    // array writes and no allocation; the window storage is allocated up front and the dump file stays open.
+    // Not thread safe, record from the thread that draws.
+    class FrameStats {
+    public:
+        explicit FrameStats(const FrameStatsOptions &options = FrameStatsOptions());
+
+        ~FrameStats();
+
+        FrameStats(const FrameStats &) = delete;
+
+        FrameStats &operator=(const FrameStats &) = delete;
+
+        // resizes the windows, allocates, and clears everything recorded
+        void SetOptions(const FrameStatsOptions &options);
+
+        const FrameStatsOptions &GetOptions() const { return m_options; }
+
+        // a CPU frame also checks whether a periodic dump is due
+        void Record(FrameSeries series, double milliseconds);
+
+        // since the last Reset
+        FrameTimeSummary Summary(FrameSeries series) const;
+
+        // over the last windowFrames frames
+        FrameTimeSummary WindowSummary(FrameSeries series) const;
+
+        const FrameTimeHistogram &Histogram(FrameSeries series) const;
+
+        void Reset();
+
+        // append both summaries of both series to `path` every `intervalSeconds` from now on, checked as CPU
+        // frames are recorded; false if the file can't be opened
+        bool StartDumping(const char *path, FrameStatsFormat format, double intervalSeconds);
+
+        void StopDumping();
+
+        // a dump right now, false without a file or when the write fails
+        bool Dump();
+
+    private:
+        struct Series {
+            FrameTimeHistogram histogram;
+            uint64_t hitches = 0;
+            // milliseconds, a ring of the last windowFrames frames
+            std::vector<float> window;
+            size_t windowNext = 0;
+            size_t windowCount = 0;
+        };
+
+        Series &Get(FrameSeries series) { return m_series[(int) series]; }
+
+        const Series &Get(FrameSeries series) const { return m_series[(int) series]; }
+
+        FrameStatsOptions m_options;
+        Series m_series[2];
+        // sorted copies of a window, sized with it
+        mutable std::vector<float> m_scratch;
+
+        FILE *m_dumpFile = nullptr;
+        FrameStatsFormat m_dumpFormat = FrameStatsFormat::Csv;
+        double m_dumpInterval = 0.0;
+        double m_nextDump = 0.0;
+        double m_dumpStart = 0.0;
+    };
+}
@@ -0,0 +1,186 @@
+#include <chrono>
+#include "CpuFeatures.h"
+#include "FrustumCulling.h"
+
+#if GM_SIMD_X86
+#include <immintrin.h>
+#elif GM_SIMD_NEON
+#include <arm_neon.h>
+#endif
+
+Gm::Frustum Gm::ExtractFrustumPlanes(const Eigen::Matrix4f &matrix) {
+    Frustum frustum;
+    Eigen::Vector4f row0 = matrix.row(0), row1 = matrix.row(1), row2 = matrix.row(2), row3 = matrix.row(3);
+    frustum.planes[0] = row3 + row0;
+    frustum.planes[1] = row3 - row0;
+    frustum.planes[2] = row3 + row1;
+    frustum.planes[3] = row3 - row1;
+    // OpenGL clips z against [-w, w], which is what actually gets rasterized
+    frustum.planes[4] = row3 + row2;
+    frustum.planes[5] = row3 - row2;
+    // normalize so the plane distance can be compared with a sphere radius
+    for (Eigen::Vector4f &plane : frustum.planes) {
+        plane /= plane.head<3>().norm();
+    }
+    return frustum;
+}
+
+namespace {
+    inline bool SphereVisible(const Gm::Frustum &frustum, float x, float y, float z, float radius) {
+        for (const Eigen::Vector4f &plane : frustum.planes) {
+            if (plane[0] * x + plane[1] * y + plane[2] * z + plane[3] < -radius) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    void CullRangeScalar(const Gm::Frustum &frustum, const Gm::BoundingSpheres &spheres, size_t begin, size_t end,
+                         std::vector<uint32_t> &visible) {
+        for (size_t i = begin; i < end; ++i) {
+            if (SphereVisible(frustum, spheres.x[i], spheres.y[i], spheres.z[i], spheres.radius[i])) {
+                visible.push_back((uint32_t) i);
+            }
+        }
+    }
+
+#if GM_SIMD_X86
+    // `visible` has room for 8 extra entries, every lane is written and only the visible ones are kept.
+    GM_TARGET_AVX2
+    size_t CullAvx2(const Gm::Frustum &frustum, const Gm::BoundingSpheres &spheres, uint32_t *visible) {
+        // compaction table: for each 8 bit mask, the lanes whose bit is set, packed to the front
+        static uint32_t s_compact[256][8];
+        static bool s_initialized = [] {
+            for (int mask = 0; mask < 256; ++mask) {
+                int count = 0;
+                for (int lane = 0; lane < 8; ++lane) {
+                    if (mask & (1 << lane)) {
+                        s_compact[mask][count++] = (uint32_t) lane;
+                    }
+                }
+            }
+            return true;
+        }();
+        (void) s_initialized;
+
+        __m256 planeX[6], planeY[6], planeZ[6], planeW[6];
+        for (int p = 0; p < 6; ++p) {
+            planeX[p] = _mm256_set1_ps(frustum.planes[p][0]);
+            planeY[p] = _mm256_set1_ps(frustum.planes[p][1]);
+            planeZ[p] = _mm256_set1_ps(frustum.planes[p][2]);
+            planeW[p] = _mm256_set1_ps(frustum.planes[p][3]);
+        }
+        const __m256i laneOffsets = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+
+        size_t count = spheres.Size() & ~(size_t) 7, written = 0;
+        for (size_t i = 0; i < count; i += 8) {
+            __m256 x = _mm256_loadu_ps(&spheres.x[i]);
+            __m256 y = _mm256_loadu_ps(&spheres.y[i]);
+            __m256 z = _mm256_loadu_ps(&spheres.z[i]);
+            __m256 negativeRadius = _mm256_sub_ps(_mm256_setzero_ps(), _mm256_loadu_ps(&spheres.radius[i]));
+            __m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+            for (int p = 0; p < 6; ++p) {
+                __m256 distance = _mm256_fmadd_ps(planeX[p], x, planeW[p]);
+                distance = _mm256_fmadd_ps(planeY[p], y, distance);
+                distance = _mm256_fmadd_ps(planeZ[p], z, distance);
+                inside = _mm256_and_ps(inside, _mm256_cmp_ps(distance, negativeRadius, _CMP_GE_OQ));
+            }
+            int mask = _mm256_movemask_ps(inside);
+            __m256i lanes = _mm256_loadu_si256((const __m256i *) s_compact[mask]);
+            __m256i indices = _mm256_add_epi32(_mm256_permutevar8x32_epi32(laneOffsets, lanes),
+                                               _mm256_set1_epi32((int) i));
+            _mm256_storeu_si256((__m256i *) (visible + written), indices);
+            written += __builtin_popcount((unsigned) mask);
+        }
+        return written;
+    }
+
+    void CullSse(const Gm::Frustum &frustum, const Gm::BoundingSpheres &spheres, std::vector<uint32_t> &visible) {
+        __m128 planeX[6], planeY[6], planeZ[6], planeW[6];
+        for (int p = 0; p < 6; ++p) {
+            planeX[p] = _mm_set1_ps(frustum.planes[p][0]);
+            planeY[p] = _mm_set1_ps(frustum.planes[p][1]);
+            planeZ[p] = _mm_set1_ps(frustum.planes[p][2]);
+            planeW[p] = _mm_set1_ps(frustum.planes[p][3]);
+        }
+        size_t count = spheres.Size() & ~(size_t) 3;
+        for (size_t i = 0; i < count; i += 4) {
+            __m128 x = _mm_loadu_ps(&spheres.x[i]);
+            __m128 y = _mm_loadu_ps(&spheres.y[i]);
+            __m128 z = _mm_loadu_ps(&spheres.z[i]);
+            __m128 negativeRadius = _mm_sub_ps(_mm_setzero_ps(), _mm_loadu_ps(&spheres.radius[i]));
+            __m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+            for (int p = 0; p < 6; ++p) {
+                __m128 distance = _mm_add_ps(_mm_mul_ps(planeX[p], x), planeW[p]);
+                distance = _mm_add_ps(_mm_mul_ps(planeY[p], y), distance);
+                distance = _mm_add_ps(_mm_mul_ps(planeZ[p], z), distance);
+                inside = _mm_and_ps(inside, _mm_cmpge_ps(distance, negativeRadius));
+            }
+            int mask = _mm_movemask_ps(inside);
+            while (mask != 0) {
+                visible.push_back((uint32_t) (i + __builtin_ctz(mask)));
+                mask &= mask - 1;
+            }
+        }
+        CullRangeScalar(frustum, spheres, count, spheres.Size(), visible);
+    }
+#elif GM_SIMD_NEON
+    void CullNeon(const Gm::Frustum &frustum, const Gm::BoundingSpheres &spheres, std::vector<uint32_t> &visible) {
+        size_t count = spheres.Size() & ~(size_t) 3;
+        for (size_t i = 0; i < count; i += 4) {
+            float32x4_t x = vld1q_f32(&spheres.x[i]);
+            float32x4_t y = vld1q_f32(&spheres.y[i]);
+            float32x4_t z = vld1q_f32(&spheres.z[i]);
+            float32x4_t negativeRadius = vnegq_f32(vld1q_f32(&spheres.radius[i]));
+            uint32x4_t inside = vdupq_n_u32(0xffffffffu);
+            for (int p = 0; p < 6; ++p) {
+                float32x4_t distance = vmlaq_n_f32(vdupq_n_f32(frustum.planes[p][3]), x, frustum.planes[p][0]);
+                distance = vmlaq_n_f32(distance, y, frustum.planes[p][1]);
+                distance = vmlaq_n_f32(distance, z, frustum.planes[p][2]);
+                inside = vandq_u32(inside, vcgeq_f32(distance, negativeRadius));
+            }
+            uint32_t lanes[4];
+            vst1q_u32(lanes, inside);
+            for (uint32_t lane = 0; lane < 4; ++lane) {
+                if (lanes[lane] != 0) {
+                    visible.push_back((uint32_t) i + lane);
+                }
+            }
+        }
+        CullRangeScalar(frustum, spheres, count, spheres.Size(), visible);
+    }
+#endif
+}
+
+void Gm::CullSpheresScalar(const Frustum &frustum, const BoundingSpheres &spheres, std::vector<uint32_t> &visible) {
+    CullRangeScalar(frustum, spheres, 0, spheres.Size(), visible);
+}
+
+void Gm::CullSpheres(const Frustum &frustum, const BoundingSpheres &spheres, std::vector<uint32_t> &visible,
+                     CullStats *stats) {
+    auto start = std::chrono::steady_clock::now();
+    size_t before = visible.size();
+#if GM_SIMD_X86
+    if (Cpu::HasAvx2()) {
+        // the kernel stores whole 8 lane groups, leave room for the last one
+        visible.resize(before + spheres.Size() + 8);
+        size_t written = CullAvx2(frustum, spheres, visible.data() + before);
+        visible.resize(before + written);
+        CullRangeScalar(frustum, spheres, spheres.Size() & ~(size_t) 7, spheres.Size(), visible);
+    } else {
+        CullSse(frustum, spheres, visible);
+    }
+#elif GM_SIMD_NEON
+    CullNeon(frustum, spheres, visible);
+#else
+    CullRangeScalar(frustum, spheres, 0, spheres.Size(), visible);
+#endif
+    if (stats != nullptr) {
+        size_t visibleCount = visible.size() - before;
+        stats->tested += spheres.Size();
+        stats->visible += visibleCount;
+        stats->culled += spheres.Size() - visibleCount;
+        stats->microseconds += std::chrono::duration<double, std::micro>(
+                std::chrono::steady_clock::now() - start).count();
+    }
+}
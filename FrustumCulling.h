@@ -0,0 +1,46 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include "Eigen/Core"
+
+namespace Gm {
+    // Six planes (a, b, c, d) with a * x + b * y + c * z + d >= 0 on the inside,
+    // ordered left, right, bottom, top, near, far.
+    struct Frustum {
+        Eigen::Vector4f planes[6];
+    };
+
+    // Gribb/Hartmann extraction from a column-vector matrix (clip = matrix * position),
+    // e.g. m_projectionMatrix * m_viewMatrix. Planes live in the space the matrix consumes.
+    Frustum ExtractFrustumPlanes(const Eigen::Matrix4f &matrix);
+
+    // Bounding spheres as structure of arrays so the kernels load 4 or 8 of them at once.
+    struct BoundingSpheres {
+        std::vector<float> x, y, z, radius;
+
+        void Resize(size_t count) {
+            x.resize(count);
+            y.resize(count);
+            z.resize(count);
+            radius.resize(count);
+        }
+
+        size_t Size() const { return x.size(); }
+    };
+
+    struct CullStats {
+        size_t tested = 0;
+        size_t visible = 0;
+        size_t culled = 0;
+        double microseconds = 0.0;
+    };
+
+    // Appends the indices of the spheres intersecting the frustum to `visible`, in ascending order.
+    // Uses AVX2 (8 spheres per step), SSE2 or NEON (4) when available, scalar otherwise.
+    void CullSpheres(const Frustum &frustum, const BoundingSpheres &spheres, std::vector<uint32_t> &visible,
+                     CullStats *stats = nullptr);
+
+    // Same as CullSpheres without SIMD, the reference the vector kernels must match.
+    void CullSpheresScalar(const Frustum &frustum, const BoundingSpheres &spheres, std::vector<uint32_t> &visible);
+}
@@ -0,0 +1,71 @@
+#include <algorithm>
+#include "GeometryArena.h"
+#include "GlState.h"
+
+Gm::MeshId Gm::GeometryArena::AddMesh(const VertexType *vertices, size_t vertexCount, const uint32_t *indices,
+                                      size_t indexCount) {
+    MeshRange range;
+    range.firstIndex = (GLuint) m_indices.size();
+    range.indexCount = (GLuint) indexCount;
+    range.baseVertex = (GLint) m_vertices.size();
+
+    m_vertices.insert(m_vertices.end(), vertices, vertices + vertexCount);
+    m_indices.insert(m_indices.end(), indices, indices + indexCount);
+    m_ranges.push_back(range);
+
+    // sphere around the center of the bounding box, good enough for culling
+    Eigen::Vector3f minimum = Eigen::Vector3f::Constant(0.0f), maximum = Eigen::Vector3f::Constant(0.0f);
+    for (size_t i = 0; i < vertexCount; ++i) {
+        minimum = i == 0 ? vertices[i].position : minimum.cwiseMin(vertices[i].position);
+        maximum = i == 0 ? vertices[i].position : maximum.cwiseMax(vertices[i].position);
+    }
+    Eigen::Vector3f center = (minimum + maximum) * 0.5f;
+    float radius = 0.0f;
+    for (size_t i = 0; i < vertexCount; ++i) {
+        radius = std::max(radius, (vertices[i].position - center).norm());
+    }
+    m_boundingSpheres.push_back(Eigen::Vector4f(center[0], center[1], center[2], radius));
+    m_dirty = true;
+    return (MeshId) (m_ranges.size() - 1);
+}
+
+Gm::MeshId Gm::GeometryArena::AddMesh(const VertexType *vertices, size_t vertexCount, const uint16_t *indices,
+                                      size_t indexCount) {
+    std::vector<uint32_t> wideIndices(indices, indices + indexCount);
+    return AddMesh(vertices, vertexCount, wideIndices.data(), wideIndices.size());
+}
+
+void Gm::GeometryArena::Upload() {
+    if (m_buffers[0] == 0) {
+        glGenBuffers(2, m_buffers);
+    }
+
+    // Bind the vertex buffer as being the **active** buffer and storing vertex attributes (coordinates)
+    GlState::Current().BindBuffer(GL_ARRAY_BUFFER, m_buffers[0]);
+    if (m_dirty) {
+        glBufferData(GL_ARRAY_BUFFER, m_vertices.size() * sizeof(VertexType), m_vertices.data(), GL_STATIC_DRAW);
+    }
+
+    // Specify that our coordinate data is going into attribute index 0, and contains three floats per vertex
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(VertexType), 0);
+    // offset to color portion
+    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(VertexType), (float *) NULL + 3);
+    glEnableVertexAttribArray(0);
+    glEnableVertexAttribArray(1);
+
+    // The element buffer binding is part of the VAO state
+    GlState::Current().BindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_buffers[1]);
+    if (m_dirty) {
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, m_indices.size() * sizeof(uint32_t), m_indices.data(),
+                     GL_STATIC_DRAW);
+    }
+    m_dirty = false;
+}
+
+void Gm::GeometryArena::Finalize() {
+    if (m_buffers[0] != 0) {
+        GlState::Current().DeleteBuffers(2, m_buffers);
+        m_buffers[0] = m_buffers[1] = 0;
+    }
+    m_dirty = true;
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include "glad/glad.h"
+#include "Eigen/Core"
+
+namespace Gm {
+    struct VertexType {
+        Eigen::Vector3f position;
+        Eigen::Vector3f color;
+    };
+
+    // where a mesh lives inside the arena, in the units glDrawElements*BaseVertex expects
+    struct MeshRange {
+        GLuint firstIndex;
+        GLuint indexCount;
+        GLint baseVertex;
+    };
+
+    typedef uint32_t MeshId;
+
+    // All meshes share one vertex buffer and one index buffer, so switching meshes
+    // never needs a buffer bind and many meshes can be drawn with one indirect call.
+    class GeometryArena {
+    public:
+        MeshId AddMesh(const VertexType *vertices, size_t vertexCount, const uint32_t *indices, size_t indexCount);
+
+        MeshId AddMesh(const VertexType *vertices, size_t vertexCount, const uint16_t *indices, size_t indexCount);
+
+        const MeshRange &Range(MeshId mesh) const { return m_ranges[mesh]; }
+
+        // object space bounding sphere of a mesh, center in xyz and radius in w
+        const Eigen::Vector4f &BoundingSphere(MeshId mesh) const { return m_boundingSpheres[mesh]; }
+
+        size_t MeshCount() const { return m_ranges.size(); }
+
+        // CPU copies of the buffers, kept for picking
+        const std::vector<VertexType> &Vertices() const { return m_vertices; }
+
+        const std::vector<uint32_t> &Indices() const { return m_indices; }
+
+        // create the GL buffers (if needed), upload pending meshes and point attributes 0 and 1
+        // of the currently bound VAO at them
+        void Upload();
+
+        void Finalize();
+
+        // indices are always 32 bit so any mesh fits
+        static const GLenum IndexType = GL_UNSIGNED_INT;
+
+    private:
+        std::vector<VertexType> m_vertices;
+        std::vector<uint32_t> m_indices;
+        std::vector<MeshRange> m_ranges;
+        std::vector<Eigen::Vector4f, Eigen::aligned_allocator<Eigen::Vector4f>> m_boundingSpheres;
+
+        // handles for Vertex Buffer Object: vertices and indices
+        GLuint m_buffers[2] = {0, 0};
+        bool m_dirty = true;
+    };
+}
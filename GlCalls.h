@@ -0,0 +1,34 @@
+#pragma once
+
+// Every GL entry point the engine calls: GlLoader looks these up front when it loads lazily, GlTrace captures
+// the first list. New code calling a GL function the engine didn't use before adds it to one of them.
+//
+// SCALAR calls take values only (offsets into bound buffers count as values) and are captured and replayed
+// generically, NAMED ones also, but their object names and locations are mapped on replay, or their output
+// pointers replaced. DATA calls point at data of their own or return something, they have a wrapper and a
+// replay case of their own. The position in the list is the op code in a trace: add new calls at the end.
+#define GM_GL_CALLS(SCALAR, NAMED, DATA)                                                                       \
+    SCALAR(ActiveTexture) NAMED(AttachShader) NAMED(BeginQuery) NAMED(BindBuffer) NAMED(BindBufferBase)        \
+    NAMED(BindFramebuffer) NAMED(BindImageTexture) NAMED(BindRenderbuffer) NAMED(BindTexture)                  \
+    NAMED(BindVertexArray) DATA(BindAttribLocation) SCALAR(BlendFunc) SCALAR(BlitFramebuffer) DATA(BufferData) \
+    DATA(BufferSubData) SCALAR(CheckFramebufferStatus) SCALAR(Clear) SCALAR(ClearColor) SCALAR(ClearDepth)     \
+    NAMED(CompileShader) DATA(CompressedTexImage2D) DATA(CompressedTexImage3D) DATA(CreateProgram)            \
+    DATA(CreateShader) SCALAR(CullFace) DATA(DeleteBuffers) DATA(DeleteFramebuffers) NAMED(DeleteProgram)      \
+    DATA(DeleteQueries) DATA(DeleteRenderbuffers) NAMED(DeleteShader) DATA(DeleteTextures)                     \
+    DATA(DeleteVertexArrays) SCALAR(DepthFunc) SCALAR(DepthMask) SCALAR(Disable)                               \
+    SCALAR(DisableVertexAttribArray) SCALAR(DispatchCompute) SCALAR(DrawBuffer) SCALAR(DrawElementsInstanced)  \
+    SCALAR(DrawElementsInstancedBaseVertex) SCALAR(DrawElementsInstancedBaseVertexBaseInstance) SCALAR(Enable) \
+    SCALAR(EnableVertexAttribArray) SCALAR(EndQuery) SCALAR(Finish) SCALAR(Flush)                              \
+    NAMED(FramebufferRenderbuffer) NAMED(FramebufferTexture2D) SCALAR(FrontFace) DATA(GenBuffers)              \
+    DATA(GenFramebuffers) DATA(GenQueries) DATA(GenRenderbuffers) DATA(GenTextures) DATA(GenVertexArrays)      \
+    NAMED(GetFramebufferAttachmentParameteriv) NAMED(GetInteger64v) NAMED(GetIntegerv)                         \
+    NAMED(GetProgramInfoLog) NAMED(GetProgramiv) NAMED(GetQueryObjectiv) NAMED(GetQueryObjectui64v)            \
+    NAMED(GetShaderInfoLog) NAMED(GetShaderiv) DATA(GetUniformLocation) NAMED(LinkProgram)                     \
+    SCALAR(MemoryBarrier) DATA(MultiDrawElementsBaseVertex) SCALAR(MultiDrawElementsIndirect)                  \
+    NAMED(QueryCounter) SCALAR(RenderbufferStorage) DATA(ShaderSource) NAMED(TexBuffer) DATA(TexImage2D)       \
+    DATA(TexImage3D) SCALAR(TexParameteri) SCALAR(TexStorage2D) NAMED(Uniform1i) NAMED(Uniform1ui)             \
+    NAMED(Uniform2i) DATA(Uniform4fv) DATA(UniformMatrix4fv) NAMED(UseProgram) SCALAR(VertexAttribDivisor)     \
+    SCALAR(VertexAttribIPointer) SCALAR(VertexAttribPointer) SCALAR(Viewport)
+
+// the debug layer's calls, left out of traces
+#define GM_GL_UNTRACED_CALLS(CALL) CALL(DebugMessageCallback) CALL(DebugMessageControl) CALL(GetError)
@@ -0,0 +1,174 @@
+#include <algorithm>
+#include <cstdio>
+#include "GlDebug.h"
+
+namespace {
+    const char *SourceName(GLenum source) {
+        switch (source) {
+            case GL_DEBUG_SOURCE_API:
+                return "api";
+            case GL_DEBUG_SOURCE_WINDOW_SYSTEM:
+                return "window system";
+            case GL_DEBUG_SOURCE_SHADER_COMPILER:
+                return "shader compiler";
+            case GL_DEBUG_SOURCE_THIRD_PARTY:
+                return "third party";
+            case GL_DEBUG_SOURCE_APPLICATION:
+                return "application";
+            default:
+                return "other";
+        }
+    }
+
+    const char *TypeName(GLenum type) {
+        switch (type) {
+            case GL_DEBUG_TYPE_ERROR:
+                return "error";
+            case GL_DEBUG_TYPE_DEPRECATED_BEHAVIOR:
+                return "deprecated";
+            case GL_DEBUG_TYPE_UNDEFINED_BEHAVIOR:
+                return "undefined behavior";
+            case GL_DEBUG_TYPE_PORTABILITY:
+                return "portability";
+            case GL_DEBUG_TYPE_PERFORMANCE:
+                return "performance";
+            case GL_DEBUG_TYPE_MARKER:
+                return "marker";
+            default:
+                return "other";
+        }
+    }
+
+    const char *SeverityName(GLenum severity) {
+        switch (severity) {
+            case GL_DEBUG_SEVERITY_HIGH:
+                return "high";
+            case GL_DEBUG_SEVERITY_MEDIUM:
+                return "medium";
+            case GL_DEBUG_SEVERITY_LOW:
+                return "low";
+            default:
+                return "notification";
+        }
+    }
+
+    // most severe first
+    const GLenum Severities[] = {GL_DEBUG_SEVERITY_HIGH, GL_DEBUG_SEVERITY_MEDIUM, GL_DEBUG_SEVERITY_LOW,
+                                 GL_DEBUG_SEVERITY_NOTIFICATION};
+
+    void GLAPIENTRY DebugCallback(GLenum source, GLenum type, GLuint id, GLenum severity, GLsizei,
+                                  const GLchar *message, const void *layer) {
+        ((Gm::GlDebugLayer *) layer)->Report(source, type, id, severity, message);
+    }
+}
+
+Gm::GlDebugLayer &Gm::GlDebugLayer::Instance() {
+    static GlDebugLayer layer;
+    return layer;
+}
+
+bool Gm::GlDebugLayer::Install(bool synchronous) {
+#if GM_GL_DEBUG
+    if (!GLAD_GL_VERSION_4_3 && !GLAD_GL_KHR_debug) {
+        return false;
+    }
+    glDebugMessageCallback(DebugCallback, this);
+    glEnable(GL_DEBUG_OUTPUT);
+    if (synchronous) {
+        glEnable(GL_DEBUG_OUTPUT_SYNCHRONOUS);
+    } else {
+        glDisable(GL_DEBUG_OUTPUT_SYNCHRONOUS);
+    }
+    m_installed = true;
+    ApplySeverity();
+    return true;
+#else
+    (void) synchronous;
+    return false;
+#endif
+}
+
+void Gm::GlDebugLayer::Uninstall() {
+    if (!m_installed) {
+        return;
+    }
+    glDisable(GL_DEBUG_OUTPUT);
+    glDebugMessageCallback(nullptr, nullptr);
+    m_installed = false;
+}
+
+void Gm::GlDebugLayer::Mute(GLuint id) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (std::find(m_muted.begin(), m_muted.end(), id) == m_muted.end()) {
+        m_muted.push_back(id);
+    }
+}
+
+void Gm::GlDebugLayer::Unmute(GLuint id) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_muted.erase(std::remove(m_muted.begin(), m_muted.end(), id), m_muted.end());
+}
+
+void Gm::GlDebugLayer::SetMinimumSeverity(GLenum severity) {
+    m_minimumSeverity = severity;
+    ApplySeverity();
+}
+
+void Gm::GlDebugLayer::ApplySeverity() {
+    if (!m_installed) {
+        return;
+    }
+    bool enabled = true;
+    for (GLenum severity : Severities) {
+        glDebugMessageControl(GL_DONT_CARE, GL_DONT_CARE, severity, 0, nullptr, enabled ? GL_TRUE : GL_FALSE);
+        // everything after the minimum is less severe
+        enabled = enabled && severity != m_minimumSeverity;
+    }
+}
+
+void Gm::GlDebugLayer::Report(GLenum source, GLenum type, GLuint id, GLenum severity, const char *text) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto message = std::find_if(m_messages.begin(), m_messages.end(), [&](const GlDebugMessage &m) {
+        return m.source == source && m.type == type && m.id == id;
+    });
+    if (message == m_messages.end()) {
+        m_messages.push_back(GlDebugMessage{source, type, id, severity, 0, std::string()});
+        message = m_messages.end() - 1;
+    }
+    ++message->count;
+    message->severity = severity;
+    message->lastText = text;
+    if (type == GL_DEBUG_TYPE_ERROR) {
+        ++m_errors;
+    }
+    if (message->count > LoggedRepeats || std::find(m_muted.begin(), m_muted.end(), id) != m_muted.end()) {
+        return;
+    }
+    fprintf(stderr, "GL %s %s (%s, %u)%s: %s\n", TypeName(type), SeverityName(severity), SourceName(source), id,
+            message->count == LoggedRepeats ? ", logged no more" : "", text);
+}
+
+void Gm::GlDebugLayer::Poll(const char *file, int line) {
+    GLenum error;
+    while ((error = glGetError()) != GL_NO_ERROR) {
+        char text[256];
+        snprintf(text, sizeof(text), "glGetError 0x%x at %s:%d", error, file, line);
+        Report(GL_DEBUG_SOURCE_API, GL_DEBUG_TYPE_ERROR, error, GL_DEBUG_SEVERITY_HIGH, text);
+    }
+}
+
+std::vector<Gm::GlDebugMessage> Gm::GlDebugLayer::GetMessages() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_messages;
+}
+
+uint64_t Gm::GlDebugLayer::ErrorCount() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_errors;
+}
+
+void Gm::GlDebugLayer::ResetCounts() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_messages.clear();
+    m_errors = 0;
+}
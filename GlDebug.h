@@ -0,0 +1,92 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "glad/glad.h"
+
+// GL errors and driver warnings through KHR_debug (GL 4.3) instead of polling glGetError, which can stall
+// the driver. GM_GL_DEBUG=0 compiles the layer out. Otherwise debug builds get the messages synchronously,
+// on the thread and inside the call that caused them, and GM_GL_CHECK() falls back to glGetError where there
+// is no KHR_debug (macOS). Release builds take them asynchronously and never poll.
+
+#ifndef GM_GL_DEBUG
+#define GM_GL_DEBUG 1
+#endif
+
+#if GM_GL_DEBUG && !defined(NDEBUG)
+#define GM_GL_DEBUG_SYNCHRONOUS 1
+#define GM_GL_CHECK() Gm::GlDebugLayer::Instance().Check(__FILE__, __LINE__)
+#else
+#define GM_GL_DEBUG_SYNCHRONOUS 0
+#define GM_GL_CHECK() (void) 0
+#endif
+
+namespace Gm {
+    struct GlDebugMessage {
+        GLenum source;
+        GLenum type;
+        GLuint id;
+        GLenum severity;
+        // since the last ResetCounts, muted ones included
+        uint64_t count;
+        std::string lastText;
+    };
+
+    class GlDebugLayer {
+    public:
+        // a message is logged this many times, then only counted
+        static const uint64_t LoggedRepeats = 8;
+
+        static GlDebugLayer &Instance();
+
+        // on the context current on this thread, false without GL 4.3 or KHR_debug (or with GM_GL_DEBUG=0)
+        bool Install(bool synchronous = GM_GL_DEBUG_SYNCHRONOUS);
+
+        void Uninstall();
+
+        bool IsInstalled() const { return m_installed; }
+
+        // counted, but not logged; e.g. the performance notes a driver keeps repeating
+        void Mute(GLuint id);
+
+        void Unmute(GLuint id);
+
+        // the driver drops less severe messages before they are even counted, GL_DEBUG_SEVERITY_LOW by default;
+        // GL_DEBUG_SEVERITY_NOTIFICATION lets everything through
+        void SetMinimumSeverity(GLenum severity);
+
+        // every message seen, one entry per source, type and id
+        std::vector<GlDebugMessage> GetMessages() const;
+
+        // GL_DEBUG_TYPE_ERROR messages, and glGetError codes seen by Check
+        uint64_t ErrorCount() const;
+
+        void ResetCounts();
+
+        // where the callback is not installed, reports what glGetError returns; nothing to do otherwise
+        void Check(const char *file, int line) {
+            if (!m_installed) {
+                Poll(file, line);
+            }
+        }
+
+        // what the callback gets, public so that other sources of diagnostics can feed it too
+        void Report(GLenum source, GLenum type, GLuint id, GLenum severity, const char *text);
+
+    private:
+        void Poll(const char *file, int line);
+
+        void ApplySeverity();
+
+        bool m_installed = false;
+        GLenum m_minimumSeverity = GL_DEBUG_SEVERITY_LOW;
+        // the driver's threads call in when asynchronous
+        mutable std::mutex m_mutex;
+        std::vector<GlDebugMessage> m_messages;
+        std::vector<GLuint> m_muted;
+        uint64_t m_errors = 0;
+    };
+}
@@ -0,0 +1,212 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <dlfcn.h>
+#include <string>
+#include <vector>
+#include "Clock.h"
+#include "GlCalls.h"
+#include "GlLoader.h"
+#include "GladEntries.inc"
+
+namespace {
+    enum Function : uint32_t {
+#define GM_LOADER_FUNCTION(name) Function##name,
+        GM_GLAD_FUNCTIONS(GM_LOADER_FUNCTION)
+#undef GM_LOADER_FUNCTION
+        FunctionCount
+    };
+
+    const char *const FunctionNames[] = {
+#define GM_LOADER_NAME(name) "gl" #name,
+            GM_GLAD_FUNCTIONS(GM_LOADER_NAME)
+#undef GM_LOADER_NAME
+    };
+
+    Gm::GlLoadStats g_stats;
+    // where the trampolines look their functions up, and what they found since the last Load
+    GLADloadproc g_load = nullptr;
+    void *g_resolved[FunctionCount];
+
+    // the system's GL library, opened the way gladLoadGL opens it but kept open for the trampolines
+    void *g_library = nullptr;
+    void *(*g_getProcAddress)(const char *) = nullptr;
+
+    bool OpenLibrary() {
+        if (g_library != nullptr) {
+            return true;
+        }
+#ifdef __APPLE__
+        const char *names[] = {"/System/Library/Frameworks/OpenGL.framework/OpenGL",
+                               "/System/Library/Frameworks/OpenGL.framework/Versions/Current/OpenGL"};
+#else
+        const char *names[] = {"libGL.so.1", "libGL.so"};
+#endif
+        for (const char *name : names) {
+            g_library = dlopen(name, RTLD_NOW | RTLD_GLOBAL);
+            if (g_library != nullptr) {
+                break;
+            }
+        }
+#ifndef __APPLE__
+        if (g_library != nullptr) {
+            g_getProcAddress = (void *(*)(const char *)) dlsym(g_library, "glXGetProcAddressARB");
+        }
+        return g_getProcAddress != nullptr;
+#else
+        return g_library != nullptr;
+#endif
+    }
+
+    void *LibraryProc(const char *name) {
+        void *proc = g_getProcAddress != nullptr ? g_getProcAddress(name) : nullptr;
+        return proc != nullptr ? proc : dlsym(g_library, name);
+    }
+
+    void *Resolve(Function function) {
+        if (g_resolved[function] == nullptr) {
+            g_resolved[function] = g_load(FunctionNames[function]);
+            if (g_resolved[function] == nullptr) {
+                // gladLoadGL would have left a null pointer to crash on, say which
+                fprintf(stderr, "%s is not available\n", FunctionNames[function]);
+                abort();
+            }
+            ++g_stats.resolvedOnFirstCall;
+        }
+        return g_resolved[function];
+    }
+
+    template<typename F>
+    struct Lazy;
+
+    template<typename R, typename... A>
+    struct Lazy<R (APIENTRYP)(A...)> {
+        template<Function function, R (APIENTRYP *slot)(A...)>
+        static R GLAPIENTRY Call(A... args) {
+            auto real = (R (APIENTRYP)(A...)) Resolve(function);
+            // straight to the driver from the next call on, unless a trace hooked the pointer since
+            if (*slot == &Call<function, slot>) {
+                *slot = real;
+            }
+            return real(args...);
+        }
+    };
+
+    void SetVersion(const char *version) {
+        int major = 0, minor = 0;
+        sscanf(version, "%d.%d", &major, &minor);
+        GLVersion.major = major;
+        GLVersion.minor = minor;
+#define GM_LOADER_VERSION(versionMajor, versionMinor) \
+        GLAD_GL_VERSION_##versionMajor##_##versionMinor = \
+                (major == versionMajor && minor >= versionMinor) || major > versionMajor;
+        GM_GLAD_VERSIONS(GM_LOADER_VERSION)
+#undef GM_LOADER_VERSION
+    }
+
+    // one pass over the context's extensions, sorted for the lookups
+    bool SetExtensions() {
+        std::vector<std::string> extensions;
+        if (GLVersion.major >= 3) {
+            glad_glGetStringi = (PFNGLGETSTRINGIPROC) g_load("glGetStringi");
+            if (glad_glGetStringi == nullptr) {
+                return false;
+            }
+            GLint count = 0;
+            glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+            extensions.reserve((size_t) count);
+            for (GLint i = 0; i < count; ++i) {
+                const char *extension = (const char *) glGetStringi(GL_EXTENSIONS, (GLuint) i);
+                if (extension != nullptr) {
+                    extensions.emplace_back(extension);
+                }
+            }
+        } else {
+            const char *list = (const char *) glGetString(GL_EXTENSIONS);
+            if (list == nullptr) {
+                return false;
+            }
+            for (const char *begin = list; *begin != '\0';) {
+                const char *end = strchr(begin, ' ');
+                end = end != nullptr ? end : begin + strlen(begin);
+                if (end != begin) {
+                    extensions.emplace_back(begin, end);
+                }
+                begin = *end != '\0' ? end + 1 : end;
+            }
+        }
+        std::sort(extensions.begin(), extensions.end());
+        auto has = [&](const char *name) {
+            return std::binary_search(extensions.begin(), extensions.end(), name);
+        };
+#define GM_LOADER_EXTENSION(name) GLAD_GL_##name = has("GL_" #name);
+        GM_GLAD_EXTENSIONS(GM_LOADER_EXTENSION)
+#undef GM_LOADER_EXTENSION
+        return true;
+    }
+
+    bool LoadLazy() {
+        glad_glGetString = (PFNGLGETSTRINGPROC) g_load("glGetString");
+        glad_glGetIntegerv = (PFNGLGETINTEGERVPROC) g_load("glGetIntegerv");
+        if (glad_glGetString == nullptr || glad_glGetIntegerv == nullptr || glGetString(GL_VERSION) == nullptr) {
+            return false;
+        }
+        SetVersion((const char *) glGetString(GL_VERSION));
+        if (!SetExtensions()) {
+            return false;
+        }
+        std::fill(g_resolved, g_resolved + FunctionCount, nullptr);
+#define GM_LOADER_DEFER(name) glad_gl##name = &Lazy<decltype(glad_gl##name)>::Call<Function##name, &glad_gl##name>;
+        GM_GLAD_FUNCTIONS(GM_LOADER_DEFER)
+#undef GM_LOADER_DEFER
+        // the engine's calls, and what the load itself used; a null pointer, as gladLoadGL leaves it, for the
+        // ones this context doesn't have
+#define GM_LOADER_RESOLVE(name) \
+        glad_gl##name = (decltype(glad_gl##name)) (g_resolved[Function##name] = g_load("gl" #name)); \
+        ++g_stats.resolved;
+        GM_GL_CALLS(GM_LOADER_RESOLVE, GM_LOADER_RESOLVE, GM_LOADER_RESOLVE)
+        GM_GL_UNTRACED_CALLS(GM_LOADER_RESOLVE)
+        GM_LOADER_RESOLVE(GetString)
+        GM_LOADER_RESOLVE(GetStringi)
+#undef GM_LOADER_RESOLVE
+        g_stats.deferred = (uint32_t) FunctionCount - g_stats.resolved;
+        return true;
+    }
+
+    uint32_t CountLoaded() {
+        uint32_t loaded = 0;
+#define GM_LOADER_COUNT(name) loaded += glad_gl##name != nullptr ? 1 : 0;
+        GM_GLAD_FUNCTIONS(GM_LOADER_COUNT)
+#undef GM_LOADER_COUNT
+        return loaded;
+    }
+}
+
+bool Gm::GlLoader::Load(GlLoadMode mode, GLADloadproc load) {
+    double start = Clock::Now();
+    g_stats = GlLoadStats();
+    g_stats.mode = mode;
+    bool loaded;
+    if (mode == GlLoadMode::All) {
+        loaded = (load != nullptr ? gladLoadGLLoader(load) : gladLoadGL()) != 0;
+        g_stats.milliseconds = (Clock::Now() - start) * 1000.0;
+        g_stats.resolved = CountLoaded();
+        return loaded;
+    }
+    if (load == nullptr && !OpenLibrary()) {
+        return false;
+    }
+    g_load = load != nullptr ? load : &LibraryProc;
+    loaded = LoadLazy();
+    g_stats.milliseconds = (Clock::Now() - start) * 1000.0;
+    return loaded;
+}
+
+const Gm::GlLoadStats &Gm::GlLoader::Stats() {
+    return g_stats;
+}
+
+const char *Gm::GlLoader::ModeName(GlLoadMode mode) {
+    return mode == GlLoadMode::All ? "all" : "lazy";
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <cstdint>
+#include "glad/glad.h"
+
+// Loading GL for the current context: the version, the extension flags and glad's function pointers.
+//
+// gladLoadGL looks up all of the ~3000 entry points and tests each of the ~600 extensions against the
+// context's list, where the engine calls about ninety functions. The lazy mode looks up only those (GlCalls.h)
+// and sets every other pointer to a trampoline that looks its function up on the first call, then puts it
+// in the pointer; the flags come from one pass over the extension list. Either way every pointer glad
+// declares can be called afterwards and the GLAD_GL_* flags are those gladLoadGL sets.
+
+namespace Gm {
+    enum class GlLoadMode {
+        // gladLoadGL, every entry point looked up now
+        All,
+        // the engine's calls now, the rest on first use
+        Lazy,
+    };
+
+    struct GlLoadStats {
+        GlLoadMode mode = GlLoadMode::All;
+        double milliseconds = 0.0;
+        // entry points looked up during the load, and the ones left to a trampoline
+        uint32_t resolved = 0;
+        uint32_t deferred = 0;
+        // trampolines that looked their function up since
+        uint32_t resolvedOnFirstCall = 0;
+    };
+
+    namespace GlLoader {
+        // Loads GL for the context current on this thread with `load`, or from the system's GL library as
+        // gladLoadGL does when null. The lazy mode keeps using `load` after it returns, it must stay valid.
+        // False when there is no context or GL can't be found.
+        bool Load(GlLoadMode mode, GLADloadproc load = nullptr);
+
+        // of the last Load
+        const GlLoadStats &Stats();
+
+        const char *ModeName(GlLoadMode mode);
+    }
+}
@@ -0,0 +1,298 @@
+#include "GlState.h"
+
+namespace {
+    const GLenum TrackedBufferTargets[] = {
+            GL_ARRAY_BUFFER, GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, GL_DRAW_INDIRECT_BUFFER,
+            GL_PIXEL_PACK_BUFFER, GL_PIXEL_UNPACK_BUFFER, GL_SHADER_STORAGE_BUFFER, GL_UNIFORM_BUFFER,
+    };
+
+    const GLenum TrackedTextureTargets[] = {GL_TEXTURE_2D, GL_TEXTURE_BUFFER};
+
+    const GLenum TrackedCapabilities[] = {GL_DEPTH_TEST, GL_CULL_FACE, GL_BLEND, GL_SCISSOR_TEST};
+}
+
+Gm::GlState &Gm::GlState::Current() {
+    // a context is current on one thread at a time, so one shadow per thread
+    static thread_local GlState state;
+    return state;
+}
+
+void Gm::GlState::Invalidate() {
+    m_program = Unknown;
+    m_vertexArray = Unknown;
+    for (GLuint &buffer : m_buffers) {
+        buffer = Unknown;
+    }
+    for (int i = 0; i < IndexedBindings; ++i) {
+        m_storageBuffers[i] = Unknown;
+        m_uniformBuffers[i] = Unknown;
+    }
+    m_activeTexture = Unknown;
+    for (GLuint (&units)[TextureUnits] : m_textures) {
+        for (GLuint &texture : units) {
+            texture = Unknown;
+        }
+    }
+    m_readFramebuffer = m_drawFramebuffer = Unknown;
+    for (int &capability : m_capabilities) {
+        capability = -1;
+    }
+    m_depthFunc = Unknown;
+    m_depthMask = 0xff;
+    m_cullFace = m_frontFace = Unknown;
+    m_blendSource = m_blendDestination = Unknown;
+    m_viewport[0] = m_viewport[1] = m_viewport[2] = m_viewport[3] = -1;
+}
+
+int Gm::GlState::BufferSlot(GLenum target) {
+    static_assert(sizeof(TrackedBufferTargets) / sizeof(GLenum) == BufferTargets, "one slot per target");
+    for (int i = 0; i < BufferTargets; ++i) {
+        if (TrackedBufferTargets[i] == target) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+int Gm::GlState::TextureSlot(GLenum target) {
+    static_assert(sizeof(TrackedTextureTargets) / sizeof(GLenum) == TextureTargets, "one slot per target");
+    for (int i = 0; i < TextureTargets; ++i) {
+        if (TrackedTextureTargets[i] == target) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+int Gm::GlState::CapabilitySlot(GLenum capability) {
+    static_assert(sizeof(TrackedCapabilities) / sizeof(GLenum) == Capabilities, "one slot per capability");
+    for (int i = 0; i < Capabilities; ++i) {
+        if (TrackedCapabilities[i] == capability) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+void Gm::GlState::UseProgram(GLuint program) {
+    if (Change(m_program, program)) {
+        glUseProgram(program);
+    }
+}
+
+void Gm::GlState::BindVertexArray(GLuint vertexArray) {
+    if (Change(m_vertexArray, vertexArray)) {
+        glBindVertexArray(vertexArray);
+    }
+}
+
+void Gm::GlState::BindBuffer(GLenum target, GLuint buffer) {
+    int slot = BufferSlot(target);
+    if (slot < 0) {
+        m_stats.issued++;
+        glBindBuffer(target, buffer);
+        return;
+    }
+    if (Change(m_buffers[slot], buffer)) {
+        glBindBuffer(target, buffer);
+    }
+}
+
+void Gm::GlState::BindBufferBase(GLenum target, GLuint index, GLuint buffer) {
+    GLuint *bindings = target == GL_SHADER_STORAGE_BUFFER ? m_storageBuffers
+                       : target == GL_UNIFORM_BUFFER ? m_uniformBuffers : nullptr;
+    int slot = BufferSlot(target);
+    if (bindings == nullptr || index >= (GLuint) IndexedBindings) {
+        m_stats.issued++;
+        glBindBufferBase(target, index, buffer);
+        if (slot >= 0) {
+            m_buffers[slot] = buffer;
+        }
+        return;
+    }
+    if (Change(bindings[index], buffer)) {
+        glBindBufferBase(target, index, buffer);
+        m_buffers[slot] = buffer;
+    }
+}
+
+void Gm::GlState::ActiveTexture(GLenum unit) {
+    if (Change(m_activeTexture, unit)) {
+        glActiveTexture(unit);
+    }
+}
+
+void Gm::GlState::BindTexture(GLenum target, GLuint texture) {
+    GLuint unit = m_activeTexture - GL_TEXTURE0;
+    int slot = TextureSlot(target);
+    if (slot < 0 || m_activeTexture == Unknown || unit >= (GLuint) TextureUnits) {
+        m_stats.issued++;
+        glBindTexture(target, texture);
+        return;
+    }
+    if (Change(m_textures[slot][unit], texture)) {
+        glBindTexture(target, texture);
+    }
+}
+
+void Gm::GlState::BindFramebuffer(GLenum target, GLuint framebuffer) {
+    bool read = target == GL_FRAMEBUFFER || target == GL_READ_FRAMEBUFFER;
+    bool draw = target == GL_FRAMEBUFFER || target == GL_DRAW_FRAMEBUFFER;
+    if ((!read || m_readFramebuffer == framebuffer) && (!draw || m_drawFramebuffer == framebuffer)) {
+        m_stats.filtered++;
+        return;
+    }
+    if (read) {
+        m_readFramebuffer = framebuffer;
+    }
+    if (draw) {
+        m_drawFramebuffer = framebuffer;
+    }
+    m_stats.issued++;
+    glBindFramebuffer(target, framebuffer);
+}
+
+void Gm::GlState::SetCapability(GLenum capability, bool enabled) {
+    int slot = CapabilitySlot(capability);
+    if (slot >= 0 && !Change(m_capabilities[slot], enabled ? 1 : 0)) {
+        return;
+    }
+    if (slot < 0) {
+        m_stats.issued++;
+    }
+    if (enabled) {
+        glEnable(capability);
+    } else {
+        glDisable(capability);
+    }
+}
+
+void Gm::GlState::Enable(GLenum capability) {
+    SetCapability(capability, true);
+}
+
+void Gm::GlState::Disable(GLenum capability) {
+    SetCapability(capability, false);
+}
+
+void Gm::GlState::DepthFunc(GLenum function) {
+    if (Change(m_depthFunc, function)) {
+        glDepthFunc(function);
+    }
+}
+
+void Gm::GlState::DepthMask(GLboolean mask) {
+    if (Change(m_depthMask, mask)) {
+        glDepthMask(mask);
+    }
+}
+
+void Gm::GlState::CullFace(GLenum mode) {
+    if (Change(m_cullFace, mode)) {
+        glCullFace(mode);
+    }
+}
+
+void Gm::GlState::FrontFace(GLenum mode) {
+    if (Change(m_frontFace, mode)) {
+        glFrontFace(mode);
+    }
+}
+
+void Gm::GlState::BlendFunc(GLenum source, GLenum destination) {
+    if (m_blendSource == source && m_blendDestination == destination) {
+        m_stats.filtered++;
+        return;
+    }
+    m_blendSource = source;
+    m_blendDestination = destination;
+    m_stats.issued++;
+    glBlendFunc(source, destination);
+}
+
+void Gm::GlState::Viewport(GLint x, GLint y, GLsizei width, GLsizei height) {
+    if (m_viewport[0] == x && m_viewport[1] == y && m_viewport[2] == width && m_viewport[3] == height) {
+        m_stats.filtered++;
+        return;
+    }
+    m_viewport[0] = x;
+    m_viewport[1] = y;
+    m_viewport[2] = width;
+    m_viewport[3] = height;
+    m_stats.issued++;
+    glViewport(x, y, width, height);
+}
+
+GLuint Gm::GlState::DrawFramebuffer() {
+    if (m_drawFramebuffer == Unknown) {
+        GLint framebuffer = 0;
+        glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &framebuffer);
+        m_drawFramebuffer = (GLuint) framebuffer;
+    }
+    return m_drawFramebuffer;
+}
+
+void Gm::GlState::GetViewport(GLint viewport[4]) {
+    if (m_viewport[2] < 0) {
+        glGetIntegerv(GL_VIEWPORT, m_viewport);
+    }
+    for (int i = 0; i < 4; ++i) {
+        viewport[i] = m_viewport[i];
+    }
+}
+
+void Gm::GlState::DeleteProgram(GLuint program) {
+    // a program in use stays bound until replaced, only its name goes away
+    if (program != 0 && m_program == program) {
+        m_program = Unknown;
+    }
+    glDeleteProgram(program);
+}
+
+void Gm::GlState::DeleteVertexArrays(GLsizei count, const GLuint *vertexArrays) {
+    for (GLsizei i = 0; i < count; ++i) {
+        if (vertexArrays[i] != 0 && m_vertexArray == vertexArrays[i]) {
+            m_vertexArray = 0;
+        }
+    }
+    glDeleteVertexArrays(count, vertexArrays);
+}
+
+void Gm::GlState::DeleteBuffers(GLsizei count, const GLuint *buffers) {
+    for (GLsizei i = 0; i < count; ++i) {
+        if (buffers[i] == 0) {
+            continue;
+        }
+        for (GLuint &buffer : m_buffers) {
+            buffer = buffer == buffers[i] ? 0 : buffer;
+        }
+        // indexed bindings of deleted buffers are not reset by every driver
+        for (int binding = 0; binding < IndexedBindings; ++binding) {
+            m_storageBuffers[binding] = m_storageBuffers[binding] == buffers[i] ? Unknown : m_storageBuffers[binding];
+            m_uniformBuffers[binding] = m_uniformBuffers[binding] == buffers[i] ? Unknown : m_uniformBuffers[binding];
+        }
+    }
+    glDeleteBuffers(count, buffers);
+}
+
+void Gm::GlState::DeleteTextures(GLsizei count, const GLuint *textures) {
+    for (GLsizei i = 0; i < count; ++i) {
+        for (GLuint (&units)[TextureUnits] : m_textures) {
+            for (GLuint &texture : units) {
+                texture = textures[i] != 0 && texture == textures[i] ? 0 : texture;
+            }
+        }
+    }
+    glDeleteTextures(count, textures);
+}
+
+void Gm::GlState::DeleteFramebuffers(GLsizei count, const GLuint *framebuffers) {
+    for (GLsizei i = 0; i < count; ++i) {
+        if (framebuffers[i] == 0) {
+            continue;
+        }
+        m_readFramebuffer = m_readFramebuffer == framebuffers[i] ? 0 : m_readFramebuffer;
+        m_drawFramebuffer = m_drawFramebuffer == framebuffers[i] ? 0 : m_drawFramebuffer;
+    }
+    glDeleteFramebuffers(count, framebuffers);
+}
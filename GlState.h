@@ -0,0 +1,134 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include "glad/glad.h"
+
+namespace Gm {
+    struct GlStateStats {
+        // calls that reached GL, and calls dropped because they would not have changed anything
+        uint64_t issued = 0;
+        uint64_t filtered = 0;
+    };
+
+    // Shadow copy of the GL state the renderer changes per frame. Setting a value that is already current
+    // returns before calling through glad, which saves the driver's validation at high draw counts.
+    //
+    // One instance per thread, matching the context current on it. Anything changing the same state behind
+    // its back (another library, a new context) must call Invalidate, and objects must be deleted through
+    // it: GL unbinds deleted names and reuses them, a stale shadow would then filter a needed bind.
+    class GlState {
+    public:
+        static GlState &Current();
+
+        // forget everything, the next call of each kind reaches GL
+        void Invalidate();
+
+        void UseProgram(GLuint program);
+
+        void BindVertexArray(GLuint vertexArray);
+
+        // GL_ELEMENT_ARRAY_BUFFER belongs to the bound VAO and is passed through untracked
+        void BindBuffer(GLenum target, GLuint buffer);
+
+        // also binds `buffer` to `target` itself, as GL does
+        void BindBufferBase(GLenum target, GLuint index, GLuint buffer);
+
+        void ActiveTexture(GLenum unit);
+
+        // on the active unit, GL_TEXTURE_2D and GL_TEXTURE_BUFFER are tracked
+        void BindTexture(GLenum target, GLuint texture);
+
+        // GL_FRAMEBUFFER binds both the read and the draw framebuffer
+        void BindFramebuffer(GLenum target, GLuint framebuffer);
+
+        // GL_DEPTH_TEST, GL_CULL_FACE, GL_BLEND and GL_SCISSOR_TEST are tracked
+        void Enable(GLenum capability);
+
+        void Disable(GLenum capability);
+
+        void DepthFunc(GLenum function);
+
+        void DepthMask(GLboolean mask);
+
+        void CullFace(GLenum mode);
+
+        void FrontFace(GLenum mode);
+
+        void BlendFunc(GLenum source, GLenum destination);
+
+        void Viewport(GLint x, GLint y, GLsizei width, GLsizei height);
+
+        // the shadow values when known, otherwise queried once and remembered
+        GLuint DrawFramebuffer();
+
+        void GetViewport(GLint viewport[4]);
+
+        void DeleteProgram(GLuint program);
+
+        void DeleteVertexArrays(GLsizei count, const GLuint *vertexArrays);
+
+        void DeleteBuffers(GLsizei count, const GLuint *buffers);
+
+        void DeleteTextures(GLsizei count, const GLuint *textures);
+
+        void DeleteFramebuffers(GLsizei count, const GLuint *framebuffers);
+
+        const GlStateStats &GetStats() const { return m_stats; }
+
+        void ResetStats() { m_stats = GlStateStats(); }
+
+    private:
+        GlState() { Invalidate(); }
+
+        // false if `value` is current already, otherwise records it
+        template<typename T>
+        bool Change(T &shadow, T value) {
+            if (shadow == value) {
+                m_stats.filtered++;
+                return false;
+            }
+            shadow = value;
+            m_stats.issued++;
+            return true;
+        }
+
+        // slot of a tracked buffer target, -1 for the rest
+        static int BufferSlot(GLenum target);
+
+        static int TextureSlot(GLenum target);
+
+        static int CapabilitySlot(GLenum capability);
+
+        void SetCapability(GLenum capability, bool enabled);
+
+        static const int BufferTargets = 8;
+        static const int IndexedBindings = 8;
+        static const int TextureTargets = 2;
+        static const int TextureUnits = 16;
+        static const int Capabilities = 4;
+        // neither a name nor an enum GL hands out, the shadow of anything not known since Invalidate
+        static const GLuint Unknown = ~0u;
+
+        GLuint m_program;
+        GLuint m_vertexArray;
+        GLuint m_buffers[BufferTargets];
+        // shader storage and uniform buffer binding points
+        GLuint m_storageBuffers[IndexedBindings];
+        GLuint m_uniformBuffers[IndexedBindings];
+        GLenum m_activeTexture;
+        GLuint m_textures[TextureTargets][TextureUnits];
+        GLuint m_readFramebuffer;
+        GLuint m_drawFramebuffer;
+        // 0 disabled, 1 enabled, -1 unknown
+        int m_capabilities[Capabilities];
+        GLenum m_depthFunc;
+        GLboolean m_depthMask;
+        GLenum m_cullFace;
+        GLenum m_frontFace;
+        GLenum m_blendSource, m_blendDestination;
+        GLint m_viewport[4];
+
+        GlStateStats m_stats;
+    };
+}
@@ -0,0 +1,1123 @@
+#include <algorithm>
+#include <cstring>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include "GlCalls.h"
+#include "GlTrace.h"
+
+namespace {
+    const char Magic[8] = {'G', 'M', 'G', 'L', 'T', 'R', 'C', 'E'};
+    const uint32_t Version = 1;
+
+    // magic, version, a reserved word, the viewport
+    const size_t HeaderSize = 32;
+
+    // every record: the op, two reserved bytes, the size of the payload that follows, padded to 8 bytes
+    struct RecordHeader {
+        uint16_t op;
+        uint16_t reserved;
+        uint32_t size;
+    };
+
+    // before the blob's bytes: its id, a reserved word and the size
+    const size_t BlobPrefix = 16;
+    const uint32_t NullBlob = ~0u;
+
+    // written to the file directly rather than through the buffer
+    const size_t LargeWrite = 1 << 16;
+    const size_t FlushSize = 4 << 20;
+
+    enum Op : uint16_t {
+        OpBlob,
+        OpBeginFrame,
+        OpEndFrame,
+#define GM_TRACE_OP(name) Op##name,
+        GM_GL_CALLS(GM_TRACE_OP, GM_TRACE_OP, GM_TRACE_OP)
+#undef GM_TRACE_OP
+        OpCount
+    };
+
+    // the driver's entry points while the wrappers are in glad's pointers
+    void *g_real[OpCount];
+
+    template<typename F>
+    F Real(Op op) {
+        return (F) g_real[op];
+    }
+
+    size_t Padding(size_t size) {
+        return (8 - size % 8) % 8;
+    }
+
+    uint64_t Hash(const void *data, size_t size) {
+        const uint8_t *bytes = (const uint8_t *) data;
+        uint64_t hash = 0x9e3779b97f4a7c15ull ^ size;
+        size_t i = 0;
+        for (; i + 8 <= size; i += 8) {
+            uint64_t word;
+            memcpy(&word, bytes + i, 8);
+            hash = (hash ^ word) * 0xff51afd7ed558ccdull;
+            hash ^= hash >> 29;
+        }
+        uint64_t tail = 0;
+        memcpy(&tail, bytes + i, size - i);
+        hash = (hash ^ tail) * 0xc4ceb9fe1a85ec53ull;
+        return hash ^ (hash >> 32);
+    }
+
+    // bytes per pixel of a client side image, 0 for combinations the renderer doesn't upload
+    size_t PixelBytes(GLenum format, GLenum type) {
+        switch (type) {
+            case GL_UNSIGNED_SHORT_5_6_5:
+            case GL_UNSIGNED_SHORT_4_4_4_4:
+            case GL_UNSIGNED_SHORT_5_5_5_1:
+                return 2;
+            case GL_UNSIGNED_INT_8_8_8_8_REV:
+            case GL_UNSIGNED_INT_2_10_10_10_REV:
+            case GL_UNSIGNED_INT_24_8:
+            case GL_UNSIGNED_INT_10F_11F_11F_REV:
+                return 4;
+            default:
+                break;
+        }
+        size_t components;
+        switch (format) {
+            case GL_RED:
+            case GL_RED_INTEGER:
+            case GL_DEPTH_COMPONENT:
+                components = 1;
+                break;
+            case GL_RG:
+            case GL_RG_INTEGER:
+                components = 2;
+                break;
+            case GL_RGB:
+            case GL_BGR:
+            case GL_RGB_INTEGER:
+                components = 3;
+                break;
+            case GL_RGBA:
+            case GL_BGRA:
+            case GL_RGBA_INTEGER:
+                components = 4;
+                break;
+            default:
+                return 0;
+        }
+        switch (type) {
+            case GL_UNSIGNED_BYTE:
+            case GL_BYTE:
+                return components;
+            case GL_UNSIGNED_SHORT:
+            case GL_SHORT:
+            case GL_HALF_FLOAT:
+                return components * 2;
+            case GL_UNSIGNED_INT:
+            case GL_INT:
+            case GL_FLOAT:
+                return components * 4;
+            default:
+                return 0;
+        }
+    }
+
+    // what glTexImage reads from `pixels`, rows aligned to GL_UNPACK_ALIGNMENT
+    size_t ImageBytes(GLsizei width, GLsizei height, GLsizei depth, GLenum format, GLenum type) {
+        size_t pixel = PixelBytes(format, type);
+        if (pixel == 0 || width <= 0 || height <= 0 || depth <= 0) {
+            return 0;
+        }
+        GLint alignment = 4;
+        Real<PFNGLGETINTEGERVPROC>(OpGetIntegerv)(GL_UNPACK_ALIGNMENT, &alignment);
+        size_t row = width * pixel;
+        size_t stride = (row + alignment - 1) / alignment * alignment;
+        // the last row isn't padded
+        return stride * ((size_t) height * depth - 1) + row;
+    }
+
+    Gm::GlTraceRecorder &Recorder() {
+        return Gm::GlTraceRecorder::Instance();
+    }
+
+    // the wrapper of every SCALAR and NAMED call: the arguments as they are, then the driver
+    template<Op op, typename R, typename... A>
+    struct ScalarCall {
+        static R GLAPIENTRY Trace(A... args) {
+            Gm::GlTraceRecorder &recorder = Recorder();
+            recorder.BeginCall(op);
+            int expand[] = {0, (recorder.Put(args), 0)...};
+            (void) expand;
+            recorder.EndCall();
+            return Real<R (APIENTRYP)(A...)>(op)(args...);
+        }
+    };
+
+    template<Op op, typename R, typename... A>
+    void HookScalar(R (APIENTRYP &pointer)(A...)) {
+        auto wrapper = &ScalarCall<op, R, A...>::Trace;
+        if (pointer != wrapper) {
+            g_real[op] = (void *) pointer;
+            pointer = wrapper;
+        }
+    }
+
+    template<typename F>
+    void HookData(Op op, F &pointer, F wrapper) {
+        if (pointer != wrapper) {
+            g_real[op] = (void *) pointer;
+            pointer = wrapper;
+        }
+    }
+
+    template<typename F>
+    void Unhook(Op op, F &pointer) {
+        if (g_real[op] != nullptr) {
+            pointer = (F) g_real[op];
+            g_real[op] = nullptr;
+        }
+    }
+
+    void PutString(Gm::GlTraceRecorder &recorder, const char *text, size_t length) {
+        recorder.Put((uint32_t) length);
+        recorder.PutBytes(text, length);
+    }
+
+    void PutNames(Gm::GlTraceRecorder &recorder, GLsizei count, const GLuint *names) {
+        recorder.Put(count);
+        recorder.PutBytes(names, sizeof(GLuint) * (count > 0 ? count : 0));
+    }
+
+    // the DATA calls
+
+    void GLAPIENTRY TraceBindAttribLocation(GLuint program, GLuint index, const GLchar *name) {
+        Gm::GlTraceRecorder &recorder = Recorder();
+        recorder.BeginCall(OpBindAttribLocation);
+        recorder.Put(program);
+        recorder.Put(index);
+        PutString(recorder, name, strlen(name));
+        recorder.EndCall();
+        Real<PFNGLBINDATTRIBLOCATIONPROC>(OpBindAttribLocation)(program, index, name);
+    }
+
+    void GLAPIENTRY TraceBufferData(GLenum target, GLsizeiptr size, const void *data, GLenum usage) {
+        Gm::GlTraceRecorder &recorder = Recorder();
+        uint32_t blob = recorder.Blob(data, (size_t) size);
+        recorder.BeginCall(OpBufferData);
+        recorder.Put(target);
+        recorder.Put((int64_t) size);
+        recorder.Put(blob);
+        recorder.Put(usage);
+        recorder.EndCall();
+        Real<PFNGLBUFFERDATAPROC>(OpBufferData)(target, size, data, usage);
+    }
+
+    void GLAPIENTRY TraceBufferSubData(GLenum target, GLintptr offset, GLsizeiptr size, const void *data) {
+        Gm::GlTraceRecorder &recorder = Recorder();
+        uint32_t blob = recorder.Blob(data, (size_t) size);
+        recorder.BeginCall(OpBufferSubData);
+        recorder.Put(target);
+        recorder.Put((int64_t) offset);
+        recorder.Put((int64_t) size);
+        recorder.Put(blob);
+        recorder.EndCall();
+        Real<PFNGLBUFFERSUBDATAPROC>(OpBufferSubData)(target, offset, size, data);
+    }
+
+    void GLAPIENTRY TraceCompressedTexImage2D(GLenum target, GLint level, GLenum internalFormat, GLsizei width,
+                                              GLsizei height, GLint border, GLsizei imageSize, const void *data) {
+        Gm::GlTraceRecorder &recorder = Recorder();
+        uint32_t blob = recorder.Blob(data, (size_t) imageSize);
+        recorder.BeginCall(OpCompressedTexImage2D);
+        recorder.Put(target);
+        recorder.Put(level);
+        recorder.Put(internalFormat);
+        recorder.Put(width);
+        recorder.Put(height);
+        recorder.Put(border);
+        recorder.Put(imageSize);
+        recorder.Put(blob);
+        recorder.EndCall();
+        Real<PFNGLCOMPRESSEDTEXIMAGE2DPROC>(OpCompressedTexImage2D)(target, level, internalFormat, width, height,
+                                                                     border, imageSize, data);
+    }
+
+    void GLAPIENTRY TraceCompressedTexImage3D(GLenum target, GLint level, GLenum internalFormat, GLsizei width,
+                                              GLsizei height, GLsizei depth, GLint border, GLsizei imageSize,
+                                              const void *data) {
+        Gm::GlTraceRecorder &recorder = Recorder();
+        uint32_t blob = recorder.Blob(data, (size_t) imageSize);
+        recorder.BeginCall(OpCompressedTexImage3D);
+        recorder.Put(target);
+        recorder.Put(level);
+        recorder.Put(internalFormat);
+        recorder.Put(width);
+        recorder.Put(height);
+        recorder.Put(depth);
+        recorder.Put(border);
+        recorder.Put(imageSize);
+        recorder.Put(blob);
+        recorder.EndCall();
+        Real<PFNGLCOMPRESSEDTEXIMAGE3DPROC>(OpCompressedTexImage3D)(target, level, internalFormat, width, height,
+                                                                     depth, border, imageSize, data);
+    }
+
+    GLuint GLAPIENTRY TraceCreateProgram() {
+        GLuint program = Real<PFNGLCREATEPROGRAMPROC>(OpCreateProgram)();
+        Gm::GlTraceRecorder &recorder = Recorder();
+        recorder.BeginCall(OpCreateProgram);
+        recorder.Put(program);
+        recorder.EndCall();
+        return program;
+    }
+
+    GLuint GLAPIENTRY TraceCreateShader(GLenum type) {
+        GLuint shader = Real<PFNGLCREATESHADERPROC>(OpCreateShader)(type);
+        Gm::GlTraceRecorder &recorder = Recorder();
+        recorder.BeginCall(OpCreateShader);
+        recorder.Put(type);
+        recorder.Put(shader);
+        recorder.EndCall();
+        return shader;
+    }
+
+    // glGen* and glDelete*, the names after the call
+    template<Op op, typename F>
+    struct NamesCall;
+
+    template<Op op>
+    struct NamesCall<op, void (APIENTRYP)(GLsizei, GLuint *)> {
+        static void GLAPIENTRY Trace(GLsizei count, GLuint *names) {
+            Real<void (APIENTRYP)(GLsizei, GLuint *)>(op)(count, names);
+            Gm::GlTraceRecorder &recorder = Recorder();
+            recorder.BeginCall(op);
+            PutNames(recorder, count, names);
+            recorder.EndCall();
+        }
+    };
+
+    template<Op op>
+    struct NamesCall<op, void (APIENTRYP)(GLsizei, const GLuint *)> {
+        static void GLAPIENTRY Trace(GLsizei count, const GLuint *names) {
+            Gm::GlTraceRecorder &recorder = Recorder();
+            recorder.BeginCall(op);
+            PutNames(recorder, count, names);
+            recorder.EndCall();
+            Real<void (APIENTRYP)(GLsizei, const GLuint *)>(op)(count, names);
+        }
+    };
+
+#define GM_TRACE_NAMES(name) \
+    const auto Trace##name = &NamesCall<Op##name, decltype(glad_gl##name)>::Trace;
+
+    GM_TRACE_NAMES(DeleteBuffers)
+    GM_TRACE_NAMES(DeleteFramebuffers)
+    GM_TRACE_NAMES(DeleteQueries)
+    GM_TRACE_NAMES(DeleteRenderbuffers)
+    GM_TRACE_NAMES(DeleteTextures)
+    GM_TRACE_NAMES(DeleteVertexArrays)
+    GM_TRACE_NAMES(GenBuffers)
+    GM_TRACE_NAMES(GenFramebuffers)
+    GM_TRACE_NAMES(GenQueries)
+    GM_TRACE_NAMES(GenRenderbuffers)
+    GM_TRACE_NAMES(GenTextures)
+    GM_TRACE_NAMES(GenVertexArrays)
+#undef GM_TRACE_NAMES
+
+    GLint GLAPIENTRY TraceGetUniformLocation(GLuint program, const GLchar *name) {
+        GLint location = Real<PFNGLGETUNIFORMLOCATIONPROC>(OpGetUniformLocation)(program, name);
+        Gm::GlTraceRecorder &recorder = Recorder();
+        recorder.BeginCall(OpGetUniformLocation);
+        recorder.Put(program);
+        recorder.Put(location);
+        PutString(recorder, name, strlen(name));
+        recorder.EndCall();
+        return location;
+    }
+
+    void GLAPIENTRY TraceMultiDrawElementsBaseVertex(GLenum mode, const GLsizei *count, GLenum type,
+                                                     const void *const *indices, GLsizei drawCount,
+                                                     const GLint *baseVertex) {
+        Gm::GlTraceRecorder &recorder = Recorder();
+        recorder.BeginCall(OpMultiDrawElementsBaseVertex);
+        recorder.Put(mode);
+        recorder.Put(type);
+        recorder.Put(drawCount);
+        for (GLsizei i = 0; i < drawCount; ++i) {
+            recorder.Put(count[i]);
+            recorder.Put(indices[i]);
+            recorder.Put(baseVertex[i]);
+        }
+        recorder.EndCall();
+        Real<PFNGLMULTIDRAWELEMENTSBASEVERTEXPROC>(OpMultiDrawElementsBaseVertex)(mode, count, type, indices,
+                                                                                   drawCount, baseVertex);
+    }
+
+    void GLAPIENTRY TraceShaderSource(GLuint shader, GLsizei count, const GLchar *const *strings,
+                                      const GLint *lengths) {
+        Gm::GlTraceRecorder &recorder = Recorder();
+        std::vector<uint32_t> blobs((size_t) count);
+        std::vector<uint64_t> sizes((size_t) count);
+        for (GLsizei i = 0; i < count; ++i) {
+            sizes[i] = lengths != nullptr && lengths[i] >= 0 ? (size_t) lengths[i] : strlen(strings[i]);
+            blobs[i] = recorder.Blob(strings[i], sizes[i]);
+        }
+        recorder.BeginCall(OpShaderSource);
+        recorder.Put(shader);
+        recorder.Put(count);
+        for (GLsizei i = 0; i < count; ++i) {
+            recorder.Put(sizes[i]);
+            recorder.Put(blobs[i]);
+        }
+        recorder.EndCall();
+        Real<PFNGLSHADERSOURCEPROC>(OpShaderSource)(shader, count, strings, lengths);
+    }
+
+    void GLAPIENTRY TraceTexImage2D(GLenum target, GLint level, GLint internalFormat, GLsizei width, GLsizei height,
+                                    GLint border, GLenum format, GLenum type, const void *pixels) {
+        Gm::GlTraceRecorder &recorder = Recorder();
+        uint32_t blob = pixels != nullptr ? recorder.Blob(pixels, ImageBytes(width, height, 1, format, type))
+                                          : NullBlob;
+        recorder.BeginCall(OpTexImage2D);
+        recorder.Put(target);
+        recorder.Put(level);
+        recorder.Put(internalFormat);
+        recorder.Put(width);
+        recorder.Put(height);
+        recorder.Put(border);
+        recorder.Put(format);
+        recorder.Put(type);
+        recorder.Put(blob);
+        recorder.EndCall();
+        Real<PFNGLTEXIMAGE2DPROC>(OpTexImage2D)(target, level, internalFormat, width, height, border, format, type,
+                                                 pixels);
+    }
+
+    void GLAPIENTRY TraceTexImage3D(GLenum target, GLint level, GLint internalFormat, GLsizei width, GLsizei height,
+                                    GLsizei depth, GLint border, GLenum format, GLenum type, const void *pixels) {
+        Gm::GlTraceRecorder &recorder = Recorder();
+        uint32_t blob = pixels != nullptr ? recorder.Blob(pixels, ImageBytes(width, height, depth, format, type))
+                                          : NullBlob;
+        recorder.BeginCall(OpTexImage3D);
+        recorder.Put(target);
+        recorder.Put(level);
+        recorder.Put(internalFormat);
+        recorder.Put(width);
+        recorder.Put(height);
+        recorder.Put(depth);
+        recorder.Put(border);
+        recorder.Put(format);
+        recorder.Put(type);
+        recorder.Put(blob);
+        recorder.EndCall();
+        Real<PFNGLTEXIMAGE3DPROC>(OpTexImage3D)(target, level, internalFormat, width, height, depth, border, format,
+                                                 type, pixels);
+    }
+
+    void GLAPIENTRY TraceUniform4fv(GLint location, GLsizei count, const GLfloat *value) {
+        Gm::GlTraceRecorder &recorder = Recorder();
+        uint32_t blob = recorder.Blob(value, sizeof(GLfloat) * 4 * count);
+        recorder.BeginCall(OpUniform4fv);
+        recorder.Put(location);
+        recorder.Put(count);
+        recorder.Put(blob);
+        recorder.EndCall();
+        Real<PFNGLUNIFORM4FVPROC>(OpUniform4fv)(location, count, value);
+    }
+
+    void GLAPIENTRY TraceUniformMatrix4fv(GLint location, GLsizei count, GLboolean transpose, const GLfloat *value) {
+        Gm::GlTraceRecorder &recorder = Recorder();
+        uint32_t blob = recorder.Blob(value, sizeof(GLfloat) * 16 * count);
+        recorder.BeginCall(OpUniformMatrix4fv);
+        recorder.Put(location);
+        recorder.Put(count);
+        recorder.Put(transpose);
+        recorder.Put(blob);
+        recorder.EndCall();
+        Real<PFNGLUNIFORMMATRIX4FVPROC>(OpUniformMatrix4fv)(location, count, transpose, value);
+    }
+}
+
+Gm::GlTraceRecorder &Gm::GlTraceRecorder::Instance() {
+    static GlTraceRecorder recorder;
+    return recorder;
+}
+
+bool Gm::GlTraceRecorder::Start(const char *path) {
+    Stop();
+    // read as well, a blob's hash is confirmed against its bytes in the file
+    m_file = fopen(path, "w+b");
+    if (m_file == nullptr) {
+        fprintf(stderr, "can't write %s\n", path);
+        return false;
+    }
+    m_buffer.clear();
+    m_blobs.clear();
+    m_nextBlob = 0;
+    m_stats = GlTraceStats();
+    // the header, the viewport is filled in by the first Hook
+    m_buffer.resize(HeaderSize, 0);
+    memcpy(m_buffer.data(), Magic, sizeof(Magic));
+    memcpy(m_buffer.data() + 8, &Version, sizeof(Version));
+    return true;
+}
+
+void Gm::GlTraceRecorder::Hook() {
+    if (m_file == nullptr) {
+        return;
+    }
+    if (m_stats.bytesWritten == 0 && m_buffer.size() == HeaderSize) {
+        // GL is loaded now, and nothing was captured yet
+        GLint viewport[4] = {0, 0, 0, 0};
+        glGetIntegerv(GL_VIEWPORT, viewport);
+        memcpy(m_buffer.data() + 16, viewport, sizeof(viewport));
+    }
+#define GM_HOOK_SCALAR(name) HookScalar<Op##name>(glad_gl##name);
+#define GM_HOOK_DATA(name) HookData(Op##name, glad_gl##name, Trace##name);
+    GM_GL_CALLS(GM_HOOK_SCALAR, GM_HOOK_SCALAR, GM_HOOK_DATA)
+#undef GM_HOOK_SCALAR
+#undef GM_HOOK_DATA
+}
+
+void Gm::GlTraceRecorder::Stop() {
+    if (m_file == nullptr) {
+        return;
+    }
+#define GM_UNHOOK(name) Unhook(Op##name, glad_gl##name);
+    GM_GL_CALLS(GM_UNHOOK, GM_UNHOOK, GM_UNHOOK)
+#undef GM_UNHOOK
+    Flush();
+    fclose(m_file);
+    m_file = nullptr;
+    m_buffer = std::vector<uint8_t>();
+    m_blobs.clear();
+}
+
+void Gm::GlTraceRecorder::BeginFrame() {
+    if (m_file != nullptr) {
+        WriteRecord(OpBeginFrame, nullptr, 0);
+    }
+}
+
+void Gm::GlTraceRecorder::EndFrame() {
+    if (m_file == nullptr) {
+        return;
+    }
+    WriteRecord(OpEndFrame, nullptr, 0);
+    ++m_stats.frames;
+    // a session that crashes keeps the frames before
+    Flush();
+}
+
+void Gm::GlTraceRecorder::BeginCall(uint16_t op) {
+    m_callStart = m_buffer.size();
+    RecordHeader header = {op, 0, 0};
+    m_buffer.insert(m_buffer.end(), (const uint8_t *) &header, (const uint8_t *) &header + sizeof(header));
+}
+
+void Gm::GlTraceRecorder::PutBytes(const void *data, size_t size) {
+    m_buffer.insert(m_buffer.end(), (const uint8_t *) data, (const uint8_t *) data + size);
+}
+
+void Gm::GlTraceRecorder::EndCall() {
+    uint32_t size = (uint32_t) (m_buffer.size() - m_callStart - sizeof(RecordHeader));
+    memcpy(m_buffer.data() + m_callStart + offsetof(RecordHeader, size), &size, sizeof(size));
+    m_buffer.resize(m_buffer.size() + Padding(size), 0);
+    ++m_stats.calls;
+    if (m_buffer.size() >= FlushSize) {
+        Flush();
+    }
+}
+
+uint32_t Gm::GlTraceRecorder::Blob(const void *data, size_t size) {
+    if (data == nullptr) {
+        return NullBlob;
+    }
+    m_stats.dataBytes += size;
+    // a hash hit is only taken when the bytes match, a collision writes a blob of its own
+    uint64_t hash = Hash(data, size);
+    auto found = m_blobs.find(hash);
+    if (found != m_blobs.end() && found->second.size == size && BlobMatches(found->second.offset, data, size)) {
+        m_stats.dedupedBytes += size;
+        return found->second.id;
+    }
+    uint32_t id = m_nextBlob++;
+
+    uint8_t prefix[sizeof(RecordHeader) + BlobPrefix] = {};
+    RecordHeader header = {OpBlob, 0, (uint32_t) (BlobPrefix + size)};
+    uint64_t size64 = size;
+    memcpy(prefix, &header, sizeof(header));
+    memcpy(prefix + sizeof(header), &id, sizeof(id));
+    memcpy(prefix + sizeof(header) + 8, &size64, sizeof(size64));
+    PutBytes(prefix, sizeof(prefix));
+    m_blobs[hash] = {id, (uint64_t) size, m_stats.bytesWritten + m_buffer.size()};
+    if (size >= LargeWrite) {
+        // no copy through the buffer
+        Flush();
+        fwrite(data, 1, size, m_file);
+        m_stats.bytesWritten += size;
+    } else {
+        PutBytes(data, size);
+    }
+    m_buffer.resize(m_buffer.size() + Padding(size), 0);
+    return id;
+}
+
+bool Gm::GlTraceRecorder::BlobMatches(uint64_t offset, const void *data, size_t size) {
+    if (offset >= m_stats.bytesWritten) {
+        // not flushed yet, a blob is either all in the buffer or all in the file
+        return memcmp(m_buffer.data() + (offset - m_stats.bytesWritten), data, size) == 0;
+    }
+    const uint8_t *bytes = (const uint8_t *) data;
+    uint8_t chunk[64 * 1024];
+    bool matches = fseek(m_file, (long) offset, SEEK_SET) == 0;
+    for (size_t done = 0; matches && done < size;) {
+        size_t count = std::min(size - done, sizeof(chunk));
+        matches = fread(chunk, 1, count, m_file) == count && memcmp(chunk, bytes + done, count) == 0;
+        done += count;
+    }
+    // back to appending
+    fseek(m_file, 0, SEEK_END);
+    return matches;
+}
+
+void Gm::GlTraceRecorder::WriteRecord(uint16_t op, const void *payload, size_t size) {
+    RecordHeader header = {op, 0, (uint32_t) size};
+    PutBytes(&header, sizeof(header));
+    if (size > 0) {
+        PutBytes(payload, size);
+        m_buffer.resize(m_buffer.size() + Padding(size), 0);
+    }
+}
+
+void Gm::GlTraceRecorder::Flush() {
+    if (m_file != nullptr && !m_buffer.empty()) {
+        fwrite(m_buffer.data(), 1, m_buffer.size(), m_file);
+        m_stats.bytesWritten += m_buffer.size();
+    }
+    m_buffer.clear();
+}
+
+struct Gm::GlTraceReplayer::Reader {
+    const uint8_t *cursor;
+
+    template<typename T>
+    T Get() {
+        return Get<T>(std::is_pointer<T>());
+    }
+
+    template<typename T>
+    T Get(std::false_type) {
+        T value;
+        memcpy(&value, cursor, sizeof(T));
+        cursor += sizeof(T);
+        return value;
+    }
+
+    // pointers were written as 64 bit offsets
+    template<typename T>
+    T Get(std::true_type) {
+        return (T) (uintptr_t) Get<uint64_t>(std::false_type());
+    }
+
+    std::string String() {
+        uint32_t length = Get<uint32_t>();
+        std::string text((const char *) cursor, length);
+        cursor += length;
+        return text;
+    }
+};
+
+namespace {
+    template<typename R, typename... A, size_t... I>
+    void Apply(R (APIENTRYP function)(A...), std::tuple<A...> &args, std::index_sequence<I...>) {
+        function(std::get<I>(args)...);
+    }
+
+    // a SCALAR call as it was captured, arguments are read in order inside the braces
+    template<typename Reader, typename R, typename... A>
+    void Invoke(Reader &reader, R (APIENTRYP function)(A...)) {
+        std::tuple<A...> args{reader.template Get<A>()...};
+        Apply(function, args, std::index_sequence_for<A...>());
+    }
+}
+
+bool Gm::GlTraceReplayer::Load(const char *path) {
+    m_error.clear();
+    m_blobOffsets.clear();
+    m_frames.clear();
+    m_callCount = 0;
+    FILE *file = fopen(path, "rb");
+    if (file == nullptr) {
+        m_error = std::string("can't read ") + path;
+        return false;
+    }
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    m_size = size > 0 ? (size_t) size : 0;
+    m_storage.assign((m_size + 7) / 8, 0);
+    bool read = fread(m_storage.data(), 1, m_size, file) == m_size;
+    fclose(file);
+    const uint8_t *data = (const uint8_t *) m_storage.data();
+    uint32_t version = 0;
+    if (read && m_size >= HeaderSize) {
+        memcpy(&version, data + 8, sizeof(version));
+    }
+    if (!read || m_size < HeaderSize || memcmp(data, Magic, sizeof(Magic)) != 0 || version != Version) {
+        m_error = std::string(path) + " is not a GL trace of this version";
+        return false;
+    }
+    memcpy(m_viewport, data + 16, sizeof(m_viewport));
+
+    // index the blobs and frames; a session that ended without Stop leaves a partial record, the trace ends
+    // before it
+    m_setupEnd = 0;
+    size_t frameBegin = 0;
+    size_t offset = HeaderSize;
+    while (offset + sizeof(RecordHeader) <= m_size) {
+        RecordHeader header;
+        memcpy(&header, data + offset, sizeof(header));
+        size_t next = offset + sizeof(header) + header.size + Padding(header.size);
+        if (next > m_size || header.op >= OpCount) {
+            break;
+        }
+        if (header.op == OpBlob) {
+            uint32_t id;
+            memcpy(&id, data + offset + sizeof(header), sizeof(id));
+            if (id != m_blobOffsets.size()) {
+                break;
+            }
+            m_blobOffsets.push_back(offset + sizeof(header) + BlobPrefix);
+        } else if (header.op == OpBeginFrame) {
+            m_setupEnd = m_setupEnd == 0 ? offset : m_setupEnd;
+            frameBegin = next;
+        } else if (header.op == OpEndFrame) {
+            m_frames.push_back(std::make_pair(frameBegin, offset));
+        } else {
+            ++m_callCount;
+        }
+        offset = next;
+    }
+    m_size = std::min(offset, m_size);
+    m_setupEnd = m_setupEnd == 0 ? m_size : m_setupEnd;
+    return true;
+}
+
+void Gm::GlTraceReplayer::ReplaySetup() {
+    for (std::unordered_map<GLuint, GLuint> &names : m_names) {
+        names.clear();
+    }
+    m_locations.clear();
+    m_program = 0;
+    GLint framebuffer = 0;
+    glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &framebuffer);
+    m_defaultFramebuffer = (GLuint) framebuffer;
+    m_callsReplayed = 0;
+    Replay(HeaderSize, m_setupEnd);
+}
+
+void Gm::GlTraceReplayer::ReplayFrame(size_t frame) {
+    if (frame < m_frames.size()) {
+        Replay(m_frames[frame].first, m_frames[frame].second);
+    }
+}
+
+void Gm::GlTraceReplayer::ReplayAll() {
+    ReplaySetup();
+    Replay(m_setupEnd, m_size);
+}
+
+void Gm::GlTraceReplayer::Replay(size_t begin, size_t end) {
+    const uint8_t *data = (const uint8_t *) m_storage.data();
+    size_t offset = begin;
+    while (offset < end) {
+        RecordHeader header;
+        memcpy(&header, data + offset, sizeof(header));
+        if (header.op > OpEndFrame) {
+            Reader reader = {data + offset + sizeof(header)};
+            Execute(header.op, reader);
+            ++m_callsReplayed;
+        }
+        offset += sizeof(header) + header.size + Padding(header.size);
+    }
+}
+
+const void *Gm::GlTraceReplayer::BlobData(uint32_t blob) const {
+    if (blob >= m_blobOffsets.size()) {
+        return nullptr;
+    }
+    return (const uint8_t *) m_storage.data() + m_blobOffsets[blob];
+}
+
+GLuint Gm::GlTraceReplayer::Map(Namespace space, GLuint name) const {
+    if (name == 0) {
+        return 0;
+    }
+    auto found = m_names[space].find(name);
+    if (found != m_names[space].end()) {
+        return found->second;
+    }
+    // made before the capture started
+    return space == Framebuffers ? m_defaultFramebuffer : name;
+}
+
+GLint Gm::GlTraceReplayer::MapLocation(GLint location) const {
+    auto found = m_locations.find(((uint64_t) m_program << 32) | (uint32_t) location);
+    return found != m_locations.end() ? found->second : location;
+}
+
+void Gm::GlTraceReplayer::Generated(Namespace space, GLsizei count, const GLuint *captured,
+                                    const GLuint *replayed) {
+    for (GLsizei i = 0; i < count; ++i) {
+        m_names[space][captured[i]] = replayed[i];
+    }
+}
+
+void Gm::GlTraceReplayer::Deleted(Namespace space, GLsizei count, const GLuint *captured, GLuint *replayed) {
+    for (GLsizei i = 0; i < count; ++i) {
+        replayed[i] = Map(space, captured[i]);
+        // the driver may hand the captured name out again
+        if (space != Framebuffers || m_names[space].count(captured[i]) != 0) {
+            m_names[space].erase(captured[i]);
+        } else {
+            // never delete what the replay draws into
+            replayed[i] = 0;
+        }
+    }
+}
+
+void Gm::GlTraceReplayer::Execute(uint16_t op, Reader &reader) {
+    // what the getters write, the replay doesn't look at it
+    static GLint64 sink[64];
+    static char logSink[4096];
+    switch (op) {
+#define GM_REPLAY_SCALAR(name) \
+        case Op##name: \
+            Invoke(reader, glad_gl##name); \
+            break;
+#define GM_REPLAY_NONE(name)
+        GM_GL_CALLS(GM_REPLAY_SCALAR, GM_REPLAY_NONE, GM_REPLAY_NONE)
+#undef GM_REPLAY_SCALAR
+#undef GM_REPLAY_NONE
+
+        case OpAttachShader: {
+            GLuint program = reader.Get<GLuint>(), shader = reader.Get<GLuint>();
+            glAttachShader(Map(Programs, program), Map(Programs, shader));
+            break;
+        }
+        case OpBeginQuery: {
+            GLenum target = reader.Get<GLenum>();
+            GLuint query = reader.Get<GLuint>();
+            glBeginQuery(target, Map(Queries, query));
+            break;
+        }
+        case OpBindBuffer: {
+            GLenum target = reader.Get<GLenum>();
+            GLuint buffer = reader.Get<GLuint>();
+            glBindBuffer(target, Map(Buffers, buffer));
+            break;
+        }
+        case OpBindBufferBase: {
+            GLenum target = reader.Get<GLenum>();
+            GLuint index = reader.Get<GLuint>(), buffer = reader.Get<GLuint>();
+            glBindBufferBase(target, index, Map(Buffers, buffer));
+            break;
+        }
+        case OpBindFramebuffer: {
+            GLenum target = reader.Get<GLenum>();
+            GLuint framebuffer = reader.Get<GLuint>();
+            glBindFramebuffer(target, Map(Framebuffers, framebuffer));
+            break;
+        }
+        case OpBindImageTexture: {
+            GLuint unit = reader.Get<GLuint>(), texture = reader.Get<GLuint>();
+            GLint level = reader.Get<GLint>();
+            GLboolean layered = reader.Get<GLboolean>();
+            GLint layer = reader.Get<GLint>();
+            GLenum access = reader.Get<GLenum>(), format = reader.Get<GLenum>();
+            glBindImageTexture(unit, Map(Textures, texture), level, layered, layer, access, format);
+            break;
+        }
+        case OpBindRenderbuffer: {
+            GLenum target = reader.Get<GLenum>();
+            GLuint renderbuffer = reader.Get<GLuint>();
+            glBindRenderbuffer(target, Map(Renderbuffers, renderbuffer));
+            break;
+        }
+        case OpBindTexture: {
+            GLenum target = reader.Get<GLenum>();
+            GLuint texture = reader.Get<GLuint>();
+            glBindTexture(target, Map(Textures, texture));
+            break;
+        }
+        case OpBindVertexArray:
+            glBindVertexArray(Map(VertexArrays, reader.Get<GLuint>()));
+            break;
+        case OpBindAttribLocation: {
+            GLuint program = reader.Get<GLuint>(), index = reader.Get<GLuint>();
+            std::string name = reader.String();
+            glBindAttribLocation(Map(Programs, program), index, name.c_str());
+            break;
+        }
+        case OpBufferData: {
+            GLenum target = reader.Get<GLenum>();
+            int64_t size = reader.Get<int64_t>();
+            uint32_t blob = reader.Get<uint32_t>();
+            GLenum usage = reader.Get<GLenum>();
+            glBufferData(target, (GLsizeiptr) size, BlobData(blob), usage);
+            break;
+        }
+        case OpBufferSubData: {
+            GLenum target = reader.Get<GLenum>();
+            int64_t offset = reader.Get<int64_t>(), size = reader.Get<int64_t>();
+            uint32_t blob = reader.Get<uint32_t>();
+            glBufferSubData(target, (GLintptr) offset, (GLsizeiptr) size, BlobData(blob));
+            break;
+        }
+        case OpCompileShader:
+            glCompileShader(Map(Programs, reader.Get<GLuint>()));
+            break;
+        case OpCompressedTexImage2D: {
+            GLenum target = reader.Get<GLenum>();
+            GLint level = reader.Get<GLint>();
+            GLenum internalFormat = reader.Get<GLenum>();
+            GLsizei width = reader.Get<GLsizei>(), height = reader.Get<GLsizei>();
+            GLint border = reader.Get<GLint>();
+            GLsizei imageSize = reader.Get<GLsizei>();
+            uint32_t blob = reader.Get<uint32_t>();
+            glCompressedTexImage2D(target, level, internalFormat, width, height, border, imageSize, BlobData(blob));
+            break;
+        }
+        case OpCompressedTexImage3D: {
+            GLenum target = reader.Get<GLenum>();
+            GLint level = reader.Get<GLint>();
+            GLenum internalFormat = reader.Get<GLenum>();
+            GLsizei width = reader.Get<GLsizei>(), height = reader.Get<GLsizei>(), depth = reader.Get<GLsizei>();
+            GLint border = reader.Get<GLint>();
+            GLsizei imageSize = reader.Get<GLsizei>();
+            uint32_t blob = reader.Get<uint32_t>();
+            glCompressedTexImage3D(target, level, internalFormat, width, height, depth, border, imageSize,
+                                   BlobData(blob));
+            break;
+        }
+        case OpCreateProgram: {
+            GLuint captured = reader.Get<GLuint>();
+            m_names[Programs][captured] = glCreateProgram();
+            break;
+        }
+        case OpCreateShader: {
+            GLenum type = reader.Get<GLenum>();
+            GLuint captured = reader.Get<GLuint>();
+            m_names[Programs][captured] = glCreateShader(type);
+            break;
+        }
+        case OpDeleteProgram: {
+            GLuint program = reader.Get<GLuint>();
+            glDeleteProgram(Map(Programs, program));
+            m_names[Programs].erase(program);
+            break;
+        }
+        case OpDeleteShader: {
+            GLuint shader = reader.Get<GLuint>();
+            glDeleteShader(Map(Programs, shader));
+            m_names[Programs].erase(shader);
+            break;
+        }
+#define GM_REPLAY_NAMES(name, space, generate) \
+        case Op##name: { \
+            GLsizei count = reader.Get<GLsizei>(); \
+            std::vector<GLuint> captured((size_t) count), replayed((size_t) count); \
+            memcpy(captured.data(), reader.cursor, sizeof(GLuint) * count); \
+            if (generate) { \
+                gl##name(count, replayed.data()); \
+                Generated(space, count, captured.data(), replayed.data()); \
+            } else { \
+                Deleted(space, count, captured.data(), replayed.data()); \
+                gl##name(count, replayed.data()); \
+            } \
+            break; \
+        }
+        GM_REPLAY_NAMES(GenBuffers, Buffers, true)
+        GM_REPLAY_NAMES(GenFramebuffers, Framebuffers, true)
+        GM_REPLAY_NAMES(GenQueries, Queries, true)
+        GM_REPLAY_NAMES(GenRenderbuffers, Renderbuffers, true)
+        GM_REPLAY_NAMES(GenTextures, Textures, true)
+        GM_REPLAY_NAMES(GenVertexArrays, VertexArrays, true)
+        GM_REPLAY_NAMES(DeleteBuffers, Buffers, false)
+        GM_REPLAY_NAMES(DeleteFramebuffers, Framebuffers, false)
+        GM_REPLAY_NAMES(DeleteQueries, Queries, false)
+        GM_REPLAY_NAMES(DeleteRenderbuffers, Renderbuffers, false)
+        GM_REPLAY_NAMES(DeleteTextures, Textures, false)
+        GM_REPLAY_NAMES(DeleteVertexArrays, VertexArrays, false)
+#undef GM_REPLAY_NAMES
+        case OpFramebufferRenderbuffer: {
+            GLenum target = reader.Get<GLenum>(), attachment = reader.Get<GLenum>();
+            GLenum renderbufferTarget = reader.Get<GLenum>();
+            GLuint renderbuffer = reader.Get<GLuint>();
+            glFramebufferRenderbuffer(target, attachment, renderbufferTarget, Map(Renderbuffers, renderbuffer));
+            break;
+        }
+        case OpFramebufferTexture2D: {
+            GLenum target = reader.Get<GLenum>(), attachment = reader.Get<GLenum>();
+            GLenum textureTarget = reader.Get<GLenum>();
+            GLuint texture = reader.Get<GLuint>();
+            GLint level = reader.Get<GLint>();
+            glFramebufferTexture2D(target, attachment, textureTarget, Map(Textures, texture), level);
+            break;
+        }
+        case OpGetFramebufferAttachmentParameteriv: {
+            GLenum target = reader.Get<GLenum>(), attachment = reader.Get<GLenum>(), pname = reader.Get<GLenum>();
+            glGetFramebufferAttachmentParameteriv(target, attachment, pname, (GLint *) sink);
+            break;
+        }
+        case OpGetInteger64v:
+            glGetInteger64v(reader.Get<GLenum>(), sink);
+            break;
+        case OpGetIntegerv:
+            glGetIntegerv(reader.Get<GLenum>(), (GLint *) sink);
+            break;
+        case OpGetProgramInfoLog: {
+            GLuint program = reader.Get<GLuint>();
+            GLsizei size = std::min(reader.Get<GLsizei>(), (GLsizei) sizeof(logSink));
+            glGetProgramInfoLog(Map(Programs, program), size, nullptr, logSink);
+            break;
+        }
+        case OpGetProgramiv: {
+            GLuint program = reader.Get<GLuint>();
+            GLenum pname = reader.Get<GLenum>();
+            glGetProgramiv(Map(Programs, program), pname, (GLint *) sink);
+            break;
+        }
+        case OpGetQueryObjectiv: {
+            GLuint query = reader.Get<GLuint>();
+            GLenum pname = reader.Get<GLenum>();
+            glGetQueryObjectiv(Map(Queries, query), pname, (GLint *) sink);
+            break;
+        }
+        case OpGetQueryObjectui64v: {
+            GLuint query = reader.Get<GLuint>();
+            GLenum pname = reader.Get<GLenum>();
+            glGetQueryObjectui64v(Map(Queries, query), pname, (GLuint64 *) sink);
+            break;
+        }
+        case OpGetShaderInfoLog: {
+            GLuint shader = reader.Get<GLuint>();
+            GLsizei size = std::min(reader.Get<GLsizei>(), (GLsizei) sizeof(logSink));
+            glGetShaderInfoLog(Map(Programs, shader), size, nullptr, logSink);
+            break;
+        }
+        case OpGetShaderiv: {
+            GLuint shader = reader.Get<GLuint>();
+            GLenum pname = reader.Get<GLenum>();
+            glGetShaderiv(Map(Programs, shader), pname, (GLint *) sink);
+            break;
+        }
+        case OpGetUniformLocation: {
+            GLuint program = reader.Get<GLuint>();
+            GLint captured = reader.Get<GLint>();
+            std::string name = reader.String();
+            GLint location = glGetUniformLocation(Map(Programs, program), name.c_str());
+            m_locations[((uint64_t) program << 32) | (uint32_t) captured] = location;
+            break;
+        }
+        case OpLinkProgram:
+            glLinkProgram(Map(Programs, reader.Get<GLuint>()));
+            break;
+        case OpMultiDrawElementsBaseVertex: {
+            GLenum mode = reader.Get<GLenum>(), type = reader.Get<GLenum>();
+            GLsizei drawCount = reader.Get<GLsizei>();
+            std::vector<GLsizei> counts((size_t) drawCount);
+            std::vector<const void *> indices((size_t) drawCount);
+            std::vector<GLint> baseVertices((size_t) drawCount);
+            for (GLsizei i = 0; i < drawCount; ++i) {
+                counts[i] = reader.Get<GLsizei>();
+                indices[i] = reader.Get<const void *>();
+                baseVertices[i] = reader.Get<GLint>();
+            }
+            glMultiDrawElementsBaseVertex(mode, counts.data(), type, indices.data(), drawCount, baseVertices.data());
+            break;
+        }
+        case OpQueryCounter: {
+            GLuint query = reader.Get<GLuint>();
+            GLenum target = reader.Get<GLenum>();
+            glQueryCounter(Map(Queries, query), target);
+            break;
+        }
+        case OpShaderSource: {
+            GLuint shader = reader.Get<GLuint>();
+            GLsizei count = reader.Get<GLsizei>();
+            std::vector<const GLchar *> strings((size_t) count);
+            std::vector<GLint> lengths((size_t) count);
+            for (GLsizei i = 0; i < count; ++i) {
+                lengths[i] = (GLint) reader.Get<uint64_t>();
+                strings[i] = (const GLchar *) BlobData(reader.Get<uint32_t>());
+            }
+            glShaderSource(Map(Programs, shader), count, strings.data(), lengths.data());
+            break;
+        }
+        case OpTexBuffer: {
+            GLenum target = reader.Get<GLenum>(), internalFormat = reader.Get<GLenum>();
+            GLuint buffer = reader.Get<GLuint>();
+            glTexBuffer(target, internalFormat, Map(Buffers, buffer));
+            break;
+        }
+        case OpTexImage2D: {
+            GLenum target = reader.Get<GLenum>();
+            GLint level = reader.Get<GLint>(), internalFormat = reader.Get<GLint>();
+            GLsizei width = reader.Get<GLsizei>(), height = reader.Get<GLsizei>();
+            GLint border = reader.Get<GLint>();
+            GLenum format = reader.Get<GLenum>(), type = reader.Get<GLenum>();
+            uint32_t blob = reader.Get<uint32_t>();
+            glTexImage2D(target, level, internalFormat, width, height, border, format, type, BlobData(blob));
+            break;
+        }
+        case OpTexImage3D: {
+            GLenum target = reader.Get<GLenum>();
+            GLint level = reader.Get<GLint>(), internalFormat = reader.Get<GLint>();
+            GLsizei width = reader.Get<GLsizei>(), height = reader.Get<GLsizei>(), depth = reader.Get<GLsizei>();
+            GLint border = reader.Get<GLint>();
+            GLenum format = reader.Get<GLenum>(), type = reader.Get<GLenum>();
+            uint32_t blob = reader.Get<uint32_t>();
+            glTexImage3D(target, level, internalFormat, width, height, depth, border, format, type, BlobData(blob));
+            break;
+        }
+        case OpUniform1i: {
+            GLint location = reader.Get<GLint>(), value = reader.Get<GLint>();
+            glUniform1i(MapLocation(location), value);
+            break;
+        }
+        case OpUniform1ui: {
+            GLint location = reader.Get<GLint>();
+            GLuint value = reader.Get<GLuint>();
+            glUniform1ui(MapLocation(location), value);
+            break;
+        }
+        case OpUniform2i: {
+            GLint location = reader.Get<GLint>(), x = reader.Get<GLint>(), y = reader.Get<GLint>();
+            glUniform2i(MapLocation(location), x, y);
+            break;
+        }
+        case OpUniform4fv: {
+            GLint location = reader.Get<GLint>();
+            GLsizei count = reader.Get<GLsizei>();
+            uint32_t blob = reader.Get<uint32_t>();
+            glUniform4fv(MapLocation(location), count, (const GLfloat *) BlobData(blob));
+            break;
+        }
+        case OpUniformMatrix4fv: {
+            GLint location = reader.Get<GLint>();
+            GLsizei count = reader.Get<GLsizei>();
+            GLboolean transpose = reader.Get<GLboolean>();
+            uint32_t blob = reader.Get<uint32_t>();
+            glUniformMatrix4fv(MapLocation(location), count, transpose, (const GLfloat *) BlobData(blob));
+            break;
+        }
+        case OpUseProgram:
+            m_program = reader.Get<GLuint>();
+            glUseProgram(Map(Programs, m_program));
+            break;
+        default:
+            break;
+    }
+}
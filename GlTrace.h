@@ -0,0 +1,192 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "glad/glad.h"
+
+// Capture of the GL call stream into a compact binary trace, and its replay on another context.
+//
+// glad calls GL through one function pointer per entry point (glad_glDrawElements and the rest); capturing
+// swaps the pointers of the entry points this renderer uses for wrappers that serialize the arguments and
+// everything the pointers among them point at, then call the driver. Data goes into the trace once: repeated
+// uploads of the same bytes (a static instance buffer, the same matrices) refer back to the first copy.
+// The replayer re-executes the calls on the current context, mapping the names the driver hands out then
+// to the ones it hands out now, so a trace of a customer session runs on any machine, headless included.
+//
+// GL calls not in GM_GL_CALLS (GlCalls.h) go straight to the driver and are missing from the trace.
+
+namespace Gm {
+    struct GlTraceStats {
+        uint64_t calls = 0;
+        uint64_t frames = 0;
+        uint64_t bytesWritten = 0;
+        // data the calls pointed at, and the part of it written as a reference to an earlier copy
+        uint64_t dataBytes = 0;
+        uint64_t dedupedBytes = 0;
+    };
+
+    class GlTraceRecorder {
+    public:
+        static GlTraceRecorder &Instance();
+
+        // Opens `path`, calls are captured from the next Hook on. For a trace that replays, start before
+        // the resources are created: GraphicsManager::Initialize hooks right after loading GL, and starts a
+        // capture itself when GM_GL_TRACE names a file. GraphicsManager::Finalize stops it.
+        bool Start(const char *path);
+
+        // puts the wrappers in place of glad's pointers while capturing, needed again after every gladLoadGL
+        void Hook();
+
+        // restores glad's pointers, writes out what is buffered and closes the file
+        void Stop();
+
+        bool IsCapturing() const { return m_file != nullptr; }
+
+        // the calls between the two are one frame of the trace, see GlTraceReplayer::ReplayFrame
+        void BeginFrame();
+
+        void EndFrame();
+
+        GlTraceStats GetStats() const { return m_stats; }
+
+        // used by the wrappers
+        void BeginCall(uint16_t op);
+
+        template<typename T>
+        void Put(T value) {
+            PutBytes(&value, sizeof(T));
+        }
+
+        void Put(const void *pointer) {
+            // an offset into the bound buffer, as GL takes them in a core profile
+            Put((uint64_t) (uintptr_t) pointer);
+        }
+
+        void PutBytes(const void *data, size_t size);
+
+        // the bytes as a blob record of their own, or the id of an identical earlier one; call before
+        // BeginCall, the call refers to the blob by the id returned
+        uint32_t Blob(const void *data, size_t size);
+
+        void EndCall();
+
+    private:
+        void WriteRecord(uint16_t op, const void *payload, size_t size);
+
+        void Flush();
+
+        FILE *m_file = nullptr;
+        std::vector<uint8_t> m_buffer;
+        // where the call being written starts in m_buffer
+        size_t m_callStart = 0;
+        // true when the `size` bytes written at `offset` in the trace are those at `data`
+        bool BlobMatches(uint64_t offset, const void *data, size_t size);
+
+        struct BlobEntry {
+            uint32_t id;
+            uint64_t size;
+            // of the bytes, in the trace file
+            uint64_t offset;
+        };
+
+        // hash of the bytes to the last blob written with it
+        std::unordered_map<uint64_t, BlobEntry> m_blobs;
+        uint32_t m_nextBlob = 0;
+        GlTraceStats m_stats;
+    };
+
+    // a frame of the trace from here to the end of the scope; made first, it ends after the other locals, the
+    // GPU profile scopes that issue a query on their way out included
+    struct GlTraceFrameScope {
+        GlTraceFrameScope() { GlTraceRecorder::Instance().BeginFrame(); }
+
+        ~GlTraceFrameScope() { GlTraceRecorder::Instance().EndFrame(); }
+
+        GlTraceFrameScope(const GlTraceFrameScope &) = delete;
+
+        GlTraceFrameScope &operator=(const GlTraceFrameScope &) = delete;
+    };
+
+    class GlTraceReplayer {
+    public:
+        // reads the whole trace into memory, false if it isn't one
+        bool Load(const char *path);
+
+        const std::string &Error() const { return m_error; }
+
+        // the viewport when the capture started, the size to make the context to replay on
+        int Width() const { return m_viewport[2]; }
+
+        int Height() const { return m_viewport[3]; }
+
+        size_t FrameCount() const { return m_frames.size(); }
+
+        uint64_t CallCount() const { return m_callCount; }
+
+        // The calls before the first frame, on the context current on this thread: the resources and state
+        // the frames start from. Forgets the names of an earlier replay.
+        void ReplaySetup();
+
+        // One frame, after the setup. Names generated in a frame are mapped again when it is replayed again,
+        // the first time through the frames go in order, after that any frame can be repeated.
+        void ReplayFrame(size_t frame);
+
+        // setup, every frame and whatever came after the last, e.g. the deletes of Finalize
+        void ReplayAll();
+
+        uint64_t CallsReplayed() const { return m_callsReplayed; }
+
+    private:
+        enum Namespace {
+            Buffers,
+            Textures,
+            VertexArrays,
+            Queries,
+            Framebuffers,
+            Renderbuffers,
+            // shaders and programs share theirs
+            Programs,
+            NamespaceCount,
+        };
+
+        struct Reader;
+
+        void Replay(size_t begin, size_t end);
+
+        void Execute(uint16_t op, Reader &reader);
+
+        GLuint Map(Namespace space, GLuint name) const;
+
+        GLint MapLocation(GLint location) const;
+
+        void Generated(Namespace space, GLsizei count, const GLuint *captured, const GLuint *replayed);
+
+        void Deleted(Namespace space, GLsizei count, const GLuint *captured, GLuint *replayed);
+
+        const void *BlobData(uint32_t blob) const;
+
+        // 8 byte aligned for the data handed to GL as floats and ints
+        std::vector<uint64_t> m_storage;
+        size_t m_size = 0;
+        std::string m_error;
+        int m_viewport[4] = {0, 0, 0, 0};
+        // offsets of the records of each blob, and of the begin and end marker of each frame
+        std::vector<size_t> m_blobOffsets;
+        std::vector<std::pair<size_t, size_t>> m_frames;
+        size_t m_setupEnd = 0;
+        uint64_t m_callCount = 0;
+
+        std::unordered_map<GLuint, GLuint> m_names[NamespaceCount];
+        // (program, captured location) to the location in the replayed program
+        std::unordered_map<uint64_t, GLint> m_locations;
+        GLuint m_program = 0;
+        // what the captured session drew into without creating it in the trace, e.g. a window or the headless
+        // context's framebuffer: the replay draws into the framebuffer bound when it started
+        GLuint m_defaultFramebuffer = 0;
+        uint64_t m_callsReplayed = 0;
+    };
+}
@@ -1,16 +1,16 @@
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
 #include <cstdio>
+#include <cstdlib>
 #include <iostream>
+#include "GlDebug.h"
+#include "GlState.h"
+#include "GlTrace.h"
 #include "GraphicsManager.h"
-
-GLenum glCheckError_(int line) {
-    GLenum errorCode = glGetError();
-    if (errorCode != GL_NO_ERROR) {
-        fprintf(stderr, "line: %i, errorCode: %i\n", line, errorCode);
-    }
-    return errorCode;
-}
-
-#define glCheckError() glCheckError_(__LINE__)
+#include "Profiler.h"
+#include "SimdMath.h"
+#include "TaskSystem.h"
 
 using namespace Eigen;
 
@@ -24,9 +24,20 @@ namespace Asset {
     static const float DefaultPositionZ = -10;
     static const float DefaultRotationAngle = 45;
 
+    // below this many instances a linear SIMD pass beats walking a hierarchy
+    static const size_t BvhCullThreshold = 4096;
+
+    // how many instances are rasterized into the occlusion buffer each frame
+    static const size_t MaxOccluders = 16;
+
+    // color scale of the highlighted instance
+    static const float HighlightBrightness = 1.6f;
+
     const char *vertexShaderSource = "#version 330 core\n"
                                      "in vec3 vertexPosition;\n"
                                      "in vec3 vertexColor;\n"
+                                     "in mat4 instanceMatrix;\n"
+                                     "in vec4 instanceColor;\n"
                                      "out vec3 fragmentColor;\n"
                                      "uniform mat4 worldMatrix;\n"
                                      "uniform mat4 viewMatrix;\n"
@@ -34,10 +45,11 @@ namespace Asset {
                                      "void main()\n"
                                      "{\n"
                                      //                                     "   gl_Position = projectionMatrix * viewMatrix * worldMatrix * vec4(vertexPosition, 1.0f);\n"
-                                     "   gl_Position = worldMatrix * vec4(vertexPosition, 1.0f);\n"
+                                     "   gl_Position = instanceMatrix * vec4(vertexPosition, 1.0f);\n"
+                                     "   gl_Position = worldMatrix * gl_Position;\n"
                                      "   gl_Position = viewMatrix * gl_Position;\n"
                                      "   gl_Position = projectionMatrix * gl_Position;\n"
-                                     "   fragmentColor = vertexColor;\n"
+                                     "   fragmentColor = vertexColor * instanceColor.rgb;\n"
                                      "}\0";
 
     const char *fragmentShaderSource = "#version 330 core\n"
@@ -48,10 +60,7 @@ namespace Asset {
                                        "   color = vec4(fragmentColor, 1.0f);\n"
                                        "}\n\0";
 
-    struct VertexType {
-        Vector3f position;
-        Vector3f color;
-    };
+    using Gm::VertexType;
 
     static const VertexType g_vertex_buffer_data[] = {
             {{1.0f,  1.0f,  1.0f},  {1.0f, 0.0f, 0.0f}},
@@ -72,47 +81,6 @@ namespace Asset {
     static const int m_index_count = sizeof(g_indices_buffer_data) / sizeof(uint16_t);
 }
 
-void BuildPerspectiveFovLHMatrix(Matrix4f &matrix, const float fieldOfView, const float screenAspect,
-                                 const float screenNear, const float screenDepth) {
-    matrix << 1.0f / (screenAspect * tanf(fieldOfView * 0.5f)), 0.0f, 0.0f, 0.0f,
-            0.0f, 1.0f / tanf(fieldOfView * 0.5f), 0.0f, 0.0f,
-            0.0f, 0.0f, screenDepth / (screenDepth - screenNear), 1.0f,
-            0.0f, 0.0f, (-screenNear * screenDepth) / (screenDepth - screenNear), 0.0f;
-    // eigen matrix are row-based by default
-    // opengl accepts col-based matrix data by default
-    // eigen's matrix had a data method to return col-based data.
-    // the matrix inputs before are col-based (copy from MakiEngine)
-    // so we transpose the data from "col-based" form to "row-based"
-    // so that we can use matrix's data method to pass data to opengl api
-    matrix.transposeInPlace();
-    return;
-}
-
-void BuildViewMatrix(Matrix4f &result, const Vector3f position, const Vector3f lookAt, const Vector3f up) {
-    Vector3f zAxis, xAxis, yAxis;
-    float result1, result2, result3;
-
-    zAxis = lookAt - position;
-    zAxis.normalize();
-
-    xAxis = up.cross(zAxis);
-    xAxis.normalize();
-
-    yAxis = zAxis.cross(xAxis);
-
-    result1 = -(xAxis.dot(position));
-    result2 = -(yAxis.dot(position));
-    result3 = -(zAxis.dot(position));
-
-    result << xAxis[0], yAxis[0], zAxis[0], 0.0f,
-            xAxis[1], yAxis[1], zAxis[1], 0.0f,
-            xAxis[2], yAxis[2], zAxis[2], 0.0f,
-            result1, result2, result3, 1.0f;
-    // see `BuildPerspectiveFovLHMatrix`
-    result.transposeInPlace();
-    return;
-}
-
 bool Gm::GraphicsManager::InitializeProgram() {
     // build and compile our shader program
     // ------------------------------------
@@ -147,6 +115,9 @@ bool Gm::GraphicsManager::InitializeProgram() {
     // TODO optional?
     glBindAttribLocation(shaderProgram, 0, "vertexPosition");
     glBindAttribLocation(shaderProgram, 1, "vertexColor");
+    // a mat4 attribute takes four consecutive locations (2, 3, 4, 5)
+    glBindAttribLocation(shaderProgram, 2, "instanceMatrix");
+    glBindAttribLocation(shaderProgram, 6, "instanceColor");
 
     glLinkProgram(shaderProgram);
     // check for linking errors
@@ -158,9 +129,24 @@ bool Gm::GraphicsManager::InitializeProgram() {
     }
     glDeleteShader(vertexShader);
     glDeleteShader(fragmentShader);
+
+    // looked up once, recording the matrices then needs no GL call
+    m_worldMatrixLocation = glGetUniformLocation(shaderProgram, "worldMatrix");
+    m_viewMatrixLocation = glGetUniformLocation(shaderProgram, "viewMatrix");
+    m_projectionMatrixLocation = glGetUniformLocation(shaderProgram, "projectionMatrix");
     return true;
 }
 
+Gm::GraphicsManager::GraphicsManager() {
+    m_geometry.AddMesh(Asset::g_vertex_buffer_data, Asset::m_vertex_count, Asset::g_indices_buffer_data,
+                       Asset::m_index_count);
+    m_meshInstances.resize(m_geometry.MeshCount());
+    m_meshBounds.resize(m_geometry.MeshCount());
+    m_meshBvh.resize(m_geometry.MeshCount());
+    m_meshBvhDirty.resize(m_geometry.MeshCount(), true);
+    m_meshTriangles.resize(m_geometry.MeshCount());
+}
+
 /**
  * create&bind VAP and VBO
  */
@@ -171,102 +157,502 @@ void Gm::GraphicsManager::InitializeBuffers() {
     // Allocate adn assign a Vertex Array Object to out handle
     glGenVertexArrays(1, &VAO);
     // Bind our VAO as the **current used** object
-    glBindVertexArray(VAO);
+    GlState::Current().BindVertexArray(VAO);
+
+    // Section 1: the vertex and index buffers shared by every mesh become attributes 0, 1 and the element
+    // buffer of our VAO
+    m_geometry.Upload();
+
+    // Section 2 of processing instance VBO start
+
+    // The instance buffer is filled in Draw, we only describe its layout here
+    glGenBuffers(1, &instanceVBO);
+    CommandBuffer commands;
+    RecordInstanceAttributes(commands, instanceVBO, 0);
+    commands.Execute();
+    for (GLuint location = 2; location <= 6; ++location) {
+        glEnableVertexAttribArray(location);
+        // advance the attribute once per instance instead of once per vertex
+        glVertexAttribDivisor(location, 1);
+    }
+    m_instancesDirty = true;
+    // Section 2 of processing instance VBO end
+
+    m_batcher.Initialize();
+    // one buffer per worker and one for the GL thread, which helps recording while it waits
+    m_sceneCommands.resize(TaskSystem::Instance().WorkerCount() + 1);
+}
+
+void Gm::GraphicsManager::RecordStaticCommands() {
+    // Set the color to clear the screen to, then clear the screen and depth buffer.
+    m_clearCommands.Reset();
+    m_clearCommands.Clear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT, 0.8f, 0.3f, 0.4f, 1.0f);
+
+    // the GPU culled scene is the same every frame: one multi draw over the commands the culler writes,
+    // the matrices are passed by pointer
+    m_gpuSceneCommands.Reset();
+    if (!m_gpuCullingReady) {
+        return;
+    }
+    m_gpuSceneCommands.BindVertexArray(VAO);
+    m_gpuSceneCommands.UseProgram(shaderProgram);
+    RecordShaderParameters(m_gpuSceneCommands);
+    RecordInstanceAttributes(m_gpuSceneCommands, m_hiZCuller.VisibleInstanceBuffer(), 0);
+    m_gpuSceneCommands.BindBuffer(GL_DRAW_INDIRECT_BUFFER, m_hiZCuller.CommandBuffer());
+    m_gpuSceneCommands.MultiDrawElementsIndirect(GeometryArena::IndexType, 0, (GLsizei) m_meshInstances.size());
+    RecordInstanceAttributes(m_gpuSceneCommands, instanceVBO, 0);
+}
+
+void Gm::GraphicsManager::RecordInstanceAttributes(CommandBuffer &commands, GLuint buffer, GLuint baseInstance) {
+    commands.BindBuffer(GL_ARRAY_BUFFER, buffer);
+    size_t base = baseInstance * sizeof(InstanceType);
+    // instanceMatrix is passed as four vec4 columns
+    for (GLuint column = 0; column < 4; ++column) {
+        commands.VertexAttribPointer(2 + column, 4, sizeof(InstanceType), base + column * 4 * sizeof(float));
+    }
+    commands.VertexAttribPointer(6, 4, sizeof(InstanceType), base + offsetof(InstanceType, color));
+}
 
-    // Allocate and assign two Vertex Buffer Object to our handle(handles array)
-    glGenBuffers(2, VBOs);
+void Gm::GraphicsManager::GatherInstances(const Frustum *frustum) {
+    // concatenate the instances of every mesh, baseInstance tells each draw where its instances start
+    m_instances.clear();
+    m_meshBaseInstance.resize(m_meshInstances.size());
+    m_meshDrawCount.resize(m_meshInstances.size());
+    m_meshNearestDepth.assign(m_meshInstances.size(), 0.0f);
+    m_cullStats = CullStats();
+    bool occlusion = frustum != nullptr && m_occlusionCullingEnabled;
+    Matrix4f worldView = ToEigen(Multiply(m_viewMatrix, m_worldMatrix));
+    Vector3f camera = worldView.inverse().col(3).head<3>();
+    Vector4f depthRow = worldView.row(2);
+    m_nextOccluders.clear();
+    for (size_t mesh = 0; mesh < m_meshInstances.size(); ++mesh) {
+        const InstanceArray &instances = m_meshInstances[mesh];
+        m_meshBaseInstance[mesh] = (GLuint) m_instances.size();
+        bool highlighted = m_hasHighlight && m_highlightedMesh == mesh;
+        if (frustum == nullptr) {
+            m_instances.insert(m_instances.end(), instances.begin(), instances.end());
+            if (highlighted && m_highlightedInstance < instances.size()) {
+                m_instances[m_meshBaseInstance[mesh] + m_highlightedInstance].color *= Asset::HighlightBrightness;
+            }
+        } else {
+            CullMeshInstances((MeshId) mesh, *frustum);
+            if (occlusion) {
+                m_occlusionCuller.Filter(m_meshBounds[mesh], m_visible);
+                SelectOccluders((MeshId) mesh, m_visible, camera);
+            }
+            SortFrontToBack((MeshId) mesh, m_visible, depthRow);
+            for (uint32_t index : m_visible) {
+                m_instances.push_back(instances[index]);
+                if (highlighted && index == m_highlightedInstance) {
+                    m_instances.back().color *= Asset::HighlightBrightness;
+                }
+            }
+        }
+        m_meshDrawCount[mesh] = (GLuint) m_instances.size() - m_meshBaseInstance[mesh];
+    }
+    if (occlusion) {
+        m_occluders.swap(m_nextOccluders);
+    }
+    // the gather brightened the highlighted instance already
+    m_highlightChanges.clear();
+}
 
-    // Section 1 of processing VBO 1 start
+void Gm::GraphicsManager::SortFrontToBack(MeshId mesh, std::vector<uint32_t> &visible, const Vector4f &depthRow) {
+    if (visible.empty()) {
+        return;
+    }
+    const BoundingSpheres &spheres = m_meshBounds[mesh];
+    m_depthSortItems.resize(visible.size());
+    for (size_t i = 0; i < visible.size(); ++i) {
+        uint32_t index = visible[i];
+        float depth = depthRow.dot(Vector4f(spheres.x[index], spheres.y[index], spheres.z[index], 1.0f));
+        m_depthSortItems[i] = {QuantizeDepth(depth), index};
+    }
+    RadixSort(m_depthSortItems, m_depthSortScratch);
+    for (size_t i = 0; i < visible.size(); ++i) {
+        visible[i] = m_depthSortItems[i].value;
+    }
+    const SortItem &nearest = m_depthSortItems.front();
+    m_meshNearestDepth[mesh] = depthRow.dot(Vector4f(spheres.x[nearest.value], spheres.y[nearest.value],
+                                                     spheres.z[nearest.value], 1.0f));
+}
 
-    // Bind out first VBO as being the **active** buffer and storing vertex attributes (coordinates)
-    glBindBuffer(GL_ARRAY_BUFFER, VBOs[0]);
+void Gm::GraphicsManager::StartOcclusionRaster() {
+    m_occlusionCuller.BeginFrame(WorldViewProjection());
+    const std::vector<VertexType> &vertices = m_geometry.Vertices();
+    const std::vector<uint32_t> &indices = m_geometry.Indices();
+    for (const Occluder &occluder : m_occluders) {
+        if (occluder.instance >= m_meshInstances[occluder.mesh].size()) {
+            continue;
+        }
+        const MeshRange &range = m_geometry.Range(occluder.mesh);
+        m_occlusionCuller.AddOccluder(m_meshInstances[occluder.mesh][occluder.instance].worldMatrix,
+                                      &vertices[range.baseVertex].position, sizeof(VertexType),
+                                      &indices[range.firstIndex], range.indexCount);
+    }
+    m_occlusionCuller.RasterizeAsync(TaskSystem::Instance());
+}
 
-    // Copy the vertex data from g_vertex_buffer_data to our active buffer
-    glBufferData(GL_ARRAY_BUFFER, sizeof(Asset::g_vertex_buffer_data), Asset::g_vertex_buffer_data, GL_STATIC_DRAW);
+void Gm::GraphicsManager::SelectOccluders(MeshId mesh, const std::vector<uint32_t> &visible,
+                                          const Vector3f &camera) {
+    const BoundingSpheres &spheres = m_meshBounds[mesh];
+    for (uint32_t index : visible) {
+        // projected area is roughly proportional to (radius / distance)^2
+        Vector3f offset = Vector3f(spheres.x[index], spheres.y[index], spheres.z[index]) - camera;
+        float weight = spheres.radius[index] * spheres.radius[index] / std::max(offset.squaredNorm(), 1e-6f);
+        if (m_nextOccluders.size() == Asset::MaxOccluders && weight <= m_nextOccluders.back().weight) {
+            continue;
+        }
+        Occluder occluder{mesh, index, weight};
+        auto position = std::upper_bound(m_nextOccluders.begin(), m_nextOccluders.end(), occluder,
+                                         [](const Occluder &a, const Occluder &b) { return a.weight > b.weight; });
+        m_nextOccluders.insert(position, occluder);
+        if (m_nextOccluders.size() > Asset::MaxOccluders) {
+            m_nextOccluders.pop_back();
+        }
+    }
+}
 
-    // Specify that our coordinate data is going into attribute index 0, and contains two floats per vertex
-    // see code in vertex shader: `layout (location = 0) in vec3 vertexPosition;`
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Asset::VertexType), 0);
-    // offset to color portion
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FLOAT, sizeof(Asset::VertexType), (float *) NULL + 3);
+void Gm::GraphicsManager::CullMeshInstances(MeshId mesh, const Frustum &frustum) {
+    m_visible.clear();
+    const BoundingSpheres &spheres = m_meshBounds[mesh];
+    if (spheres.Size() < Asset::BvhCullThreshold) {
+        CullSpheres(frustum, spheres, m_visible, &m_cullStats);
+        return;
+    }
 
-    // Enable attribute index 0 ad being used
-    glEnableVertexAttribArray(0);
-    glEnableVertexAttribArray(1);
+    auto start = std::chrono::steady_clock::now();
+    UpdateMeshBvh(mesh);
+    m_meshBvh[mesh].Cull(frustum, m_visible);
 
-    // Section 1 of processing VBO 1 end
+    m_cullStats.tested += spheres.Size();
+    m_cullStats.visible += m_visible.size();
+    m_cullStats.culled += spheres.Size() - m_visible.size();
+    m_cullStats.microseconds += std::chrono::duration<double, std::micro>(
+            std::chrono::steady_clock::now() - start).count();
+}
 
-    // Section 2 of processing VBO 2 start
+void Gm::GraphicsManager::UpdateMeshBvh(MeshId mesh) {
+    if (!m_meshBvhDirty[mesh]) {
+        return;
+    }
+    const BoundingSpheres &spheres = m_meshBounds[mesh];
+    std::vector<Aabb> boxes(spheres.Size());
+    for (size_t i = 0; i < boxes.size(); ++i) {
+        Vector3f center(spheres.x[i], spheres.y[i], spheres.z[i]);
+        boxes[i].min = center - Vector3f::Constant(spheres.radius[i]);
+        boxes[i].max = center + Vector3f::Constant(spheres.radius[i]);
+    }
+    m_meshBvh[mesh].Build(boxes.data(), boxes.size());
+    m_meshBvhDirty[mesh] = false;
+}
 
-    // Bind our second VBO ad being the **active** buffer and storing index buffer
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, VBOs[1]);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(Asset::g_indices_buffer_data), Asset::g_indices_buffer_data,
-                 GL_STATIC_DRAW);
-    // Section 2 of processing VBO 2 end
+// the cull shader reads and writes instances as a mat4 followed by a vec4
+static_assert(sizeof(Gm::InstanceType) == 20 * sizeof(float), "InstanceType must match the Hi-Z shader layout");
+
+void Gm::GraphicsManager::AddGpuCulledPasses(FrameResource backbuffer) {
+    FrameResource pyramid = m_frameGraph.ImportTexture("HiZPyramid", m_hiZCuller.PyramidTexture());
+    FrameResource visible = m_frameGraph.ImportBuffer("VisibleInstances", m_hiZCuller.VisibleInstanceBuffer());
+    FrameResource commands = m_frameGraph.ImportBuffer("DrawCommands", m_hiZCuller.CommandBuffer());
+
+    m_frameGraph.AddPass("GpuCull", [&](FrameGraph::Builder &builder) {
+        // last frame's pyramid, the pass at the end of this frame overwrites it
+        builder.Read(pyramid, FrameAccess::Sampled);
+        builder.Write(visible, FrameAccess::Storage);
+        builder.Write(commands, FrameAccess::Storage);
+    }, [this](const FrameGraph &) {
+        if (m_instancesDirty) {
+            // all instances live on the GPU, they are only uploaded again when they change
+            GatherInstances(nullptr);
+            m_instanceSpheres.clear();
+            for (const BoundingSpheres &spheres : m_meshBounds) {
+                for (size_t i = 0; i < spheres.Size(); ++i) {
+                    m_instanceSpheres.emplace_back(spheres.x[i], spheres.y[i], spheres.z[i], spheres.radius[i]);
+                }
+            }
+            m_hiZCuller.SetInstances(m_instances.data(), sizeof(InstanceType), m_instanceSpheres.data(),
+                                     m_instances.size());
+            m_instancesDirty = false;
+        } else if (!m_highlightChanges.empty()) {
+            UploadHighlightChanges();
+        }
+        m_gpuDraws.resize(m_meshInstances.size());
+        for (size_t mesh = 0; mesh < m_meshInstances.size(); ++mesh) {
+            m_gpuDraws[mesh] = {m_geometry.Range((MeshId) mesh), m_meshBaseInstance[mesh], m_meshDrawCount[mesh]};
+        }
+        m_hiZCuller.Cull(WorldViewProjection(), m_gpuDraws);
+        // how many survived is only known on the GPU
+        m_cullStats = CullStats();
+        m_cullStats.tested = m_instances.size();
+        m_cullStats.microseconds = m_hiZCuller.GpuMicroseconds();
+    });
+
+    m_frameGraph.AddPass("Scene", [&](FrameGraph::Builder &builder) {
+        builder.Read(visible, FrameAccess::VertexInput);
+        builder.Read(commands, FrameAccess::IndirectInput);
+        builder.Read(backbuffer, FrameAccess::ColorTarget);
+        builder.Write(backbuffer, FrameAccess::ColorTarget);
+    }, [this](const FrameGraph &) {
+        // the matrices are read through their pointers as the commands run
+        GM_PROFILE_SCOPE("SetShaderParameters");
+        m_gpuSceneCommands.Execute();
+        GM_GL_CHECK();
+    });
+
+    m_frameGraph.AddPass("HiZPyramid", [&](FrameGraph::Builder &builder) {
+        builder.Read(backbuffer, FrameAccess::Transfer);
+        builder.Write(pyramid, FrameAccess::Storage);
+    }, [this](const FrameGraph &) {
+        // this frame's depth becomes the occlusion test of the next one
+        GLint viewport[4];
+        GlState::Current().GetViewport(viewport);
+        m_hiZCuller.CaptureDepth(viewport[2], viewport[3]);
+    });
+}
+
+void Gm::GraphicsManager::AddCpuCulledPasses(FrameResource backbuffer) {
+    FrameResource instances = m_frameGraph.ImportBuffer("Instances", instanceVBO);
+
+    bool occlusion = m_cullingEnabled && m_occlusionCullingEnabled;
+    FrameResource occluderDepth = m_frameGraph.ImportCpu("OccluderDepth");
+    if (occlusion) {
+        m_frameGraph.AddPass("OcclusionRaster", [&](FrameGraph::Builder &builder) {
+            builder.Write(occluderDepth, FrameAccess::Cpu);
+        }, [this](const FrameGraph &) {
+            // rasterize last frame's occluders on worker threads while this frame is being culled
+            StartOcclusionRaster();
+        });
+    }
+    // the visible set changes with the camera, rebuild the instance buffer every frame
+    if (m_cullingEnabled || m_instancesDirty || !m_highlightChanges.empty()) {
+        m_frameGraph.AddPass("Cull", [&](FrameGraph::Builder &builder) {
+            if (occlusion) {
+                builder.Read(occluderDepth, FrameAccess::Cpu);
+            }
+            builder.Write(instances, FrameAccess::Transfer);
+        }, [this](const FrameGraph &) {
+            if (m_cullingEnabled) {
+                Frustum frustum = ExtractFrustumPlanes(WorldViewProjection());
+                GatherInstances(&frustum);
+            } else if (m_instancesDirty) {
+                GatherInstances(nullptr);
+            } else {
+                // only the highlight moved
+                UploadHighlightChanges();
+                return;
+            }
+            UploadInstances();
+        });
+    }
+
+    m_frameGraph.AddPass("Scene", [&](FrameGraph::Builder &builder) {
+        builder.Read(instances, FrameAccess::VertexInput);
+        builder.Read(backbuffer, FrameAccess::ColorTarget);
+        builder.Write(backbuffer, FrameAccess::ColorTarget);
+    }, [this](const FrameGraph &) {
+        // one command per mesh, ordered by state then depth; meshes sharing a program end up in one multi draw
+        m_batcher.Begin();
+        for (size_t mesh = 0; mesh < m_meshInstances.size(); ++mesh) {
+            uint64_t key = MakeSortKey(RenderPass::Opaque, shaderProgram, 0, VAO, m_meshNearestDepth[mesh]);
+            m_batcher.Add(key, shaderProgram, m_geometry.Range((MeshId) mesh), m_meshDrawCount[mesh],
+                          m_meshBaseInstance[mesh]);
+        }
+        // recorded on the workers, replayed here in order
+        m_batcher.Record(m_sceneCommands, TaskSystem::Instance(), [this](CommandBuffer &commands, GLuint program) {
+            commands.UseProgram(program);
+            RecordShaderParameters(commands);
+        }, [this](CommandBuffer &commands, GLuint baseInstance) {
+            RecordInstanceAttributes(commands, instanceVBO, baseInstance);
+        });
+        // seeing as we only have a single VAO there's no need to bind it every time,
+        // but we'll do so to keep things a bit more organized (the state cache drops the repeats)
+        GlState::Current().BindVertexArray(VAO);
+        // the matrices are read through their pointers as the commands run
+        GM_PROFILE_SCOPE("SetShaderParameters");
+        for (const CommandBuffer &commands : m_sceneCommands) {
+            commands.Execute();
+        }
+        GM_GL_CHECK();
+    });
+}
+
+void Gm::GraphicsManager::UploadInstances() {
+    // orphan the old storage so we don't wait for the previous frame to finish reading it
+    GlState::Current().BindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+    glBufferData(GL_ARRAY_BUFFER, m_instances.size() * sizeof(InstanceType), m_instances.data(),
+                 GL_DYNAMIC_DRAW);
+    m_instancesDirty = false;
 }
 
 int Gm::GraphicsManager::Initialize() {
+    GM_PROFILE_SCOPE("Initialize");
     int result;
-    result = gladLoadGL();
+    result = GlLoader::Load(m_glLoadMode);
     if (!result) {
         printf("OpenGL load failed!\n");
         result = -1;
     } else {
         result = 0;
-        printf("OpenGL Version %d.%d loaded\n", GLVersion.major, GLVersion.minor);
+        printf("OpenGL Version %d.%d loaded (%s, %.2f ms)\n", GLVersion.major, GLVersion.minor,
+               GlLoader::ModeName(m_glLoadMode), GlLoader::Stats().milliseconds);
+        // errors reported by the driver as they happen, GM_GL_CHECK polls only where it can't
+        GlDebugLayer::Instance().Install();
+        // GM_GL_TRACE=path captures the calls from here on for GlTraceReplay
+        GlTraceRecorder &trace = GlTraceRecorder::Instance();
+        const char *tracePath = getenv("GM_GL_TRACE");
+        if (tracePath != nullptr && !trace.IsCapturing()) {
+            trace.Start(tracePath);
+        }
+        trace.Hook();
+        // the context may be new, or others may have used it since the cache last saw it
+        GlState &state = GlState::Current();
+        state.Invalidate();
         if (GLAD_GL_VERSION_3_0) {
             // Set the depth buffer to be entirely cleared to 1.0 values.
             glClearDepth(1.0f);
 
             // Enable depth testing.
-            glEnable(GL_DEPTH_TEST);
-            glDepthFunc(GL_LESS);
+            state.Enable(GL_DEPTH_TEST);
+            state.DepthFunc(GL_LESS);
 
             // Set the polygon winding to front facing for the right-handed system.
-            glFrontFace(GL_CW);
+            state.FrontFace(GL_CW);
 
             // Enable back face culling.
-            glEnable(GL_CULL_FACE);
-            glCullFace(GL_BACK);
+            state.Enable(GL_CULL_FACE);
+            state.CullFace(GL_BACK);
 
             // Initialize the model matrix to the identity matrix.
-            m_worldMatrix = Matrix4f::Identity();
+            m_worldMatrix = Mat4::Identity();
             InitializePerspectiveMatrix();
         }
+        // Draw a single untinted cube unless instances were provided up front.
+        if (m_meshInstances[0].empty()) {
+            InstanceType instance;
+            instance.worldMatrix = Matrix4f::Identity();
+            instance.color = Vector4f::Ones();
+            SetInstances(&instance, 1);
+        }
         result = InitializeProgram();
         InitializeBuffers();
+        m_gpuCullingReady = m_hiZCuller.Initialize();
+        m_skinnedMeshes.Initialize();
+        RecordStaticCommands();
+        // the simulation starts now, not when the manager was created
+        SnapModelRotation();
+        m_timestep.Reset();
     }
     return result;
 }
 
 void Gm::GraphicsManager::Finalize() {
-    glUseProgram(0);
+    GlState &state = GlState::Current();
+    Profiler::Instance().FinalizeGpu();
+    state.UseProgram(0);
     glDisableVertexAttribArray(0);
     glDisableVertexAttribArray(1);
-    glDeleteProgram(shaderProgram);
-    glDeleteBuffers(2, VBOs);
-    glDeleteVertexArrays(1, &VAO);
+    state.DeleteProgram(shaderProgram);
+    m_geometry.Finalize();
+    m_batcher.Finalize();
+    m_hiZCuller.Finalize();
+    m_gpuCullingReady = false;
+    m_skinnedMeshes.Finalize();
+    m_frameGraph.Finalize();
+    state.DeleteBuffers(1, &instanceVBO);
+    state.DeleteVertexArrays(1, &VAO);
+    GlDebugLayer::Instance().Uninstall();
+    GlTraceRecorder::Instance().Stop();
 }
 
 void Gm::GraphicsManager::Clear() {
-    // Set the color to clear the screen to.
-    glClearColor(0.8f, 0.3f, 0.4f, 1.0f);
-    // Clear the screen and depth buffer.
-    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    GM_PROFILE_SCOPE("Clear");
+    // recorded as the first pass of the next Draw
+    m_clearPending = true;
 }
 
 void Gm::GraphicsManager::Draw() {
+    GlTraceFrameScope traceFrame;
+    // reads back the GPU scopes of a few frames ago before this frame's begin
+    Profiler::Instance().BeginFrame();
+    GM_PROFILE_SCOPE("Draw");
+    GM_PROFILE_GPU_SCOPE("Draw");
+    double frameStart = Clock::Now();
+    // catch the simulation up with the time since the last frame
+    for (int steps = m_timestep.Tick(); steps > 0; --steps) {
+        FixedUpdate((float) m_timestep.StepSeconds());
+    }
     UpdateModelMatrix();
     UpdateCameraViewMatrix();
 
-    glUseProgram(shaderProgram);
-    glCheckError();
-    SetShaderParameters(m_worldMatrix.data(), m_viewMatrix.data(), m_projectionMatrix.data());
-    // seeing as we only have a single VAO there's no need to bind it every time,
-    // but we'll do so to keep things a bit more organized
-    glBindVertexArray(VAO);
-    glDrawElements(GL_TRIANGLES, Asset::m_index_count, GL_UNSIGNED_SHORT, 0);
+    // whatever we are drawing into: the window, or the headless context's framebuffer
+    m_frameGraph.Reset();
+    FrameResource backbuffer = m_frameGraph.ImportFramebuffer("Backbuffer", GlState::Current().DrawFramebuffer());
+    if (m_clearPending) {
+        m_clearPending = false;
+        m_frameGraph.AddPass("Clear", [&](FrameGraph::Builder &builder) {
+            builder.Write(backbuffer, FrameAccess::ColorTarget);
+            builder.Write(backbuffer, FrameAccess::DepthTarget);
+        }, [this](const FrameGraph &) {
+            m_clearCommands.Execute();
+        });
+    }
+    if (IsGpuCullingActive()) {
+        AddGpuCulledPasses(backbuffer);
+    } else {
+        AddCpuCulledPasses(backbuffer);
+    }
+    if (m_skinnedMeshes.CharacterCount() > 0) {
+        m_frameGraph.AddPass("Skinned", [&](FrameGraph::Builder &builder) {
+            builder.Read(backbuffer, FrameAccess::ColorTarget);
+            builder.Write(backbuffer, FrameAccess::ColorTarget);
+            builder.Write(backbuffer, FrameAccess::DepthTarget);
+        }, [this](const FrameGraph &) {
+            // posed between the last two simulation steps, like the model rotation
+            m_skinnedMeshes.Animate((float) (m_timestep.Alpha() * m_timestep.StepSeconds()));
+            m_skinnedMeshes.Draw(Multiply(m_projectionMatrix, m_viewMatrix));
+            GM_GL_CHECK();
+        });
+    }
+    if (m_frameGraph.Compile()) {
+        m_frameGraph.Execute();
+    }
+    // the GPU time of a frame a few frames back, once its timestamps are in
+    if (m_frameGraph.ResolvedGpuFrames() != m_recordedGpuFrames) {
+        m_recordedGpuFrames = m_frameGraph.ResolvedGpuFrames();
+        double gpuMicroseconds = 0.0;
+        for (const FramePassTiming &timing : m_frameGraph.GetTimings()) {
+            gpuMicroseconds += timing.gpuMicroseconds;
+        }
+        m_frameStats.Record(FrameSeries::Gpu, gpuMicroseconds / 1000.0);
+    }
     glFlush();
+    m_frameStats.Record(FrameSeries::Cpu, (Clock::Now() - frameStart) * 1000.0);
+}
+
+void Gm::GraphicsManager::UploadHighlightChanges() {
+    for (const std::pair<MeshId, uint32_t> &change : m_highlightChanges) {
+        MeshId mesh = change.first;
+        uint32_t instance = change.second;
+        if (mesh >= m_meshBaseInstance.size() || instance >= m_meshInstances[mesh].size()) {
+            continue;
+        }
+        size_t index = m_meshBaseInstance[mesh] + instance;
+        if (index >= m_instances.size()) {
+            continue;
+        }
+        InstanceType &target = m_instances[index];
+        target.color = m_meshInstances[mesh][instance].color;
+        if (m_hasHighlight && m_highlightedMesh == mesh && m_highlightedInstance == instance) {
+            target.color *= Asset::HighlightBrightness;
+        }
+        if (IsGpuCullingActive()) {
+            m_hiZCuller.UpdateInstances(index, &target, 1);
+        } else {
+            GlState::Current().BindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+            glBufferSubData(GL_ARRAY_BUFFER, index * sizeof(InstanceType), sizeof(InstanceType), &target);
+        }
+    }
+    m_highlightChanges.clear();
 }
 
 void Gm::GraphicsManager::InitializePerspectiveMatrix() {
@@ -274,87 +660,186 @@ void Gm::GraphicsManager::InitializePerspectiveMatrix() {
     float fieldOfView = M_PI / 4.0f;
     float screenAspect = Asset::Width / Asset::Height;
 
-    BuildPerspectiveFovLHMatrix(m_projectionMatrix, fieldOfView, screenAspect, screenNear, screenDepth);
+    m_projectionMatrix = PerspectiveFovLH(fieldOfView, screenAspect, screenNear, screenDepth);
 }
 
-void Gm::GraphicsManager::UpdateCameraViewMatrix() {
-    Eigen::Vector3f up, position, lookAt;
-    float yaw, pitch, roll;
-    Affine3f rotationMatrix;
-
-    // Setup the vector that points upwards.
-    up[0] = 0.0f;
-    up[1] = 1.0f;
-    up[2] = 0.0f;
-
-    // Setup the position of the camera in the world.
-    position[0] = m_positionX;
-    position[1] = m_positionY;
-    position[2] = m_positionZ;
+Eigen::Matrix4f Gm::GraphicsManager::WorldViewProjection() const {
+    return ToEigen(Multiply(m_projectionMatrix, Multiply(m_viewMatrix, m_worldMatrix)));
+}
 
-    // Setup where the camera is looking by default.
-    lookAt[0] = 0.0f;
-    lookAt[1] = 0.0f;
-    lookAt[2] = 1.0f;
+void Gm::GraphicsManager::UpdateCameraViewMatrix() {
+    GM_PROFILE_SCOPE("UpdateCameraViewMatrix");
+    // Setup the vector that points upwards, the position of the camera in the world
+    // and where the camera is looking by default.
+    Vec4 up = {0.0f, 1.0f, 0.0f, 0.0f};
+    Vec4 position = {m_positionX, m_positionY, m_positionZ, 1.0f};
+    Vec4 lookAt = {0.0f, 0.0f, 1.0f, 0.0f};
 
     // Set the yaw (Y axis), pitch (X axis), and roll (Z axis) rotations in radians.
-    pitch = m_rotationX * 0.0174532925f;
-    yaw = m_rotationY * 0.0174532925f;
-    roll = m_rotationZ * 0.0174532925f;
-
-    rotationMatrix = AngleAxisf(pitch, Vector3f::UnitX()) * AngleAxisf(yaw, Vector3f::UnitY()) *
-                     AngleAxisf(roll, Vector3f::UnitZ());
+    float pitch = m_rotationX * 0.0174532925f;
+    float yaw = m_rotationY * 0.0174532925f;
+    float roll = m_rotationZ * 0.0174532925f;
+    Quat rotation = QuatFromEuler(pitch, yaw, roll);
 
-    // Transform the lookAt and up vector by the rotation matrix so the view is correctly rotated at the origin.
-    lookAt = rotationMatrix * lookAt;
-    up = rotationMatrix * up;
+    // Rotate the lookAt and up vector so the view is correctly rotated at the origin.
+    lookAt = Rotate(rotation, lookAt);
+    up = Rotate(rotation, up);
 
     // Translate the rotated camera position to the location of the viewer.
-    lookAt = position + lookAt;
+    lookAt = {position.x + lookAt.x, position.y + lookAt.y, position.z + lookAt.z, 1.0f};
 
     // Finally, create the view matrix from the three updated vectors.
-    BuildViewMatrix(m_viewMatrix, position, lookAt, up);
+    m_viewMatrix = LookAtLH(position, lookAt, up);
 }
 
 void Gm::GraphicsManager::UpdateModelMatrix() {
-    // Update world matrix to rotate the model
-//    m_modelRotationX += DEG_RAD_3;
-//    m_modelRotationY += DEG_RAD_3 / 2;
-//    m_modelRotationZ += DEG_RAD_3 / 2;
-    Eigen::Affine3f transform = Eigen::Affine3f::Identity();
-    transform.rotate(Eigen::AngleAxisf(m_modelRotationX * DEG_TO_RAD, Eigen::Vector3f::UnitX()));
-    transform.rotate(Eigen::AngleAxisf(m_modelRotationY * DEG_TO_RAD, Eigen::Vector3f::UnitY()));
-    transform.rotate(Eigen::AngleAxisf(m_modelRotationZ * DEG_TO_RAD, Eigen::Vector3f::UnitZ()));
+    // Draw the model between its last two simulated rotations, by how far the frame is into the next step.
+    Quat rotation = Slerp(m_previousModelRotation, m_modelRotation, m_timestep.Alpha());
+    m_worldMatrix = RotationMatrix(rotation);
+}
 
+void Gm::GraphicsManager::FixedUpdate(float seconds) {
+    // Update the model rotation at a constant rate.
+    m_previousModelRotation = m_modelRotation;
+    m_modelRotationX += m_modelSpinX * seconds;
+    m_modelRotationY += m_modelSpinY * seconds;
+    m_modelRotationZ += m_modelSpinZ * seconds;
+    m_modelRotation = QuatFromEuler(m_modelRotationX * DEG_TO_RAD, m_modelRotationY * DEG_TO_RAD,
+                                    m_modelRotationZ * DEG_TO_RAD);
+    m_skinnedMeshes.Advance(seconds);
+}
 
-    m_worldMatrix = transform * Matrix4f::Identity();
+void Gm::GraphicsManager::SnapModelRotation() {
+    m_modelRotation = QuatFromEuler(m_modelRotationX * DEG_TO_RAD, m_modelRotationY * DEG_TO_RAD,
+                                    m_modelRotationZ * DEG_TO_RAD);
+    m_previousModelRotation = m_modelRotation;
 }
 
-bool Gm::GraphicsManager::SetShaderParameters(float *worldMatrix, float *viewMatrix, float *projectionMatrix) {
-    unsigned int location;
+void Gm::GraphicsManager::RecordShaderParameters(CommandBuffer &commands) {
+    // Set the world, view and projection matrices in the vertex shader, as they are when the commands run.
+    commands.UniformMatrix4Pointer(m_worldMatrixLocation, m_worldMatrix.m);
+    commands.UniformMatrix4Pointer(m_viewMatrixLocation, m_viewMatrix.m);
+    commands.UniformMatrix4Pointer(m_projectionMatrixLocation, m_projectionMatrix.m);
+}
 
-    // Set the world matrix in the vertex shader.
-    location = glGetUniformLocation(shaderProgram, "worldMatrix");
-    if (location == -1) {
-        return false;
+Gm::MeshId Gm::GraphicsManager::AddMesh(const VertexType *vertices, size_t vertexCount, const uint32_t *indices,
+                                         size_t indexCount) {
+    MeshId mesh = m_geometry.AddMesh(vertices, vertexCount, indices, indexCount);
+    m_meshInstances.resize(m_geometry.MeshCount());
+    m_meshBounds.resize(m_geometry.MeshCount());
+    m_meshBvh.resize(m_geometry.MeshCount());
+    m_meshBvhDirty.resize(m_geometry.MeshCount(), true);
+    m_meshTriangles.resize(m_geometry.MeshCount());
+    return mesh;
+}
+
+void Gm::GraphicsManager::SetInstances(const InstanceType *instances, size_t count) {
+    SetInstances(0, instances, count);
+}
+
+void Gm::GraphicsManager::SetInstances(MeshId mesh, const InstanceType *instances, size_t count) {
+    m_meshInstances[mesh].assign(instances, instances + count);
+    m_instancesDirty = true;
+    m_meshBvhDirty[mesh] = true;
+
+    // move the mesh's bounding sphere along with each instance, scaled by the largest axis scale
+    const Vector4f &sphere = m_geometry.BoundingSphere(mesh);
+    BoundingSpheres &bounds = m_meshBounds[mesh];
+    bounds.Resize(count);
+    for (size_t i = 0; i < count; ++i) {
+        const Matrix4f &matrix = instances[i].worldMatrix;
+        Vector3f center = (matrix * Vector4f(sphere[0], sphere[1], sphere[2], 1.0f)).head<3>();
+        float scale = matrix.topLeftCorner<3, 3>().colwise().norm().maxCoeff();
+        bounds.x[i] = center[0];
+        bounds.y[i] = center[1];
+        bounds.z[i] = center[2];
+        bounds.radius[i] = sphere[3] * scale;
     }
-    glUniformMatrix4fv(location, 1, false, worldMatrix);
+}
 
-    // Set the view matrix in the vertex shader.
-    location = glGetUniformLocation(shaderProgram, "viewMatrix");
-    if (location == -1) {
-        return false;
+bool Gm::GraphicsManager::Pick(float x, float y, float viewWidth, float viewHeight, PickResult &result) {
+    // unproject the cursor on the near and far plane into the space instances are placed in
+    Matrix4f inverse = ToEigen(Inverse(Multiply(m_projectionMatrix, Multiply(m_viewMatrix, m_worldMatrix))));
+    float ndcX = 2.0f * x / viewWidth - 1.0f, ndcY = 2.0f * y / viewHeight - 1.0f;
+    Vector4f nearPoint = inverse * Vector4f(ndcX, ndcY, 0.0f, 1.0f);
+    Vector4f farPoint = inverse * Vector4f(ndcX, ndcY, 1.0f, 1.0f);
+    Ray ray;
+    ray.origin = nearPoint.head<3>() / nearPoint[3];
+    // not normalized: t is the same in every space an affine transform takes the ray to
+    ray.direction = farPoint.head<3>() / farPoint[3] - ray.origin;
+
+    bool hit = false;
+    for (MeshId mesh = 0; mesh < (MeshId) m_meshInstances.size(); ++mesh) {
+        const InstanceArray &instances = m_meshInstances[mesh];
+        if (instances.empty()) {
+            continue;
+        }
+        UpdateMeshBvh(mesh);
+        if (m_meshTriangles[mesh].Empty()) {
+            m_meshTriangles[mesh].Build(m_geometry, mesh);
+        }
+        // two levels: instance bounds first, then the mesh triangles in the instance's object space
+        m_meshBvh[mesh].Intersect(ray, [&](uint32_t instance, Ray &worldRay) {
+            Matrix4f toObject = instances[instance].worldMatrix.inverse();
+            Ray objectRay;
+            objectRay.origin = (toObject * worldRay.origin.homogeneous()).head<3>();
+            objectRay.direction = toObject.topLeftCorner<3, 3>() * worldRay.direction;
+            objectRay.tMin = worldRay.tMin;
+            objectRay.tMax = worldRay.tMax;
+            uint32_t triangle;
+            if (!m_meshTriangles[mesh].Intersect(objectRay, triangle)) {
+                return false;
+            }
+            worldRay.tMax = objectRay.tMax;
+            result.mesh = mesh;
+            result.instance = instance;
+            result.triangle = triangle;
+            hit = true;
+            return true;
+        });
+    }
+    if (hit) {
+        result.distance = ray.tMax;
+        Vector3f point = ray.origin + ray.direction * ray.tMax;
+        result.hitPoint = (ToEigen(m_worldMatrix) * point.homogeneous()).head<3>();
     }
-    glUniformMatrix4fv(location, 1, false, viewMatrix);
+    return hit;
+}
 
-    // Set the projection matrix in the vertex shader.
-    location = glGetUniformLocation(shaderProgram, "projectionMatrix");
-    if (location == -1) {
-        return false;
+void Gm::GraphicsManager::SetHighlightedInstance(MeshId mesh, uint32_t instance) {
+    if (m_hasHighlight && m_highlightedMesh == mesh && m_highlightedInstance == instance) {
+        return;
+    }
+    // the old and the new instance are rewritten on their own by the next Draw, nothing else is gathered again
+    if (m_hasHighlight) {
+        m_highlightChanges.emplace_back(m_highlightedMesh, m_highlightedInstance);
     }
-    glUniformMatrix4fv(location, 1, false, projectionMatrix);
+    m_hasHighlight = true;
+    m_highlightedMesh = mesh;
+    m_highlightedInstance = instance;
+    m_highlightChanges.emplace_back(mesh, instance);
+}
 
-    return true;
+void Gm::GraphicsManager::ClearHighlightedInstance() {
+    if (m_hasHighlight) {
+        m_hasHighlight = false;
+        m_highlightChanges.emplace_back(m_highlightedMesh, m_highlightedInstance);
+    }
+}
+
+void Gm::GraphicsManager::SetOcclusionCullingEnabled(bool enabled) {
+    m_occlusionCullingEnabled = enabled;
+    m_occluders.clear();
+}
+
+void Gm::GraphicsManager::SetGpuCullingEnabled(bool enabled) {
+    m_gpuCullingEnabled = enabled;
+    m_instancesDirty = true;
+}
+
+void Gm::GraphicsManager::SetCullingEnabled(bool enabled) {
+    m_cullingEnabled = enabled;
+    m_instancesDirty = true;
 }
 
 void Gm::GraphicsManager::Reset() {
@@ -362,6 +847,13 @@ void Gm::GraphicsManager::Reset() {
     m_modelRotationX = Asset::DefaultRotationAngle;
     m_modelRotationY = Asset::DefaultRotationAngle;
     m_modelRotationZ = 0.0f;
+    SnapModelRotation();
+}
+
+void Gm::GraphicsManager::SetModelSpin(float x, float y, float z) {
+    m_modelSpinX = x;
+    m_modelSpinY = y;
+    m_modelSpinZ = z;
 }
 
 void Gm::GraphicsManager::UpdateCameraPositionZ(float dz) {
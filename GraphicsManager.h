@@ -1,19 +1,51 @@
 #pragma once
 
+#include <vector>
 #include "glad/glad.h"
 #include "Eigen/Core"
 #include "Eigen/Geometry"
+#include "Bvh.h"
+#include "Clock.h"
+#include "CommandBuffer.h"
+#include "FrameGraph.h"
+#include "FrameStats.h"
+#include "FrustumCulling.h"
+#include "GeometryArena.h"
+#include "GlLoader.h"
+#include "HiZCuller.h"
+#include "IndirectBatcher.h"
+#include "OcclusionCuller.h"
+#include "Picking.h"
+#include "RenderQueue.h"
+#include "SimdMath.h"
+#include "SkinnedMeshRenderer.h"
 
 #define DEG_TO_RAD M_PI / 180.0f
-#define DEG_RAD_3 DEG_TO_RAD * 3
 
 namespace Gm {
+    // per-instance attributes, laid out exactly as they are uploaded to the instance VBO
+    struct InstanceType {
+        EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+        Eigen::Matrix4f worldMatrix;
+        Eigen::Vector4f color;
+    };
+
+    typedef std::vector<InstanceType, Eigen::aligned_allocator<InstanceType>> InstanceArray;
+
     class GraphicsManager {
     public:
+        // registers the cube as mesh 0
+        GraphicsManager();
+
         virtual int Initialize();
 
         virtual void Finalize();
 
+        // how Initialize loads GL, lazily by default; see GlLoader
+        void SetGlLoadMode(GlLoadMode mode) { m_glLoadMode = mode; }
+
+        // clears at the start of the next Draw
         virtual void Clear();
 
         virtual void Draw();
@@ -24,18 +56,115 @@ namespace Gm {
 
         virtual void UpdateCameraRotationXY(float drx, float dry);
 
+        // spin the model at these rates, in degrees per second; simulated in fixed steps and interpolated
+        // for drawing, so the speed doesn't depend on the frame rate. The default, all zero, keeps it still.
+        virtual void SetModelSpin(float x, float y, float z);
+
+        // meshes must be added before Initialize, they all share one vertex and one index buffer
+        virtual MeshId AddMesh(const VertexType *vertices, size_t vertexCount, const uint32_t *indices,
+                               size_t indexCount);
+
+        // replace the set of cube instances drawn by Draw, uploaded lazily on the next frame
+        virtual void SetInstances(const InstanceType *instances, size_t count);
+
+        // replace the instances of any mesh returned by AddMesh
+        virtual void SetInstances(MeshId mesh, const InstanceType *instances, size_t count);
+
+        // frustum culling is on by default, without it every instance is drawn every frame
+        virtual void SetCullingEnabled(bool enabled);
+
+        // culling result of the last Draw
+        const CullStats &GetCullStats() const { return m_cullStats; }
+
+        // software occlusion culling on top of frustum culling, for dense scenes
+        virtual void SetOcclusionCullingEnabled(bool enabled);
+
+        const OcclusionStats &GetOcclusionStats() const { return m_occlusionCuller.GetStats(); }
+
+        // cull on the GPU against last frame's depth pyramid where compute shaders exist (GL 4.3),
+        // replaces the CPU frustum and occlusion culling while culling is enabled
+        virtual void SetGpuCullingEnabled(bool enabled);
+
+        bool IsGpuCullingActive() const { return m_cullingEnabled && m_gpuCullingEnabled && m_gpuCullingReady; }
+
+        // GPU time of the depth pyramid build and culling dispatches, a couple of frames behind
+        double GetGpuCullMicroseconds() const { return m_hiZCuller.GpuMicroseconds(); }
+
+        // closest instance under the point (x, y) of a view of the given size, origin at the bottom left
+        virtual bool Pick(float x, float y, float viewWidth, float viewHeight, PickResult &result);
+
+        // passes of the last frame with their timings, and the graph's memory statistics
+        const FrameGraph &GetFrameGraph() const { return m_frameGraph; }
+
+        // CPU time of every Draw and GPU time of every frame graph, as percentiles, hitches and periodic dumps
+        FrameStats &GetFrameStats() { return m_frameStats; }
+
+        // animated characters drawn after the scene, give it a mesh, clips and characters once initialized
+        SkinnedMeshRenderer &GetSkinnedMeshRenderer() { return m_skinnedMeshes; }
+
+        // draw one instance brighter, e.g. the one under the cursor
+        virtual void SetHighlightedInstance(MeshId mesh, uint32_t instance);
+
+        virtual void ClearHighlightedInstance();
+
+        // rebuilt by Draw every frame, callable on their own so the benchmarks can time them
+        void UpdateCameraViewMatrix();
+
+        void UpdateModelMatrix();
+
     private:
         void InitializeBuffers();
 
         bool InitializeProgram();
 
+        // point the instanced attributes at `buffer`, starting `baseInstance` entries in
+        void RecordInstanceAttributes(CommandBuffer &commands, GLuint buffer, GLuint baseInstance);
+
+        // the clear and the GPU culled scene, replayed every frame
+        void RecordStaticCommands();
+
+        // collect the instances to draw this frame into m_instances, only those inside `frustum` if given
+        void GatherInstances(const Frustum *frustum);
+
+        void UploadInstances();
+
+        // rewrite the color of the instances whose highlight changed since the last gather, in m_instances and
+        // in the buffer drawn from, which both hold every instance unculled
+        void UploadHighlightChanges();
+
+        // cull against the Hi-Z pyramid on the GPU, draw what it left, rebuild the pyramid from the result
+        void AddGpuCulledPasses(FrameResource backbuffer);
+
+        // occlusion raster, CPU culling and upload, then the batched draws
+        void AddCpuCulledPasses(FrameResource backbuffer);
+
+        // visible instances of one mesh into m_visible, through its BVH when it has one
+        void CullMeshInstances(MeshId mesh, const Frustum &frustum);
+
+        // order `visible` front to back for early-Z, `depthRow` takes a position to view space depth
+        void SortFrontToBack(MeshId mesh, std::vector<uint32_t> &visible, const Eigen::Vector4f &depthRow);
+
+        // build the instance BVH of a mesh if its instances changed since the last build
+        void UpdateMeshBvh(MeshId mesh);
+
+        // rasterize last frame's occluders on worker threads while this frame is being culled
+        void StartOcclusionRaster();
+
+        // keep the instances covering most of the screen as next frame's occluders
+        void SelectOccluders(MeshId mesh, const std::vector<uint32_t> &visible, const Eigen::Vector3f &camera);
+
         void InitializePerspectiveMatrix();
 
-        void UpdateCameraViewMatrix();
+        // projection * view * world, for the Eigen based culling and picking
+        Eigen::Matrix4f WorldViewProjection() const;
 
-        void UpdateModelMatrix();
+        // one simulation step of `seconds`
+        void FixedUpdate(float seconds);
 
-        bool SetShaderParameters(float *worldMatrix, float *viewMatrix, float *projectionMatrix);
+        // make the current model rotation the simulated state, without interpolating towards it
+        void SnapModelRotation();
+
+        void RecordShaderParameters(CommandBuffer &commands);
 
     private:
 
@@ -43,19 +172,92 @@ namespace Gm {
 
         // handle to the shader program
         GLuint shaderProgram;
+        GLint m_worldMatrixLocation = -1, m_viewMatrixLocation = -1, m_projectionMatrixLocation = -1;
         // handle for Vertex Array Object
         GLuint VAO;
-        // handles for Vertex Buffer Object
-        GLuint VBOs[2];
+        // vertex and index buffers of every mesh
+        GeometryArena m_geometry;
+        // handle for the per-instance attribute buffer
+        GLuint instanceVBO;
+
+        // instances of each mesh, concatenated into the instance buffer in mesh order
+        std::vector<InstanceArray> m_meshInstances;
+        std::vector<GLuint> m_meshBaseInstance;
+        std::vector<GLuint> m_meshDrawCount;
+        // view depth of each mesh's closest drawn instance, orders the draws front to back
+        std::vector<float> m_meshNearestDepth;
+        std::vector<SortItem> m_depthSortItems;
+        std::vector<SortItem> m_depthSortScratch;
+        InstanceArray m_instances;
+        bool m_instancesDirty = true;
+
+        // world space bounding spheres of each mesh's instances
+        std::vector<BoundingSpheres> m_meshBounds;
+        // hierarchy over the instances of meshes with many of them, rebuilt when they change
+        std::vector<Bvh> m_meshBvh;
+        std::vector<bool> m_meshBvhDirty;
+        // object space triangle hierarchies, built on the first pick
+        std::vector<TriangleMeshBvh> m_meshTriangles;
+
+        struct Occluder {
+            MeshId mesh;
+            uint32_t instance;
+            float weight;
+        };
+
+        OcclusionCuller m_occlusionCuller;
+        bool m_occlusionCullingEnabled = true;
+        std::vector<Occluder> m_occluders;
+        std::vector<Occluder> m_nextOccluders;
+
+        bool m_hasHighlight = false;
+        MeshId m_highlightedMesh = 0;
+        uint32_t m_highlightedInstance = 0;
+        // instances that gained or lost the highlight, uploaded on their own unless everything is gathered anyway
+        std::vector<std::pair<MeshId, uint32_t>> m_highlightChanges;
+        std::vector<uint32_t> m_visible;
+        bool m_cullingEnabled = true;
+        CullStats m_cullStats;
+
+        HiZCuller m_hiZCuller;
+        bool m_gpuCullingEnabled = true;
+        bool m_gpuCullingReady = false;
+        std::vector<HiZCuller::MeshDraw> m_gpuDraws;
+        std::vector<Eigen::Vector4f, Eigen::aligned_allocator<Eigen::Vector4f>> m_instanceSpheres;
 
-        Eigen::Matrix4f m_worldMatrix;
-        Eigen::Matrix4f m_viewMatrix;
-        Eigen::Matrix4f m_projectionMatrix;
+        SkinnedMeshRenderer m_skinnedMeshes;
+
+        IndirectBatcher m_batcher;
+        // the CPU culled scene, recorded every frame by the worker threads
+        std::vector<CommandBuffer> m_sceneCommands;
+        CommandBuffer m_clearCommands;
+        CommandBuffer m_gpuSceneCommands;
+
+        // rebuilt every Draw from the passes of the active culling path
+        FrameGraph m_frameGraph;
+        bool m_clearPending = false;
+
+        GlLoadMode m_glLoadMode = GlLoadMode::Lazy;
+
+        FrameStats m_frameStats;
+        // the frame graph's resolved GPU frames already recorded
+        uint64_t m_recordedGpuFrames = 0;
+
+        // rebuilt every frame by SimdMath, kept in its type so nothing is converted on the way
+        Mat4 m_worldMatrix;
+        Mat4 m_viewMatrix;
+        Mat4 m_projectionMatrix;
 
         float m_positionX = 0, m_positionY = 0, m_positionZ = -10;
         float m_rotationX = 0, m_rotationY = 0, m_rotationZ = 0;
 
         float m_modelRotationX = 45, m_modelRotationY = 45, m_modelRotationZ = 0;
+        float m_modelSpinX = 0, m_modelSpinY = 0, m_modelSpinZ = 0;
+
+        FixedTimestep m_timestep;
+        // the model rotation before and after the last simulation step, drawn in between
+        Quat m_previousModelRotation;
+        Quat m_modelRotation;
 
         const float screenDepth = 1000.0f;
         const float screenNear = 0.1f;
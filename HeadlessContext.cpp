@@ -0,0 +1,188 @@
+#include <cstdio>
+#include "GlDebug.h"
+#include "GlLoader.h"
+#include "GlState.h"
+#include "HeadlessContext.h"
+
+#ifdef __APPLE__
+#include <OpenGL/OpenGL.h>
+
+bool Gm::HeadlessContext::CreateContext() {
+    // Same profile as the window's pixel format, minus the drawable.
+    CGLPixelFormatAttribute attrs[] = {
+            kCGLPFAAccelerated,
+            kCGLPFAOpenGLProfile, (CGLPixelFormatAttribute) kCGLOGLPVersion_GL4_Core,
+            kCGLPFAColorSize, (CGLPixelFormatAttribute) 32,
+            kCGLPFADepthSize, (CGLPixelFormatAttribute) 24,
+            kCGLPFAAllowOfflineRenderers,
+            (CGLPixelFormatAttribute) 0
+    };
+
+    CGLPixelFormatObj pixelFormat = nullptr;
+    GLint formatCount = 0;
+    if (CGLChoosePixelFormat(attrs, &pixelFormat, &formatCount) != kCGLNoError || pixelFormat == nullptr) {
+        fprintf(stderr, "No valid headless pixel format found\n");
+        return false;
+    }
+    CGLContextObj context = nullptr;
+    CGLError error = CGLCreateContext(pixelFormat, nullptr, &context);
+    CGLReleasePixelFormat(pixelFormat);
+    if (error != kCGLNoError) {
+        fprintf(stderr, "CGLCreateContext failed: %d\n", error);
+        return false;
+    }
+    m_context = context;
+    MakeCurrent();
+    return GlLoader::Load(GlLoadMode::Lazy);
+}
+
+void Gm::HeadlessContext::DestroyContext() {
+    CGLSetCurrentContext(nullptr);
+    CGLDestroyContext((CGLContextObj) m_context);
+}
+
+void Gm::HeadlessContext::MakeCurrent() {
+    CGLSetCurrentContext((CGLContextObj) m_context);
+}
+
+#else
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+
+namespace {
+    // without a window system only Mesa's surfaceless platform has a display to offer
+    EGLDisplay OpenDisplay() {
+        PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay =
+                (PFNEGLGETPLATFORMDISPLAYEXTPROC) eglGetProcAddress("eglGetPlatformDisplayEXT");
+        if (getPlatformDisplay != nullptr) {
+            EGLDisplay display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr);
+            if (display != EGL_NO_DISPLAY && eglInitialize(display, nullptr, nullptr)) {
+                return display;
+            }
+        }
+        EGLDisplay display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+        if (display != EGL_NO_DISPLAY && eglInitialize(display, nullptr, nullptr)) {
+            return display;
+        }
+        return EGL_NO_DISPLAY;
+    }
+}
+
+bool Gm::HeadlessContext::CreateContext() {
+    EGLDisplay display = OpenDisplay();
+    if (display == EGL_NO_DISPLAY) {
+        fprintf(stderr, "No EGL display available\n");
+        return false;
+    }
+    m_display = display;
+    EGLint configAttrs[] = {
+            EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+            EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+            EGL_NONE
+    };
+    EGLConfig config = nullptr;
+    EGLint configCount = 0;
+    if (!eglChooseConfig(display, configAttrs, &config, 1, &configCount) || configCount == 0 ||
+        !eglBindAPI(EGL_OPENGL_API)) {
+        fprintf(stderr, "No valid headless EGL config found\n");
+        eglTerminate(display);
+        return false;
+    }
+    // the newest core profile first so compute shaders are there when the driver has them
+    const EGLint versions[][2] = {{4, 5}, {4, 3}, {4, 1}};
+    EGLContext context = EGL_NO_CONTEXT;
+    for (const EGLint *version : versions) {
+        EGLint contextAttrs[] = {
+                EGL_CONTEXT_MAJOR_VERSION, version[0],
+                EGL_CONTEXT_MINOR_VERSION, version[1],
+                EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+                // debug builds want every message the driver has, see GlDebug.h
+                EGL_CONTEXT_OPENGL_DEBUG, GM_GL_DEBUG_SYNCHRONOUS ? EGL_TRUE : EGL_FALSE,
+                EGL_NONE
+        };
+        context = eglCreateContext(display, config, EGL_NO_CONTEXT, contextAttrs);
+        if (context != EGL_NO_CONTEXT) {
+            break;
+        }
+    }
+    if (context == EGL_NO_CONTEXT) {
+        fprintf(stderr, "eglCreateContext failed: 0x%x\n", eglGetError());
+        eglTerminate(display);
+        return false;
+    }
+    m_context = context;
+    // rendering only ever goes to our framebuffer object, no surface needed
+    if (!eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, context)) {
+        fprintf(stderr, "eglMakeCurrent failed: 0x%x\n", eglGetError());
+        return false;
+    }
+    return GlLoader::Load(GlLoadMode::Lazy, (GLADloadproc) eglGetProcAddress);
+}
+
+void Gm::HeadlessContext::DestroyContext() {
+    eglMakeCurrent((EGLDisplay) m_display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+    eglDestroyContext((EGLDisplay) m_display, (EGLContext) m_context);
+    eglTerminate((EGLDisplay) m_display);
+    m_display = nullptr;
+}
+
+void Gm::HeadlessContext::MakeCurrent() {
+    eglMakeCurrent((EGLDisplay) m_display, EGL_NO_SURFACE, EGL_NO_SURFACE, (EGLContext) m_context);
+}
+
+#endif
+
+bool Gm::HeadlessContext::Create(int width, int height) {
+    if (!CreateContext()) {
+        fprintf(stderr, "OpenGL load failed!\n");
+        if (m_context != nullptr) {
+            DestroyContext();
+            m_context = nullptr;
+        }
+        return false;
+    }
+
+    // a new context starts from the GL defaults, not from what the state cache remembers of the last one
+    GlState &state = GlState::Current();
+    state.Invalidate();
+
+    // There is no default framebuffer without a drawable, so render into our own.
+    m_width = width;
+    m_height = height;
+    glGenRenderbuffers(2, m_renderbuffers);
+    glBindRenderbuffer(GL_RENDERBUFFER, m_renderbuffers[0]);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+    glBindRenderbuffer(GL_RENDERBUFFER, m_renderbuffers[1]);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, width, height);
+
+    glGenFramebuffers(1, &m_framebuffer);
+    state.BindFramebuffer(GL_FRAMEBUFFER, m_framebuffer);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, m_renderbuffers[0]);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, m_renderbuffers[1]);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+        fprintf(stderr, "Headless framebuffer is incomplete\n");
+        Destroy();
+        return false;
+    }
+    state.Viewport(0, 0, width, height);
+    return true;
+}
+
+void Gm::HeadlessContext::Destroy() {
+    if (m_context == nullptr) {
+        return;
+    }
+    MakeCurrent();
+    GlState &state = GlState::Current();
+    state.BindFramebuffer(GL_FRAMEBUFFER, 0);
+    state.DeleteFramebuffers(1, &m_framebuffer);
+    glDeleteRenderbuffers(2, m_renderbuffers);
+    m_framebuffer = 0;
+
+    DestroyContext();
+    m_context = nullptr;
+}
+
+void Gm::HeadlessContext::Finish() {
+    glFinish();
+}
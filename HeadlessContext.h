@@ -0,0 +1,38 @@
+#pragma once
+
+#include "glad/glad.h"
+
+namespace Gm {
+    // An offscreen OpenGL context rendering into its own framebuffer object,
+    // used by the benchmarks and tools that have no window to draw into.
+    // CGL on macOS, a surfaceless EGL context elsewhere (e.g. Mesa's llvmpipe, which has compute shaders).
+    class HeadlessContext {
+    public:
+        bool Create(int width, int height);
+
+        void Destroy();
+
+        void MakeCurrent();
+
+        // block until the GPU has finished all submitted work
+        void Finish();
+
+        int Width() const { return m_width; }
+
+        int Height() const { return m_height; }
+
+    private:
+        bool CreateContext();
+
+        void DestroyContext();
+
+        void *m_context = nullptr;
+        // EGLDisplay, unused with CGL
+        void *m_display = nullptr;
+
+        GLuint m_framebuffer = 0;
+        GLuint m_renderbuffers[2] = {0, 0};
+
+        int m_width = 0, m_height = 0;
+    };
+}
@@ -0,0 +1,436 @@
+#include <algorithm>
+#include <cstdio>
+#include "GlState.h"
+#include "HiZCuller.h"
+
+namespace {
+    const GLuint PyramidGroupSize = 8;
+    const GLuint CullGroupSize = 64;
+
+    // One max reduction step: every destination texel covers 2x2 source texels, plus the
+    // trailing row / column when the source size is odd so no depth is ever dropped.
+    const char *PyramidShaderSource = R"glsl(
+#version 430 core
+layout(local_size_x = 8, local_size_y = 8) in;
+layout(r32f, binding = 0) uniform writeonly image2D destination;
+uniform sampler2D source;
+uniform int sourceLevel;
+// passed in rather than asked with textureSize, whose dynamic LOD gave wrong heights on llvmpipe
+uniform ivec2 sourceSize;
+
+float Fetch(ivec2 p, ivec2 size) {
+    return texelFetch(source, min(p, size - 1), sourceLevel).r;
+}
+
+void main() {
+    ivec2 p = ivec2(gl_GlobalInvocationID.xy);
+    ivec2 size = imageSize(destination);
+    if (any(greaterThanEqual(p, size))) {
+        return;
+    }
+    ivec2 s = p * 2;
+    float d = max(max(Fetch(s, sourceSize), Fetch(s + ivec2(1, 0), sourceSize)),
+                  max(Fetch(s + ivec2(0, 1), sourceSize), Fetch(s + ivec2(1, 1), sourceSize)));
+    bool extraX = (sourceSize.x & 1) != 0 && p.x == size.x - 1;
+    bool extraY = (sourceSize.y & 1) != 0 && p.y == size.y - 1;
+    if (extraX) {
+        d = max(d, max(Fetch(s + ivec2(2, 0), sourceSize), Fetch(s + ivec2(2, 1), sourceSize)));
+    }
+    if (extraY) {
+        d = max(d, max(Fetch(s + ivec2(0, 2), sourceSize), Fetch(s + ivec2(1, 2), sourceSize)));
+    }
+    if (extraX && extraY) {
+        d = max(d, Fetch(s + ivec2(2, 2), sourceSize));
+    }
+    imageStore(destination, p, vec4(d));
+}
+)glsl";
+
+    const char *CullShaderSource = R"glsl(
+#version 430 core
+layout(local_size_x = 64) in;
+
+struct Instance {
+    mat4 worldMatrix;
+    vec4 color;
+};
+
+struct Command {
+    uint count;
+    uint instanceCount;
+    uint firstIndex;
+    int baseVertex;
+    uint baseInstance;
+};
+
+layout(std430, binding = 0) readonly buffer Instances { Instance instances[]; };
+layout(std430, binding = 1) readonly buffer Spheres { vec4 spheres[]; };
+layout(std430, binding = 2) writeonly buffer Visible { Instance visible[]; };
+layout(std430, binding = 3) buffer Commands { Command commands[]; };
+
+uniform mat4 viewProjection;
+uniform vec4 frustumPlanes[6];
+uniform sampler2D hiZ;
+uniform ivec2 hiZSize;
+uniform int hiZLevels;
+uniform ivec2 depthSize;
+uniform bool hiZValid;
+uniform uint firstInstance;
+uniform uint instanceCount;
+uniform uint commandIndex;
+
+bool Occluded(vec4 sphere) {
+    // screen rectangle and nearest depth of the sphere's bounding box
+    vec2 lower = vec2(1.0);
+    vec2 upper = vec2(-1.0);
+    float nearest = 1.0;
+    for (int i = 0; i < 8; ++i) {
+        vec3 corner = sphere.xyz + sphere.w * vec3((i & 1) != 0 ? 1.0 : -1.0,
+                                                   (i & 2) != 0 ? 1.0 : -1.0,
+                                                   (i & 4) != 0 ? 1.0 : -1.0);
+        vec4 clip = viewProjection * vec4(corner, 1.0);
+        if (clip.w < 1e-3) {
+            return false;
+        }
+        vec3 ndc = clip.xyz / clip.w;
+        lower = min(lower, ndc.xy);
+        upper = max(upper, ndc.xy);
+        nearest = min(nearest, ndc.z);
+    }
+    // the projection maps depth to [0, 1] in NDC, the depth buffer holds it remapped once more
+    nearest = nearest * 0.5 + 0.5;
+
+    // Work in depth buffer texels: texel t of the depth copy ends up in texel t >> (level + 1) of the pyramid,
+    // clamped to the level's size since the last texel of every level also takes in the odd remainder.
+    // Scaling uv by a level's size instead would drift by up to a texel on odd sized levels.
+    ivec2 lowerTexel = clamp(ivec2((lower * 0.5 + 0.5) * vec2(depthSize)), ivec2(0), depthSize - 1);
+    ivec2 upperTexel = clamp(ivec2((upper * 0.5 + 0.5) * vec2(depthSize)), ivec2(0), depthSize - 1);
+    // the coarsest level at which the rectangle still spans at most 2x2 texels
+    ivec2 extent = upperTexel - lowerTexel;
+    int level = max(int(ceil(log2(float(max(max(extent.x, extent.y), 1))))) - 1, 0);
+    while (level < hiZLevels - 1 &&
+           any(greaterThan((upperTexel >> (level + 1)) - (lowerTexel >> (level + 1)), ivec2(1)))) {
+        ++level;
+    }
+    // level sizes halve rounding down, same as shifting the first one
+    ivec2 last = max(hiZSize >> level, ivec2(1)) - 1;
+    ivec2 a = min(lowerTexel >> (level + 1), last);
+    ivec2 b = min(upperTexel >> (level + 1), last);
+    float farthest = max(max(texelFetch(hiZ, a, level).r, texelFetch(hiZ, ivec2(b.x, a.y), level).r),
+                         max(texelFetch(hiZ, ivec2(a.x, b.y), level).r, texelFetch(hiZ, b, level).r));
+    return nearest > farthest;
+}
+
+void main() {
+    uint i = gl_GlobalInvocationID.x;
+    if (i >= instanceCount) {
+        return;
+    }
+    uint index = firstInstance + i;
+    vec4 sphere = spheres[index];
+    for (int p = 0; p < 6; ++p) {
+        if (dot(frustumPlanes[p].xyz, sphere.xyz) + frustumPlanes[p].w < -sphere.w) {
+            return;
+        }
+    }
+    if (hiZValid && Occluded(sphere)) {
+        return;
+    }
+    uint slot = atomicAdd(commands[commandIndex].instanceCount, 1u);
+    visible[commands[commandIndex].baseInstance + slot] = instances[index];
+}
+)glsl";
+
+    GLuint GroupCount(GLuint items, GLuint groupSize) {
+        return (items + groupSize - 1) / groupSize;
+    }
+
+    // depth blits need identical formats on both ends, mirror the one of the framebuffer we copy from
+    GLenum DepthFormatOf(GLuint framebuffer) {
+        // the window's framebuffer names its attachments differently from framebuffer objects
+        GLenum depth = framebuffer == 0 ? GL_DEPTH : GL_DEPTH_ATTACHMENT;
+        GLenum stencil = framebuffer == 0 ? GL_STENCIL : GL_STENCIL_ATTACHMENT;
+        GLint depthBits = 0, stencilBits = 0, type = GL_UNSIGNED_NORMALIZED;
+        Gm::GlState::Current().BindFramebuffer(GL_READ_FRAMEBUFFER, framebuffer);
+        glGetFramebufferAttachmentParameteriv(GL_READ_FRAMEBUFFER, depth, GL_FRAMEBUFFER_ATTACHMENT_DEPTH_SIZE,
+                                              &depthBits);
+        glGetFramebufferAttachmentParameteriv(GL_READ_FRAMEBUFFER, depth, GL_FRAMEBUFFER_ATTACHMENT_COMPONENT_TYPE,
+                                              &type);
+        glGetFramebufferAttachmentParameteriv(GL_READ_FRAMEBUFFER, stencil, GL_FRAMEBUFFER_ATTACHMENT_STENCIL_SIZE,
+                                              &stencilBits);
+        if (type == GL_FLOAT) {
+            return stencilBits > 0 ? GL_DEPTH32F_STENCIL8 : GL_DEPTH_COMPONENT32F;
+        }
+        if (stencilBits > 0) {
+            return GL_DEPTH24_STENCIL8;
+        }
+        return depthBits <= 16 ? GL_DEPTH_COMPONENT16 : depthBits <= 24 ? GL_DEPTH_COMPONENT24 : GL_DEPTH_COMPONENT32;
+    }
+}
+
+bool Gm::HiZCuller::Supported() {
+    return GLAD_GL_VERSION_4_3 != 0;
+}
+
+bool Gm::HiZCuller::BuildProgram(GLuint &program, const char *source) {
+    GLuint shader = glCreateShader(GL_COMPUTE_SHADER);
+    glShaderSource(shader, 1, &source, nullptr);
+    glCompileShader(shader);
+    GLint status = 0;
+    glGetShaderiv(shader, GL_COMPILE_STATUS, &status);
+    if (!status) {
+        char log[1024];
+        glGetShaderInfoLog(shader, sizeof(log), nullptr, log);
+        fprintf(stderr, "Hi-Z compute shader failed to compile: %s\n", log);
+        glDeleteShader(shader);
+        return false;
+    }
+    program = glCreateProgram();
+    glAttachShader(program, shader);
+    glLinkProgram(program);
+    glDeleteShader(shader);
+    glGetProgramiv(program, GL_LINK_STATUS, &status);
+    if (!status) {
+        char log[1024];
+        glGetProgramInfoLog(program, sizeof(log), nullptr, log);
+        fprintf(stderr, "Hi-Z compute program failed to link: %s\n", log);
+        glDeleteProgram(program);
+        program = 0;
+        return false;
+    }
+    return true;
+}
+
+bool Gm::HiZCuller::Initialize() {
+    if (!Supported()) {
+        return false;
+    }
+    if (!BuildProgram(m_pyramidProgram, PyramidShaderSource) || !BuildProgram(m_cullProgram, CullShaderSource)) {
+        Finalize();
+        return false;
+    }
+    // looked up once, the dispatches then only set the values
+    m_sourceLevelLocation = glGetUniformLocation(m_pyramidProgram, "sourceLevel");
+    m_sourceSizeLocation = glGetUniformLocation(m_pyramidProgram, "sourceSize");
+    m_viewProjectionLocation = glGetUniformLocation(m_cullProgram, "viewProjection");
+    m_frustumPlanesLocation = glGetUniformLocation(m_cullProgram, "frustumPlanes");
+    m_hiZSizeLocation = glGetUniformLocation(m_cullProgram, "hiZSize");
+    m_hiZLevelsLocation = glGetUniformLocation(m_cullProgram, "hiZLevels");
+    m_depthSizeLocation = glGetUniformLocation(m_cullProgram, "depthSize");
+    m_hiZValidLocation = glGetUniformLocation(m_cullProgram, "hiZValid");
+    m_firstInstanceLocation = glGetUniformLocation(m_cullProgram, "firstInstance");
+    m_instanceCountLocation = glGetUniformLocation(m_cullProgram, "instanceCount");
+    m_commandIndexLocation = glGetUniformLocation(m_cullProgram, "commandIndex");
+    // both programs sample texture unit 0, which never changes
+    GlState &state = GlState::Current();
+    state.UseProgram(m_pyramidProgram);
+    glUniform1i(glGetUniformLocation(m_pyramidProgram, "source"), 0);
+    state.UseProgram(m_cullProgram);
+    glUniform1i(glGetUniformLocation(m_cullProgram, "hiZ"), 0);
+    glGenFramebuffers(1, &m_depthFramebuffer);
+    glGenBuffers(1, &m_instanceBuffer);
+    glGenBuffers(1, &m_sphereBuffer);
+    glGenBuffers(1, &m_visibleBuffer);
+    glGenBuffers(1, &m_commandBuffer);
+    return true;
+}
+
+void Gm::HiZCuller::Finalize() {
+    GlState &state = GlState::Current();
+    if (m_pyramidProgram) {
+        state.DeleteProgram(m_pyramidProgram);
+    }
+    if (m_cullProgram) {
+        state.DeleteProgram(m_cullProgram);
+    }
+    if (m_depthFramebuffer) {
+        state.DeleteFramebuffers(1, &m_depthFramebuffer);
+        GLuint textures[] = {m_depthTexture, m_pyramidTexture};
+        state.DeleteTextures(2, textures);
+        GLuint buffers[] = {m_instanceBuffer, m_sphereBuffer, m_visibleBuffer, m_commandBuffer};
+        state.DeleteBuffers(4, buffers);
+    }
+    *this = HiZCuller();
+}
+
+void Gm::HiZCuller::SetInstances(const void *instances, size_t instanceSize, const Eigen::Vector4f *spheres,
+                                 size_t count) {
+    m_instanceSize = instanceSize;
+    m_instanceCount = count;
+    // keep at least one element around, binding an empty buffer range is an error
+    size_t bytes = std::max<size_t>(count, 1) * instanceSize;
+    GlState &state = GlState::Current();
+    state.BindBuffer(GL_SHADER_STORAGE_BUFFER, m_instanceBuffer);
+    // mostly static, UpdateInstances rewrites a few at a time
+    glBufferData(GL_SHADER_STORAGE_BUFFER, bytes, instances, GL_DYNAMIC_DRAW);
+    state.BindBuffer(GL_SHADER_STORAGE_BUFFER, m_visibleBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, bytes, nullptr, GL_DYNAMIC_COPY);
+    state.BindBuffer(GL_SHADER_STORAGE_BUFFER, m_sphereBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, std::max<size_t>(count, 1) * sizeof(Eigen::Vector4f), spheres,
+                 GL_STATIC_DRAW);
+}
+
+void Gm::HiZCuller::UpdateInstances(size_t first, const void *instances, size_t count) {
+    if (first + count > m_instanceCount) {
+        return;
+    }
+    GlState::Current().BindBuffer(GL_SHADER_STORAGE_BUFFER, m_instanceBuffer);
+    glBufferSubData(GL_SHADER_STORAGE_BUFFER, first * m_instanceSize, count * m_instanceSize, instances);
+}
+
+void Gm::HiZCuller::Cull(const Eigen::Matrix4f &viewProjection, const std::vector<MeshDraw> &draws) {
+    TimerFrame &timer = CurrentTimer();
+    GpuProfileScope gpuScope("HiZCull");
+    timer.cullScope = gpuScope.Index();
+
+    // the shader only ever adds to instanceCount, everything else comes from here
+    m_commands.resize(draws.size());
+    for (size_t i = 0; i < draws.size(); ++i) {
+        DrawElementsIndirectCommand &command = m_commands[i];
+        command.count = draws[i].range.indexCount;
+        command.instanceCount = 0;
+        command.firstIndex = draws[i].range.firstIndex;
+        command.baseVertex = draws[i].range.baseVertex;
+        command.baseInstance = draws[i].firstInstance;
+    }
+    GlState &state = GlState::Current();
+    state.BindBuffer(GL_SHADER_STORAGE_BUFFER, m_commandBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, m_commands.size() * sizeof(DrawElementsIndirectCommand),
+                 m_commands.data(), GL_DYNAMIC_COPY);
+
+    Frustum frustum = ExtractFrustumPlanes(viewProjection);
+
+    state.UseProgram(m_cullProgram);
+    glUniformMatrix4fv(m_viewProjectionLocation, 1, GL_FALSE, viewProjection.data());
+    glUniform4fv(m_frustumPlanesLocation, 6, frustum.planes[0].data());
+    glUniform2i(m_hiZSizeLocation, m_pyramidWidth, m_pyramidHeight);
+    glUniform1i(m_hiZLevelsLocation, m_pyramidLevels);
+    glUniform2i(m_depthSizeLocation, m_depthWidth, m_depthHeight);
+    glUniform1i(m_hiZValidLocation, m_hasDepth ? 1 : 0);
+    state.ActiveTexture(GL_TEXTURE0);
+    state.BindTexture(GL_TEXTURE_2D, m_hasDepth ? m_pyramidTexture : 0);
+
+    state.BindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, m_instanceBuffer);
+    state.BindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, m_sphereBuffer);
+    state.BindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, m_visibleBuffer);
+    state.BindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, m_commandBuffer);
+
+    for (size_t i = 0; i < draws.size(); ++i) {
+        if (draws[i].instanceCount == 0) {
+            continue;
+        }
+        glUniform1ui(m_firstInstanceLocation, draws[i].firstInstance);
+        glUniform1ui(m_instanceCountLocation, draws[i].instanceCount);
+        glUniform1ui(m_commandIndexLocation, (GLuint) i);
+        glDispatchCompute(GroupCount(draws[i].instanceCount, CullGroupSize), 1, 1);
+    }
+}
+
+void Gm::HiZCuller::ResizeDepth(int width, int height, GLenum format) {
+    if (width == m_depthWidth && height == m_depthHeight && format == m_depthFormat) {
+        return;
+    }
+    GlState &state = GlState::Current();
+    GLuint textures[] = {m_depthTexture, m_pyramidTexture};
+    state.DeleteTextures(2, textures);
+
+    m_depthWidth = width;
+    m_depthHeight = height;
+    m_depthFormat = format;
+    glGenTextures(1, &m_depthTexture);
+    state.BindTexture(GL_TEXTURE_2D, m_depthTexture);
+    glTexStorage2D(GL_TEXTURE_2D, 1, format, width, height);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_MODE, GL_NONE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    state.BindFramebuffer(GL_DRAW_FRAMEBUFFER, m_depthFramebuffer);
+    bool hasStencil = format == GL_DEPTH24_STENCIL8 || format == GL_DEPTH32F_STENCIL8;
+    glFramebufferTexture2D(GL_DRAW_FRAMEBUFFER, hasStencil ? GL_DEPTH_STENCIL_ATTACHMENT : GL_DEPTH_ATTACHMENT,
+                           GL_TEXTURE_2D, m_depthTexture, 0);
+    glDrawBuffer(GL_NONE);
+
+    // the first level is already half the resolution of the depth buffer
+    m_pyramidWidth = std::max(width / 2, 1);
+    m_pyramidHeight = std::max(height / 2, 1);
+    m_pyramidLevels = 1;
+    for (int size = std::max(m_pyramidWidth, m_pyramidHeight); size > 1; size /= 2) {
+        ++m_pyramidLevels;
+    }
+    glGenTextures(1, &m_pyramidTexture);
+    state.BindTexture(GL_TEXTURE_2D, m_pyramidTexture);
+    glTexStorage2D(GL_TEXTURE_2D, m_pyramidLevels, GL_R32F, m_pyramidWidth, m_pyramidHeight);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    m_hasDepth = false;
+}
+
+void Gm::HiZCuller::CaptureDepth(int width, int height) {
+    if (width <= 0 || height <= 0) {
+        return;
+    }
+    // whatever the frame was drawn into: the window, or the headless context's framebuffer
+    GlState &state = GlState::Current();
+    GLuint drawFramebuffer = state.DrawFramebuffer();
+    ResizeDepth(width, height, DepthFormatOf(drawFramebuffer));
+
+    TimerFrame &timer = CurrentTimer();
+    GpuProfileScope gpuScope("HiZPyramid");
+    timer.pyramidScope = gpuScope.Index();
+    // a multisampled source is resolved by the blit, any one sample is close enough for culling
+    state.BindFramebuffer(GL_READ_FRAMEBUFFER, drawFramebuffer);
+    state.BindFramebuffer(GL_DRAW_FRAMEBUFFER, m_depthFramebuffer);
+    glBlitFramebuffer(0, 0, width, height, 0, 0, width, height, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+    state.BindFramebuffer(GL_FRAMEBUFFER, drawFramebuffer);
+
+    state.UseProgram(m_pyramidProgram);
+    state.ActiveTexture(GL_TEXTURE0);
+    int sourceWidth = m_depthWidth, sourceHeight = m_depthHeight;
+    int levelWidth = m_pyramidWidth, levelHeight = m_pyramidHeight;
+    for (int level = 0; level < m_pyramidLevels; ++level) {
+        // level 0 reduces the depth copy, every other level the one above it
+        state.BindTexture(GL_TEXTURE_2D, level == 0 ? m_depthTexture : m_pyramidTexture);
+        glUniform1i(m_sourceLevelLocation, level == 0 ? 0 : level - 1);
+        glUniform2i(m_sourceSizeLocation, sourceWidth, sourceHeight);
+        glBindImageTexture(0, m_pyramidTexture, level, GL_FALSE, 0, GL_WRITE_ONLY, GL_R32F);
+        glDispatchCompute(GroupCount(levelWidth, PyramidGroupSize), GroupCount(levelHeight, PyramidGroupSize), 1);
+        glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT | GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+        sourceWidth = levelWidth;
+        sourceHeight = levelHeight;
+        levelWidth = std::max(levelWidth / 2, 1);
+        levelHeight = std::max(levelHeight / 2, 1);
+    }
+    m_hasDepth = true;
+}
+
+Gm::HiZCuller::TimerFrame &Gm::HiZCuller::CurrentTimer() {
+    uint64_t gpuFrame = Profiler::Instance().CurrentGpuFrame();
+    // the profiler reads a frame back GpuFrames frames later, right before its slot comes round again
+    TimerFrame &timer = m_timerFrames[gpuFrame % Profiler::GpuFrames];
+    if (timer.gpuFrame != gpuFrame) {
+        ResolveTimer(timer);
+        timer = TimerFrame();
+        timer.gpuFrame = gpuFrame;
+    }
+    return timer;
+}
+
+void Gm::HiZCuller::ResolveTimer(TimerFrame &timer) {
+    Profiler &profiler = Profiler::Instance();
+    if (timer.gpuFrame == 0 || timer.gpuFrame != profiler.ResolvedGpuFrame()) {
+        return;
+    }
+    double total = 0.0;
+    bool resolved = false;
+    for (int scope : {timer.pyramidScope, timer.cullScope}) {
+        double microseconds = profiler.ResolvedGpuMicroseconds(scope);
+        if (microseconds >= 0.0) {
+            total += microseconds;
+            resolved = true;
+        }
+    }
+    if (resolved) {
+        m_gpuMicroseconds = total;
+    }
+}
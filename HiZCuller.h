@@ -0,0 +1,102 @@
+#pragma once
+
+#include <vector>
+#include "glad/glad.h"
+#include "Eigen/Core"
+#include "FrustumCulling.h"
+#include "IndirectBatcher.h"
+#include "Profiler.h"
+
+namespace Gm {
+    // GPU driven occlusion culling against a hierarchical Z pyramid.
+    //
+    // After a frame is drawn its depth buffer is copied and reduced into a max-depth mip chain.
+    // The next frame a compute shader tests every instance's bounding sphere against the frustum
+    // and that pyramid, appends survivors to a visible instance buffer and bumps instanceCount in
+    // an indirect draw buffer, so culled instances never make the round trip through the CPU.
+    // Needs compute shaders (GL 4.3); macOS stops at 4.1 and keeps the CPU culling path.
+    class HiZCuller {
+    public:
+        // one indirect command per mesh, instances [firstInstance, firstInstance + instanceCount)
+        struct MeshDraw {
+            MeshRange range;
+            GLuint firstInstance;
+            GLuint instanceCount;
+        };
+
+        static bool Supported();
+
+        bool Initialize();
+
+        void Finalize();
+
+        // all instances, `instanceSize` bytes each, and their bounding spheres (center, radius)
+        void SetInstances(const void *instances, size_t instanceSize, const Eigen::Vector4f *spheres, size_t count);
+
+        // rewrites `count` of the instances given to SetInstances, from `first` on; their spheres stay
+        void UpdateInstances(size_t first, const void *instances, size_t count);
+
+        // fills CommandBuffer() and VisibleInstanceBuffer(), expects SetInstances to have been called.
+        // Both are shader storage writes: issue GL_COMMAND_BARRIER_BIT | GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT
+        // before drawing from them (the frame graph does when the draw reads them).
+        void Cull(const Eigen::Matrix4f &viewProjection, const std::vector<MeshDraw> &draws);
+
+        // copy the depth of the frame just drawn into the pyramid used by the next Cull
+        void CaptureDepth(int width, int height);
+
+        GLuint CommandBuffer() const { return m_commandBuffer; }
+
+        GLuint VisibleInstanceBuffer() const { return m_visibleBuffer; }
+
+        // max depth mip chain of the last captured frame, 0 before the first capture
+        GLuint PyramidTexture() const { return m_pyramidTexture; }
+
+        // GPU time of the pyramid build and culling dispatches of the last frame the profiler read back
+        double GpuMicroseconds() const { return m_gpuMicroseconds; }
+
+    private:
+        bool BuildProgram(GLuint &program, const char *source);
+
+        void ResizeDepth(int width, int height, GLenum format);
+
+        // the profiler scopes of the pyramid and the culling of one frame
+        struct TimerFrame {
+            // Profiler::CurrentGpuFrame they were recorded in, 0 once resolved
+            uint64_t gpuFrame = 0;
+            int pyramidScope = -1;
+            int cullScope = -1;
+        };
+
+        // this frame's slot, the frame that held it before resolved first
+        TimerFrame &CurrentTimer();
+
+        void ResolveTimer(TimerFrame &timer);
+
+        GLuint m_pyramidProgram = 0;
+        GLuint m_cullProgram = 0;
+        GLint m_sourceLevelLocation = -1, m_sourceSizeLocation = -1;
+        GLint m_viewProjectionLocation = -1, m_frustumPlanesLocation = -1;
+        GLint m_hiZSizeLocation = -1, m_hiZLevelsLocation = -1, m_depthSizeLocation = -1, m_hiZValidLocation = -1;
+        GLint m_firstInstanceLocation = -1, m_instanceCountLocation = -1, m_commandIndexLocation = -1;
+
+        GLuint m_depthFramebuffer = 0;
+        GLuint m_depthTexture = 0;
+        GLuint m_pyramidTexture = 0;
+        int m_depthWidth = 0, m_depthHeight = 0;
+        GLenum m_depthFormat = GL_NONE;
+        int m_pyramidWidth = 0, m_pyramidHeight = 0, m_pyramidLevels = 0;
+        bool m_hasDepth = false;
+
+        GLuint m_instanceBuffer = 0;
+        GLuint m_sphereBuffer = 0;
+        GLuint m_visibleBuffer = 0;
+        GLuint m_commandBuffer = 0;
+        size_t m_instanceSize = 0;
+        size_t m_instanceCount = 0;
+        std::vector<DrawElementsIndirectCommand> m_commands;
+
+        // the frames the profiler hasn't read back yet
+        TimerFrame m_timerFrames[Profiler::GpuFrames];
+        double m_gpuMicroseconds = 0.0;
+    };
+}
@@ -0,0 +1,408 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include "CpuFeatures.h"
+#include "ImageImport.h"
+#include "JpegDecoder.h"
+#include "PngDecoder.h"
+#include "TaskSystem.h"
+
+#if GM_SIMD_X86
+#include <xmmintrin.h>
+#elif GM_SIMD_NEON
+#include <arm_neon.h>
+#endif
+
+namespace {
+    // texels filtered per task
+    const size_t TileTexels = 16384;
+
+    // Kaiser windowed sinc for halving: the taps sit half a texel either side of the destination center
+    const int KaiserTaps = 6;
+    const double KaiserAlpha = 4.0;
+
+    // modified Bessel function of the first kind, order 0
+    double BesselI0(double x) {
+        double sum = 1.0, term = 1.0;
+        for (int k = 1; k < 32; ++k) {
+            term *= (x / (2.0 * k)) * (x / (2.0 * k));
+            sum += term;
+        }
+        return sum;
+    }
+
+    struct KaiserWeights {
+        float weights[KaiserTaps];
+
+        KaiserWeights() {
+            double radius = KaiserTaps / 2, total = 0.0;
+            double taps[KaiserTaps];
+            for (int i = 0; i < KaiserTaps; ++i) {
+                double distance = i - radius + 0.5;
+                // sinc cut off at the new Nyquist frequency, half the old one
+                double x = distance * 0.5 * M_PI;
+                double sinc = x == 0.0 ? 1.0 : std::sin(x) / x;
+                double window = distance / radius;
+                taps[i] = sinc * BesselI0(KaiserAlpha * std::sqrt(1.0 - window * window)) / BesselI0(KaiserAlpha);
+                total += taps[i];
+            }
+            for (int i = 0; i < KaiserTaps; ++i) {
+                weights[i] = (float) (taps[i] / total);
+            }
+        }
+    };
+
+    struct ColorTables {
+        // 8 bit sRGB to linear
+        float toLinear[256];
+        // linear quantized to 16 bits to 8 bit sRGB
+        uint8_t toSrgb[65536];
+
+        ColorTables() {
+            for (int i = 0; i < 256; ++i) {
+                double c = i / 255.0;
+                toLinear[i] = (float) (c <= 0.04045 ? c / 12.92 : std::pow((c + 0.055) / 1.055, 2.4));
+            }
+            for (int i = 0; i < 65536; ++i) {
+                double c = i / 65535.0;
+                double s = c <= 0.0031308 ? c * 12.92 : 1.055 * std::pow(c, 1.0 / 2.4) - 0.055;
+                toSrgb[i] = (uint8_t) std::lround(s * 255.0);
+            }
+        }
+    };
+
+    const ColorTables &Tables() {
+        static const ColorTables tables;
+        return tables;
+    }
+
+    // one RGBA texel in the 4 lanes of a register, or 4 floats without SIMD
+    struct ScalarOps {
+        struct Pixel {
+            float c[4];
+        };
+
+        static Pixel Zero() { return Pixel{{0.0f, 0.0f, 0.0f, 0.0f}}; }
+
+        static Pixel Load(const float *p) { return Pixel{{p[0], p[1], p[2], p[3]}}; }
+
+        static void Store(float *p, const Pixel &x) { std::memcpy(p, x.c, sizeof(x.c)); }
+
+        static Pixel MulAdd(const Pixel &sum, const Pixel &x, float weight) {
+            return Pixel{{sum.c[0] + x.c[0] * weight, sum.c[1] + x.c[1] * weight, sum.c[2] + x.c[2] * weight,
+                          sum.c[3] + x.c[3] * weight}};
+        }
+    };
+
+#if GM_SIMD_X86
+    struct SimdOps {
+        typedef __m128 Pixel;
+
+        static Pixel Zero() { return _mm_setzero_ps(); }
+
+        static Pixel Load(const float *p) { return _mm_loadu_ps(p); }
+
+        static void Store(float *p, Pixel x) { _mm_storeu_ps(p, x); }
+
+        static Pixel MulAdd(Pixel sum, Pixel x, float weight) {
+            return _mm_add_ps(sum, _mm_mul_ps(x, _mm_set1_ps(weight)));
+        }
+    };
+#elif GM_SIMD_NEON
+    struct SimdOps {
+        typedef float32x4_t Pixel;
+
+        static Pixel Zero() { return vdupq_n_f32(0.0f); }
+
+        static Pixel Load(const float *p) { return vld1q_f32(p); }
+
+        static void Store(float *p, Pixel x) { vst1q_f32(p, x); }
+
+        static Pixel MulAdd(Pixel sum, Pixel x, float weight) { return vmlaq_n_f32(sum, x, weight); }
+    };
+#else
+    typedef ScalarOps SimdOps;
+#endif
+
+    // a level as linear floats, 4 per texel
+    struct FloatLevel {
+        uint32_t width = 0, height = 0;
+        std::vector<float> texels;
+
+        float *Row(size_t y) { return texels.data() + y * width * 4; }
+
+        const float *Row(size_t y) const { return texels.data() + y * width * 4; }
+    };
+
+    // splits rows into tasks of about TileTexels texels
+    void ForRows(size_t rows, size_t width, bool parallel, const std::function<void(size_t, size_t)> &function) {
+        size_t grain = std::max<size_t>(1, TileTexels / std::max<size_t>(width, 1));
+        if (!parallel || rows <= grain * 2) {
+            function(0, rows);
+            return;
+        }
+        Gm::TaskSystem::Instance().ParallelFor(0, rows, grain, function);
+    }
+
+    template<typename Ops>
+    void BoxRows(const FloatLevel &source, FloatLevel &target, size_t begin, size_t end) {
+        for (size_t y = begin; y < end; ++y) {
+            const float *row0 = source.Row(std::min<size_t>(y * 2, source.height - 1));
+            const float *row1 = source.Row(std::min<size_t>(y * 2 + 1, source.height - 1));
+            float *out = target.Row(y);
+            for (uint32_t x = 0; x < target.width; ++x, out += 4) {
+                size_t x0 = std::min<size_t>(x * 2, source.width - 1) * 4;
+                size_t x1 = std::min<size_t>(x * 2 + 1, source.width - 1) * 4;
+                typename Ops::Pixel sum = Ops::Zero();
+                sum = Ops::MulAdd(sum, Ops::Load(row0 + x0), 0.25f);
+                sum = Ops::MulAdd(sum, Ops::Load(row0 + x1), 0.25f);
+                sum = Ops::MulAdd(sum, Ops::Load(row1 + x0), 0.25f);
+                sum = Ops::MulAdd(sum, Ops::Load(row1 + x1), 0.25f);
+                Ops::Store(out, sum);
+            }
+        }
+    }
+
+    // halves the width of rows [begin, end), clamping at the edges
+    template<typename Ops>
+    void KaiserHorizontal(const FloatLevel &source, FloatLevel &target, size_t begin, size_t end) {
+        static const KaiserWeights kaiser;
+        int sourceWidth = (int) source.width;
+        for (size_t y = begin; y < end; ++y) {
+            const float *row = source.Row(y);
+            float *out = target.Row(y);
+            for (int x = 0; x < (int) target.width; ++x, out += 4) {
+                typename Ops::Pixel sum = Ops::Zero();
+                for (int tap = 0; tap < KaiserTaps; ++tap) {
+                    int sx = std::min(std::max(x * 2 - KaiserTaps / 2 + 1 + tap, 0), sourceWidth - 1);
+                    sum = Ops::MulAdd(sum, Ops::Load(row + sx * 4), kaiser.weights[tap]);
+                }
+                Ops::Store(out, sum);
+            }
+        }
+    }
+
+    // halves the height, rows [begin, end) of the target
+    template<typename Ops>
+    void KaiserVertical(const FloatLevel &source, FloatLevel &target, size_t begin, size_t end) {
+        static const KaiserWeights kaiser;
+        int sourceHeight = (int) source.height;
+        for (size_t y = begin; y < end; ++y) {
+            const float *rows[KaiserTaps];
+            for (int tap = 0; tap < KaiserTaps; ++tap) {
+                rows[tap] = source.Row(std::min(std::max((int) y * 2 - KaiserTaps / 2 + 1 + tap, 0),
+                                                sourceHeight - 1));
+            }
+            float *out = target.Row(y);
+            for (size_t offset = 0; offset < (size_t) target.width * 4; offset += 4) {
+                typename Ops::Pixel sum = Ops::Zero();
+                for (int tap = 0; tap < KaiserTaps; ++tap) {
+                    sum = Ops::MulAdd(sum, Ops::Load(rows[tap] + offset), kaiser.weights[tap]);
+                }
+                Ops::Store(out + offset, sum);
+            }
+        }
+    }
+
+    template<typename Ops>
+    void Downsample(const FloatLevel &source, FloatLevel &target, Gm::MipFilter filter, bool parallel) {
+        if (filter == Gm::MipFilter::Box) {
+            ForRows(target.height, target.width, parallel, [&](size_t begin, size_t end) {
+                BoxRows<Ops>(source, target, begin, end);
+            });
+            return;
+        }
+        // separable: the width first at full height, then the height
+        FloatLevel half;
+        half.width = target.width;
+        half.height = source.height;
+        half.texels.resize((size_t) half.width * half.height * 4);
+        if (source.width > 1) {
+            ForRows(half.height, half.width, parallel, [&](size_t begin, size_t end) {
+                KaiserHorizontal<Ops>(source, half, begin, end);
+            });
+        } else {
+            half.texels = source.texels;
+        }
+        if (source.height > 1) {
+            ForRows(target.height, target.width, parallel, [&](size_t begin, size_t end) {
+                KaiserVertical<Ops>(half, target, begin, end);
+            });
+        } else {
+            target.texels = half.texels;
+        }
+    }
+
+    void ToFloat(const uint8_t *texels, FloatLevel &level, bool srgb, bool parallel) {
+        const ColorTables &tables = Tables();
+        ForRows(level.height, level.width, parallel, [&](size_t begin, size_t end) {
+            const uint8_t *in = texels + begin * level.width * 4;
+            float *out = level.Row(begin);
+            for (size_t i = 0; i < (end - begin) * level.width; ++i, in += 4, out += 4) {
+                for (int channel = 0; channel < 3; ++channel) {
+                    out[channel] = srgb ? tables.toLinear[in[channel]] : in[channel] * (1.0f / 255.0f);
+                }
+                out[3] = in[3] * (1.0f / 255.0f);
+            }
+        });
+    }
+
+    inline int Quantize(float value, int maximum) {
+        value = value < 0.0f ? 0.0f : value > 1.0f ? 1.0f : value;
+        return (int) (value * maximum + 0.5f);
+    }
+
+    void ToBytes(const FloatLevel &level, uint8_t *texels, bool srgb, bool parallel) {
+        const ColorTables &tables = Tables();
+        ForRows(level.height, level.width, parallel, [&](size_t begin, size_t end) {
+            const float *in = level.Row(begin);
+            uint8_t *out = texels + begin * level.width * 4;
+            for (size_t i = 0; i < (end - begin) * level.width; ++i, in += 4, out += 4) {
+                for (int channel = 0; channel < 3; ++channel) {
+                    out[channel] = srgb ? tables.toSrgb[Quantize(in[channel], 65535)]
+                                        : (uint8_t) Quantize(in[channel], 255);
+                }
+                out[3] = (uint8_t) Quantize(in[3], 255);
+            }
+        });
+    }
+
+    bool ReadFile(const char *path, std::vector<uint8_t> &contents) {
+        FILE *file = fopen(path, "rb");
+        if (file == nullptr) {
+            fprintf(stderr, "Failed to open %s\n", path);
+            return false;
+        }
+        fseek(file, 0, SEEK_END);
+        long size = ftell(file);
+        fseek(file, 0, SEEK_SET);
+        contents.resize(size > 0 ? (size_t) size : 0);
+        bool ok = size > 0 && fread(contents.data(), 1, contents.size(), file) == contents.size();
+        fclose(file);
+        if (!ok) {
+            fprintf(stderr, "Failed to read %s\n", path);
+        }
+        return ok;
+    }
+}
+
+bool Gm::DecodeImage(const uint8_t *data, size_t size, const ImportOptions &options, Image &image) {
+    if (IsPng(data, size)) {
+        return DecodePng(data, size, options, image);
+    }
+    if (IsJpeg(data, size)) {
+        return DecodeJpeg(data, size, options, image);
+    }
+    fprintf(stderr, "Unknown image format\n");
+    return false;
+}
+
+void Gm::GenerateMips(Image &image, const ImportOptions &options) {
+    if (image.format != TextureFormat::Rgba8) {
+        return;
+    }
+    size_t baseBytes = (size_t) image.width * image.height * 4;
+    image.levels.assign(1, ImageLevel{0, image.width, image.height});
+    if (options.mipFilter == MipFilter::None) {
+        image.texels.resize(baseBytes);
+        return;
+    }
+    size_t totalBytes = baseBytes;
+    for (uint32_t width = image.width, height = image.height; width > 1 || height > 1;) {
+        width = std::max(width >> 1, 1u);
+        height = std::max(height >> 1, 1u);
+        image.levels.push_back(ImageLevel{totalBytes, width, height});
+        totalBytes += (size_t) width * height * 4;
+    }
+    image.texels.resize(totalBytes);
+
+    // every level is filtered from the float one above, not from its 8 bit rounding
+    FloatLevel source, target;
+    source.width = image.width;
+    source.height = image.height;
+    source.texels.resize(baseBytes);
+    ToFloat(image.texels.data(), source, options.srgb, options.parallel);
+    for (size_t level = 1; level < image.levels.size(); ++level) {
+        target.width = image.levels[level].width;
+        target.height = image.levels[level].height;
+        target.texels.resize((size_t) target.width * target.height * 4);
+        if (options.simd) {
+            Downsample<SimdOps>(source, target, options.mipFilter, options.parallel);
+        } else {
+            Downsample<ScalarOps>(source, target, options.mipFilter, options.parallel);
+        }
+        ToBytes(target, image.texels.data() + image.levels[level].offset, options.srgb, options.parallel);
+        std::swap(source, target);
+    }
+}
+
+void Gm::CompressImage(Image &image, const ImportOptions &options) {
+    TextureFormat format = SupportedTextureFormat(options.format, options.srgb);
+    if (image.format != TextureFormat::Rgba8 || format == TextureFormat::Rgba8) {
+        return;
+    }
+    CompressionOptions compression;
+    compression.quality = options.quality;
+    compression.parallel = options.parallel;
+    compression.simd = options.simd;
+    std::vector<uint8_t> blocks;
+    std::vector<ImageLevel> levels;
+    for (const ImageLevel &level : image.levels) {
+        size_t offset = blocks.size();
+        levels.push_back(ImageLevel{offset, level.width, level.height});
+        blocks.resize(offset + TextureLevelBytes(format, level.width, level.height));
+        CompressLevel(image.texels.data() + level.offset, level.width, level.height, format, compression,
+                      blocks.data() + offset);
+    }
+    image.format = format;
+    image.texels.swap(blocks);
+    image.levels.swap(levels);
+}
+
+bool Gm::ImportImage(const char *path, const ImportOptions &options, Image &image) {
+    std::vector<uint8_t> contents;
+    if (!ReadFile(path, contents) || !DecodeImage(contents.data(), contents.size(), options, image)) {
+        return false;
+    }
+    GenerateMips(image, options);
+    CompressImage(image, options);
+    return true;
+}
+
+bool Gm::ImportImages(const std::vector<std::string> &paths, const ImportOptions &options,
+                      std::vector<Image> &images) {
+    images.assign(paths.size(), Image());
+    std::vector<char> imported(paths.size(), 0);
+    if (!options.parallel) {
+        for (size_t i = 0; i < paths.size(); ++i) {
+            imported[i] = ImportImage(paths[i].c_str(), options, images[i]);
+        }
+    } else {
+        TaskSystem &tasks = TaskSystem::Instance();
+        TaskSystem::TaskGroup group;
+        for (size_t i = 0; i < paths.size(); ++i) {
+            tasks.Run(group, [&, i] { imported[i] = ImportImage(paths[i].c_str(), options, images[i]); });
+        }
+        tasks.Wait(group);
+    }
+    bool ok = true;
+    for (size_t i = 0; i < paths.size(); ++i) {
+        if (!imported[i]) {
+            images[i] = Image();
+            ok = false;
+        }
+    }
+    return ok;
+}
+
+Gm::MipLoader Gm::ImageMipLoader(std::shared_ptr<const Image> image) {
+    return [image](uint32_t level, uint32_t width, uint32_t height, std::vector<uint8_t> &texels) {
+        if (level >= image->LevelCount() || image->levels[level].width != width ||
+            image->levels[level].height != height) {
+            return false;
+        }
+        texels.assign(image->LevelTexels(level), image->LevelTexels(level) + image->LevelBytes(level));
+        return true;
+    };
+}
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+#include "BlockCompression.h"
+#include "TextureStreamer.h"
+
+namespace Gm {
+    struct ImageLevel {
+        // into Image::texels
+        size_t offset;
+        uint32_t width;
+        uint32_t height;
+    };
+
+    // RGBA8 texels of every mip level back to back, finest first, rows tightly packed from the top row down
+    // as the files store them: each level is what glTexImage2D takes with GL_RGBA / GL_UNSIGNED_BYTE, which
+    // puts the top row at t = 0. Once compressed, the levels hold the blocks glCompressedTexImage2D takes.
+    struct Image {
+        uint32_t width = 0;
+        uint32_t height = 0;
+        TextureFormat format = TextureFormat::Rgba8;
+        std::vector<uint8_t> texels;
+        std::vector<ImageLevel> levels;
+
+        size_t LevelCount() const { return levels.size(); }
+
+        const uint8_t *LevelTexels(size_t level) const { return texels.data() + levels[level].offset; }
+
+        size_t LevelBytes(size_t level) const {
+            return TextureLevelBytes(format, levels[level].width, levels[level].height);
+        }
+    };
+
+    enum class MipFilter {
+        // level 0 only
+        None,
+        // average of 2x2 texels
+        Box,
+        // Kaiser windowed sinc over 6x6 texels, sharper than the box without its aliasing
+        Kaiser,
+    };
+
+    struct ImportOptions {
+        MipFilter mipFilter = MipFilter::Kaiser;
+        // the color channels are sRGB encoded and filtered in linear space, alpha always is linear;
+        // turn off for normal maps and other data
+        bool srgb = true;
+        // split rows and tiles over the TaskSystem
+        bool parallel = true;
+        // SSE2 / NEON filters, off only to compare against the scalar code
+        bool simd = true;
+        // what ImportImage leaves the levels in, the GPU format to upload them as; with a context loaded,
+        // whatever SupportedTextureFormat falls back to if the driver doesn't take it
+        TextureFormat format = TextureFormat::Rgba8;
+        CompressionQuality quality = CompressionQuality::Normal;
+    };
+
+    // PNG (any color type, 1 to 16 bits, not interlaced) and baseline JPEG into level 0 of `image`;
+    // false, with the reason on stderr, for anything else
+    bool DecodeImage(const uint8_t *data, size_t size, const ImportOptions &options, Image &image);
+
+    // replace the levels below level 0 of an RGBA8 image with a chain down to 1x1
+    void GenerateMips(Image &image, const ImportOptions &options);
+
+    // codes every level of an RGBA8 image into SupportedTextureFormat(options.format), see ImportOptions
+    void CompressImage(Image &image, const ImportOptions &options);
+
+    // read, decode, build the mips of and compress one file
+    bool ImportImage(const char *path, const ImportOptions &options, Image &image);
+
+    // every file on its own task, their rows and tiles split further; false if any failed, which stay empty
+    bool ImportImages(const std::vector<std::string> &paths, const ImportOptions &options,
+                      std::vector<Image> &images);
+
+    // streams the levels of an imported image, see TextureStreamer::AddTexture
+    MipLoader ImageMipLoader(std::shared_ptr<const Image> image);
+}
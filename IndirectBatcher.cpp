@@ -0,0 +1,129 @@
+#include <algorithm>
+#include "GlState.h"
+#include "IndirectBatcher.h"
+
+void Gm::IndirectBatcher::Initialize() {
+    m_multiDrawIndirect = GLAD_GL_VERSION_4_3 || GLAD_GL_ARB_multi_draw_indirect;
+    m_baseInstance = GLAD_GL_VERSION_4_2 || GLAD_GL_ARB_base_instance;
+    if (m_multiDrawIndirect && m_indirectBuffer == 0) {
+        glGenBuffers(1, &m_indirectBuffer);
+    }
+}
+
+void Gm::IndirectBatcher::Begin() {
+    m_items.clear();
+    m_queue.Begin();
+}
+
+void Gm::IndirectBatcher::Add(uint64_t sortKey, GLuint program, const MeshRange &mesh, GLuint instanceCount,
+                              GLuint baseInstance) {
+    if (instanceCount == 0) {
+        return;
+    }
+    DrawItem item;
+    item.program = program;
+    item.command.count = mesh.indexCount;
+    item.command.instanceCount = instanceCount;
+    item.command.firstIndex = mesh.firstIndex;
+    item.command.baseVertex = mesh.baseVertex;
+    item.command.baseInstance = baseInstance;
+    m_queue.Push(sortKey, (uint32_t) m_items.size());
+    m_items.push_back(item);
+}
+
+void Gm::IndirectBatcher::Record(std::vector<CommandBuffer> &buffers, TaskSystem &tasks,
+                                 const BindProgramCallback &bindProgram,
+                                 const RebaseInstancesCallback &rebaseInstances) {
+    for (CommandBuffer &buffer : buffers) {
+        buffer.Reset();
+    }
+    m_submittedCalls = 0;
+    // the sort is stable, draws with equal keys keep their submission order
+    m_queue.Sort();
+
+    m_commands.clear();
+    m_programs.clear();
+    for (const SortItem &sorted : m_queue.Items()) {
+        const DrawItem &item = m_items[sorted.value];
+        m_commands.push_back(item.command);
+        m_programs.push_back(item.program);
+    }
+    if (m_commands.empty() || buffers.empty()) {
+        return;
+    }
+
+    if (m_multiDrawIndirect) {
+        // every range reads its commands from the one indirect buffer, uploaded ahead of all of them
+        CommandBuffer &upload = buffers[0];
+        upload.BindBuffer(GL_DRAW_INDIRECT_BUFFER, m_indirectBuffer);
+        size_t size = m_commands.size() * sizeof(DrawElementsIndirectCommand);
+        if (size > m_indirectCapacity) {
+            m_indirectCapacity = size * 2;
+            upload.BufferData(GL_DRAW_INDIRECT_BUFFER, m_indirectCapacity, nullptr, GL_DYNAMIC_DRAW);
+        }
+        upload.BufferSubData(GL_DRAW_INDIRECT_BUFFER, 0, size, m_commands.data());
+    }
+
+    // small frames are not worth waking the workers, each range costs a program bind and a draw call
+    size_t ranges = std::min(buffers.size(), (m_commands.size() + MinRangeSize - 1) / MinRangeSize);
+    m_rangeCalls.assign(ranges, 0);
+    if (ranges == 1) {
+        m_rangeCalls[0] = RecordRange(buffers[0], 0, m_commands.size(), bindProgram, rebaseInstances);
+    } else {
+        TaskSystem::TaskGroup group;
+        for (size_t range = 0; range < ranges; ++range) {
+            tasks.Run(group, [&, range]() {
+                size_t begin = m_commands.size() * range / ranges;
+                size_t end = m_commands.size() * (range + 1) / ranges;
+                m_rangeCalls[range] = RecordRange(buffers[range], begin, end, bindProgram, rebaseInstances);
+            });
+        }
+        tasks.Wait(group);
+    }
+    for (size_t calls : m_rangeCalls) {
+        m_submittedCalls += calls;
+    }
+}
+
+size_t Gm::IndirectBatcher::RecordRange(CommandBuffer &commands, size_t begin, size_t end,
+                                        const BindProgramCallback &bindProgram,
+                                        const RebaseInstancesCallback &rebaseInstances) const {
+    size_t calls = 0;
+    size_t i = begin;
+    while (i < end) {
+        // a run of draws sharing a program
+        GLuint program = m_programs[i];
+        size_t runEnd = i + 1;
+        while (runEnd < end && m_programs[runEnd] == program) {
+            ++runEnd;
+        }
+        bindProgram(commands, program);
+        if (m_multiDrawIndirect) {
+            commands.MultiDrawElementsIndirect(GeometryArena::IndexType, i * sizeof(DrawElementsIndirectCommand),
+                                               (GLsizei) (runEnd - i));
+            calls++;
+            i = runEnd;
+            continue;
+        }
+        // GL 4.1 (macOS) has neither multi draw indirect nor base instance, fall back to one call per command
+        for (; i < runEnd; ++i) {
+            if (!m_baseInstance) {
+                rebaseInstances(commands, m_commands[i].baseInstance);
+            }
+            commands.DrawElementsInstanced(GeometryArena::IndexType, m_commands[i]);
+            calls++;
+        }
+    }
+    if (!m_multiDrawIndirect && !m_baseInstance) {
+        rebaseInstances(commands, 0);
+    }
+    return calls;
+}
+
+void Gm::IndirectBatcher::Finalize() {
+    if (m_indirectBuffer != 0) {
+        GlState::Current().DeleteBuffers(1, &m_indirectBuffer);
+        m_indirectBuffer = 0;
+        m_indirectCapacity = 0;
+    }
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <functional>
+#include <vector>
+#include "CommandBuffer.h"
+#include "GeometryArena.h"
+#include "RenderQueue.h"
+#include "TaskSystem.h"
+
+namespace Gm {
+    // Collects the draws of a frame, sorts them by their sort key (see MakeSortKey) and records
+    // each run of draws sharing a program as a single glMultiDrawElementsIndirect. The per-draw
+    // data is found through baseInstance, which offsets every instanced attribute of the draw.
+    class IndirectBatcher {
+    public:
+        // records what a group needs before its draws, called once per group and command buffer
+        typedef std::function<void(CommandBuffer &commands, GLuint program)> BindProgramCallback;
+        // only used without GL_ARB_base_instance: re-point the instanced attributes at `baseInstance`
+        typedef std::function<void(CommandBuffer &commands, GLuint baseInstance)> RebaseInstancesCallback;
+
+        // creates the indirect buffer, on the GL thread
+        void Initialize();
+
+        void Begin();
+
+        void Add(uint64_t sortKey, GLuint program, const MeshRange &mesh, GLuint instanceCount, GLuint baseInstance);
+
+        // Sorts the draws and records them into `buffers`, which are to be executed in order with the
+        // arena's VAO bound. Large frames are split over the buffers and recorded in parallel on `tasks`,
+        // so the callbacks run on worker threads. Touches no GL state.
+        void Record(std::vector<CommandBuffer> &buffers, TaskSystem &tasks, const BindProgramCallback &bindProgram,
+                    const RebaseInstancesCallback &rebaseInstances);
+
+        void Finalize();
+
+        size_t CommandCount() const { return m_commands.size(); }
+
+        // number of draw calls the last Record issued
+        size_t SubmittedCalls() const { return m_submittedCalls; }
+
+    private:
+        struct DrawItem {
+            GLuint program;
+            DrawElementsIndirectCommand command;
+        };
+
+        // the sorted draws [begin, end) into `commands`, returns the number of draw calls
+        size_t RecordRange(CommandBuffer &commands, size_t begin, size_t end, const BindProgramCallback &bindProgram,
+                           const RebaseInstancesCallback &rebaseInstances) const;
+
+        // fewest draws recorded on a worker of their own
+        static const size_t MinRangeSize = 256;
+
+        std::vector<DrawItem> m_items;
+        RenderQueue m_queue;
+        // the sorted draws and their programs
+        std::vector<DrawElementsIndirectCommand> m_commands;
+        std::vector<GLuint> m_programs;
+        std::vector<size_t> m_rangeCalls;
+
+        GLuint m_indirectBuffer = 0;
+        size_t m_indirectCapacity = 0;
+        size_t m_submittedCalls = 0;
+        bool m_multiDrawIndirect = false;
+        bool m_baseInstance = false;
+    };
+}
@@ -0,0 +1,393 @@
+#include <cstring>
+#include "CpuFeatures.h"
+#include "Inflate.h"
+
+#if GM_SIMD_X86
+#include <emmintrin.h>
+#elif GM_SIMD_NEON
+#include <arm_neon.h>
+#endif
+
+namespace {
+    const int FastBits = 10;
+    const int MaxCodeLength = 15;
+
+    // matches are copied in whole 16 byte chunks, which may write this far past their end
+    const size_t CopySlack = 16;
+
+    const uint16_t LengthBase[29] = {3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83,
+                                     99, 115, 131, 163, 195, 227, 258};
+    const uint8_t LengthExtra[29] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5,
+                                     5, 0};
+    const uint16_t DistanceBase[30] = {1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769,
+                                       1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577};
+    const uint8_t DistanceExtra[30] = {0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11,
+                                       11, 12, 12, 13, 13};
+    // order the code length code lengths are stored in
+    const uint8_t CodeLengthOrder[19] = {16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15};
+
+    // Canonical Huffman code. Codes up to FastBits long resolve with one lookup of the next bits as they come
+    // from the stream (least significant first), longer ones by walking the code lengths.
+    struct Huffman {
+        // symbol << 4 | code length, 0 where the code is longer than FastBits
+        uint16_t fast[1 << FastBits];
+        uint16_t counts[MaxCodeLength + 1];
+        // symbols ordered by code
+        uint16_t symbols[288];
+
+        bool Build(const uint8_t *lengths, int count);
+    };
+
+    bool Huffman::Build(const uint8_t *lengths, int count) {
+        std::memset(counts, 0, sizeof(counts));
+        for (int symbol = 0; symbol < count; ++symbol) {
+            ++counts[lengths[symbol]];
+        }
+        counts[0] = 0;
+        // more codes than the lengths allow; incomplete codes are fine, e.g. a single distance code
+        int left = 1;
+        for (int length = 1; length <= MaxCodeLength; ++length) {
+            left = (left << 1) - counts[length];
+            if (left < 0) {
+                return false;
+            }
+        }
+        uint16_t offsets[MaxCodeLength + 2] = {};
+        for (int length = 1; length <= MaxCodeLength; ++length) {
+            offsets[length + 1] = offsets[length] + counts[length];
+        }
+        for (int symbol = 0; symbol < count; ++symbol) {
+            if (lengths[symbol] != 0) {
+                symbols[offsets[lengths[symbol]]++] = (uint16_t) symbol;
+            }
+        }
+
+        std::memset(fast, 0, sizeof(fast));
+        int code = 0, index = 0;
+        for (int length = 1; length <= FastBits; ++length) {
+            for (int i = 0; i < counts[length]; ++i, ++code) {
+                // codes are stored most significant bit first, the lookup sees them reversed
+                int reversed = 0;
+                for (int bit = 0; bit < length; ++bit) {
+                    reversed |= ((code >> bit) & 1) << (length - 1 - bit);
+                }
+                uint16_t entry = (uint16_t) (symbols[index++] << 4 | length);
+                for (int slot = reversed; slot < (1 << FastBits); slot += 1 << length) {
+                    fast[slot] = entry;
+                }
+            }
+            code <<= 1;
+        }
+        return true;
+    }
+
+    class BitReader {
+    public:
+        BitReader(const uint8_t *data, size_t size) : m_next(data), m_end(data + size) {}
+
+        // at least 56 bits buffered afterwards
+        void Refill() {
+            if (m_end - m_next >= 8) {
+                // the bits above m_count are the next input bytes already, or'ing them again changes nothing
+                uint64_t word;
+                std::memcpy(&word, m_next, 8);
+                m_bits |= word << m_count;
+                m_next += (63 - m_count) >> 3;
+                m_count |= 56;
+                return;
+            }
+            while (m_count <= 56) {
+                uint64_t byte = 0;
+                if (m_next < m_end) {
+                    byte = *m_next++;
+                } else {
+                    ++m_padding;
+                }
+                m_bits |= byte << m_count;
+                m_count += 8;
+            }
+        }
+
+        uint32_t Peek(int count) const { return (uint32_t) (m_bits & ((uint64_t(1) << count) - 1)); }
+
+        void Consume(int count) {
+            m_bits >>= count;
+            m_count -= count;
+        }
+
+        uint32_t Read(int count) {
+            if (m_count < count) {
+                Refill();
+            }
+            uint32_t value = Peek(count);
+            Consume(count);
+            return value;
+        }
+
+        int Decode(const Huffman &huffman) {
+            uint16_t entry = huffman.fast[Peek(FastBits)];
+            if (entry != 0) {
+                Consume(entry & 15);
+                return entry >> 4;
+            }
+            // one bit at a time: the codes of each length are consecutive, starting at `first`
+            int code = 0, first = 0, index = 0;
+            for (int length = 1; length <= MaxCodeLength; ++length) {
+                code |= (int) (m_bits >> (length - 1)) & 1;
+                int count = huffman.counts[length];
+                if (code - count < first) {
+                    Consume(length);
+                    return huffman.symbols[index + (code - first)];
+                }
+                index += count;
+                first = (first + count) << 1;
+                code <<= 1;
+            }
+            return -1;
+        }
+
+        // drop the rest of the current byte and hand out whole bytes from there on, nullptr past the end
+        const uint8_t *AlignToByte() {
+            Consume(m_count & 7);
+            // zeros fed past the end sit on top of the real bytes in the buffer
+            int buffered = (m_count >> 3) - m_padding;
+            const uint8_t *position = buffered >= 0 ? m_next - buffered : nullptr;
+            m_bits = 0;
+            m_count = 0;
+            m_padding = 0;
+            return position;
+        }
+
+        void Seek(const uint8_t *position) { m_next = position; }
+
+        const uint8_t *End() const { return m_end; }
+
+        // read past the end of the input
+        bool Overrun() const { return m_padding * 8 > m_count; }
+
+    private:
+        const uint8_t *m_next;
+        const uint8_t *m_end;
+        uint64_t m_bits = 0;
+        int m_count = 0;
+        int m_padding = 0;
+    };
+
+    inline void Copy16(uint8_t *to, const uint8_t *from) {
+#if GM_SIMD_X86
+        _mm_storeu_si128((__m128i *) to, _mm_loadu_si128((const __m128i *) from));
+#elif GM_SIMD_NEON
+        vst1q_u8(to, vld1q_u8(from));
+#else
+        std::memcpy(to, from, 16);
+#endif
+    }
+
+    // `length` bytes from `distance` back, the source overlaps the destination when distance < length
+    inline void CopyMatch(uint8_t *out, size_t distance, size_t length) {
+        const uint8_t *from = out - distance;
+        if (distance >= 16) {
+            // every chunk reads only bytes written before it
+            for (size_t i = 0; i < length; i += 16) {
+                Copy16(out + i, from + i);
+            }
+        } else if (distance == 1) {
+            std::memset(out, from[0], length);
+        } else if (distance >= 8) {
+            for (size_t i = 0; i < length; i += 8) {
+                std::memcpy(out + i, from + i, 8);
+            }
+        } else {
+            for (size_t i = 0; i < length; ++i) {
+                out[i] = from[i];
+            }
+        }
+    }
+
+    class Inflater {
+    public:
+        Inflater(const uint8_t *data, size_t size, uint8_t *output, size_t maxSize)
+                : m_reader(data, size), m_begin(output), m_out(output), m_end(output + maxSize) {}
+
+        bool Run();
+
+        size_t Written() const { return (size_t) (m_out - m_begin); }
+
+    private:
+        bool Stored();
+
+        bool DynamicTables();
+
+        void FixedTables();
+
+        bool Codes();
+
+        BitReader m_reader;
+        uint8_t *m_begin;
+        uint8_t *m_out;
+        uint8_t *m_end;
+        Huffman m_literals;
+        Huffman m_distances;
+    };
+
+    bool Inflater::Run() {
+        bool last = false;
+        while (!last) {
+            m_reader.Refill();
+            last = m_reader.Read(1) != 0;
+            uint32_t type = m_reader.Read(2);
+            bool ok;
+            if (type == 0) {
+                ok = Stored();
+            } else if (type == 1) {
+                FixedTables();
+                ok = Codes();
+            } else if (type == 2) {
+                ok = DynamicTables() && Codes();
+            } else {
+                ok = false;
+            }
+            if (!ok || m_reader.Overrun()) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    bool Inflater::Stored() {
+        const uint8_t *position = m_reader.AlignToByte();
+        const uint8_t *end = m_reader.End();
+        if (position == nullptr || end - position < 4) {
+            return false;
+        }
+        size_t length = position[0] | position[1] << 8;
+        size_t complement = position[2] | position[3] << 8;
+        position += 4;
+        if (length != (~complement & 0xffff) || (size_t) (end - position) < length ||
+            (size_t) (m_end - m_out) < length) {
+            return false;
+        }
+        std::memcpy(m_out, position, length);
+        m_out += length;
+        m_reader.Seek(position + length);
+        return true;
+    }
+
+    void Inflater::FixedTables() {
+        uint8_t lengths[320];
+        std::memset(lengths, 8, 144);
+        std::memset(lengths + 144, 9, 112);
+        std::memset(lengths + 256, 7, 24);
+        std::memset(lengths + 280, 8, 8);
+        m_literals.Build(lengths, 288);
+        std::memset(lengths, 5, 30);
+        m_distances.Build(lengths, 30);
+    }
+
+    bool Inflater::DynamicTables() {
+        m_reader.Refill();
+        int literalCount = (int) m_reader.Read(5) + 257;
+        int distanceCount = (int) m_reader.Read(5) + 1;
+        int codeLengthCount = (int) m_reader.Read(4) + 4;
+        if (literalCount > 286 || distanceCount > 30) {
+            return false;
+        }
+        uint8_t lengths[286 + 30] = {};
+        for (int i = 0; i < codeLengthCount; ++i) {
+            lengths[CodeLengthOrder[i]] = (uint8_t) m_reader.Read(3);
+        }
+        Huffman codeLengths;
+        if (!codeLengths.Build(lengths, 19)) {
+            return false;
+        }
+        // literal / length and distance code lengths, run length coded as one sequence
+        int total = literalCount + distanceCount;
+        std::memset(lengths, 0, sizeof(lengths));
+        for (int i = 0; i < total;) {
+            m_reader.Refill();
+            int symbol = m_reader.Decode(codeLengths);
+            if (symbol < 0) {
+                return false;
+            }
+            if (symbol < 16) {
+                lengths[i++] = (uint8_t) symbol;
+                continue;
+            }
+            uint8_t value = 0;
+            int repeat;
+            if (symbol == 16) {
+                if (i == 0) {
+                    return false;
+                }
+                value = lengths[i - 1];
+                repeat = 3 + (int) m_reader.Read(2);
+            } else if (symbol == 17) {
+                repeat = 3 + (int) m_reader.Read(3);
+            } else {
+                repeat = 11 + (int) m_reader.Read(7);
+            }
+            if (i + repeat > total) {
+                return false;
+            }
+            std::memset(lengths + i, value, repeat);
+            i += repeat;
+        }
+        // a block without an end of block code could never finish
+        return lengths[256] != 0 && m_literals.Build(lengths, literalCount) &&
+               m_distances.Build(lengths + literalCount, distanceCount);
+    }
+
+    bool Inflater::Codes() {
+        while (true) {
+            // enough for the longest length code, its extra bits, a distance code and its extra bits: 48
+            m_reader.Refill();
+            int symbol = m_reader.Decode(m_literals);
+            if (symbol < 256) {
+                if (symbol < 0 || m_out == m_end) {
+                    return false;
+                }
+                *m_out++ = (uint8_t) symbol;
+                continue;
+            }
+            if (symbol == 256) {
+                return true;
+            }
+            symbol -= 257;
+            if (symbol >= 29) {
+                return false;
+            }
+            size_t length = LengthBase[symbol] + m_reader.Read(LengthExtra[symbol]);
+            int distanceSymbol = m_reader.Decode(m_distances);
+            if (distanceSymbol < 0 || distanceSymbol >= 30) {
+                return false;
+            }
+            size_t distance = DistanceBase[distanceSymbol] + m_reader.Read(DistanceExtra[distanceSymbol]);
+            if (distance > (size_t) (m_out - m_begin) || length > (size_t) (m_end - m_out)) {
+                return false;
+            }
+            CopyMatch(m_out, distance, length);
+            m_out += length;
+            if (m_reader.Overrun()) {
+                return false;
+            }
+        }
+    }
+}
+
+bool Gm::Inflate(const uint8_t *data, size_t size, size_t maxSize, std::vector<uint8_t> &output) {
+    output.resize(maxSize + CopySlack);
+    Inflater inflater(data, size, output.data(), maxSize);
+    bool ok = inflater.Run();
+    output.resize(ok ? inflater.Written() : 0);
+    return ok;
+}
+
+bool Gm::ZlibDecompress(const uint8_t *data, size_t size, size_t maxSize, std::vector<uint8_t> &output) {
+    // deflate with a window of at most 32K, no preset dictionary, header checksum
+    if (size < 2 || (data[0] & 15) != 8 || (data[0] >> 4) > 7 || (data[1] & 0x20) != 0 ||
+        (data[0] << 8 | data[1]) % 31 != 0) {
+        output.clear();
+        return false;
+    }
+    return Inflate(data + 2, size - 2, maxSize, output);
+}
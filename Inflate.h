@@ -0,0 +1,17 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace Gm {
+    // DEFLATE (RFC 1951) decompression into `output`, which ends up holding exactly the decompressed bytes.
+    // Producing more than `maxSize` bytes is an error, like any malformed or truncated input.
+    //
+    // Codes are read from a 64 bit buffer refilled eight bytes at a time and looked up in 10 bit tables,
+    // matches are copied 16 bytes per SIMD load / store where their distance allows it.
+    bool Inflate(const uint8_t *data, size_t size, size_t maxSize, std::vector<uint8_t> &output);
+
+    // a zlib stream (RFC 1950): DEFLATE behind a two byte header; the trailing Adler-32 is not checked
+    bool ZlibDecompress(const uint8_t *data, size_t size, size_t maxSize, std::vector<uint8_t> &output);
+}
@@ -0,0 +1,597 @@
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include "JpegDecoder.h"
+#include "TaskSystem.h"
+
+namespace {
+    const int FastBits = 9;
+
+    // restart intervals entropy decoded per task, and MCU rows transformed and converted per task
+    const size_t SegmentGrain = 4;
+    const size_t BandGrain = 2;
+
+    // position in the 8x8 block of the nth coefficient in the stream
+    const uint8_t ZigZag[64] = {0, 1, 8, 16, 9, 2, 3, 10, 17, 24, 32, 25, 18, 11, 4, 5, 12, 19, 26, 33, 40, 48,
+                                41, 34, 27, 20, 13, 6, 7, 14, 21, 28, 35, 42, 49, 56, 57, 50, 43, 36, 29, 22, 15, 23,
+                                30, 37, 44, 51, 58, 59, 52, 45, 38, 31, 39, 46, 53, 60, 61, 54, 47, 55, 62, 63};
+
+    bool Fail(const char *reason) {
+        fprintf(stderr, "JPEG: %s\n", reason);
+        return false;
+    }
+
+    uint16_t ReadBigEndian16(const uint8_t *p) {
+        return (uint16_t) (p[0] << 8 | p[1]);
+    }
+
+    // codes are stored most significant bit first
+    struct Huffman {
+        // symbol << 4 | code length, 0 where the code is longer than FastBits
+        uint16_t fast[1 << FastBits];
+        int32_t maxCode[18];
+        int32_t valueOffset[17];
+        uint8_t values[256];
+        bool defined = false;
+
+        bool Build(const uint8_t *counts, const uint8_t *symbols, int total);
+    };
+
+    bool Huffman::Build(const uint8_t *counts, const uint8_t *symbols, int total) {
+        std::memcpy(values, symbols, total);
+        std::memset(fast, 0, sizeof(fast));
+        int32_t code = 0, index = 0;
+        for (int length = 1; length <= 16; ++length) {
+            valueOffset[length] = index - code;
+            for (int i = 0; i < counts[length - 1]; ++i, ++code, ++index) {
+                if (length <= FastBits) {
+                    int shift = FastBits - length;
+                    for (int slot = code << shift; slot < (code + 1) << shift; ++slot) {
+                        fast[slot] = (uint16_t) (values[index] << 4 | length);
+                    }
+                }
+            }
+            // the highest code of this length, below any code of it when there is none
+            maxCode[length] = code - 1;
+            if (code > (1 << length)) {
+                return false;
+            }
+            code <<= 1;
+        }
+        // stops the slow search
+        maxCode[17] = INT32_MAX;
+        defined = true;
+        return true;
+    }
+
+    // entropy coded bits of one restart interval, the stuffed zero after every 0xff already excluded by
+    // the caller splitting the scan at its markers
+    class BitReader {
+    public:
+        BitReader(const uint8_t *data, const uint8_t *end) : m_next(data), m_end(end) {}
+
+        // bits past the end read as zeros
+        void Fill() {
+            while (m_count <= 24) {
+                uint32_t byte = 0;
+                if (m_next < m_end) {
+                    byte = *m_next++;
+                    if (byte == 0xff) {
+                        ++m_next;
+                    }
+                }
+                m_bits |= byte << (24 - m_count);
+                m_count += 8;
+            }
+        }
+
+        int Decode(const Huffman &huffman) {
+            if (m_count < 16) {
+                Fill();
+            }
+            uint16_t entry = huffman.fast[m_bits >> (32 - FastBits)];
+            if (entry != 0) {
+                Consume(entry & 15);
+                return entry >> 4;
+            }
+            int length = FastBits + 1;
+            while ((int32_t) (m_bits >> (32 - length)) > huffman.maxCode[length]) {
+                ++length;
+            }
+            if (length > 16) {
+                return -1;
+            }
+            int32_t code = (int32_t) (m_bits >> (32 - length));
+            Consume(length);
+            return huffman.values[(huffman.valueOffset[length] + code) & 255];
+        }
+
+        // `count` (1 to 16) bits as a signed value, the negative half stored as its one's complement
+        int Receive(int count) {
+            if (m_count < count) {
+                Fill();
+            }
+            int value = (int) (m_bits >> (32 - count));
+            Consume(count);
+            return value < 1 << (count - 1) ? value - (1 << count) + 1 : value;
+        }
+
+    private:
+        void Consume(int count) {
+            m_bits <<= count;
+            m_count -= count;
+        }
+
+        const uint8_t *m_next;
+        const uint8_t *m_end;
+        uint32_t m_bits = 0;
+        int m_count = 0;
+    };
+
+    struct Component {
+        int id = 0;
+        int h = 1, v = 1;
+        int quantTable = 0;
+        int dcTable = 0, acTable = 0;
+        // whole MCUs of blocks
+        size_t blocksPerLine = 0, blockRows = 0;
+        std::vector<int16_t> coefficients;
+        // samples of the blocks, blocksPerLine * 8 wide
+        std::vector<uint8_t> samples;
+    };
+
+    struct Segment {
+        const uint8_t *begin;
+        const uint8_t *end;
+    };
+
+    struct Decoder {
+        uint32_t width = 0, height = 0;
+        std::vector<Component> components;
+        int hMax = 1, vMax = 1;
+        size_t mcusPerLine = 0, mcuRows = 0;
+        uint16_t quant[4][64] = {};
+        Huffman dc[4], ac[4];
+        size_t restartInterval = 0;
+        std::vector<Segment> segments;
+
+        bool DecodeSegment(size_t index);
+
+        void TransformBand(size_t mcuRowBegin, size_t mcuRowEnd);
+
+        void ConvertBand(size_t mcuRowBegin, size_t mcuRowEnd, uint8_t *texels) const;
+    };
+
+    bool Decoder::DecodeSegment(size_t index) {
+        size_t mcuCount = mcusPerLine * mcuRows;
+        size_t interval = restartInterval != 0 ? restartInterval : mcuCount;
+        size_t mcuBegin = index * interval, mcuEnd = std::min(mcuCount, mcuBegin + interval);
+        BitReader reader(segments[index].begin, segments[index].end);
+        int predictions[4] = {};
+        for (size_t mcu = mcuBegin; mcu < mcuEnd; ++mcu) {
+            size_t mcuX = mcu % mcusPerLine, mcuY = mcu / mcusPerLine;
+            for (size_t c = 0; c < components.size(); ++c) {
+                Component &component = components[c];
+                const Huffman &dcTable = dc[component.dcTable], &acTable = ac[component.acTable];
+                for (int by = 0; by < component.v; ++by) {
+                    for (int bx = 0; bx < component.h; ++bx) {
+                        size_t block = (mcuY * component.v + by) * component.blocksPerLine + mcuX * component.h + bx;
+                        int16_t *out = component.coefficients.data() + block * 64;
+                        int size = reader.Decode(dcTable);
+                        if (size < 0 || size > 11) {
+                            return false;
+                        }
+                        predictions[c] += size != 0 ? reader.Receive(size) : 0;
+                        out[0] = (int16_t) predictions[c];
+                        for (int k = 1; k < 64;) {
+                            int symbol = reader.Decode(acTable);
+                            if (symbol < 0) {
+                                return false;
+                            }
+                            int run = symbol >> 4, bits = symbol & 15;
+                            if (bits == 0) {
+                                // end of block, or 16 zeros
+                                if (run != 15) {
+                                    break;
+                                }
+                                k += 16;
+                                continue;
+                            }
+                            k += run;
+                            if (k > 63) {
+                                return false;
+                            }
+                            out[ZigZag[k++]] = (int16_t) reader.Receive(bits);
+                        }
+                    }
+                }
+            }
+        }
+        return true;
+    }
+
+    // islow IDCT of the IJG library: 13 bit fixed point constants, 2 extra bits kept between the passes
+    const int ConstBits = 13;
+    const int Pass1Bits = 2;
+
+    inline int Descale(int x, int n) {
+        return (x + (1 << (n - 1))) >> n;
+    }
+
+    inline uint8_t ClampSample(int x) {
+        return (uint8_t) (x < 0 ? 0 : x > 255 ? 255 : x);
+    }
+
+    // one 1-D pass over 8 values `stride` apart, the even and odd parts of the AAN style factorization
+    template<typename In, typename Out>
+    inline void Idct8(const In *in, int stride, Out *out, int outStride, int shift, int bias) {
+        int z2 = in[2 * stride], z3 = in[6 * stride];
+        int z1 = (z2 + z3) * 4433;
+        int tmp2 = z1 + z3 * -15137;
+        int tmp3 = z1 + z2 * 6270;
+        z2 = in[0];
+        z3 = in[4 * stride];
+        int tmp0 = (z2 + z3) * (1 << ConstBits);
+        int tmp1 = (z2 - z3) * (1 << ConstBits);
+        int tmp10 = tmp0 + tmp3, tmp13 = tmp0 - tmp3, tmp11 = tmp1 + tmp2, tmp12 = tmp1 - tmp2;
+
+        tmp0 = in[7 * stride];
+        tmp1 = in[5 * stride];
+        tmp2 = in[3 * stride];
+        tmp3 = in[1 * stride];
+        z1 = tmp0 + tmp3;
+        z2 = tmp1 + tmp2;
+        z3 = tmp0 + tmp2;
+        int z4 = tmp1 + tmp3;
+        int z5 = (z3 + z4) * 9633;
+        tmp0 *= 2446;
+        tmp1 *= 16819;
+        tmp2 *= 25172;
+        tmp3 *= 12299;
+        z1 *= -7373;
+        z2 *= -20995;
+        z3 = z3 * -16069 + z5;
+        z4 = z4 * -3196 + z5;
+        tmp0 += z1 + z3;
+        tmp1 += z2 + z4;
+        tmp2 += z2 + z3;
+        tmp3 += z1 + z4;
+
+        out[0] = (Out) (Descale(tmp10 + tmp3, shift) + bias);
+        out[7 * outStride] = (Out) (Descale(tmp10 - tmp3, shift) + bias);
+        out[1 * outStride] = (Out) (Descale(tmp11 + tmp2, shift) + bias);
+        out[6 * outStride] = (Out) (Descale(tmp11 - tmp2, shift) + bias);
+        out[2 * outStride] = (Out) (Descale(tmp12 + tmp1, shift) + bias);
+        out[5 * outStride] = (Out) (Descale(tmp12 - tmp1, shift) + bias);
+        out[3 * outStride] = (Out) (Descale(tmp13 + tmp0, shift) + bias);
+        out[4 * outStride] = (Out) (Descale(tmp13 - tmp0, shift) + bias);
+    }
+
+    void IdctBlock(const int16_t *coefficients, const uint16_t *quant, uint8_t *out, size_t outStride) {
+        int block[64], workspace[64];
+        for (int i = 0; i < 64; ++i) {
+            block[i] = coefficients[i] * quant[i];
+        }
+        for (int column = 0; column < 8; ++column) {
+            const int *in = block + column;
+            if (in[8] == 0 && in[16] == 0 && in[24] == 0 && in[32] == 0 && in[40] == 0 && in[48] == 0 &&
+                in[56] == 0) {
+                // only DC, the common case after quantization
+                for (int row = 0; row < 8; ++row) {
+                    workspace[row * 8 + column] = in[0] * (1 << Pass1Bits);
+                }
+                continue;
+            }
+            Idct8(in, 8, workspace + column, 8, ConstBits - Pass1Bits, 0);
+        }
+        int samples[8];
+        for (int row = 0; row < 8; ++row) {
+            // the level shift is folded into the bias
+            Idct8(workspace + row * 8, 1, samples, 1, ConstBits + Pass1Bits + 3, 128);
+            for (int i = 0; i < 8; ++i) {
+                out[row * outStride + i] = ClampSample(samples[i]);
+            }
+        }
+    }
+
+    void Decoder::TransformBand(size_t mcuRowBegin, size_t mcuRowEnd) {
+        for (Component &component : components) {
+            size_t stride = component.blocksPerLine * 8;
+            for (size_t blockRow = mcuRowBegin * component.v; blockRow < mcuRowEnd * component.v; ++blockRow) {
+                for (size_t blockX = 0; blockX < component.blocksPerLine; ++blockX) {
+                    size_t block = blockRow * component.blocksPerLine + blockX;
+                    IdctBlock(component.coefficients.data() + block * 64, quant[component.quantTable],
+                              component.samples.data() + blockRow * 8 * stride + blockX * 8, stride);
+                }
+            }
+        }
+    }
+
+    // YCbCr to RGB in the 16 bit fixed point of the IJG library
+    struct ColorTables {
+        int crR[256], cbB[256], crG[256], cbG[256];
+
+        ColorTables() {
+            const int Half = 1 << 15;
+            for (int i = 0; i < 256; ++i) {
+                int x = i - 128;
+                crR[i] = (91881 * x + Half) >> 16;
+                cbB[i] = (116130 * x + Half) >> 16;
+                crG[i] = -46802 * x;
+                cbG[i] = -22554 * x + Half;
+            }
+        }
+    };
+
+    void Decoder::ConvertBand(size_t mcuRowBegin, size_t mcuRowEnd, uint8_t *texels) const {
+        static const ColorTables tables;
+        size_t rowBegin = mcuRowBegin * vMax * 8, rowEnd = std::min<size_t>(height, mcuRowEnd * vMax * 8);
+        for (size_t y = rowBegin; y < rowEnd; ++y) {
+            uint8_t *out = texels + y * width * 4;
+            const Component &luma = components[0];
+            const uint8_t *yRow = luma.samples.data() + y * luma.v / vMax * luma.blocksPerLine * 8;
+            if (components.size() == 1) {
+                for (uint32_t x = 0; x < width; ++x, out += 4) {
+                    out[0] = out[1] = out[2] = yRow[x];
+                    out[3] = 255;
+                }
+                continue;
+            }
+            const Component &blue = components[1], &red = components[2];
+            const uint8_t *cbRow = blue.samples.data() + y * blue.v / vMax * blue.blocksPerLine * 8;
+            const uint8_t *crRow = red.samples.data() + y * red.v / vMax * red.blocksPerLine * 8;
+            for (uint32_t x = 0; x < width; ++x, out += 4) {
+                int luminance = yRow[x * luma.h / hMax];
+                int cb = cbRow[x * blue.h / hMax], cr = crRow[x * red.h / hMax];
+                out[0] = ClampSample(luminance + tables.crR[cr]);
+                out[1] = ClampSample(luminance + ((tables.cbG[cb] + tables.crG[cr]) >> 16));
+                out[2] = ClampSample(luminance + tables.cbB[cb]);
+                out[3] = 255;
+            }
+        }
+    }
+
+    bool ParseFrame(const uint8_t *p, size_t length, Decoder &decoder) {
+        if (length < 6 || p[0] != 8) {
+            return Fail("only 8 bit samples are supported");
+        }
+        decoder.height = ReadBigEndian16(p + 1);
+        decoder.width = ReadBigEndian16(p + 3);
+        int count = p[5];
+        if (decoder.width == 0 || decoder.height == 0) {
+            return Fail("bad image size");
+        }
+        if ((count != 1 && count != 3) || length < 6 + (size_t) count * 3) {
+            return Fail("only gray and YCbCr images are supported");
+        }
+        decoder.components.resize(count);
+        for (int i = 0; i < count; ++i) {
+            Component &component = decoder.components[i];
+            const uint8_t *entry = p + 6 + i * 3;
+            component.id = entry[0];
+            component.h = entry[1] >> 4;
+            component.v = entry[1] & 15;
+            component.quantTable = entry[2] & 3;
+            if (component.h < 1 || component.h > 4 || component.v < 1 || component.v > 4) {
+                return Fail("bad sampling factors");
+            }
+            if (count == 1) {
+                // a single component is not interleaved, its MCU is one block whatever the factors say
+                component.h = component.v = 1;
+            }
+            decoder.hMax = std::max(decoder.hMax, component.h);
+            decoder.vMax = std::max(decoder.vMax, component.v);
+        }
+        for (const Component &component : decoder.components) {
+            if (decoder.hMax % component.h != 0 || decoder.vMax % component.v != 0) {
+                return Fail("unsupported sampling factors");
+            }
+        }
+        decoder.mcusPerLine = (decoder.width + decoder.hMax * 8 - 1) / (decoder.hMax * 8);
+        decoder.mcuRows = (decoder.height + decoder.vMax * 8 - 1) / (decoder.vMax * 8);
+        for (Component &component : decoder.components) {
+            component.blocksPerLine = decoder.mcusPerLine * component.h;
+            component.blockRows = decoder.mcuRows * component.v;
+            component.coefficients.assign(component.blocksPerLine * component.blockRows * 64, 0);
+            component.samples.resize(component.blocksPerLine * component.blockRows * 64);
+        }
+        return true;
+    }
+
+    bool ParseQuantTables(const uint8_t *p, size_t length, Decoder &decoder) {
+        while (length > 0) {
+            int precision = p[0] >> 4, table = p[0] & 15;
+            size_t size = precision != 0 ? 129 : 65;
+            if (table > 3 || precision > 1 || length < size) {
+                return Fail("bad DQT");
+            }
+            // stored in zig zag order, kept in block order
+            for (int k = 0; k < 64; ++k) {
+                decoder.quant[table][ZigZag[k]] = precision != 0 ? ReadBigEndian16(p + 1 + k * 2) : p[1 + k];
+            }
+            p += size;
+            length -= size;
+        }
+        return true;
+    }
+
+    bool ParseHuffmanTables(const uint8_t *p, size_t length, Decoder &decoder) {
+        while (length > 0) {
+            int tableClass = p[0] >> 4, table = p[0] & 15;
+            if (length < 17 || tableClass > 1 || table > 3) {
+                return Fail("bad DHT");
+            }
+            int total = 0;
+            for (int i = 0; i < 16; ++i) {
+                total += p[1 + i];
+            }
+            if (total > 256 || length < 17 + (size_t) total) {
+                return Fail("bad DHT");
+            }
+            Huffman &huffman = tableClass == 0 ? decoder.dc[table] : decoder.ac[table];
+            if (!huffman.Build(p + 1, p + 17, total)) {
+                return Fail("bad DHT");
+            }
+            p += 17 + total;
+            length -= 17 + total;
+        }
+        return true;
+    }
+
+    // reads the scan header and splits the entropy coded data at its restart markers; returns the end of it
+    const uint8_t *ParseScan(const uint8_t *p, size_t length, const uint8_t *end, Decoder &decoder) {
+        if (decoder.components.empty()) {
+            Fail("SOS before SOF");
+            return nullptr;
+        }
+        int count = p[0];
+        if (count != (int) decoder.components.size() || length < 4 + (size_t) count * 2) {
+            Fail("only a single interleaved scan is supported");
+            return nullptr;
+        }
+        for (int i = 0; i < count; ++i) {
+            // MCUs hold the blocks in the order of the scan, which encoders keep the same as the frame's
+            Component *component = &decoder.components[i];
+            int tables = p[2 + i * 2];
+            if (p[1 + i * 2] != component->id) {
+                Fail("unexpected component order in scan");
+                return nullptr;
+            }
+            component->dcTable = (tables >> 4) & 3;
+            component->acTable = tables & 3;
+            if (!decoder.dc[component->dcTable].defined || !decoder.ac[component->acTable].defined) {
+                Fail("missing Huffman table");
+                return nullptr;
+            }
+        }
+        const uint8_t *spectral = p + 1 + count * 2;
+        if (spectral[0] != 0 || spectral[1] != 63 || spectral[2] != 0) {
+            Fail("progressive JPEGs are not supported");
+            return nullptr;
+        }
+
+        const uint8_t *data = p + length, *begin = data;
+        decoder.segments.clear();
+        for (; data + 1 < end; ++data) {
+            if (data[0] != 0xff || data[1] == 0 || data[1] == 0xff) {
+                continue;
+            }
+            if (data[1] < 0xd0 || data[1] > 0xd7) {
+                break;
+            }
+            decoder.segments.push_back(Segment{begin, data});
+            begin = data + 2;
+            ++data;
+        }
+        if (data + 1 >= end) {
+            data = end;
+        }
+        decoder.segments.push_back(Segment{begin, data});
+        return data;
+    }
+}
+
+bool Gm::IsJpeg(const uint8_t *data, size_t size) {
+    return size >= 3 && data[0] == 0xff && data[1] == 0xd8 && data[2] == 0xff;
+}
+
+bool Gm::DecodeJpeg(const uint8_t *data, size_t size, const ImportOptions &options, Image &image) {
+    if (!IsJpeg(data, size)) {
+        return Fail("not a JPEG");
+    }
+    Decoder decoder;
+    const uint8_t *p = data + 2, *end = data + size;
+    bool scanned = false;
+    while (!scanned) {
+        // markers may be padded with any number of 0xff
+        while (p < end && *p == 0xff && p + 1 < end && p[1] == 0xff) {
+            ++p;
+        }
+        if (end - p < 4 || p[0] != 0xff) {
+            return Fail("truncated");
+        }
+        int marker = p[1];
+        size_t length = ReadBigEndian16(p + 2);
+        if (length < 2 || (size_t) (end - p) < 2 + length) {
+            return Fail("truncated");
+        }
+        const uint8_t *segment = p + 4;
+        length -= 2;
+        p += 2 + length + 2;
+        bool ok = true;
+        switch (marker) {
+            case 0xc0:
+            case 0xc1:
+                ok = ParseFrame(segment, length, decoder);
+                break;
+            case 0xc2:
+            case 0xc3:
+            case 0xc5:
+            case 0xc6:
+            case 0xc7:
+            case 0xc9:
+            case 0xca:
+            case 0xcb:
+            case 0xcd:
+            case 0xce:
+            case 0xcf:
+                return Fail("only baseline and extended sequential Huffman JPEGs are supported");
+            case 0xc4:
+                ok = ParseHuffmanTables(segment, length, decoder);
+                break;
+            case 0xdb:
+                ok = ParseQuantTables(segment, length, decoder);
+                break;
+            case 0xdd:
+                ok = length >= 2;
+                decoder.restartInterval = ok ? ReadBigEndian16(segment) : 0;
+                break;
+            case 0xda:
+                ok = ParseScan(segment, length, end, decoder) != nullptr;
+                scanned = true;
+                break;
+            default:
+                // APPn, COM and the like
+                break;
+        }
+        if (!ok) {
+            return false;
+        }
+    }
+
+    TaskSystem &tasks = TaskSystem::Instance();
+    size_t segmentCount = decoder.segments.size();
+    std::atomic<bool> decoded{true};
+    auto decode = [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            if (!decoder.DecodeSegment(i)) {
+                decoded = false;
+            }
+        }
+    };
+    if (options.parallel && segmentCount > SegmentGrain) {
+        tasks.ParallelFor(0, segmentCount, SegmentGrain, decode);
+    } else {
+        decode(0, segmentCount);
+    }
+    if (!decoded) {
+        return Fail("corrupt entropy coded data");
+    }
+
+    image.format = TextureFormat::Rgba8;
+    image.width = decoder.width;
+    image.height = decoder.height;
+    image.texels.resize((size_t) decoder.width * decoder.height * 4);
+    image.levels.assign(1, ImageLevel{0, decoder.width, decoder.height});
+    auto transform = [&](size_t begin, size_t end) {
+        decoder.TransformBand(begin, end);
+        decoder.ConvertBand(begin, end, image.texels.data());
+    };
+    if (options.parallel && decoder.mcuRows > BandGrain) {
+        tasks.ParallelFor(0, decoder.mcuRows, BandGrain, transform);
+    } else {
+        transform(0, decoder.mcuRows);
+    }
+    return true;
+}
@@ -0,0 +1,15 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include "ImageImport.h"
+
+namespace Gm {
+    bool IsJpeg(const uint8_t *data, size_t size);
+
+    // Decodes a baseline or extended sequential Huffman JPEG (8 bit, gray or YCbCr with 1, 2 or 4 times
+    // subsampled chroma, one interleaved scan) into RGBA8 level 0 of `image`. Chroma is replicated, not
+    // interpolated. With options.parallel the restart intervals are entropy decoded on separate tasks and the
+    // IDCT and color conversion run in bands of MCU rows.
+    bool DecodeJpeg(const uint8_t *data, size_t size, const ImportOptions &options, Image &image);
+}
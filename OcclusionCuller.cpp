@@ -0,0 +1,273 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include "Eigen/Geometry"
+#include "CpuFeatures.h"
+#include "OcclusionCuller.h"
+
+#if GM_SIMD_X86
+#include <immintrin.h>
+#endif
+
+namespace {
+    // below this clip space w a vertex is too close to (or behind) the camera to project
+    const float MinimumW = 1e-3f;
+
+    // candidate lists longer than this are tested on the workers
+    const size_t ParallelFilterSize = 16 * 1024;
+
+    // edge function coefficients: A * x + B * y + C >= 0 on the inner side
+    struct Edge {
+        float a, b, c;
+
+        Edge(float x0, float y0, float x1, float y1) {
+            a = y0 - y1;
+            b = x1 - x0;
+            c = x0 * y1 - y0 * x1;
+        }
+    };
+
+    // offset of the first pixel of row y in the tile containing x
+    int TileRowOffset(int x, int y) {
+        const int tileSize = Gm::OcclusionCuller::TileSize;
+        int tile = (y / tileSize) * Gm::OcclusionCuller::TilesX + x / tileSize;
+        return tile * tileSize * tileSize + (y % tileSize) * tileSize;
+    }
+
+    struct Setup {
+        Edge e0, e1, e2;
+        // depth plane z = zA * x + zB * y + zC
+        float zA, zB, zC;
+    };
+
+    void RasterizeRowScalar(const Setup &setup, float *row, int tileX, float py) {
+        for (int lane = 0; lane < Gm::OcclusionCuller::TileSize; ++lane) {
+            float px = (float) (tileX + lane) + 0.5f;
+            float w0 = setup.e0.a * px + setup.e0.b * py + setup.e0.c;
+            float w1 = setup.e1.a * px + setup.e1.b * py + setup.e1.c;
+            float w2 = setup.e2.a * px + setup.e2.b * py + setup.e2.c;
+            if (w0 >= 0.0f && w1 >= 0.0f && w2 >= 0.0f) {
+                float z = setup.zA * px + setup.zB * py + setup.zC;
+                row[lane] = std::min(row[lane], z);
+            }
+        }
+    }
+
+#if GM_SIMD_X86
+    // one tile row: 8 pixel coverage mask from the three edges, masked depth min
+    GM_TARGET_AVX2
+    void RasterizeRowAvx2(const Setup &setup, float *row, int tileX, float py) {
+        __m256 px = _mm256_add_ps(_mm256_set1_ps((float) tileX + 0.5f),
+                                  _mm256_setr_ps(0.0f, 1.0f, 2.0f, 3.0f, 4.0f, 5.0f, 6.0f, 7.0f));
+        __m256 w0 = _mm256_fmadd_ps(_mm256_set1_ps(setup.e0.a), px, _mm256_set1_ps(setup.e0.b * py + setup.e0.c));
+        __m256 w1 = _mm256_fmadd_ps(_mm256_set1_ps(setup.e1.a), px, _mm256_set1_ps(setup.e1.b * py + setup.e1.c));
+        __m256 w2 = _mm256_fmadd_ps(_mm256_set1_ps(setup.e2.a), px, _mm256_set1_ps(setup.e2.b * py + setup.e2.c));
+        // all three non negative: the sign bits of the three are all clear
+        __m256 outside = _mm256_or_ps(_mm256_or_ps(w0, w1), w2);
+        __m256 z = _mm256_fmadd_ps(_mm256_set1_ps(setup.zA), px, _mm256_set1_ps(setup.zB * py + setup.zC));
+        __m256 current = _mm256_loadu_ps(row);
+        __m256 closer = _mm256_min_ps(current, z);
+        // blendv picks `current` where the sign bit of `outside` is set
+        _mm256_storeu_ps(row, _mm256_blendv_ps(closer, current, outside));
+    }
+#endif
+}
+
+void Gm::OcclusionCuller::BeginFrame(const Eigen::Matrix4f &viewProjection) {
+    Wait();
+    m_viewProjection = viewProjection;
+    m_triangles.clear();
+    m_stats = OcclusionStats();
+    m_rasterNanoseconds = 0;
+}
+
+void Gm::OcclusionCuller::AddOccluder(const Eigen::Matrix4f &objectToWorld, const Eigen::Vector3f *positions,
+                                      size_t positionStride, const uint32_t *indices, size_t indexCount) {
+    Eigen::Matrix4f objectToClip = m_viewProjection * objectToWorld;
+    m_stats.occluders++;
+    // every vertex once, rather than once per triangle using it
+    uint32_t vertexCount = indexCount > 0 ? *std::max_element(indices, indices + indexCount) + 1 : 0;
+    TransformPoints(FromEigen(objectToClip), positions, positionStride, vertexCount, m_clipPositions);
+    const PointsSoA &clip = m_clipPositions;
+    for (size_t i = 0; i + 2 < indexCount; i += 3) {
+        ScreenTriangle triangle;
+        bool projectable = true;
+        for (int corner = 0; corner < 3; ++corner) {
+            uint32_t vertex = indices[i + corner];
+            // an occluder is optional, skip the triangle rather than clipping it at the near plane
+            if (clip.w[vertex] < MinimumW) {
+                projectable = false;
+                break;
+            }
+            float inverseW = 1.0f / clip.w[vertex];
+            triangle.x[corner] = (clip.x[vertex] * inverseW * 0.5f + 0.5f) * Width;
+            triangle.y[corner] = (clip.y[vertex] * inverseW * 0.5f + 0.5f) * Height;
+            triangle.z[corner] = std::max(clip.z[vertex] * inverseW, 0.0f);
+        }
+        if (projectable) {
+            m_triangles.push_back(triangle);
+        }
+    }
+    m_stats.triangles = m_triangles.size();
+}
+
+void Gm::OcclusionCuller::RasterizeAsync(TaskSystem &tasks) {
+    m_tasks = &tasks;
+    // one band per tile row keeps every worker busy, bands never share a tile
+    for (int tileRow = 0; tileRow < TilesY; ++tileRow) {
+        tasks.Run(m_group, [this, tileRow] {
+            auto start = std::chrono::steady_clock::now();
+            RasterizeBand(tileRow, tileRow + 1);
+            UpdateTileMaxDepth(tileRow, tileRow + 1);
+            m_rasterNanoseconds += std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    std::chrono::steady_clock::now() - start).count();
+        });
+    }
+}
+
+void Gm::OcclusionCuller::Wait() {
+    if (m_tasks != nullptr) {
+        m_tasks->Wait(m_group);
+        m_tasks = nullptr;
+        m_stats.rasterMicroseconds = m_rasterNanoseconds.load() / 1000.0;
+    }
+}
+
+void Gm::OcclusionCuller::RasterizeBand(int firstTileRow, int lastTileRow) {
+    int bandMinY = firstTileRow * TileSize, bandMaxY = lastTileRow * TileSize - 1;
+    std::fill(m_depth.begin() + firstTileRow * TilesX * TileSize * TileSize,
+              m_depth.begin() + lastTileRow * TilesX * TileSize * TileSize, 1.0f);
+    bool avx2 = Cpu::HasAvx2();
+
+    for (const ScreenTriangle &triangle : m_triangles) {
+        float x0 = triangle.x[0], y0 = triangle.y[0];
+        float x1 = triangle.x[1], y1 = triangle.y[1];
+        float x2 = triangle.x[2], y2 = triangle.y[2];
+        float area = (x1 - x0) * (y2 - y0) - (y1 - y0) * (x2 - x0);
+        if (area == 0.0f) {
+            continue;
+        }
+        float z0 = triangle.z[0], z1 = triangle.z[1], z2 = triangle.z[2];
+        // counter clockwise so the inside of every edge is positive
+        if (area < 0.0f) {
+            std::swap(x1, x2);
+            std::swap(y1, y2);
+            std::swap(z1, z2);
+            area = -area;
+        }
+
+        int minX = std::max(0, (int) std::floor(std::min(x0, std::min(x1, x2))));
+        int maxX = std::min(Width - 1, (int) std::ceil(std::max(x0, std::max(x1, x2))));
+        int minY = std::max(bandMinY, (int) std::floor(std::min(y0, std::min(y1, y2))));
+        int maxY = std::min(bandMaxY, (int) std::ceil(std::max(y0, std::max(y1, y2))));
+        if (minX > maxX || minY > maxY) {
+            continue;
+        }
+
+        Setup setup{Edge(x1, y1, x2, y2), Edge(x2, y2, x0, y0), Edge(x0, y0, x1, y1), 0.0f, 0.0f, 0.0f};
+        // barycentric weights of vertex 1 and 2 are e1 / area and e2 / area, z is linear in them
+        float inverseArea = 1.0f / area;
+        setup.zA = (setup.e1.a * (z1 - z0) + setup.e2.a * (z2 - z0)) * inverseArea;
+        setup.zB = (setup.e1.b * (z1 - z0) + setup.e2.b * (z2 - z0)) * inverseArea;
+        setup.zC = z0 + (setup.e1.c * (z1 - z0) + setup.e2.c * (z2 - z0)) * inverseArea;
+
+        for (int y = minY; y <= maxY; ++y) {
+            float py = (float) y + 0.5f;
+            for (int tileX = minX - minX % TileSize; tileX <= maxX; tileX += TileSize) {
+                float *row = &m_depth[TileRowOffset(tileX, y)];
+#if GM_SIMD_X86
+                if (avx2) {
+                    RasterizeRowAvx2(setup, row, tileX, py);
+                    continue;
+                }
+#endif
+                RasterizeRowScalar(setup, row, tileX, py);
+            }
+        }
+    }
+    (void) avx2;
+}
+
+void Gm::OcclusionCuller::UpdateTileMaxDepth(int firstTileRow, int lastTileRow) {
+    const int tilePixels = TileSize * TileSize;
+    for (int tile = firstTileRow * TilesX; tile < lastTileRow * TilesX; ++tile) {
+        const float *depth = &m_depth[tile * tilePixels];
+        m_tileMaxDepth[tile] = *std::max_element(depth, depth + tilePixels);
+    }
+}
+
+bool Gm::OcclusionCuller::IsVisible(float x, float y, float z, float radius) const {
+    // screen rectangle and nearest depth of the sphere's bounding box
+    float minX = INFINITY, minY = INFINITY, maxX = -INFINITY, maxY = -INFINITY, minZ = INFINITY;
+    // the corners are the projected center plus or minus the radius times each matrix column
+    Eigen::Vector4f center = m_viewProjection * Eigen::Vector4f(x, y, z, 1.0f);
+    Eigen::Vector4f axisX = m_viewProjection.col(0) * radius;
+    Eigen::Vector4f axisY = m_viewProjection.col(1) * radius;
+    Eigen::Vector4f axisZ = m_viewProjection.col(2) * radius;
+    for (int corner = 0; corner < 8; ++corner) {
+        Eigen::Vector4f clip = center + (corner & 1 ? axisX : -axisX) + (corner & 2 ? axisY : -axisY) +
+                               (corner & 4 ? axisZ : -axisZ);
+        if (clip[3] < MinimumW) {
+            // crosses the camera plane, can't be hidden behind anything
+            return true;
+        }
+        float inverseW = 1.0f / clip[3];
+        float screenX = (clip[0] * inverseW * 0.5f + 0.5f) * Width;
+        float screenY = (clip[1] * inverseW * 0.5f + 0.5f) * Height;
+        minX = std::min(minX, screenX);
+        maxX = std::max(maxX, screenX);
+        minY = std::min(minY, screenY);
+        maxY = std::max(maxY, screenY);
+        minZ = std::min(minZ, clip[2] * inverseW);
+    }
+
+    int firstTileX = std::max(0, (int) std::floor(minX) / TileSize);
+    int lastTileX = std::min(TilesX - 1, (int) std::floor(maxX) / TileSize);
+    int firstTileY = std::max(0, (int) std::floor(minY) / TileSize);
+    int lastTileY = std::min(TilesY - 1, (int) std::floor(maxY) / TileSize);
+    if (firstTileX > lastTileX || firstTileY > lastTileY) {
+        // off screen, the frustum test is responsible for it
+        return true;
+    }
+    for (int tileY = firstTileY; tileY <= lastTileY; ++tileY) {
+        for (int tileX = firstTileX; tileX <= lastTileX; ++tileX) {
+            if (minZ <= m_tileMaxDepth[tileY * TilesX + tileX]) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+void Gm::OcclusionCuller::Filter(const BoundingSpheres &spheres, std::vector<uint32_t> &indices) {
+    Wait();
+    auto start = std::chrono::steady_clock::now();
+    // test in parallel chunks, then compact in order on this thread
+    m_visibleFlags.resize(indices.size());
+    auto test = [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            uint32_t index = indices[i];
+            m_visibleFlags[i] = IsVisible(spheres.x[index], spheres.y[index], spheres.z[index], spheres.radius[index]);
+        }
+    };
+    if (indices.size() < ParallelFilterSize) {
+        test(0, indices.size());
+    } else {
+        TaskSystem::Instance().ParallelFor(0, indices.size(), ParallelFilterSize / 4, test);
+    }
+    size_t kept = 0;
+    for (size_t i = 0; i < indices.size(); ++i) {
+        if (m_visibleFlags[i]) {
+            indices[kept++] = indices[i];
+        }
+    }
+    m_stats.tested += indices.size();
+    m_stats.occluded += indices.size() - kept;
+    indices.resize(kept);
+    m_stats.testMicroseconds += std::chrono::duration<double, std::micro>(
+            std::chrono::steady_clock::now() - start).count();
+}
+
+float Gm::OcclusionCuller::DepthAt(int x, int y) const {
+    return m_depth[TileRowOffset(x, y) + x % TileSize];
+}
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include "Eigen/Core"
+#include "BatchTransform.h"
+#include "FrustumCulling.h"
+#include "TaskSystem.h"
+
+namespace Gm {
+    struct OcclusionStats {
+        size_t occluders = 0;
+        size_t triangles = 0;
+        size_t tested = 0;
+        size_t occluded = 0;
+        // time the workers spent rasterizing, and the time of the visibility tests
+        double rasterMicroseconds = 0.0;
+        double testMicroseconds = 0.0;
+    };
+
+    // Masked software occlusion culling: a few large occluders are rasterized into a coarse
+    // CPU depth buffer, then every candidate's screen bounds are tested against the farthest
+    // occluder depth of the tiles it covers.
+    //
+    // The buffer is stored tile by tile (8x8 pixels) so one row of a tile is one 8 wide SIMD
+    // register. Rasterization is split in bands of tile rows that run on the TaskSystem while
+    // the calling thread keeps going, e.g. frustum culls while the GPU finishes the last frame.
+    class OcclusionCuller {
+    public:
+        static const int Width = 256;
+        static const int Height = 144;
+        static const int TileSize = 8;
+        static const int TilesX = Width / TileSize;
+        static const int TilesY = Height / TileSize;
+
+        // clears the buffer, `viewProjection` maps the space occluders and candidates live in to clip space
+        void BeginFrame(const Eigen::Matrix4f &viewProjection);
+
+        // a triangle mesh at `objectToWorld`, indices are three per triangle
+        void AddOccluder(const Eigen::Matrix4f &objectToWorld, const Eigen::Vector3f *positions, size_t positionStride,
+                         const uint32_t *indices, size_t indexCount);
+
+        // start rasterizing everything added since BeginFrame on worker threads
+        void RasterizeAsync(TaskSystem &tasks);
+
+        // block until the rasterization started by RasterizeAsync is complete
+        void Wait();
+
+        // removes the indices of occluded spheres from `indices`, keeping the order of the rest;
+        // long lists are tested on the shared TaskSystem
+        void Filter(const BoundingSpheres &spheres, std::vector<uint32_t> &indices);
+
+        bool IsVisible(float x, float y, float z, float radius) const;
+
+        const OcclusionStats &GetStats() const { return m_stats; }
+
+        // depth of pixel (x, y), y pointing up, for debugging
+        float DepthAt(int x, int y) const;
+
+    private:
+        struct ScreenTriangle {
+            // x, y in pixels, z in [0, 1]
+            float x[3], y[3], z[3];
+        };
+
+        void RasterizeBand(int firstTileRow, int lastTileRow);
+
+        void UpdateTileMaxDepth(int firstTileRow, int lastTileRow);
+
+        Eigen::Matrix4f m_viewProjection;
+        // clip space vertices of the occluder being added
+        PointsSoA m_clipPositions;
+        std::vector<ScreenTriangle> m_triangles;
+        // Width * Height depths, tile by tile
+        std::vector<float> m_depth = std::vector<float>(Width * Height, 1.0f);
+        // farthest depth of each tile, what candidates are tested against
+        std::vector<float> m_tileMaxDepth = std::vector<float>(TilesX * TilesY, 1.0f);
+
+        std::vector<uint8_t> m_visibleFlags;
+
+        TaskSystem *m_tasks = nullptr;
+        TaskSystem::TaskGroup m_group;
+        std::atomic<int64_t> m_rasterNanoseconds{0};
+        OcclusionStats m_stats;
+    };
+}
@@ -0,0 +1,91 @@
+#include <cmath>
+#include "Picking.h"
+
+Gm::WatertightRay::WatertightRay(const Ray &ray) {
+    // the dimension where the ray direction is largest becomes z
+    Eigen::Vector3f magnitude = ray.direction.cwiseAbs();
+    kz = magnitude[0] > magnitude[1] ? (magnitude[0] > magnitude[2] ? 0 : 2) : (magnitude[1] > magnitude[2] ? 1 : 2);
+    kx = (kz + 1) % 3;
+    ky = (kx + 1) % 3;
+    // keep the winding direction of the triangles
+    if (ray.direction[kz] < 0.0f) {
+        std::swap(kx, ky);
+    }
+    shearX = ray.direction[kx] / ray.direction[kz];
+    shearY = ray.direction[ky] / ray.direction[kz];
+    shearZ = 1.0f / ray.direction[kz];
+}
+
+bool Gm::IntersectTriangleWatertight(const WatertightRay &precomputed, Ray &ray, const Eigen::Vector3f &v0,
+                                     const Eigen::Vector3f &v1, const Eigen::Vector3f &v2) {
+    const int kx = precomputed.kx, ky = precomputed.ky, kz = precomputed.kz;
+    // vertices relative to the ray origin
+    Eigen::Vector3f a = v0 - ray.origin, b = v1 - ray.origin, c = v2 - ray.origin;
+
+    // shear and scale so the ray runs along +z
+    float ax = a[kx] - precomputed.shearX * a[kz], ay = a[ky] - precomputed.shearY * a[kz];
+    float bx = b[kx] - precomputed.shearX * b[kz], by = b[ky] - precomputed.shearY * b[kz];
+    float cx = c[kx] - precomputed.shearX * c[kz], cy = c[ky] - precomputed.shearY * c[kz];
+
+    // scaled barycentric coordinates
+    float u = cx * by - cy * bx;
+    float v = ax * cy - ay * cx;
+    float w = bx * ay - by * ax;
+
+    // on an edge the float result is not reliable, redo it in double
+    if (u == 0.0f || v == 0.0f || w == 0.0f) {
+        u = (float) ((double) cx * by - (double) cy * bx);
+        v = (float) ((double) ax * cy - (double) ay * cx);
+        w = (float) ((double) bx * ay - (double) by * ax);
+    }
+    if ((u < 0.0f || v < 0.0f || w < 0.0f) && (u > 0.0f || v > 0.0f || w > 0.0f)) {
+        return false;
+    }
+    float determinant = u + v + w;
+    if (determinant == 0.0f) {
+        return false;
+    }
+
+    // scaled hit distance, compared against the range before the division
+    float az = precomputed.shearZ * a[kz], bz = precomputed.shearZ * b[kz], cz = precomputed.shearZ * c[kz];
+    float t = u * az + v * bz + w * cz;
+    if (determinant < 0.0f) {
+        t = -t;
+        determinant = -determinant;
+    }
+    if (t < ray.tMin * determinant || t >= ray.tMax * determinant) {
+        return false;
+    }
+    ray.tMax = t / determinant;
+    return true;
+}
+
+void Gm::TriangleMeshBvh::Build(const GeometryArena &geometry, MeshId mesh) {
+    const MeshRange &range = geometry.Range(mesh);
+    const std::vector<VertexType> &vertices = geometry.Vertices();
+    const std::vector<uint32_t> &indices = geometry.Indices();
+    size_t triangleCount = range.indexCount / 3;
+
+    m_corners.resize(triangleCount * 3);
+    std::vector<Aabb> bounds(triangleCount);
+    for (size_t triangle = 0; triangle < triangleCount; ++triangle) {
+        for (size_t corner = 0; corner < 3; ++corner) {
+            uint32_t index = indices[range.firstIndex + triangle * 3 + corner] + range.baseVertex;
+            m_corners[triangle * 3 + corner] = vertices[index].position;
+            bounds[triangle].Grow(vertices[index].position);
+        }
+    }
+    m_bvh.Build(bounds.data(), bounds.size());
+}
+
+bool Gm::TriangleMeshBvh::Intersect(Ray &ray, uint32_t &triangle) const {
+    WatertightRay precomputed(ray);
+    return m_bvh.Intersect(ray, [&](uint32_t primitive, Ray &ray) {
+        const Eigen::Vector3f *corners = &m_corners[primitive * 3];
+        if (!IntersectTriangleWatertight(precomputed, ray, corners[0], corners[1], corners[2])) {
+            return false;
+        }
+        triangle = primitive;
+        return true;
+    });
+}
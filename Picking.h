@@ -0,0 +1,46 @@
+#pragma once
+
+#include <cstdint>
+#include "Bvh.h"
+#include "GeometryArena.h"
+
+namespace Gm {
+    // per ray constants of the watertight ray/triangle test (Woop, Benthin, Wald 2013)
+    struct WatertightRay {
+        explicit WatertightRay(const Ray &ray);
+
+        int kx, ky, kz;
+        float shearX, shearY, shearZ;
+    };
+
+    // Intersection with no cracks along shared edges or vertices, both faces count as hits.
+    // On a hit closer than ray.tMax, shrinks ray.tMax and returns true.
+    bool IntersectTriangleWatertight(const WatertightRay &precomputed, Ray &ray, const Eigen::Vector3f &v0,
+                                     const Eigen::Vector3f &v1, const Eigen::Vector3f &v2);
+
+    // Triangle level BVH of one mesh of a GeometryArena, in object space.
+    class TriangleMeshBvh {
+    public:
+        void Build(const GeometryArena &geometry, MeshId mesh);
+
+        bool Empty() const { return m_bvh.Empty(); }
+
+        // closest hit, `triangle` receives the index of the hit triangle within the mesh
+        bool Intersect(Ray &ray, uint32_t &triangle) const;
+
+    private:
+        Bvh m_bvh;
+        // three corners per triangle, copied so the test never chases indices
+        std::vector<Eigen::Vector3f> m_corners;
+    };
+
+    struct PickResult {
+        MeshId mesh = 0;
+        uint32_t instance = 0;
+        uint32_t triangle = 0;
+        // in world space, after the scene rotation
+        Eigen::Vector3f hitPoint = Eigen::Vector3f::Zero();
+        // along the unnormalized ray from the near (0) to the far (1) plane
+        float distance = 0.0f;
+    };
+}
@@ -0,0 +1,454 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include "CpuFeatures.h"
+#include "Inflate.h"
+#include "PngDecoder.h"
+#include "TaskSystem.h"
+
+#if GM_SIMD_X86
+#include <emmintrin.h>
+#endif
+
+namespace {
+    const uint8_t Signature[8] = {137, 80, 78, 71, 13, 10, 26, 10};
+
+    // rows converted to RGBA8 per task
+    const size_t ConvertGrain = 64;
+
+    enum ColorType {
+        Gray = 0,
+        Rgb = 2,
+        Palette = 3,
+        GrayAlpha = 4,
+        Rgba = 6,
+    };
+
+    enum Filter {
+        FilterNone = 0,
+        FilterSub = 1,
+        FilterUp = 2,
+        FilterAverage = 3,
+        FilterPaeth = 4,
+    };
+
+    struct Header {
+        uint32_t width = 0, height = 0;
+        int depth = 0;
+        int colorType = 0;
+        int channels = 0;
+        // the distance the filters look back, whole pixels but at least a byte
+        size_t filterStride = 0;
+        size_t rowBytes = 0;
+        uint8_t palette[256][4];
+        // tRNS of gray and RGB images: that color is transparent, 16 bit values even for 8 bit images
+        bool hasKey = false;
+        uint16_t key[3] = {};
+    };
+
+    uint32_t ReadBigEndian(const uint8_t *p) {
+        return (uint32_t) p[0] << 24 | (uint32_t) p[1] << 16 | (uint32_t) p[2] << 8 | p[3];
+    }
+
+    bool Fail(const char *reason) {
+        fprintf(stderr, "PNG: %s\n", reason);
+        return false;
+    }
+
+    uint8_t PaethPredictor(int a, int b, int c) {
+        int pa = std::abs(b - c), pb = std::abs(a - c), pc = std::abs(a + b - 2 * c);
+        return (uint8_t) (pa <= pb && pa <= pc ? a : pb <= pc ? b : c);
+    }
+
+    // undoes the filter of one row, `prior` being the previous row already unfiltered (zeros for the first)
+    void UnfilterScalar(int filter, uint8_t *row, const uint8_t *prior, size_t bytes, size_t stride) {
+        switch (filter) {
+            case FilterSub:
+                for (size_t i = stride; i < bytes; ++i) {
+                    row[i] += row[i - stride];
+                }
+                break;
+            case FilterUp:
+                for (size_t i = 0; i < bytes; ++i) {
+                    row[i] += prior[i];
+                }
+                break;
+            case FilterAverage:
+                for (size_t i = 0; i < bytes; ++i) {
+                    int left = i >= stride ? row[i - stride] : 0;
+                    row[i] += (uint8_t) ((left + prior[i]) >> 1);
+                }
+                break;
+            case FilterPaeth:
+                for (size_t i = 0; i < bytes; ++i) {
+                    int left = i >= stride ? row[i - stride] : 0;
+                    int upperLeft = i >= stride ? prior[i - stride] : 0;
+                    row[i] += PaethPredictor(left, prior[i], upperLeft);
+                }
+                break;
+            default:
+                break;
+        }
+    }
+
+#if GM_SIMD_X86
+    // one pixel of 3 or 4 bytes in the low lanes
+    inline __m128i LoadPixel(const uint8_t *p, size_t stride) {
+        int value = 0;
+        std::memcpy(&value, p, stride);
+        return _mm_cvtsi32_si128(value);
+    }
+
+    inline void StorePixel(uint8_t *p, __m128i pixel, size_t stride) {
+        int value = _mm_cvtsi128_si32(pixel);
+        std::memcpy(p, &value, stride);
+    }
+
+    inline __m128i Select(__m128i mask, __m128i a, __m128i b) {
+        return _mm_or_si128(_mm_and_si128(mask, a), _mm_andnot_si128(mask, b));
+    }
+
+    inline __m128i Abs16(__m128i x) {
+        return _mm_max_epi16(x, _mm_sub_epi16(_mm_setzero_si128(), x));
+    }
+
+    // Sub of 4 byte pixels is a running sum: 16 bytes hold four pixels, summed in two shifted adds, plus the
+    // last pixel of the chunk before
+    void UnfilterSub4(uint8_t *row, size_t bytes) {
+        __m128i carry = _mm_setzero_si128();
+        size_t i = 0;
+        for (; i + 16 <= bytes; i += 16) {
+            __m128i x = _mm_loadu_si128((const __m128i *) (row + i));
+            x = _mm_add_epi8(x, _mm_slli_si128(x, 4));
+            x = _mm_add_epi8(x, _mm_slli_si128(x, 8));
+            x = _mm_add_epi8(x, carry);
+            _mm_storeu_si128((__m128i *) (row + i), x);
+            carry = _mm_shuffle_epi32(x, _MM_SHUFFLE(3, 3, 3, 3));
+        }
+        for (; i < bytes; ++i) {
+            row[i] += i >= 4 ? row[i - 4] : 0;
+        }
+    }
+
+    void UnfilterUp(uint8_t *row, const uint8_t *prior, size_t bytes) {
+        size_t i = 0;
+        for (; i + 16 <= bytes; i += 16) {
+            __m128i x = _mm_loadu_si128((const __m128i *) (row + i));
+            __m128i b = _mm_loadu_si128((const __m128i *) (prior + i));
+            _mm_storeu_si128((__m128i *) (row + i), _mm_add_epi8(x, b));
+        }
+        for (; i < bytes; ++i) {
+            row[i] += prior[i];
+        }
+    }
+
+    // one pixel at a time since each depends on the one before, all of its channels at once
+    void UnfilterAverage(uint8_t *row, const uint8_t *prior, size_t bytes, size_t stride) {
+        __m128i one = _mm_set1_epi8(1);
+        __m128i a = _mm_setzero_si128();
+        for (size_t i = 0; i < bytes; i += stride) {
+            __m128i b = LoadPixel(prior + i, stride);
+            // pavgb rounds up, the filter rounds down
+            __m128i average = _mm_sub_epi8(_mm_avg_epu8(a, b), _mm_and_si128(_mm_xor_si128(a, b), one));
+            a = _mm_add_epi8(LoadPixel(row + i, stride), average);
+            StorePixel(row + i, a, stride);
+        }
+    }
+
+    void UnfilterPaeth(uint8_t *row, const uint8_t *prior, size_t bytes, size_t stride) {
+        __m128i zero = _mm_setzero_si128(), low = _mm_set1_epi16(0xff);
+        // left, up and upper left as 16 bit lanes
+        __m128i a = zero, c = zero;
+        for (size_t i = 0; i < bytes; i += stride) {
+            __m128i b = _mm_unpacklo_epi8(LoadPixel(prior + i, stride), zero);
+            __m128i x = _mm_unpacklo_epi8(LoadPixel(row + i, stride), zero);
+            __m128i p = _mm_sub_epi16(b, c), q = _mm_sub_epi16(a, c);
+            __m128i pa = Abs16(p), pb = Abs16(q), pc = Abs16(_mm_add_epi16(p, q));
+            __m128i smallest = _mm_min_epi16(pc, _mm_min_epi16(pa, pb));
+            // ties prefer a over b over c
+            __m128i nearest = Select(_mm_cmpeq_epi16(smallest, pa), a,
+                                     Select(_mm_cmpeq_epi16(smallest, pb), b, c));
+            a = _mm_and_si128(_mm_add_epi16(x, nearest), low);
+            StorePixel(row + i, _mm_packus_epi16(a, a), stride);
+            c = b;
+        }
+    }
+
+    bool UnfilterSse2(int filter, uint8_t *row, const uint8_t *prior, size_t bytes, size_t stride) {
+        if (filter == FilterUp) {
+            UnfilterUp(row, prior, bytes);
+            return true;
+        }
+        if (stride != 3 && stride != 4) {
+            return false;
+        }
+        if (filter == FilterSub && stride == 4) {
+            UnfilterSub4(row, bytes);
+            return true;
+        }
+        if (filter == FilterAverage) {
+            UnfilterAverage(row, prior, bytes, stride);
+            return true;
+        }
+        if (filter == FilterPaeth) {
+            UnfilterPaeth(row, prior, bytes, stride);
+            return true;
+        }
+        return false;
+    }
+#endif
+
+    bool Unfilter(uint8_t *filtered, const Header &header, bool simd) {
+        std::vector<uint8_t> zeros(header.rowBytes, 0);
+        const uint8_t *prior = zeros.data();
+        for (uint32_t y = 0; y < header.height; ++y) {
+            uint8_t *line = filtered + y * (header.rowBytes + 1);
+            int filter = line[0];
+            uint8_t *row = line + 1;
+            if (filter > FilterPaeth) {
+                return Fail("unknown row filter");
+            }
+            bool done = false;
+#if GM_SIMD_X86
+            done = simd && UnfilterSse2(filter, row, prior, header.rowBytes, header.filterStride);
+#endif
+            if (!done) {
+                UnfilterScalar(filter, row, prior, header.rowBytes, header.filterStride);
+            }
+            prior = row;
+        }
+        return true;
+    }
+
+    // sample x of a row packed at less than 8 bits
+    inline int PackedSample(const uint8_t *row, uint32_t x, int depth) {
+        size_t bit = (size_t) x * depth;
+        return (row[bit >> 3] >> (8 - depth - (bit & 7))) & ((1 << depth) - 1);
+    }
+
+    // sample `index` of a row: the high byte of 16 bit samples, and the full value to compare with the key
+    inline uint8_t Sample(const uint8_t *row, size_t index, int depth, uint16_t &full) {
+        if (depth == 16) {
+            full = (uint16_t) (row[index * 2] << 8 | row[index * 2 + 1]);
+            return row[index * 2];
+        }
+        full = row[index];
+        return row[index];
+    }
+
+    void ConvertRow(const Header &header, const uint8_t *row, uint8_t *out) {
+        uint32_t width = header.width;
+        int depth = header.depth;
+        if (header.colorType == Rgba && depth == 8) {
+            std::memcpy(out, row, (size_t) width * 4);
+            return;
+        }
+        if (header.colorType == Palette) {
+            for (uint32_t x = 0; x < width; ++x, out += 4) {
+                int index = depth == 8 ? row[x] : PackedSample(row, x, depth);
+                std::memcpy(out, header.palette[index], 4);
+            }
+            return;
+        }
+        if (depth < 8) {
+            // only gray comes packed, stretched to the full range
+            int scale = 255 / ((1 << depth) - 1);
+            for (uint32_t x = 0; x < width; ++x, out += 4) {
+                int value = PackedSample(row, x, depth);
+                uint8_t gray = (uint8_t) (value * scale);
+                out[0] = out[1] = out[2] = gray;
+                out[3] = header.hasKey && value == header.key[0] ? 0 : 255;
+            }
+            return;
+        }
+        int channels = header.channels;
+        for (uint32_t x = 0; x < width; ++x, out += 4) {
+            uint16_t full[4];
+            uint8_t value[4];
+            for (int channel = 0; channel < channels; ++channel) {
+                value[channel] = Sample(row, (size_t) x * channels + channel, depth, full[channel]);
+            }
+            switch (header.colorType) {
+                case Gray:
+                    out[0] = out[1] = out[2] = value[0];
+                    out[3] = header.hasKey && full[0] == header.key[0] ? 0 : 255;
+                    break;
+                case GrayAlpha:
+                    out[0] = out[1] = out[2] = value[0];
+                    out[3] = value[1];
+                    break;
+                case Rgb:
+                    out[0] = value[0];
+                    out[1] = value[1];
+                    out[2] = value[2];
+                    out[3] = header.hasKey && full[0] == header.key[0] && full[1] == header.key[1] &&
+                             full[2] == header.key[2] ? 0 : 255;
+                    break;
+                default:
+                    std::memcpy(out, value, 4);
+                    break;
+            }
+        }
+    }
+
+    bool ParseHeader(const uint8_t *data, uint32_t length, Header &header) {
+        if (length != 13) {
+            return Fail("bad IHDR");
+        }
+        header.width = ReadBigEndian(data);
+        header.height = ReadBigEndian(data + 4);
+        header.depth = data[8];
+        header.colorType = data[9];
+        if (header.width == 0 || header.height == 0 || header.width > (1u << 24) || header.height > (1u << 24)) {
+            return Fail("bad image size");
+        }
+        if (data[10] != 0 || data[11] != 0) {
+            return Fail("unknown compression or filter method");
+        }
+        if (data[12] != 0) {
+            return Fail("interlaced images are not supported");
+        }
+        int depth = header.depth;
+        switch (header.colorType) {
+            case Gray:
+                header.channels = 1;
+                break;
+            case Palette:
+                header.channels = 1;
+                if (depth == 16) {
+                    return Fail("bad bit depth");
+                }
+                break;
+            case Rgb:
+                header.channels = 3;
+                break;
+            case GrayAlpha:
+                header.channels = 2;
+                break;
+            case Rgba:
+                header.channels = 4;
+                break;
+            default:
+                return Fail("unknown color type");
+        }
+        bool packedAllowed = header.colorType == Gray || header.colorType == Palette;
+        if (!(depth == 8 || depth == 16 || (packedAllowed && (depth == 1 || depth == 2 || depth == 4)))) {
+            return Fail("bad bit depth");
+        }
+        size_t bitsPerPixel = (size_t) header.channels * depth;
+        header.filterStride = bitsPerPixel < 8 ? 1 : bitsPerPixel / 8;
+        header.rowBytes = (header.width * bitsPerPixel + 7) / 8;
+        return true;
+    }
+}
+
+bool Gm::IsPng(const uint8_t *data, size_t size) {
+    return size >= 8 && std::memcmp(data, Signature, 8) == 0;
+}
+
+bool Gm::DecodePng(const uint8_t *data, size_t size, const ImportOptions &options, Image &image) {
+    if (!IsPng(data, size)) {
+        return Fail("not a PNG");
+    }
+    Header header;
+    bool hasHeader = false;
+    std::vector<uint8_t> compressed;
+    // most encoders write one IDAT, which is then decompressed where it is
+    const uint8_t *firstData = nullptr;
+    size_t firstDataSize = 0;
+    int dataChunks = 0;
+    for (size_t offset = 8; ;) {
+        if (size - offset < 12) {
+            return Fail("truncated");
+        }
+        uint32_t length = ReadBigEndian(data + offset);
+        const uint8_t *type = data + offset + 4;
+        const uint8_t *chunk = data + offset + 8;
+        if (length > size - offset - 12) {
+            return Fail("truncated");
+        }
+        offset += 12 + (size_t) length;
+        if (std::memcmp(type, "IHDR", 4) == 0) {
+            if (!ParseHeader(chunk, length, header)) {
+                return false;
+            }
+            hasHeader = true;
+            // palette entries not given are opaque black
+            std::memset(header.palette, 0, sizeof(header.palette));
+            for (auto &entry : header.palette) {
+                entry[3] = 255;
+            }
+        } else if (!hasHeader) {
+            return Fail("IHDR missing");
+        } else if (std::memcmp(type, "PLTE", 4) == 0) {
+            if (length % 3 != 0 || length > 768) {
+                return Fail("bad palette");
+            }
+            for (uint32_t i = 0; i < length / 3; ++i) {
+                std::memcpy(header.palette[i], chunk + i * 3, 3);
+            }
+        } else if (std::memcmp(type, "tRNS", 4) == 0) {
+            if (header.colorType == Palette) {
+                for (uint32_t i = 0; i < length && i < 256; ++i) {
+                    header.palette[i][3] = chunk[i];
+                }
+            } else if (header.colorType == Gray && length >= 2) {
+                header.hasKey = true;
+                header.key[0] = (uint16_t) (chunk[0] << 8 | chunk[1]);
+            } else if (header.colorType == Rgb && length >= 6) {
+                header.hasKey = true;
+                for (int i = 0; i < 3; ++i) {
+                    header.key[i] = (uint16_t) (chunk[i * 2] << 8 | chunk[i * 2 + 1]);
+                }
+            }
+        } else if (std::memcmp(type, "IDAT", 4) == 0) {
+            if (dataChunks++ == 0) {
+                firstData = chunk;
+                firstDataSize = length;
+            } else {
+                if (dataChunks == 2) {
+                    compressed.assign(firstData, firstData + firstDataSize);
+                }
+                compressed.insert(compressed.end(), chunk, chunk + length);
+            }
+        } else if (std::memcmp(type, "IEND", 4) == 0) {
+            break;
+        } else if ((type[0] & 0x20) == 0) {
+            // an upper case first letter marks chunks a decoder must understand
+            return Fail("unknown critical chunk");
+        }
+    }
+    if (dataChunks == 0) {
+        return Fail("no image data");
+    }
+
+    // every row starts with its filter type
+    size_t filteredSize = (size_t) header.height * (header.rowBytes + 1);
+    std::vector<uint8_t> filtered;
+    bool inflated = dataChunks == 1 ? ZlibDecompress(firstData, firstDataSize, filteredSize, filtered)
+                                    : ZlibDecompress(compressed.data(), compressed.size(), filteredSize, filtered);
+    if (!inflated || filtered.size() != filteredSize) {
+        return Fail("corrupt image data");
+    }
+    if (!Unfilter(filtered.data(), header, options.simd)) {
+        return false;
+    }
+
+    image.format = TextureFormat::Rgba8;
+    image.width = header.width;
+    image.height = header.height;
+    image.texels.resize((size_t) header.width * header.height * 4);
+    image.levels.assign(1, ImageLevel{0, header.width, header.height});
+    auto convert = [&](size_t begin, size_t end) {
+        for (size_t y = begin; y < end; ++y) {
+            ConvertRow(header, filtered.data() + y * (header.rowBytes + 1) + 1,
+                       image.texels.data() + y * header.width * 4);
+        }
+    };
+    if (options.parallel && header.height > ConvertGrain) {
+        TaskSystem::Instance().ParallelFor(0, header.height, ConvertGrain, convert);
+    } else {
+        convert(0, header.height);
+    }
+    return true;
+}
@@ -0,0 +1,14 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include "ImageImport.h"
+
+namespace Gm {
+    bool IsPng(const uint8_t *data, size_t size);
+
+    // Decodes a non interlaced PNG of any color type and bit depth into RGBA8 level 0 of `image`, 16 bit
+    // channels keep their high byte. The filters of 3 and 4 byte pixels are undone with SSE2 on x86, the
+    // conversion to RGBA8 runs on the TaskSystem in bands of rows when options.parallel is set.
+    bool DecodePng(const uint8_t *data, size_t size, const ImportOptions &options, Image &image);
+}
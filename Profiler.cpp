@@ -0,0 +1,280 @@
+#include <algorithm>
+#include <cstdio>
+#include "Profiler.h"
+
+namespace {
+    thread_local Gm::Profiler *t_profiler = nullptr;
+    thread_local void *t_ring = nullptr;
+    // CPU scopes open on this thread
+    thread_local uint32_t t_depth = 0;
+
+    // the timeline of the GPU events, the threads' follow
+    const uint32_t GpuTimelineId = 0;
+
+    void AppendEscaped(std::string &json, const char *text) {
+        for (const char *c = text; *c != '\0'; ++c) {
+            if (*c == '"' || *c == '\\') {
+                json += '\\';
+                json += *c;
+            } else if ((unsigned char) *c < 0x20) {
+                char escaped[8];
+                snprintf(escaped, sizeof(escaped), "\\u%04x", (unsigned) *c);
+                json += escaped;
+            } else {
+                json += *c;
+            }
+        }
+    }
+}
+
+Gm::Profiler &Gm::Profiler::Instance() {
+    static Profiler profiler;
+    return profiler;
+}
+
+Gm::Profiler::Profiler() : m_epoch(std::chrono::steady_clock::now()) {
+    // the first ring, GpuTimelineId
+    m_gpuRing = AddRing("GPU");
+}
+
+uint64_t Gm::Profiler::Now() const {
+    return (uint64_t) std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() -
+                                                                           m_epoch).count();
+}
+
+Gm::Profiler::Ring *Gm::Profiler::AddRing(const char *name) {
+    std::lock_guard<std::mutex> lock(m_ringsMutex);
+    m_rings.emplace_back(new Ring());
+    Ring *ring = m_rings.back().get();
+    ring->id = (uint32_t) (m_rings.size() - 1);
+    if (name != nullptr) {
+        ring->name = name;
+    } else {
+        ring->name = "Thread " + std::to_string(ring->id);
+    }
+    return ring;
+}
+
+Gm::Profiler::Ring &Gm::Profiler::ThreadRing() {
+    if (t_profiler != this) {
+        t_ring = AddRing(nullptr);
+        t_profiler = this;
+    }
+    return *(Ring *) t_ring;
+}
+
+void Gm::Profiler::SetThreadName(const char *name) {
+    Ring &ring = ThreadRing();
+    std::lock_guard<std::mutex> lock(m_ringsMutex);
+    ring.name = name;
+}
+
+void Gm::Profiler::RecordCpu(const char *name, uint64_t beginNs, uint64_t endNs, uint32_t depth) {
+    ThreadRing().Push(ProfileEvent{name, beginNs, endNs, depth});
+}
+
+uint32_t Gm::Profiler::NextQuery(GpuFrame &frame) {
+    if (frame.usedQueries == frame.queries.size()) {
+        size_t first = frame.queries.size();
+        frame.queries.resize(first + 64);
+        glGenQueries(64, &frame.queries[first]);
+    }
+    return frame.usedQueries++;
+}
+
+void Gm::Profiler::BeginFrame() {
+    m_gpuTimers = GLAD_GL_VERSION_3_3 || GLAD_GL_ARB_timer_query;
+    if (!m_gpuTimers) {
+        return;
+    }
+    m_gpuFrame = (m_gpuFrame + 1) % GpuFrames;
+    GpuFrame &frame = m_gpuFrames[m_gpuFrame];
+    // the queries about to be reused were issued GpuFrames frames ago, reading them must not wait for the GPU
+    if (!ResolveGpuFrame(frame)) {
+        ++m_droppedGpuFrames;
+    }
+    frame.usedQueries = 0;
+    frame.scopes.clear();
+    frame.number = ++m_gpuFrameNumber;
+    m_gpuStack.clear();
+    GLint64 gpuNow = 0;
+    glGetInteger64v(GL_TIMESTAMP, &gpuNow);
+    frame.clockOffsetNs = (int64_t) Now() - gpuNow;
+}
+
+bool Gm::Profiler::ResolveGpuFrame(GpuFrame &frame) {
+    if (frame.usedQueries == 0) {
+        if (frame.number != 0) {
+            m_resolvedGpuFrame = frame.number;
+            m_resolvedMicroseconds.clear();
+        }
+        return true;
+    }
+    // timestamps land in order, once the last is there all are
+    GLint available = 0;
+    glGetQueryObjectiv(frame.queries[frame.usedQueries - 1], GL_QUERY_RESULT_AVAILABLE, &available);
+    if (!available) {
+        return false;
+    }
+    m_resolvedGpuFrame = frame.number;
+    m_resolvedMicroseconds.assign(frame.scopes.size(), -1.0);
+    for (size_t i = 0; i < frame.scopes.size(); ++i) {
+        const GpuScope &scope = frame.scopes[i];
+        if (scope.endQuery == ~0u) {
+            // still open when the frame ended
+            continue;
+        }
+        GLuint64 begin = 0, end = 0;
+        glGetQueryObjectui64v(frame.queries[scope.beginQuery], GL_QUERY_RESULT, &begin);
+        glGetQueryObjectui64v(frame.queries[scope.endQuery], GL_QUERY_RESULT, &end);
+        m_resolvedMicroseconds[i] = (end - std::min(begin, end)) / 1000.0;
+        m_gpuRing->Push(ProfileEvent{scope.name, (uint64_t) ((int64_t) begin + frame.clockOffsetNs),
+                                     (uint64_t) ((int64_t) end + frame.clockOffsetNs), scope.depth});
+    }
+    return true;
+}
+
+int Gm::Profiler::BeginGpuScope(const char *name) {
+    if (!m_gpuTimers || !IsEnabled()) {
+        return -1;
+    }
+    GpuFrame &frame = m_gpuFrames[m_gpuFrame];
+    uint32_t query = NextQuery(frame);
+    glQueryCounter(frame.queries[query], GL_TIMESTAMP);
+    frame.scopes.push_back(GpuScope{name, query, ~0u, (uint32_t) m_gpuStack.size()});
+    m_gpuStack.push_back((int) frame.scopes.size() - 1);
+    return m_gpuStack.back();
+}
+
+void Gm::Profiler::EndGpuScope(int scope) {
+    GpuFrame &frame = m_gpuFrames[m_gpuFrame];
+    // a scope opened before the last BeginFrame, or while there were no timers
+    if (scope < 0 || m_gpuStack.empty() || m_gpuStack.back() != scope) {
+        return;
+    }
+    m_gpuStack.pop_back();
+    uint32_t query = NextQuery(frame);
+    glQueryCounter(frame.queries[query], GL_TIMESTAMP);
+    frame.scopes[scope].endQuery = query;
+}
+
+double Gm::Profiler::ResolvedGpuMicroseconds(int scope) const {
+    if (scope < 0 || (size_t) scope >= m_resolvedMicroseconds.size()) {
+        return -1.0;
+    }
+    return m_resolvedMicroseconds[scope];
+}
+
+void Gm::Profiler::FinalizeGpu() {
+    for (GpuFrame &frame : m_gpuFrames) {
+        if (!frame.queries.empty()) {
+            glDeleteQueries((GLsizei) frame.queries.size(), frame.queries.data());
+        }
+        frame = GpuFrame();
+    }
+    m_gpuStack.clear();
+    m_gpuTimers = false;
+    // frame numbers keep counting, what was recorded before can't match a later frame
+    m_resolvedGpuFrame = 0;
+    m_resolvedMicroseconds.clear();
+}
+
+void Gm::Profiler::Clear() {
+    std::lock_guard<std::mutex> lock(m_ringsMutex);
+    for (const std::unique_ptr<Ring> &ring : m_rings) {
+        ring->cleared.store(ring->written.load(std::memory_order_acquire), std::memory_order_relaxed);
+    }
+}
+
+void Gm::Profiler::Collect(std::vector<ProfileTimeline> &timelines) {
+    timelines.clear();
+    std::lock_guard<std::mutex> lock(m_ringsMutex);
+    for (const std::unique_ptr<Ring> &ring : m_rings) {
+        uint64_t end = ring->written.load(std::memory_order_acquire);
+        uint64_t begin = std::max(ring->cleared.load(std::memory_order_relaxed),
+                                  end > EventsPerThread ? end - EventsPerThread : 0);
+        ProfileTimeline timeline;
+        timeline.id = ring->id;
+        timeline.name = ring->name;
+        for (uint64_t i = begin; i < end; ++i) {
+            timeline.events.push_back(ring->events[i % EventsPerThread]);
+        }
+        // the thread kept going while we copied: what it may have written over since can't be trusted,
+        // the slot it is writing now included
+        uint64_t after = ring->written.load(std::memory_order_acquire);
+        if (after + 1 > begin + EventsPerThread) {
+            size_t overwritten = (size_t) std::min<uint64_t>(after + 1 - (begin + EventsPerThread), end - begin);
+            timeline.events.erase(timeline.events.begin(), timeline.events.begin() + overwritten);
+        }
+        timelines.push_back(std::move(timeline));
+    }
+}
+
+void Gm::Profiler::ChromeTrace(std::string &json) {
+    std::vector<ProfileTimeline> timelines;
+    Collect(timelines);
+    json = "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+    bool first = true;
+    char number[96];
+    for (const ProfileTimeline &timeline : timelines) {
+        // the GPU timeline under its own process, so it doesn't sort in among the threads
+        unsigned pid = timeline.id == GpuTimelineId ? 2 : 1;
+        json += first ? "" : ",";
+        first = false;
+        snprintf(number, sizeof(number), "{\"ph\":\"M\",\"pid\":%u,\"tid\":%u,\"name\":\"thread_name\",", pid,
+                 timeline.id);
+        json += number;
+        json += "\"args\":{\"name\":\"";
+        AppendEscaped(json, timeline.name.c_str());
+        json += "\"}}";
+        for (const ProfileEvent &event : timeline.events) {
+            json += ",{\"ph\":\"X\",\"name\":\"";
+            AppendEscaped(json, event.name);
+            // microseconds, to the nanosecond
+            snprintf(number, sizeof(number), "\",\"pid\":%u,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}", pid, timeline.id,
+                     event.beginNs / 1000.0, (event.endNs - std::min(event.beginNs, event.endNs)) / 1000.0);
+            json += number;
+        }
+    }
+    json += ",{\"ph\":\"M\",\"pid\":1,\"name\":\"process_name\",\"args\":{\"name\":\"CPU\"}}";
+    json += ",{\"ph\":\"M\",\"pid\":2,\"name\":\"process_name\",\"args\":{\"name\":\"GPU\"}}]}";
+}
+
+bool Gm::Profiler::WriteChromeTrace(const char *path) {
+    std::string json;
+    ChromeTrace(json);
+    FILE *file = fopen(path, "wb");
+    if (file == nullptr) {
+        fprintf(stderr, "can't write %s\n", path);
+        return false;
+    }
+    bool ok = fwrite(json.data(), 1, json.size(), file) == json.size();
+    return fclose(file) == 0 && ok;
+}
+
+Gm::ProfilerStats Gm::Profiler::GetStats() const {
+    ProfilerStats stats;
+    std::lock_guard<std::mutex> lock(m_ringsMutex);
+    for (const std::unique_ptr<Ring> &ring : m_rings) {
+        uint64_t written = ring->written.load(std::memory_order_relaxed);
+        uint64_t cleared = ring->cleared.load(std::memory_order_relaxed);
+        stats.lostEvents += written - cleared > EventsPerThread ? written - cleared - EventsPerThread : 0;
+    }
+    stats.droppedGpuFrames = m_droppedGpuFrames;
+    return stats;
+}
+
+Gm::CpuProfileScope::CpuProfileScope(const char *name) : m_name(name) {
+    m_active = Profiler::Instance().IsEnabled();
+    if (m_active) {
+        ++t_depth;
+        m_begin = Profiler::Instance().Now();
+    }
+}
+
+Gm::CpuProfileScope::~CpuProfileScope() {
+    if (m_active) {
+        Profiler &profiler = Profiler::Instance();
+        profiler.RecordCpu(m_name, m_begin, profiler.Now(), --t_depth);
+    }
+}
@@ -0,0 +1,210 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "glad/glad.h"
+
+// Scopes timed on the CPU, and on the GPU with timestamp queries, for Chrome's trace viewer (about:tracing or
+// ui.perfetto.dev). Build with GM_PROFILER=0 to compile the macros out. Scope names are not copied, they must
+// outlive the profiler: string literals. The GPU scopes are the only timer queries the engine issues, the
+// frame graph's pass timings and the Hi-Z culler's GPU time are read back from them.
+//
+//     GM_PROFILE_SCOPE("Cull");         // this thread, until the end of the enclosing block
+//     GM_PROFILE_GPU_SCOPE("Shadows");  // the GL commands issued until the end of the block, GL thread only
+
+#ifndef GM_PROFILER
+#define GM_PROFILER 1
+#endif
+
+#define GM_PROFILE_CONCAT_(a, b) a##b
+#define GM_PROFILE_CONCAT(a, b) GM_PROFILE_CONCAT_(a, b)
+
+#if GM_PROFILER
+#define GM_PROFILE_SCOPE(name) Gm::CpuProfileScope GM_PROFILE_CONCAT(gmProfileScope, __LINE__)(name)
+#define GM_PROFILE_GPU_SCOPE(name) Gm::GpuProfileScope GM_PROFILE_CONCAT(gmGpuProfileScope, __LINE__)(name)
+#else
+#define GM_PROFILE_SCOPE(name) (void) 0
+#define GM_PROFILE_GPU_SCOPE(name) (void) 0
+#endif
+
+namespace Gm {
+    struct ProfileEvent {
+        const char *name;
+        // nanoseconds on the profiler's clock, GPU events converted to it
+        uint64_t beginNs;
+        uint64_t endNs;
+        // scopes open around it on the same timeline
+        uint32_t depth;
+    };
+
+    // the events of one thread, or of the GPU, oldest first
+    struct ProfileTimeline {
+        uint32_t id;
+        std::string name;
+        std::vector<ProfileEvent> events;
+    };
+
+    struct ProfilerStats {
+        // overwritten in a thread's ring before they were collected
+        uint64_t lostEvents = 0;
+        // frames of GPU scopes whose queries still weren't done when their slot came round again
+        uint64_t droppedGpuFrames = 0;
+    };
+
+    class Profiler {
+    public:
+        // events kept per thread, older ones are overwritten
+        static const size_t EventsPerThread = 16384;
+
+        // frames of GPU queries in flight: a frame's timestamps are read this many frames after it was issued
+        static const int GpuFrames = 4;
+
+        static Profiler &Instance();
+
+        // on by default; scopes opened while off record nothing, those already open still do
+        void SetEnabled(bool enabled) { m_enabled.store(enabled, std::memory_order_relaxed); }
+
+        bool IsEnabled() const { return m_enabled.load(std::memory_order_relaxed); }
+
+        // names the calling thread's timeline
+        void SetThreadName(const char *name);
+
+        // nanoseconds since the profiler was created
+        uint64_t Now() const;
+
+        // appends an event to the calling thread's ring, no lock taken after its first event
+        void RecordCpu(const char *name, uint64_t beginNs, uint64_t endNs, uint32_t depth);
+
+        // GL thread, once per frame before its first GPU scope: reads back the frame issued GpuFrames ago
+        void BeginFrame();
+
+        // index of the scope for EndGpuScope, -1 if nothing is recorded (off, or no timer queries)
+        int BeginGpuScope(const char *name);
+
+        void EndGpuScope(int scope);
+
+        // whether BeginGpuScope records anything: timer queries, and the profiler on
+        bool IsTimingGpu() const { return m_gpuTimers && IsEnabled(); }
+
+        // the frame GPU scopes go into now, counted from 1 by BeginFrame
+        uint64_t CurrentGpuFrame() const { return m_gpuFrameNumber; }
+
+        // the last frame whose GPU scopes were read back, 0 if none yet. Systems that report their own GPU
+        // times keep the CurrentGpuFrame and scope indices they recorded and look them up once it matches.
+        uint64_t ResolvedGpuFrame() const { return m_resolvedGpuFrame; }
+
+        // microseconds the GPU spent in a scope of ResolvedGpuFrame, negative if it wasn't recorded or closed
+        double ResolvedGpuMicroseconds(int scope) const;
+
+        // GL thread, deletes the queries; GPU scopes start over with the next BeginFrame
+        void FinalizeGpu();
+
+        // forget what was recorded so far, e.g. to trace a few frames only
+        void Clear();
+
+        // a copy of every timeline, safe while the threads keep recording
+        void Collect(std::vector<ProfileTimeline> &timelines);
+
+        // the collected timelines as Chrome trace event JSON, one complete ("X") event per scope
+        void ChromeTrace(std::string &json);
+
+        bool WriteChromeTrace(const char *path);
+
+        ProfilerStats GetStats() const;
+
+    private:
+        // one producer, any number of readers: the event is written before `written` is published
+        struct Ring {
+            uint32_t id = 0;
+            std::string name;
+            std::atomic<uint64_t> written{0};
+            // events before this were cleared
+            std::atomic<uint64_t> cleared{0};
+            ProfileEvent events[EventsPerThread];
+
+            void Push(const ProfileEvent &event) {
+                uint64_t index = written.load(std::memory_order_relaxed);
+                events[index % EventsPerThread] = event;
+                written.store(index + 1, std::memory_order_release);
+            }
+        };
+
+        struct GpuScope {
+            const char *name;
+            uint32_t beginQuery, endQuery;
+            uint32_t depth;
+        };
+
+        struct GpuFrame {
+            std::vector<GLuint> queries;
+            uint32_t usedQueries = 0;
+            std::vector<GpuScope> scopes;
+            // CPU clock minus GL_TIMESTAMP when the frame began
+            int64_t clockOffsetNs = 0;
+            // CurrentGpuFrame while it was recorded
+            uint64_t number = 0;
+        };
+
+        Profiler();
+
+        Ring &ThreadRing();
+
+        // "Thread <id>" without a name
+        Ring *AddRing(const char *name);
+
+        // false if the queries aren't done yet
+        bool ResolveGpuFrame(GpuFrame &frame);
+
+        uint32_t NextQuery(GpuFrame &frame);
+
+        std::atomic<bool> m_enabled{true};
+        std::chrono::steady_clock::time_point m_epoch;
+
+        // rings are never freed, a thread's events outlive it
+        mutable std::mutex m_ringsMutex;
+        std::vector<std::unique_ptr<Ring>> m_rings;
+
+        // GL thread only
+        Ring *m_gpuRing = nullptr;
+        GpuFrame m_gpuFrames[GpuFrames];
+        int m_gpuFrame = 0;
+        bool m_gpuTimers = false;
+        std::vector<int> m_gpuStack;
+        uint64_t m_droppedGpuFrames = 0;
+        uint64_t m_gpuFrameNumber = 0;
+        uint64_t m_resolvedGpuFrame = 0;
+        // per scope of m_resolvedGpuFrame
+        std::vector<double> m_resolvedMicroseconds;
+    };
+
+    class CpuProfileScope {
+    public:
+        explicit CpuProfileScope(const char *name);
+
+        ~CpuProfileScope();
+
+    private:
+        const char *m_name;
+        uint64_t m_begin = 0;
+        bool m_active;
+    };
+
+    class GpuProfileScope {
+    public:
+        explicit GpuProfileScope(const char *name) : m_scope(Profiler::Instance().BeginGpuScope(name)) {}
+
+        ~GpuProfileScope() { Profiler::Instance().EndGpuScope(m_scope); }
+
+        // for Profiler::ResolvedGpuMicroseconds, -1 if nothing is recorded
+        int Index() const { return m_scope; }
+
+    private:
+        int m_scope;
+    };
+}
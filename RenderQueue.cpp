@@ -0,0 +1,91 @@
+#include <cstring>
+#include "RenderQueue.h"
+
+namespace {
+    const int PassShift = 62;
+
+    const int OpaqueProgramShift = 52;
+    const int OpaqueMaterialShift = 40;
+    const int OpaqueVaoShift = 32;
+
+    const int TransparentDepthShift = 32;
+    const int TransparentProgramShift = 22;
+    const int TransparentMaterialShift = 10;
+    const int TransparentVaoShift = 2;
+
+    const uint64_t ProgramMask = (1u << 10) - 1;
+    const uint64_t MaterialMask = (1u << 12) - 1;
+    const uint64_t VaoMask = (1u << 8) - 1;
+    const uint32_t DepthMask = (1u << 24) - 1;
+
+    const int RadixBits = 8;
+    const int RadixBuckets = 1 << RadixBits;
+    const int RadixPasses = 64 / RadixBits;
+}
+
+uint32_t Gm::QuantizeDepth(float depth) {
+    if (!(depth > 0.0f)) {
+        return 0;
+    }
+    uint32_t bits;
+    std::memcpy(&bits, &depth, sizeof(bits));
+    // sign is clear: 8 exponent bits and the top 16 mantissa bits
+    return bits >> 7;
+}
+
+uint64_t Gm::MakeSortKey(RenderPass pass, GLuint program, uint32_t material, GLuint vao, float depth) {
+    uint64_t key = (uint64_t) pass << PassShift;
+    uint32_t quantized = QuantizeDepth(depth);
+    if (pass == RenderPass::Transparent) {
+        key |= (uint64_t) (DepthMask - quantized) << TransparentDepthShift;
+        key |= (program & ProgramMask) << TransparentProgramShift;
+        key |= (material & MaterialMask) << TransparentMaterialShift;
+        key |= (vao & VaoMask) << TransparentVaoShift;
+    } else {
+        key |= (program & ProgramMask) << OpaqueProgramShift;
+        key |= (material & MaterialMask) << OpaqueMaterialShift;
+        key |= (vao & VaoMask) << OpaqueVaoShift;
+        key |= quantized;
+    }
+    return key;
+}
+
+void Gm::RadixSort(std::vector<SortItem> &items, std::vector<SortItem> &scratch) {
+    size_t count = items.size();
+    if (count < 2) {
+        return;
+    }
+    // every histogram in a single read of the keys, on the stack so a sort every frame never allocates
+    static_assert(RadixPasses * RadixBits == 64, "passes must cover the whole key");
+    size_t histograms[RadixPasses][RadixBuckets] = {};
+    for (const SortItem &item : items) {
+        for (int pass = 0; pass < RadixPasses; ++pass) {
+            histograms[pass][(item.key >> (pass * RadixBits)) & (RadixBuckets - 1)]++;
+        }
+    }
+
+    scratch.resize(count);
+    SortItem *source = items.data();
+    SortItem *destination = scratch.data();
+    for (int pass = 0; pass < RadixPasses; ++pass) {
+        size_t *histogram = histograms[pass];
+        int shift = pass * RadixBits;
+        // all keys agree on this byte, the pass would only copy
+        if (histogram[(source[0].key >> shift) & (RadixBuckets - 1)] == count) {
+            continue;
+        }
+        size_t offset = 0;
+        for (int bucket = 0; bucket < RadixBuckets; ++bucket) {
+            size_t bucketCount = histogram[bucket];
+            histogram[bucket] = offset;
+            offset += bucketCount;
+        }
+        for (size_t i = 0; i < count; ++i) {
+            destination[histogram[(source[i].key >> shift) & (RadixBuckets - 1)]++] = source[i];
+        }
+        std::swap(source, destination);
+    }
+    if (source != items.data()) {
+        items.swap(scratch);
+    }
+}
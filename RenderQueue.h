@@ -0,0 +1,55 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "glad/glad.h"
+
+namespace Gm {
+    enum class RenderPass : uint32_t {
+        Opaque = 0,
+        Transparent = 1,
+    };
+
+    // Packs the state a draw needs into a 64-bit key so that sorting the keys orders the draws, from the top bit:
+    //
+    //   opaque:       pass:2 | program:10 | material:12 | vao:8 | unused:8 | depth:24
+    //   transparent:  pass:2 | unused:6 | far-to-near depth:24 | program:10 | material:12 | vao:8 | unused:2
+    //
+    // Opaque draws group by state first and go front to back within the same state for early-Z rejection.
+    // Transparent draws must blend back to front, so depth wins over state there. Program, material and VAO
+    // are truncated to their field: two names sharing the low bits only cost a redundant state change.
+    uint64_t MakeSortKey(RenderPass pass, GLuint program, uint32_t material, GLuint vao, float depth);
+
+    // view space depth to 24 bits: the top bits of a positive float compare like the float itself,
+    // which keeps the same relative precision near and far. Negative depths clamp to 0.
+    uint32_t QuantizeDepth(float depth);
+
+    struct SortItem {
+        uint64_t key;
+        // whatever the caller needs to find the item again, e.g. an index into its own draw list
+        uint32_t value;
+    };
+
+    // Stable LSD radix sort on the key, 8 bits per pass. Passes in which every key has the same byte are
+    // skipped, so keys only using their low 32 bits cost 4 passes. `scratch` is resized as needed.
+    void RadixSort(std::vector<SortItem> &items, std::vector<SortItem> &scratch);
+
+    // The draws of a frame as keys, sorted once before submission.
+    class RenderQueue {
+    public:
+        void Begin() { m_items.clear(); }
+
+        void Push(uint64_t key, uint32_t value) { m_items.push_back({key, value}); }
+
+        void Sort() { RadixSort(m_items, m_scratch); }
+
+        const std::vector<SortItem> &Items() const { return m_items; }
+
+        size_t Size() const { return m_items.size(); }
+
+    private:
+        std::vector<SortItem> m_items;
+        std::vector<SortItem> m_scratch;
+    };
+}
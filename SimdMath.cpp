@@ -0,0 +1,138 @@
+#include <cmath>
+#include "SimdMath.h"
+
+namespace {
+    Gm::Vec4 Cross(const Gm::Vec4 &a, const Gm::Vec4 &b) {
+        return {a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x, 0.0f};
+    }
+}
+
+Gm::Mat4 Gm::Mat4::Identity() {
+    return {{1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f}};
+}
+
+#if !GM_SIMD_X86
+// cofactor expansion, works on either storage order since inverse(transpose(M)) = transpose(inverse(M))
+Gm::Mat4 Gm::Math::InverseScalar(const Mat4 &matrix) {
+    const float *m = matrix.m;
+    float c[16];
+    c[0] = m[5] * m[10] * m[15] - m[5] * m[11] * m[14] - m[9] * m[6] * m[15] + m[9] * m[7] * m[14] +
+           m[13] * m[6] * m[11] - m[13] * m[7] * m[10];
+    c[4] = -m[4] * m[10] * m[15] + m[4] * m[11] * m[14] + m[8] * m[6] * m[15] - m[8] * m[7] * m[14] -
+           m[12] * m[6] * m[11] + m[12] * m[7] * m[10];
+    c[8] = m[4] * m[9] * m[15] - m[4] * m[11] * m[13] - m[8] * m[5] * m[15] + m[8] * m[7] * m[13] +
+           m[12] * m[5] * m[11] - m[12] * m[7] * m[9];
+    c[12] = -m[4] * m[9] * m[14] + m[4] * m[10] * m[13] + m[8] * m[5] * m[14] - m[8] * m[6] * m[13] -
+            m[12] * m[5] * m[10] + m[12] * m[6] * m[9];
+    c[1] = -m[1] * m[10] * m[15] + m[1] * m[11] * m[14] + m[9] * m[2] * m[15] - m[9] * m[3] * m[14] -
+           m[13] * m[2] * m[11] + m[13] * m[3] * m[10];
+    c[5] = m[0] * m[10] * m[15] - m[0] * m[11] * m[14] - m[8] * m[2] * m[15] + m[8] * m[3] * m[14] +
+           m[12] * m[2] * m[11] - m[12] * m[3] * m[10];
+    c[9] = -m[0] * m[9] * m[15] + m[0] * m[11] * m[13] + m[8] * m[1] * m[15] - m[8] * m[3] * m[13] -
+           m[12] * m[1] * m[11] + m[12] * m[3] * m[9];
+    c[13] = m[0] * m[9] * m[14] - m[0] * m[10] * m[13] - m[8] * m[1] * m[14] + m[8] * m[2] * m[13] +
+            m[12] * m[1] * m[10] - m[12] * m[2] * m[9];
+    c[2] = m[1] * m[6] * m[15] - m[1] * m[7] * m[14] - m[5] * m[2] * m[15] + m[5] * m[3] * m[14] +
+           m[13] * m[2] * m[7] - m[13] * m[3] * m[6];
+    c[6] = -m[0] * m[6] * m[15] + m[0] * m[7] * m[14] + m[4] * m[2] * m[15] - m[4] * m[3] * m[14] -
+           m[12] * m[2] * m[7] + m[12] * m[3] * m[6];
+    c[10] = m[0] * m[5] * m[15] - m[0] * m[7] * m[13] - m[4] * m[1] * m[15] + m[4] * m[3] * m[13] +
+            m[12] * m[1] * m[7] - m[12] * m[3] * m[5];
+    c[14] = -m[0] * m[5] * m[14] + m[0] * m[6] * m[13] + m[4] * m[1] * m[14] - m[4] * m[2] * m[13] -
+            m[12] * m[1] * m[6] + m[12] * m[2] * m[5];
+    c[3] = -m[1] * m[6] * m[11] + m[1] * m[7] * m[10] + m[5] * m[2] * m[11] - m[5] * m[3] * m[10] -
+           m[9] * m[2] * m[7] + m[9] * m[3] * m[6];
+    c[7] = m[0] * m[6] * m[11] - m[0] * m[7] * m[10] - m[4] * m[2] * m[11] + m[4] * m[3] * m[10] +
+           m[8] * m[2] * m[7] - m[8] * m[3] * m[6];
+    c[11] = -m[0] * m[5] * m[11] + m[0] * m[7] * m[9] + m[4] * m[1] * m[11] - m[4] * m[3] * m[9] -
+            m[8] * m[1] * m[7] + m[8] * m[3] * m[5];
+    c[15] = m[0] * m[5] * m[10] - m[0] * m[6] * m[9] - m[4] * m[1] * m[10] + m[4] * m[2] * m[9] +
+            m[8] * m[1] * m[6] - m[8] * m[2] * m[5];
+    float inverseDeterminant = 1.0f / (m[0] * c[0] + m[1] * c[4] + m[2] * c[8] + m[3] * c[12]);
+    Mat4 result;
+    for (int i = 0; i < 16; ++i) {
+        result.m[i] = c[i] * inverseDeterminant;
+    }
+    return result;
+}
+#endif
+
+Gm::Quat Gm::QuatFromAxisAngle(const Vec4 &axis, float angle) {
+    float s = std::sin(angle * 0.5f);
+    return {axis.x * s, axis.y * s, axis.z * s, std::cos(angle * 0.5f)};
+}
+
+Gm::Quat Gm::QuatFromEuler(float x, float y, float z) {
+    // Rx * Ry * Rz multiplied out: most terms of the general products are zero for axis rotations
+    float sx = std::sin(x * 0.5f), cx = std::cos(x * 0.5f);
+    float sy = std::sin(y * 0.5f), cy = std::cos(y * 0.5f);
+    float sz = std::sin(z * 0.5f), cz = std::cos(z * 0.5f);
+    float px = sx * cy, py = cx * sy, pz = sx * sy, pw = cx * cy;
+    return {px * cz + py * sz, py * cz - px * sz, pw * sz + pz * cz, pw * cz - pz * sz};
+}
+
+Gm::Quat Gm::Multiply(const Quat &a, const Quat &b) {
+    return {a.w * b.x + a.x * b.w + a.y * b.z - a.z * b.y,
+            a.w * b.y - a.x * b.z + a.y * b.w + a.z * b.x,
+            a.w * b.z + a.x * b.y - a.y * b.x + a.z * b.w,
+            a.w * b.w - a.x * b.x - a.y * b.y - a.z * b.z};
+}
+
+Gm::Vec4 Gm::Rotate(const Quat &rotation, const Vec4 &vector) {
+    // v + w t + q x t with t = 2 q x v
+    Vec4 axis = {rotation.x, rotation.y, rotation.z, 0.0f};
+    Vec4 t = Cross(axis, vector);
+    t = {2.0f * t.x, 2.0f * t.y, 2.0f * t.z, 0.0f};
+    Vec4 u = Cross(axis, t);
+    return {vector.x + rotation.w * t.x + u.x, vector.y + rotation.w * t.y + u.y, vector.z + rotation.w * t.z + u.z,
+            vector.w};
+}
+
+Gm::Quat Gm::Slerp(const Quat &a, const Quat &b, float t) {
+    if (a.x == b.x && a.y == b.y && a.z == b.z && a.w == b.w) {
+        // nothing moved, and no rounding for it either
+        return a;
+    }
+    float cosine = a.x * b.x + a.y * b.y + a.z * b.z + a.w * b.w;
+    // q and -q are the same rotation, flip b when that makes the arc shorter
+    float sign = cosine < 0.0f ? -1.0f : 1.0f;
+    cosine *= sign;
+    float weightA = 1.0f - t, weightB = t;
+    bool nearlyEqual = cosine > 0.9995f;
+    if (!nearlyEqual) {
+        float angle = std::acos(cosine);
+        float inverseSine = 1.0f / std::sin(angle);
+        weightA = std::sin(weightA * angle) * inverseSine;
+        weightB = std::sin(weightB * angle) * inverseSine;
+    }
+    weightB *= sign;
+    Quat result = {weightA * a.x + weightB * b.x, weightA * a.y + weightB * b.y, weightA * a.z + weightB * b.z,
+                   weightA * a.w + weightB * b.w};
+    if (nearlyEqual) {
+        // the sine is too small to divide by, a normalized lerp is as good there
+        float scale = 1.0f / std::sqrt(result.x * result.x + result.y * result.y + result.z * result.z +
+                                       result.w * result.w);
+        result = {result.x * scale, result.y * scale, result.z * scale, result.w * scale};
+    }
+    return result;
+}
+
+Gm::Mat4 Gm::RotationMatrix(const Quat &q) {
+    float xx = q.x * q.x, yy = q.y * q.y, zz = q.z * q.z;
+    float xy = q.x * q.y, xz = q.x * q.z, yz = q.y * q.z;
+    float wx = q.w * q.x, wy = q.w * q.y, wz = q.w * q.z;
+    return {{1.0f - 2.0f * (yy + zz), 2.0f * (xy + wz), 2.0f * (xz - wy), 0.0f,
+             2.0f * (xy - wz), 1.0f - 2.0f * (xx + zz), 2.0f * (yz + wx), 0.0f,
+             2.0f * (xz + wy), 2.0f * (yz - wx), 1.0f - 2.0f * (xx + yy), 0.0f,
+             0.0f, 0.0f, 0.0f, 1.0f}};
+}
+
+const char *Gm::Math::KernelName() {
+#if GM_SIMD_X86
+    return "sse2";
+#elif GM_SIMD_NEON
+    return "neon";
+#else
+    return "scalar";
+#endif
+}
@@ -0,0 +1,381 @@
+#pragma once
+
+#include <cmath>
+#include "Eigen/Core"
+#include "CpuFeatures.h"
+
+#if GM_SIMD_X86
+#include <emmintrin.h>
+#elif GM_SIMD_NEON
+#include <arm_neon.h>
+#endif
+
+// Small fixed-size math for the per-frame hot paths (camera, model and view-projection matrices).
+// Matrices are column-major like Eigen and OpenGL, and column vectors: clip = matrix * position.
+// Multiply, Transform, Inverse, LookAtLH and PerspectiveFovLH are inline and picked at compile time: SSE2 on
+// x86, NEON on ARM, scalar elsewhere. A single 4x4 product is too small to pay for a dispatch, the AVX2
+// kernels live in BatchTransform where one choice covers a whole batch.
+
+namespace Gm {
+    struct alignas(16) Vec4 {
+        float x, y, z, w;
+    };
+
+    // rotation as x, y, z (vector part) and w
+    struct alignas(16) Quat {
+        float x, y, z, w;
+    };
+
+    // 16 byte aligned only, what operator new guarantees before C++17, so std::vector<Mat4> works
+    struct alignas(16) Mat4 {
+        // m[column * 4 + row]
+        float m[16];
+
+        static Mat4 Identity();
+
+        float &operator()(int row, int column) { return m[column * 4 + row]; }
+
+        float operator()(int row, int column) const { return m[column * 4 + row]; }
+    };
+
+    inline Mat4 Multiply(const Mat4 &a, const Mat4 &b);
+
+    inline Vec4 Transform(const Mat4 &matrix, const Vec4 &vector);
+
+    // general inverse through 2x2 blocks, the input must not be singular
+    inline Mat4 Inverse(const Mat4 &matrix);
+
+    // left-handed view matrix from `eye` towards `target`, which ends up on +z: the rows of the upper 3x3 are
+    // the camera's x, y and z axes, the last column moves the eye to the origin
+    inline Mat4 LookAtLH(const Vec4 &eye, const Vec4 &target, const Vec4 &up);
+
+    // left-handed perspective projection for column vectors, `fieldOfView` vertical in radians: w takes the
+    // view space z, and z / w goes from 0 at `nearPlane` to 1 at `farPlane`
+    inline Mat4 PerspectiveFovLH(float fieldOfView, float aspect, float nearPlane, float farPlane);
+
+    Quat QuatFromAxisAngle(const Vec4 &axis, float angle);
+
+    // rotation about x by `x`, then y by `y`, then z by `z` (in radians), composed as Rx * Ry * Rz
+    Quat QuatFromEuler(float x, float y, float z);
+
+    // a * b applies b first
+    Quat Multiply(const Quat &a, const Quat &b);
+
+    Vec4 Rotate(const Quat &rotation, const Vec4 &vector);
+
+    // from `a` at t = 0 to `b` at t = 1 at constant angular speed, the shorter way round
+    Quat Slerp(const Quat &a, const Quat &b, float t);
+
+    Mat4 RotationMatrix(const Quat &rotation);
+
+    namespace Math {
+        // name of the kernel set compiled in, for benchmark output
+        const char *KernelName();
+
+        // cofactor expansion, where there is no blockwise SIMD inverse
+        Mat4 InverseScalar(const Mat4 &matrix);
+    }
+
+    inline Eigen::Matrix4f ToEigen(const Mat4 &matrix) {
+        return Eigen::Map<const Eigen::Matrix4f>(matrix.m);
+    }
+
+    inline Mat4 FromEigen(const Eigen::Matrix4f &matrix) {
+        Mat4 result;
+        Eigen::Map<Eigen::Matrix4f>(result.m) = matrix;
+        return result;
+    }
+
+#if GM_SIMD_X86
+#define GM_SHUFFLE(a, b, x, y, z, w) _mm_shuffle_ps(a, b, _MM_SHUFFLE(w, z, y, x))
+#define GM_SWIZZLE(a, x, y, z, w) \
+    _mm_castsi128_ps(_mm_shuffle_epi32(_mm_castps_si128(a), _MM_SHUFFLE(w, z, y, x)))
+
+    namespace Math {
+        // 2x2 blocks held as (m00, m01, m10, m11)
+        inline __m128 Mat2Multiply(__m128 a, __m128 b) {
+            return _mm_add_ps(_mm_mul_ps(a, GM_SWIZZLE(b, 0, 3, 0, 3)),
+                              _mm_mul_ps(GM_SWIZZLE(a, 1, 0, 3, 2), GM_SWIZZLE(b, 2, 1, 2, 1)));
+        }
+
+        // adjugate(a) * b
+        inline __m128 Mat2AdjugateMultiply(__m128 a, __m128 b) {
+            return _mm_sub_ps(_mm_mul_ps(GM_SWIZZLE(a, 3, 3, 0, 0), b),
+                              _mm_mul_ps(GM_SWIZZLE(a, 1, 1, 2, 2), GM_SWIZZLE(b, 2, 3, 0, 1)));
+        }
+
+        // a * adjugate(b)
+        inline __m128 Mat2MultiplyAdjugate(__m128 a, __m128 b) {
+            return _mm_sub_ps(_mm_mul_ps(a, GM_SWIZZLE(b, 3, 0, 3, 0)),
+                              _mm_mul_ps(GM_SWIZZLE(a, 1, 0, 3, 2), GM_SWIZZLE(b, 2, 1, 2, 1)));
+        }
+
+        // a0 * f[0] + a1 * f[1] + a2 * f[2] + a3 * f[3], the factors broadcast straight from memory
+        inline __m128 Combine(__m128 a0, __m128 a1, __m128 a2, __m128 a3, const float *f) {
+            __m128 sum = _mm_mul_ps(a0, _mm_set1_ps(f[0]));
+            sum = _mm_add_ps(sum, _mm_mul_ps(a1, _mm_set1_ps(f[1])));
+            sum = _mm_add_ps(sum, _mm_mul_ps(a2, _mm_set1_ps(f[2])));
+            return _mm_add_ps(sum, _mm_mul_ps(a3, _mm_set1_ps(f[3])));
+        }
+
+        // the xyz of a and b, w 0 when both w are
+        inline __m128 Cross(__m128 a, __m128 b) {
+            __m128 product = _mm_sub_ps(_mm_mul_ps(a, GM_SWIZZLE(b, 1, 2, 0, 3)),
+                                        _mm_mul_ps(GM_SWIZZLE(a, 1, 2, 0, 3), b));
+            return GM_SWIZZLE(product, 1, 2, 0, 3);
+        }
+
+        // w must be 0
+        inline __m128 Normalize3(__m128 v) {
+            __m128 squares = _mm_mul_ps(v, v);
+            squares = _mm_add_ps(squares, GM_SWIZZLE(squares, 2, 3, 0, 1));
+            squares = _mm_add_ps(squares, GM_SWIZZLE(squares, 1, 0, 3, 2));
+            return _mm_div_ps(v, _mm_sqrt_ps(squares));
+        }
+    }
+
+    inline Mat4 Multiply(const Mat4 &a, const Mat4 &b) {
+        __m128 a0 = _mm_load_ps(a.m), a1 = _mm_load_ps(a.m + 4), a2 = _mm_load_ps(a.m + 8), a3 = _mm_load_ps(a.m + 12);
+        // unrolled by hand so the result is written once, not through a temporary per column
+        Mat4 result;
+        _mm_store_ps(result.m, Math::Combine(a0, a1, a2, a3, b.m));
+        _mm_store_ps(result.m + 4, Math::Combine(a0, a1, a2, a3, b.m + 4));
+        _mm_store_ps(result.m + 8, Math::Combine(a0, a1, a2, a3, b.m + 8));
+        _mm_store_ps(result.m + 12, Math::Combine(a0, a1, a2, a3, b.m + 12));
+        return result;
+    }
+
+    inline Vec4 Transform(const Mat4 &matrix, const Vec4 &vector) {
+        __m128 v = _mm_load_ps(&vector.x);
+        __m128 sum = _mm_mul_ps(_mm_load_ps(matrix.m), GM_SWIZZLE(v, 0, 0, 0, 0));
+        sum = _mm_add_ps(sum, _mm_mul_ps(_mm_load_ps(matrix.m + 4), GM_SWIZZLE(v, 1, 1, 1, 1)));
+        sum = _mm_add_ps(sum, _mm_mul_ps(_mm_load_ps(matrix.m + 8), GM_SWIZZLE(v, 2, 2, 2, 2)));
+        sum = _mm_add_ps(sum, _mm_mul_ps(_mm_load_ps(matrix.m + 12), GM_SWIZZLE(v, 3, 3, 3, 3)));
+        Vec4 result;
+        _mm_store_ps(&result.x, sum);
+        return result;
+    }
+
+    // Blockwise inverse of | A B ; C D | with 2x2 adjugates, after Eric Zhang's SSE formulation. Like the
+    // scalar version it doesn't care about the storage order.
+    inline Mat4 Inverse(const Mat4 &matrix) {
+        using namespace Math;
+        __m128 r0 = _mm_load_ps(matrix.m), r1 = _mm_load_ps(matrix.m + 4);
+        __m128 r2 = _mm_load_ps(matrix.m + 8), r3 = _mm_load_ps(matrix.m + 12);
+        __m128 a = _mm_movelh_ps(r0, r1);
+        __m128 b = _mm_movehl_ps(r1, r0);
+        __m128 c = _mm_movelh_ps(r2, r3);
+        __m128 d = _mm_movehl_ps(r3, r2);
+
+        // (|A|, |B|, |C|, |D|)
+        __m128 determinants = _mm_sub_ps(_mm_mul_ps(GM_SHUFFLE(r0, r2, 0, 2, 0, 2), GM_SHUFFLE(r1, r3, 1, 3, 1, 3)),
+                                         _mm_mul_ps(GM_SHUFFLE(r0, r2, 1, 3, 1, 3), GM_SHUFFLE(r1, r3, 0, 2, 0, 2)));
+        __m128 detA = GM_SWIZZLE(determinants, 0, 0, 0, 0);
+        __m128 detB = GM_SWIZZLE(determinants, 1, 1, 1, 1);
+        __m128 detC = GM_SWIZZLE(determinants, 2, 2, 2, 2);
+        __m128 detD = GM_SWIZZLE(determinants, 3, 3, 3, 3);
+
+        __m128 dc = Mat2AdjugateMultiply(d, c);
+        __m128 ab = Mat2AdjugateMultiply(a, b);
+        // adjugates of the result's blocks X, Y, Z, W
+        __m128 x = _mm_sub_ps(_mm_mul_ps(detD, a), Mat2Multiply(b, dc));
+        __m128 w = _mm_sub_ps(_mm_mul_ps(detA, d), Mat2Multiply(c, ab));
+        __m128 y = _mm_sub_ps(_mm_mul_ps(detB, c), Mat2MultiplyAdjugate(d, ab));
+        __m128 z = _mm_sub_ps(_mm_mul_ps(detC, b), Mat2MultiplyAdjugate(a, dc));
+
+        // |M| = |A||D| + |B||C| - tr((A#B)(D#C))
+        __m128 trace = _mm_mul_ps(ab, GM_SWIZZLE(dc, 0, 2, 1, 3));
+        trace = _mm_add_ps(trace, GM_SWIZZLE(trace, 2, 3, 0, 1));
+        trace = _mm_add_ps(trace, GM_SWIZZLE(trace, 1, 0, 3, 2));
+        __m128 determinant = _mm_sub_ps(_mm_add_ps(_mm_mul_ps(detA, detD), _mm_mul_ps(detB, detC)), trace);
+        __m128 reciprocal = _mm_div_ps(_mm_setr_ps(1.0f, -1.0f, -1.0f, 1.0f), determinant);
+        x = _mm_mul_ps(x, reciprocal);
+        y = _mm_mul_ps(y, reciprocal);
+        z = _mm_mul_ps(z, reciprocal);
+        w = _mm_mul_ps(w, reciprocal);
+
+        // the adjugate's shuffle and the block layout in one go
+        Mat4 result;
+        _mm_store_ps(result.m, GM_SHUFFLE(x, y, 3, 1, 3, 1));
+        _mm_store_ps(result.m + 4, GM_SHUFFLE(x, y, 2, 0, 2, 0));
+        _mm_store_ps(result.m + 8, GM_SHUFFLE(z, w, 3, 1, 3, 1));
+        _mm_store_ps(result.m + 12, GM_SHUFFLE(z, w, 2, 0, 2, 0));
+        return result;
+    }
+
+    inline Mat4 LookAtLH(const Vec4 &eye, const Vec4 &target, const Vec4 &up) {
+        using namespace Math;
+        // built from the components rather than loaded: callers fill these field by field, and a 16 byte load
+        // of fresh scalar stores stalls on store forwarding. w is 0 in all three.
+        __m128 position = _mm_setr_ps(eye.x, eye.y, eye.z, 0.0f);
+        __m128 zAxis = Normalize3(_mm_sub_ps(_mm_setr_ps(target.x, target.y, target.z, 0.0f), position));
+        __m128 xAxis = Normalize3(Cross(_mm_setr_ps(up.x, up.y, up.z, 0.0f), zAxis));
+        __m128 yAxis = Cross(zAxis, xAxis);
+        // the axes are the rows: transposed they are the first three columns
+        __m128 last = _mm_setr_ps(0.0f, 0.0f, 0.0f, 1.0f);
+        __m128 column0 = xAxis, column1 = yAxis, column2 = zAxis, column3 = last;
+        _MM_TRANSPOSE4_PS(column0, column1, column2, column3);
+        // the translation moves the eye to the origin: -(axis . eye) per row
+        __m128 translation = _mm_mul_ps(column0, GM_SWIZZLE(position, 0, 0, 0, 0));
+        translation = _mm_add_ps(translation, _mm_mul_ps(column1, GM_SWIZZLE(position, 1, 1, 1, 1)));
+        translation = _mm_add_ps(translation, _mm_mul_ps(column2, GM_SWIZZLE(position, 2, 2, 2, 2)));
+        Mat4 result;
+        _mm_store_ps(result.m, column0);
+        _mm_store_ps(result.m + 4, column1);
+        _mm_store_ps(result.m + 8, column2);
+        _mm_store_ps(result.m + 12, _mm_sub_ps(last, translation));
+        return result;
+    }
+
+    inline Mat4 PerspectiveFovLH(float fieldOfView, float aspect, float nearPlane, float farPlane) {
+        float yScale = 1.0f / std::tan(fieldOfView * 0.5f);
+        float zScale = farPlane / (farPlane - nearPlane);
+        Mat4 result;
+        _mm_store_ps(result.m, _mm_setr_ps(yScale / aspect, 0.0f, 0.0f, 0.0f));
+        _mm_store_ps(result.m + 4, _mm_setr_ps(0.0f, yScale, 0.0f, 0.0f));
+        _mm_store_ps(result.m + 8, _mm_setr_ps(0.0f, 0.0f, zScale, 1.0f));
+        _mm_store_ps(result.m + 12, _mm_setr_ps(0.0f, 0.0f, -nearPlane * zScale, 0.0f));
+        return result;
+    }
+
+#undef GM_SHUFFLE
+#undef GM_SWIZZLE
+#elif GM_SIMD_NEON
+    namespace Math {
+        // (y, z, x, x): lane 3 is garbage the callers mask or multiply by 0
+        inline float32x4_t Yzxx(float32x4_t v) {
+            return vsetq_lane_f32(vgetq_lane_f32(v, 0), vextq_f32(v, v, 1), 2);
+        }
+
+        // the xyz of a and b, w left for the caller to clear
+        inline float32x4_t Cross(float32x4_t a, float32x4_t b) {
+            return Yzxx(vmlsq_f32(vmulq_f32(a, Yzxx(b)), Yzxx(a), b));
+        }
+
+        // w must be 0
+        inline float32x4_t Normalize3(float32x4_t v) {
+            float32x4_t squares = vmulq_f32(v, v);
+            float32x2_t pairs = vadd_f32(vget_low_f32(squares), vget_high_f32(squares));
+            float length = std::sqrt(vget_lane_f32(vpadd_f32(pairs, pairs), 0));
+            return vmulq_n_f32(v, 1.0f / length);
+        }
+    }
+
+    inline Mat4 Multiply(const Mat4 &a, const Mat4 &b) {
+        float32x4_t a0 = vld1q_f32(a.m), a1 = vld1q_f32(a.m + 4), a2 = vld1q_f32(a.m + 8), a3 = vld1q_f32(a.m + 12);
+        Mat4 result;
+        for (int column = 0; column < 4; ++column) {
+            const float *factors = b.m + column * 4;
+            float32x4_t sum = vmulq_n_f32(a0, factors[0]);
+            sum = vmlaq_n_f32(sum, a1, factors[1]);
+            sum = vmlaq_n_f32(sum, a2, factors[2]);
+            sum = vmlaq_n_f32(sum, a3, factors[3]);
+            vst1q_f32(result.m + column * 4, sum);
+        }
+        return result;
+    }
+
+    inline Vec4 Transform(const Mat4 &matrix, const Vec4 &vector) {
+        float32x4_t sum = vmulq_n_f32(vld1q_f32(matrix.m), vector.x);
+        sum = vmlaq_n_f32(sum, vld1q_f32(matrix.m + 4), vector.y);
+        sum = vmlaq_n_f32(sum, vld1q_f32(matrix.m + 8), vector.z);
+        sum = vmlaq_n_f32(sum, vld1q_f32(matrix.m + 12), vector.w);
+        Vec4 result;
+        vst1q_f32(&result.x, sum);
+        return result;
+    }
+
+    inline Mat4 Inverse(const Mat4 &matrix) {
+        return Math::InverseScalar(matrix);
+    }
+
+    inline Mat4 LookAtLH(const Vec4 &eye, const Vec4 &target, const Vec4 &up) {
+        using namespace Math;
+        // the w of every direction cleared, whatever the caller put there
+        const float32x4_t xyz = vreinterpretq_f32_u32(vsetq_lane_u32(0, vdupq_n_u32(~0u), 3));
+        float32x4_t position = vld1q_f32(&eye.x);
+        float32x4_t zAxis = Normalize3(vreinterpretq_f32_u32(vandq_u32(
+                vreinterpretq_u32_f32(vsubq_f32(vld1q_f32(&target.x), position)), vreinterpretq_u32_f32(xyz))));
+        float32x4_t upAxis = vreinterpretq_f32_u32(vandq_u32(vreinterpretq_u32_f32(vld1q_f32(&up.x)),
+                                                             vreinterpretq_u32_f32(xyz)));
+        float32x4_t xAxis = Cross(upAxis, zAxis);
+        xAxis = Normalize3(vreinterpretq_f32_u32(vandq_u32(vreinterpretq_u32_f32(xAxis), vreinterpretq_u32_f32(xyz))));
+        float32x4_t yAxis = vreinterpretq_f32_u32(vandq_u32(vreinterpretq_u32_f32(Cross(zAxis, xAxis)),
+                                                            vreinterpretq_u32_f32(xyz)));
+        // the axes are the rows: transposed they are the first three columns
+        float32x4_t last = vsetq_lane_f32(1.0f, vdupq_n_f32(0.0f), 3);
+        float32x4x2_t xz = vzipq_f32(xAxis, zAxis), yw = vzipq_f32(yAxis, last);
+        float32x4x2_t low = vzipq_f32(xz.val[0], yw.val[0]), high = vzipq_f32(xz.val[1], yw.val[1]);
+        // the translation moves the eye to the origin: -(axis . eye) per row
+        float32x4_t translation = vmulq_n_f32(low.val[0], eye.x);
+        translation = vmlaq_n_f32(translation, low.val[1], eye.y);
+        translation = vmlaq_n_f32(translation, high.val[0], eye.z);
+        Mat4 result;
+        vst1q_f32(result.m, low.val[0]);
+        vst1q_f32(result.m + 4, low.val[1]);
+        vst1q_f32(result.m + 8, high.val[0]);
+        vst1q_f32(result.m + 12, vsubq_f32(last, translation));
+        return result;
+    }
+
+    inline Mat4 PerspectiveFovLH(float fieldOfView, float aspect, float nearPlane, float farPlane) {
+        float yScale = 1.0f / std::tan(fieldOfView * 0.5f);
+        float zScale = farPlane / (farPlane - nearPlane);
+        float32x4_t zero = vdupq_n_f32(0.0f);
+        Mat4 result;
+        vst1q_f32(result.m, vsetq_lane_f32(yScale / aspect, zero, 0));
+        vst1q_f32(result.m + 4, vsetq_lane_f32(yScale, zero, 1));
+        vst1q_f32(result.m + 8, vsetq_lane_f32(1.0f, vsetq_lane_f32(zScale, zero, 2), 3));
+        vst1q_f32(result.m + 12, vsetq_lane_f32(-nearPlane * zScale, zero, 2));
+        return result;
+    }
+#else
+    inline Mat4 Multiply(const Mat4 &a, const Mat4 &b) {
+        Mat4 result;
+        for (int column = 0; column < 4; ++column) {
+            for (int row = 0; row < 4; ++row) {
+                result.m[column * 4 + row] = a.m[row] * b.m[column * 4] + a.m[4 + row] * b.m[column * 4 + 1] +
+                                             a.m[8 + row] * b.m[column * 4 + 2] + a.m[12 + row] * b.m[column * 4 + 3];
+            }
+        }
+        return result;
+    }
+
+    inline Vec4 Transform(const Mat4 &matrix, const Vec4 &vector) {
+        const float *m = matrix.m;
+        return {m[0] * vector.x + m[4] * vector.y + m[8] * vector.z + m[12] * vector.w,
+                m[1] * vector.x + m[5] * vector.y + m[9] * vector.z + m[13] * vector.w,
+                m[2] * vector.x + m[6] * vector.y + m[10] * vector.z + m[14] * vector.w,
+                m[3] * vector.x + m[7] * vector.y + m[11] * vector.z + m[15] * vector.w};
+    }
+
+    inline Mat4 Inverse(const Mat4 &matrix) {
+        return Math::InverseScalar(matrix);
+    }
+
+    inline Mat4 LookAtLH(const Vec4 &eye, const Vec4 &target, const Vec4 &up) {
+        float z[3] = {target.x - eye.x, target.y - eye.y, target.z - eye.z};
+        float zScale = 1.0f / std::sqrt(z[0] * z[0] + z[1] * z[1] + z[2] * z[2]);
+        z[0] *= zScale, z[1] *= zScale, z[2] *= zScale;
+        float x[3] = {up.y * z[2] - up.z * z[1], up.z * z[0] - up.x * z[2], up.x * z[1] - up.y * z[0]};
+        float xScale = 1.0f / std::sqrt(x[0] * x[0] + x[1] * x[1] + x[2] * x[2]);
+        x[0] *= xScale, x[1] *= xScale, x[2] *= xScale;
+        float y[3] = {z[1] * x[2] - z[2] * x[1], z[2] * x[0] - z[0] * x[2], z[0] * x[1] - z[1] * x[0]};
+        // the axes are the rows, the translation moves the eye to the origin
+        return {{x[0], y[0], z[0], 0.0f,
+                 x[1], y[1], z[1], 0.0f,
+                 x[2], y[2], z[2], 0.0f,
+                 -(x[0] * eye.x + x[1] * eye.y + x[2] * eye.z), -(y[0] * eye.x + y[1] * eye.y + y[2] * eye.z),
+                 -(z[0] * eye.x + z[1] * eye.y + z[2] * eye.z), 1.0f}};
+    }
+
+    inline Mat4 PerspectiveFovLH(float fieldOfView, float aspect, float nearPlane, float farPlane) {
+        float yScale = 1.0f / std::tan(fieldOfView * 0.5f);
+        float zScale = farPlane / (farPlane - nearPlane);
+        return {{yScale / aspect, 0.0f, 0.0f, 0.0f,
+                 0.0f, yScale, 0.0f, 0.0f,
+                 0.0f, 0.0f, zScale, 1.0f,
+                 0.0f, 0.0f, -nearPlane * zScale, 0.0f}};
+    }
+#endif
+}
@@ -0,0 +1,329 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include "Clock.h"
+#include "GlState.h"
+#include "SkinnedMeshRenderer.h"
+#include "TaskSystem.h"
+
+namespace {
+    // characters skinned per task on the CPU path
+    const size_t SkinGrain = 16;
+
+    // position and color of a skinned vertex
+    const size_t SkinnedFloats = 6;
+
+    // Every character's palette lives in one texture buffer, four texels (the columns) per matrix. A
+    // uniform array would be limited to a few hundred matrices, a texture buffer holds at least 65536 texels.
+    const char *GpuVertexShaderSource = R"glsl(
+#version 330 core
+in vec3 vertexPosition;
+in vec3 vertexColor;
+in uvec4 vertexJoints;
+in vec4 vertexWeights;
+out vec3 fragmentColor;
+uniform mat4 viewProjection;
+uniform int jointCount;
+uniform samplerBuffer palette;
+
+mat4 Joint(uint joint) {
+    int first = (gl_InstanceID * jointCount + int(joint)) * 4;
+    return mat4(texelFetch(palette, first), texelFetch(palette, first + 1), texelFetch(palette, first + 2),
+                texelFetch(palette, first + 3));
+}
+
+void main() {
+    mat4 skin = Joint(vertexJoints.x) * vertexWeights.x + Joint(vertexJoints.y) * vertexWeights.y +
+                Joint(vertexJoints.z) * vertexWeights.z + Joint(vertexJoints.w) * vertexWeights.w;
+    gl_Position = viewProjection * (skin * vec4(vertexPosition, 1.0));
+    fragmentColor = vertexColor;
+}
+)glsl";
+
+    const char *CpuVertexShaderSource = R"glsl(
+#version 330 core
+in vec3 vertexPosition;
+in vec3 vertexColor;
+out vec3 fragmentColor;
+uniform mat4 viewProjection;
+
+void main() {
+    gl_Position = viewProjection * vec4(vertexPosition, 1.0);
+    fragmentColor = vertexColor;
+}
+)glsl";
+
+    const char *FragmentShaderSource = R"glsl(
+#version 330 core
+in vec3 fragmentColor;
+out vec4 color;
+
+void main() {
+    color = vec4(fragmentColor, 1.0);
+}
+)glsl";
+
+    GLuint CompileShader(GLenum type, const char *source) {
+        GLuint shader = glCreateShader(type);
+        glShaderSource(shader, 1, &source, nullptr);
+        glCompileShader(shader);
+        GLint status = 0;
+        glGetShaderiv(shader, GL_COMPILE_STATUS, &status);
+        if (!status) {
+            char log[1024];
+            glGetShaderInfoLog(shader, sizeof(log), nullptr, log);
+            fprintf(stderr, "Skinning shader failed to compile: %s\n", log);
+            glDeleteShader(shader);
+            return 0;
+        }
+        return shader;
+    }
+
+    float Wrap(float time, float duration) {
+        if (duration <= 0.0f) {
+            return 0.0f;
+        }
+        time = std::fmod(time, duration);
+        return time < 0.0f ? time + duration : time;
+    }
+}
+
+bool Gm::SkinnedMeshRenderer::BuildProgram(GLuint &program, const char *vertexSource) {
+    GLuint vertexShader = CompileShader(GL_VERTEX_SHADER, vertexSource);
+    GLuint fragmentShader = CompileShader(GL_FRAGMENT_SHADER, FragmentShaderSource);
+    if (!vertexShader || !fragmentShader) {
+        glDeleteShader(vertexShader);
+        glDeleteShader(fragmentShader);
+        return false;
+    }
+    program = glCreateProgram();
+    glAttachShader(program, vertexShader);
+    glAttachShader(program, fragmentShader);
+    // both programs read the same locations, so either VAO fits either program
+    glBindAttribLocation(program, 0, "vertexPosition");
+    glBindAttribLocation(program, 1, "vertexColor");
+    glBindAttribLocation(program, 2, "vertexJoints");
+    glBindAttribLocation(program, 3, "vertexWeights");
+    glLinkProgram(program);
+    glDeleteShader(vertexShader);
+    glDeleteShader(fragmentShader);
+    GLint status = 0;
+    glGetProgramiv(program, GL_LINK_STATUS, &status);
+    if (!status) {
+        char log[1024];
+        glGetProgramInfoLog(program, sizeof(log), nullptr, log);
+        fprintf(stderr, "Skinning program failed to link: %s\n", log);
+        glDeleteProgram(program);
+        program = 0;
+        return false;
+    }
+    return true;
+}
+
+bool Gm::SkinnedMeshRenderer::Initialize() {
+    if (!GLAD_GL_VERSION_3_2) {
+        return false;
+    }
+    if (!BuildProgram(m_gpuProgram, GpuVertexShaderSource) || !BuildProgram(m_cpuProgram, CpuVertexShaderSource)) {
+        Finalize();
+        return false;
+    }
+    m_gpuViewProjectionLocation = glGetUniformLocation(m_gpuProgram, "viewProjection");
+    m_jointCountLocation = glGetUniformLocation(m_gpuProgram, "jointCount");
+    m_paletteLocation = glGetUniformLocation(m_gpuProgram, "palette");
+    m_cpuViewProjectionLocation = glGetUniformLocation(m_cpuProgram, "viewProjection");
+    glGetIntegerv(GL_MAX_TEXTURE_BUFFER_SIZE, &m_maxPaletteTexels);
+
+    GlState &state = GlState::Current();
+    glGenBuffers(1, &m_meshBuffer);
+    glGenBuffers(1, &m_indexBuffer);
+    glGenBuffers(1, &m_paletteBuffer);
+    glGenBuffers(1, &m_skinnedBuffer);
+    glGenTextures(1, &m_paletteTexture);
+    // a generated name only becomes a buffer once bound, glTexBuffer refuses it before
+    state.BindBuffer(GL_TEXTURE_BUFFER, m_paletteBuffer);
+    state.BindTexture(GL_TEXTURE_BUFFER, m_paletteTexture);
+    glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, m_paletteBuffer);
+    state.BindTexture(GL_TEXTURE_BUFFER, 0);
+
+    glGenVertexArrays(1, &m_gpuVertexArray);
+    state.BindVertexArray(m_gpuVertexArray);
+    state.BindBuffer(GL_ARRAY_BUFFER, m_meshBuffer);
+    GLsizei stride = sizeof(SkinnedVertex);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, stride, (void *) offsetof(SkinnedVertex, position));
+    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, stride, (void *) offsetof(SkinnedVertex, color));
+    // integer attribute, the joints stay indices instead of becoming floats
+    glVertexAttribIPointer(2, 4, GL_UNSIGNED_BYTE, stride, (void *) offsetof(SkinnedVertex, joints));
+    glVertexAttribPointer(3, 4, GL_FLOAT, GL_FALSE, stride, (void *) offsetof(SkinnedVertex, weights));
+    for (GLuint location = 0; location < 4; ++location) {
+        glEnableVertexAttribArray(location);
+    }
+    state.BindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_indexBuffer);
+
+    glGenVertexArrays(1, &m_cpuVertexArray);
+    state.BindVertexArray(m_cpuVertexArray);
+    state.BindBuffer(GL_ARRAY_BUFFER, m_skinnedBuffer);
+    stride = SkinnedFloats * sizeof(float);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, stride, (void *) 0);
+    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, stride, (void *) (3 * sizeof(float)));
+    glEnableVertexAttribArray(0);
+    glEnableVertexAttribArray(1);
+    state.BindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_indexBuffer);
+    state.BindVertexArray(0);
+    return true;
+}
+
+void Gm::SkinnedMeshRenderer::Finalize() {
+    GlState &state = GlState::Current();
+    if (m_gpuProgram) {
+        state.DeleteProgram(m_gpuProgram);
+    }
+    if (m_cpuProgram) {
+        state.DeleteProgram(m_cpuProgram);
+    }
+    if (m_meshBuffer) {
+        GLuint buffers[] = {m_meshBuffer, m_indexBuffer, m_paletteBuffer, m_skinnedBuffer};
+        state.DeleteBuffers(4, buffers);
+        state.DeleteTextures(1, &m_paletteTexture);
+        GLuint vertexArrays[] = {m_gpuVertexArray, m_cpuVertexArray};
+        state.DeleteVertexArrays(2, vertexArrays);
+    }
+    *this = SkinnedMeshRenderer();
+}
+
+void Gm::SkinnedMeshRenderer::SetMesh(const Skeleton &skeleton, const SkinnedVertex *vertices, size_t vertexCount,
+                                      const uint32_t *indices, size_t indexCount) {
+    m_skeleton = skeleton;
+    m_vertices.assign(vertices, vertices + vertexCount);
+    m_indexCount = indexCount;
+    GlState &state = GlState::Current();
+    state.BindBuffer(GL_ARRAY_BUFFER, m_meshBuffer);
+    glBufferData(GL_ARRAY_BUFFER, vertexCount * sizeof(SkinnedVertex), vertices, GL_STATIC_DRAW);
+    // the element buffer is VAO state, bind one of ours before touching it
+    state.BindVertexArray(m_gpuVertexArray);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexCount * sizeof(uint32_t), indices, GL_STATIC_DRAW);
+    state.BindVertexArray(0);
+    // the characters' skeletons changed with it
+    SetCharacters(m_characters.data(), m_worldMatrices.data(), m_characters.size());
+}
+
+uint32_t Gm::SkinnedMeshRenderer::AddClip(AnimationClip clip) {
+    m_clips.push_back(std::move(clip));
+    return (uint32_t) (m_clips.size() - 1);
+}
+
+void Gm::SkinnedMeshRenderer::SetCharacters(const CharacterAnimation *characters, const Mat4 *worldMatrices,
+                                            size_t count) {
+    if (characters != m_characters.data()) {
+        m_characters.assign(characters, characters + count);
+        m_worldMatrices.assign(worldMatrices, worldMatrices + count);
+    }
+    m_palettes.resize(count * m_skeleton.JointCount());
+
+    // colors never change, only the positions are skinned each frame
+    size_t vertexCount = m_vertices.size();
+    m_skinnedVertices.resize(count * vertexCount * SkinnedFloats);
+    for (size_t c = 0; c < count; ++c) {
+        float *out = m_skinnedVertices.data() + c * vertexCount * SkinnedFloats;
+        for (size_t v = 0; v < vertexCount; ++v, out += SkinnedFloats) {
+            std::copy(m_vertices[v].color, m_vertices[v].color + 3, out + 3);
+        }
+    }
+    UpdateDrawArrays();
+    m_stats.characters = count;
+    m_stats.vertices = count * vertexCount;
+}
+
+void Gm::SkinnedMeshRenderer::UpdateDrawArrays() {
+    // the CPU path draws the shared index buffer once per character, offset by its vertices
+    size_t count = m_characters.size();
+    m_drawCounts.assign(count, (GLsizei) m_indexCount);
+    m_drawOffsets.assign(count, nullptr);
+    m_drawBaseVertices.resize(count);
+    for (size_t c = 0; c < count; ++c) {
+        m_drawBaseVertices[c] = (GLint) (c * m_vertices.size());
+    }
+}
+
+void Gm::SkinnedMeshRenderer::Advance(float seconds) {
+    for (CharacterAnimation &character : m_characters) {
+        character.timeA = Wrap(character.timeA + seconds, m_clips[character.clipA].Duration());
+        character.timeB = Wrap(character.timeB + seconds, m_clips[character.clipB].Duration());
+    }
+}
+
+void Gm::SkinnedMeshRenderer::Animate(float extraSeconds) {
+    size_t count = m_characters.size();
+    if (count == 0 || m_skeleton.JointCount() == 0) {
+        return;
+    }
+    double start = Clock::Now();
+    AnimateCharacters(m_skeleton, m_clips, m_characters.data(), m_worldMatrices.data(), count, extraSeconds,
+                      m_palettes.data());
+    double animated = Clock::Now();
+    m_stats.animateMicroseconds = (animated - start) * 1e6;
+
+    m_stats.skinMicroseconds = 0.0;
+    if (m_path != SkinningPath::Cpu) {
+        return;
+    }
+    size_t joints = m_skeleton.JointCount();
+    size_t vertexCount = m_vertices.size();
+    auto skin = [&](size_t begin, size_t end) {
+        for (size_t c = begin; c < end; ++c) {
+            SkinPositions(m_palettes.data() + c * joints, m_vertices.data(), vertexCount,
+                          m_skinnedVertices.data() + c * vertexCount * SkinnedFloats, SkinnedFloats * sizeof(float));
+        }
+    };
+    if (count <= SkinGrain * 2) {
+        skin(0, count);
+    } else {
+        TaskSystem::Instance().ParallelFor(0, count, SkinGrain, skin);
+    }
+    m_stats.skinMicroseconds = (Clock::Now() - animated) * 1e6;
+}
+
+void Gm::SkinnedMeshRenderer::Draw(const Mat4 &viewProjection) {
+    size_t count = m_characters.size();
+    if (count == 0 || m_indexCount == 0) {
+        return;
+    }
+    GlState &state = GlState::Current();
+    if (m_path == SkinningPath::Cpu) {
+        state.UseProgram(m_cpuProgram);
+        glUniformMatrix4fv(m_cpuViewProjectionLocation, 1, GL_FALSE, viewProjection.m);
+        state.BindBuffer(GL_ARRAY_BUFFER, m_skinnedBuffer);
+        // orphan last frame's storage instead of waiting for the draws still reading it
+        size_t bytes = m_skinnedVertices.size() * sizeof(float);
+        glBufferData(GL_ARRAY_BUFFER, bytes, nullptr, GL_STREAM_DRAW);
+        glBufferSubData(GL_ARRAY_BUFFER, 0, bytes, m_skinnedVertices.data());
+        m_stats.uploadBytes = bytes;
+        state.BindVertexArray(m_cpuVertexArray);
+        glMultiDrawElementsBaseVertex(GL_TRIANGLES, m_drawCounts.data(), GL_UNSIGNED_INT, m_drawOffsets.data(),
+                                      (GLsizei) count, m_drawBaseVertices.data());
+        return;
+    }
+
+    size_t joints = m_skeleton.JointCount();
+    state.UseProgram(m_gpuProgram);
+    glUniformMatrix4fv(m_gpuViewProjectionLocation, 1, GL_FALSE, viewProjection.m);
+    glUniform1i(m_jointCountLocation, (GLint) joints);
+    glUniform1i(m_paletteLocation, 0);
+    state.ActiveTexture(GL_TEXTURE0);
+    state.BindTexture(GL_TEXTURE_BUFFER, m_paletteTexture);
+    state.BindVertexArray(m_gpuVertexArray);
+    state.BindBuffer(GL_TEXTURE_BUFFER, m_paletteBuffer);
+    // as many characters per draw as the texture buffer holds palettes for
+    size_t perDraw = std::max<size_t>((size_t) m_maxPaletteTexels / (joints * 4), 1);
+    m_stats.uploadBytes = 0;
+    for (size_t first = 0; first < count; first += perDraw) {
+        size_t characters = std::min(perDraw, count - first);
+        size_t bytes = characters * joints * sizeof(Mat4);
+        glBufferData(GL_TEXTURE_BUFFER, bytes, nullptr, GL_STREAM_DRAW);
+        glBufferSubData(GL_TEXTURE_BUFFER, 0, bytes, m_palettes.data() + first * joints);
+        glDrawElementsInstanced(GL_TRIANGLES, (GLsizei) m_indexCount, GL_UNSIGNED_INT, nullptr,
+                                (GLsizei) characters);
+        m_stats.uploadBytes += bytes;
+    }
+    state.BindTexture(GL_TEXTURE_BUFFER, 0);
+}
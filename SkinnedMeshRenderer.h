@@ -0,0 +1,99 @@
+#pragma once
+
+#include <vector>
+#include "glad/glad.h"
+#include "Animation.h"
+#include "Skinning.h"
+
+namespace Gm {
+    struct SkinnedStats {
+        size_t characters = 0;
+        size_t vertices = 0;
+        // sampling, blending and palettes, then the CPU path's skinning, both on the workers
+        double animateMicroseconds = 0.0;
+        double skinMicroseconds = 0.0;
+        // palettes (GPU path) or skinned vertices (CPU path) sent per frame
+        size_t uploadBytes = 0;
+    };
+
+    // Many copies of one skinned mesh, each playing its own blend of two clips.
+    //
+    // Palettes are built on the worker threads every frame. The GPU path uploads them into a texture buffer
+    // and skins in the vertex shader, all characters in one instanced draw. The CPU path skins into a
+    // streamed vertex buffer (SkinPositions) and draws every character with one multi draw. Both need GL 3.2.
+    class SkinnedMeshRenderer {
+    public:
+        enum class SkinningPath {
+            Gpu,
+            Cpu,
+        };
+
+        bool Initialize();
+
+        void Finalize();
+
+        // the mesh every character uses, bound to `skeleton`; triangles wound like the rest of the scene
+        void SetMesh(const Skeleton &skeleton, const SkinnedVertex *vertices, size_t vertexCount,
+                     const uint32_t *indices, size_t indexCount);
+
+        // returns the index CharacterAnimation refers to the clip by
+        uint32_t AddClip(AnimationClip clip);
+
+        void SetCharacters(const CharacterAnimation *characters, const Mat4 *worldMatrices, size_t count);
+
+        // moves every character's clip times on, wrapping at the clip ends
+        void Advance(float seconds);
+
+        void SetSkinningPath(SkinningPath path) { m_path = path; }
+
+        SkinningPath GetSkinningPath() const { return m_path; }
+
+        size_t CharacterCount() const { return m_characters.size(); }
+
+        // pose every character `extraSeconds` past its clip times, e.g. to interpolate between simulation steps
+        void Animate(float extraSeconds);
+
+        // draw the poses of the last Animate
+        void Draw(const Mat4 &viewProjection);
+
+        const SkinnedStats &GetStats() const { return m_stats; }
+
+    private:
+        bool BuildProgram(GLuint &program, const char *vertexSource);
+
+        void UpdateDrawArrays();
+
+        GLuint m_gpuProgram = 0;
+        GLuint m_cpuProgram = 0;
+        GLint m_gpuViewProjectionLocation = -1, m_jointCountLocation = -1, m_paletteLocation = -1;
+        GLint m_cpuViewProjectionLocation = -1;
+
+        // the bind pose mesh with joints and weights, and its indices shared by both paths
+        GLuint m_meshBuffer = 0;
+        GLuint m_indexBuffer = 0;
+        GLuint m_gpuVertexArray = 0;
+        GLuint m_paletteBuffer = 0;
+        GLuint m_paletteTexture = 0;
+        GLint m_maxPaletteTexels = 0;
+        // skinned positions and colors of every character
+        GLuint m_skinnedBuffer = 0;
+        GLuint m_cpuVertexArray = 0;
+
+        Skeleton m_skeleton;
+        std::vector<SkinnedVertex> m_vertices;
+        size_t m_indexCount = 0;
+        std::vector<AnimationClip> m_clips;
+        std::vector<CharacterAnimation> m_characters;
+        std::vector<Mat4> m_worldMatrices;
+        // JointCount() matrices per character
+        std::vector<Mat4> m_palettes;
+        // 6 floats per vertex of every character, colors filled in once
+        std::vector<float> m_skinnedVertices;
+        std::vector<GLsizei> m_drawCounts;
+        std::vector<const void *> m_drawOffsets;
+        std::vector<GLint> m_drawBaseVertices;
+
+        SkinningPath m_path = SkinningPath::Gpu;
+        SkinnedStats m_stats;
+    };
+}
@@ -0,0 +1,72 @@
+#include "CpuFeatures.h"
+#include "Skinning.h"
+
+#if GM_SIMD_X86
+#include <immintrin.h>
+#endif
+
+namespace {
+    inline float *OutputAt(float *positions, size_t stride, size_t index) {
+        return reinterpret_cast<float *>(reinterpret_cast<char *>(positions) + index * stride);
+    }
+
+#if GM_SIMD_X86
+    GM_TARGET_AVX2
+    void SkinAvx2(const Gm::Mat4 *palette, const Gm::SkinnedVertex *vertices, size_t count, float *positions,
+                  size_t stride) {
+        for (size_t i = 0; i < count; ++i) {
+            const Gm::SkinnedVertex &vertex = vertices[i];
+            // columns 0 and 1, and 2 and 3, of the blended matrix
+            __m256 columns01 = _mm256_setzero_ps(), columns23 = _mm256_setzero_ps();
+            for (int influence = 0; influence < 4; ++influence) {
+                const float *matrix = palette[vertex.joints[influence]].m;
+                __m256 weight = _mm256_set1_ps(vertex.weights[influence]);
+                columns01 = _mm256_fmadd_ps(weight, _mm256_loadu_ps(matrix), columns01);
+                columns23 = _mm256_fmadd_ps(weight, _mm256_loadu_ps(matrix + 8), columns23);
+            }
+            // (column0 * x | column1 * y) + (column2 * z | column3), then the two halves added
+            __m256 xy = _mm256_insertf128_ps(_mm256_set1_ps(vertex.position[0]), _mm_set1_ps(vertex.position[1]), 1);
+            __m256 z1 = _mm256_insertf128_ps(_mm256_set1_ps(vertex.position[2]), _mm_set1_ps(1.0f), 1);
+            __m256 sum = _mm256_fmadd_ps(columns01, xy, _mm256_mul_ps(columns23, z1));
+            __m128 result = _mm_add_ps(_mm256_castps256_ps128(sum), _mm256_extractf128_ps(sum, 1));
+            float *output = OutputAt(positions, stride, i);
+            _mm_storel_pi(reinterpret_cast<__m64 *>(output), result);
+            _mm_store_ss(output + 2, _mm_movehl_ps(result, result));
+        }
+    }
+#endif
+}
+
+void Gm::SkinPositionsScalar(const Mat4 *palette, const SkinnedVertex *vertices, size_t count, float *positions,
+                             size_t stride) {
+    for (size_t i = 0; i < count; ++i) {
+        const SkinnedVertex &vertex = vertices[i];
+        float blended[12] = {};
+        for (int influence = 0; influence < 4; ++influence) {
+            const float *matrix = palette[vertex.joints[influence]].m;
+            float weight = vertex.weights[influence];
+            // the bottom row of an affine matrix is 0 0 0 1, only the upper three rows matter
+            for (int column = 0; column < 4; ++column) {
+                for (int row = 0; row < 3; ++row) {
+                    blended[column * 3 + row] += weight * matrix[column * 4 + row];
+                }
+            }
+        }
+        float *output = OutputAt(positions, stride, i);
+        for (int row = 0; row < 3; ++row) {
+            output[row] = blended[row] * vertex.position[0] + blended[3 + row] * vertex.position[1] +
+                          blended[6 + row] * vertex.position[2] + blended[9 + row];
+        }
+    }
+}
+
+void Gm::SkinPositions(const Mat4 *palette, const SkinnedVertex *vertices, size_t count, float *positions,
+                       size_t stride) {
+#if GM_SIMD_X86
+    if (Cpu::HasAvx2()) {
+        SkinAvx2(palette, vertices, count, positions, stride);
+        return;
+    }
+#endif
+    SkinPositionsScalar(palette, vertices, count, positions, stride);
+}
@@ -0,0 +1,24 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include "SimdMath.h"
+
+namespace Gm {
+    struct SkinnedVertex {
+        float position[3];
+        float color[3];
+        // up to four joints, unused ones with a weight of 0; the weights add up to 1
+        uint8_t joints[4];
+        float weights[4];
+    };
+
+    // Linear blend skinning: each position becomes the weighted sum of its joints' palette matrices applied to
+    // it, written as three floats `stride` bytes apart. AVX2 blends the four matrices two columns per register.
+    void SkinPositions(const Mat4 *palette, const SkinnedVertex *vertices, size_t count, float *positions,
+                       size_t stride);
+
+    // Same as SkinPositions without SIMD, the reference the vector kernel must match.
+    void SkinPositionsScalar(const Mat4 *palette, const SkinnedVertex *vertices, size_t count, float *positions,
+                             size_t stride);
+}
@@ -0,0 +1,130 @@
+#include "TaskSystem.h"
+
+namespace {
+    // index of the calling thread's queue in the TaskSystem it works for, -1 outside workers
+    thread_local const Gm::TaskSystem *t_owner = nullptr;
+    thread_local unsigned t_queueIndex = 0;
+}
+
+Gm::TaskSystem::TaskSystem(unsigned workerCount) {
+    if (workerCount == 0) {
+        unsigned hardware = std::thread::hardware_concurrency();
+        workerCount = hardware > 1 ? hardware - 1 : 1;
+    }
+    for (unsigned i = 0; i <= workerCount; ++i) {
+        m_queues.emplace_back(new Queue);
+    }
+    for (unsigned i = 0; i < workerCount; ++i) {
+        m_threads.emplace_back([this, i] { WorkerLoop(i); });
+    }
+}
+
+Gm::TaskSystem::~TaskSystem() {
+    {
+        std::lock_guard<std::mutex> lock(m_sleepMutex);
+        m_stop = true;
+    }
+    m_wake.notify_all();
+    for (std::thread &thread : m_threads) {
+        thread.join();
+    }
+}
+
+Gm::TaskSystem &Gm::TaskSystem::Instance() {
+    static TaskSystem instance;
+    return instance;
+}
+
+void Gm::TaskSystem::Run(TaskGroup &group, std::function<void()> task) {
+    group.m_pending.fetch_add(1, std::memory_order_relaxed);
+    unsigned queueIndex = t_owner == this ? t_queueIndex : (unsigned) m_threads.size();
+    {
+        std::lock_guard<std::mutex> lock(m_queues[queueIndex]->mutex);
+        m_queues[queueIndex]->tasks.push_back({std::move(task), &group});
+    }
+    m_queued.fetch_add(1, std::memory_order_release);
+    // a worker that just found nothing to do must either see the new count or be woken
+    { std::lock_guard<std::mutex> lock(m_sleepMutex); }
+    m_wake.notify_one();
+}
+
+void Gm::TaskSystem::Wait(TaskGroup &group) {
+    unsigned queueIndex = t_owner == this ? t_queueIndex : (unsigned) m_threads.size();
+    while (!group.Done()) {
+        if (!TryRunOne(queueIndex)) {
+            std::this_thread::yield();
+        }
+    }
+}
+
+void Gm::TaskSystem::ParallelFor(size_t begin, size_t end, size_t grain,
+                                 const std::function<void(size_t, size_t)> &function) {
+    if (grain == 0) {
+        grain = 1;
+    }
+    TaskGroup group;
+    // keep the first chunk for the calling thread
+    for (size_t chunk = begin + grain; chunk < end; chunk += grain) {
+        size_t chunkEnd = chunk + grain < end ? chunk + grain : end;
+        Run(group, [&function, chunk, chunkEnd] { function(chunk, chunkEnd); });
+    }
+    function(begin, begin + grain < end ? begin + grain : end);
+    Wait(group);
+}
+
+void Gm::TaskSystem::WorkerLoop(unsigned index) {
+    t_owner = this;
+    t_queueIndex = index;
+    while (true) {
+        if (TryRunOne(index)) {
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(m_sleepMutex);
+        m_wake.wait(lock, [this] { return m_stop || m_queued.load(std::memory_order_acquire) > 0; });
+        if (m_stop) {
+            return;
+        }
+    }
+}
+
+bool Gm::TaskSystem::TryRunOne(unsigned queueIndex) {
+    Task task;
+    if (Pop(queueIndex, task) || Steal(queueIndex, task)) {
+        Execute(task);
+        return true;
+    }
+    return false;
+}
+
+bool Gm::TaskSystem::Pop(unsigned queueIndex, Task &task) {
+    Queue &queue = *m_queues[queueIndex];
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    if (queue.tasks.empty()) {
+        return false;
+    }
+    // newest first, its data is most likely still in cache
+    task = std::move(queue.tasks.back());
+    queue.tasks.pop_back();
+    return true;
+}
+
+bool Gm::TaskSystem::Steal(unsigned thiefIndex, Task &task) {
+    size_t queueCount = m_queues.size();
+    for (size_t offset = 1; offset < queueCount; ++offset) {
+        Queue &queue = *m_queues[(thiefIndex + offset) % queueCount];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if (!queue.tasks.empty()) {
+            // oldest first, it is usually the biggest piece of work left
+            task = std::move(queue.tasks.front());
+            queue.tasks.pop_front();
+            return true;
+        }
+    }
+    return false;
+}
+
+void Gm::TaskSystem::Execute(Task &task) {
+    m_queued.fetch_sub(1, std::memory_order_relaxed);
+    task.function();
+    task.group->m_pending.fetch_sub(1, std::memory_order_acq_rel);
+}
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace Gm {
+    // Work-stealing thread pool. Every worker owns a queue, pushes and pops its own
+    // work at the back and steals from the front of the others when it runs dry.
+    // Threads that are not workers (the GL thread) push into a shared queue and
+    // help executing tasks while they Wait.
+    class TaskSystem {
+    public:
+        // counts the unfinished tasks started with Run
+        class TaskGroup {
+        public:
+            bool Done() const { return m_pending.load(std::memory_order_acquire) == 0; }
+
+        private:
+            friend class TaskSystem;
+
+            std::atomic<int> m_pending{0};
+        };
+
+        // workerCount == 0 picks one worker per hardware thread minus the calling thread
+        explicit TaskSystem(unsigned workerCount = 0);
+
+        ~TaskSystem();
+
+        // the pool shared by the engine
+        static TaskSystem &Instance();
+
+        void Run(TaskGroup &group, std::function<void()> task);
+
+        // runs queued tasks until `group` is done
+        void Wait(TaskGroup &group);
+
+        // calls function(begin, end) on sub ranges of at most `grain` items, in parallel
+        void ParallelFor(size_t begin, size_t end, size_t grain, const std::function<void(size_t, size_t)> &function);
+
+        unsigned WorkerCount() const { return (unsigned) m_threads.size(); }
+
+    private:
+        struct Task {
+            std::function<void()> function;
+            TaskGroup *group;
+        };
+
+        struct Queue {
+            std::mutex mutex;
+            std::deque<Task> tasks;
+        };
+
+        void WorkerLoop(unsigned index);
+
+        bool TryRunOne(unsigned queueIndex);
+
+        bool Pop(unsigned queueIndex, Task &task);
+
+        bool Steal(unsigned thiefIndex, Task &task);
+
+        void Execute(Task &task);
+
+        // one queue per worker plus the shared queue of outside threads at the end
+        std::vector<std::unique_ptr<Queue>> m_queues;
+        std::vector<std::thread> m_threads;
+
+        std::mutex m_sleepMutex;
+        std::condition_variable m_wake;
+        std::atomic<int> m_queued{0};
+        std::atomic<bool> m_stop{false};
+    };
+}
@@ -0,0 +1,539 @@
+#include <algorithm>
+#include <cstring>
+#include "GlState.h"
+#include "TaskSystem.h"
+#include "TextureAtlas.h"
+
+void Gm::SkylinePacker::Reset(uint32_t width, uint32_t height) {
+    m_width = width;
+    m_height = height;
+    m_skyline.assign(1, Segment{0, 0, width});
+}
+
+bool Gm::SkylinePacker::Fit(size_t index, uint32_t width, uint32_t height, uint32_t &y, uint64_t &waste) const {
+    uint32_t x = m_skyline[index].x;
+    if (x + width > m_width) {
+        return false;
+    }
+    // the rectangle rests on the highest segment it spans
+    y = 0;
+    uint32_t end = x + width;
+    for (size_t i = index; i < m_skyline.size() && m_skyline[i].x < end; ++i) {
+        y = std::max(y, m_skyline[i].y);
+    }
+    if (y + height > m_height) {
+        return false;
+    }
+    waste = 0;
+    for (size_t i = index; i < m_skyline.size() && m_skyline[i].x < end; ++i) {
+        uint32_t covered = std::min(end, m_skyline[i].x + m_skyline[i].width) - m_skyline[i].x;
+        waste += (uint64_t) (y - m_skyline[i].y) * covered;
+    }
+    return true;
+}
+
+bool Gm::SkylinePacker::Insert(uint32_t width, uint32_t height, AtlasRect &rect) {
+    size_t best = m_skyline.size();
+    uint32_t bestBottom = ~0u, bestY = 0;
+    uint64_t bestWaste = ~0ull;
+    for (size_t i = 0; i < m_skyline.size(); ++i) {
+        uint32_t y;
+        uint64_t waste;
+        if (Fit(i, width, height, y, waste) &&
+            (y + height < bestBottom || (y + height == bestBottom && waste < bestWaste))) {
+            best = i;
+            bestBottom = y + height;
+            bestY = y;
+            bestWaste = waste;
+        }
+    }
+    if (best == m_skyline.size()) {
+        return false;
+    }
+    rect.x = m_skyline[best].x;
+    rect.y = bestY;
+    rect.width = width;
+    rect.height = height;
+
+    // the new segment replaces what it covers, a segment sticking out on the right is cut
+    uint32_t end = rect.x + width;
+    size_t last = best;
+    while (last < m_skyline.size() && m_skyline[last].x + m_skyline[last].width <= end) {
+        ++last;
+    }
+    if (last < m_skyline.size() && m_skyline[last].x < end) {
+        m_skyline[last].width -= end - m_skyline[last].x;
+        m_skyline[last].x = end;
+    }
+    m_skyline.erase(m_skyline.begin() + best, m_skyline.begin() + last);
+    m_skyline.insert(m_skyline.begin() + best, Segment{rect.x, bestBottom, width});
+    for (size_t i = 1; i < m_skyline.size();) {
+        if (m_skyline[i - 1].y == m_skyline[i].y) {
+            m_skyline[i - 1].width += m_skyline[i].width;
+            m_skyline.erase(m_skyline.begin() + i);
+        } else {
+            ++i;
+        }
+    }
+    return true;
+}
+
+uint32_t Gm::SkylinePacker::UsedHeight() const {
+    uint32_t height = 0;
+    for (const Segment &segment : m_skyline) {
+        height = std::max(height, segment.y);
+    }
+    return height;
+}
+
+void Gm::MaxRectsPacker::Reset(uint32_t width, uint32_t height) {
+    m_width = width;
+    m_height = height;
+    m_usedHeight = 0;
+    AtlasRect page;
+    page.width = width;
+    page.height = height;
+    m_free.assign(1, page);
+}
+
+bool Gm::MaxRectsPacker::Insert(uint32_t width, uint32_t height, AtlasRect &rect) {
+    size_t best = m_free.size();
+    uint32_t bestBottom = ~0u, bestShort = ~0u;
+    for (size_t i = 0; i < m_free.size(); ++i) {
+        const AtlasRect &free = m_free[i];
+        if (width > free.width || height > free.height) {
+            continue;
+        }
+        uint32_t bottom = free.y + height;
+        uint32_t shortSide = std::min(free.width - width, free.height - height);
+        if (bottom < bestBottom || (bottom == bestBottom && shortSide < bestShort)) {
+            best = i;
+            bestBottom = bottom;
+            bestShort = shortSide;
+        }
+    }
+    if (best == m_free.size()) {
+        return false;
+    }
+    rect.x = m_free[best].x;
+    rect.y = m_free[best].y;
+    rect.width = width;
+    rect.height = height;
+    SplitFree(rect);
+    PruneFree();
+    m_usedHeight = std::max(m_usedHeight, rect.y + height);
+    return true;
+}
+
+void Gm::MaxRectsPacker::SplitFree(const AtlasRect &used) {
+    m_split.clear();
+    for (const AtlasRect &free : m_free) {
+        if (used.x >= free.x + free.width || used.x + used.width <= free.x ||
+            used.y >= free.y + free.height || used.y + used.height <= free.y) {
+            m_split.push_back(free);
+            continue;
+        }
+        // what's left of the free rectangle on each side of the used one, overlapping each other
+        if (used.x > free.x) {
+            AtlasRect left = free;
+            left.width = used.x - free.x;
+            m_split.push_back(left);
+        }
+        if (used.x + used.width < free.x + free.width) {
+            AtlasRect right = free;
+            right.x = used.x + used.width;
+            right.width = free.x + free.width - right.x;
+            m_split.push_back(right);
+        }
+        if (used.y > free.y) {
+            AtlasRect top = free;
+            top.height = used.y - free.y;
+            m_split.push_back(top);
+        }
+        if (used.y + used.height < free.y + free.height) {
+            AtlasRect bottom = free;
+            bottom.y = used.y + used.height;
+            bottom.height = free.y + free.height - bottom.y;
+            m_split.push_back(bottom);
+        }
+    }
+    m_free.swap(m_split);
+}
+
+void Gm::MaxRectsPacker::PruneFree() {
+    auto contains = [](const AtlasRect &outer, const AtlasRect &inner) {
+        return inner.x >= outer.x && inner.y >= outer.y && inner.x + inner.width <= outer.x + outer.width &&
+               inner.y + inner.height <= outer.y + outer.height;
+    };
+    // a free rectangle inside another one is redundant, of two equal ones the first stays
+    for (size_t i = 0; i < m_free.size(); ++i) {
+        for (size_t j = i + 1; j < m_free.size();) {
+            if (contains(m_free[i], m_free[j])) {
+                m_free[j] = m_free.back();
+                m_free.pop_back();
+            } else if (contains(m_free[j], m_free[i])) {
+                m_free[i] = m_free[j];
+                m_free[j] = m_free.back();
+                m_free.pop_back();
+                j = i + 1;
+            } else {
+                ++j;
+            }
+        }
+    }
+}
+
+namespace {
+    uint32_t RoundUp(uint32_t value, uint32_t multiple) {
+        return (value + multiple - 1) / multiple * multiple;
+    }
+
+    struct Slot {
+        // into the sources
+        size_t source;
+        // the texture and its gutter
+        uint32_t width, height;
+        // gutter left of and above the texture, a multiple of the alignment
+        uint32_t inset;
+        Gm::AtlasRect rect;
+        uint32_t page;
+    };
+
+    // places every slot on a page of `width` x `height`, opening pages as they fill; false if a slot doesn't
+    // fit an empty page or more than `maxPages` are needed
+    template<typename Packer>
+    bool PackSlots(std::vector<Slot> &slots, uint32_t width, uint32_t height, size_t maxPages,
+                   std::vector<uint32_t> &usedHeights) {
+        std::vector<Packer> pages;
+        for (Slot &slot : slots) {
+            bool placed = false;
+            for (size_t page = 0; page < pages.size() && !placed; ++page) {
+                if (pages[page].Insert(slot.width, slot.height, slot.rect)) {
+                    slot.page = (uint32_t) page;
+                    placed = true;
+                }
+            }
+            if (!placed) {
+                if (pages.size() == maxPages) {
+                    return false;
+                }
+                pages.emplace_back();
+                pages.back().Reset(width, height);
+                if (!pages.back().Insert(slot.width, slot.height, slot.rect)) {
+                    return false;
+                }
+                slot.page = (uint32_t) (pages.size() - 1);
+            }
+        }
+        usedHeights.clear();
+        for (const Packer &page : pages) {
+            usedHeights.push_back(page.UsedHeight());
+        }
+        return true;
+    }
+
+    bool PackSlots(Gm::AtlasPacking packing, std::vector<Slot> &slots, uint32_t width, uint32_t height,
+                   size_t maxPages, std::vector<uint32_t> &usedHeights) {
+        if (packing == Gm::AtlasPacking::Skyline) {
+            return PackSlots<Gm::SkylinePacker>(slots, width, height, maxPages, usedHeights);
+        }
+        return PackSlots<Gm::MaxRectsPacker>(slots, width, height, maxPages, usedHeights);
+    }
+
+    // the first `levels` levels of an image
+    Gm::Image FirstLevels(const Gm::Image &image, size_t levels) {
+        Gm::Image result;
+        result.width = image.width;
+        result.height = image.height;
+        result.format = image.format;
+        result.levels.assign(image.levels.begin(), image.levels.begin() + levels);
+        size_t end = result.levels.back().offset + image.LevelBytes(levels - 1);
+        result.texels.assign(image.texels.begin(), image.texels.begin() + end);
+        return result;
+    }
+
+    // a level of a source into its slot on the page level, the gutter on every side repeating the nearest edge
+    void CopyToSlot(const Gm::Image &source, size_t level, const Slot &slot, uint32_t shift, Gm::Image &page,
+                    size_t pageLevel) {
+        const Gm::ImageLevel &from = source.levels[level];
+        const Gm::ImageLevel &to = page.levels[pageLevel];
+        const uint8_t *texels = source.LevelTexels(level);
+        uint32_t x0 = slot.rect.x >> shift, y0 = slot.rect.y >> shift;
+        uint32_t width = std::max(slot.width >> shift, 1u), height = std::max(slot.height >> shift, 1u);
+        uint32_t inset = slot.inset >> shift;
+        uint32_t inside = std::min(from.width, width - std::min(inset, width));
+        for (uint32_t y = 0; y < height; ++y) {
+            uint32_t row = std::min(y - std::min(y, inset), from.height - 1);
+            const uint8_t *in = texels + (size_t) row * from.width * 4;
+            uint8_t *out = page.texels.data() + to.offset + ((size_t) (y0 + y) * to.width + x0) * 4;
+            for (uint32_t x = 0; x < inset && x < width; ++x) {
+                std::memcpy(out + x * 4, in, 4);
+            }
+            std::memcpy(out + (size_t) inset * 4, in, (size_t) inside * 4);
+            for (uint32_t x = inset + inside; x < width; ++x) {
+                std::memcpy(out + x * 4, in + (size_t) (from.width - 1) * 4, 4);
+            }
+        }
+    }
+
+    Gm::ImportOptions CompressOptions(const Gm::AtlasOptions &options, Gm::TextureFormat format) {
+        Gm::ImportOptions import;
+        import.format = format;
+        import.quality = options.quality;
+        import.parallel = options.parallel;
+        return import;
+    }
+
+    // same sized textures of one format as the layers of an array binding
+    void PackArray(const std::vector<Gm::AtlasSource> &sources, const std::vector<size_t> &members,
+                   const Gm::AtlasOptions &options, Gm::TexturePack &pack) {
+        const Gm::AtlasSource &first = sources[members[0]];
+        size_t levels = first.image->LevelCount();
+        for (size_t member : members) {
+            levels = std::min(levels, sources[member].image->LevelCount());
+        }
+        Gm::AtlasBinding binding;
+        // what CompressImage will code the layers into
+        binding.format = Gm::SupportedTextureFormat(first.format, first.srgb);
+        binding.srgb = first.srgb;
+        binding.width = first.image->width;
+        binding.height = first.image->height;
+        binding.layers.resize(members.size());
+        uint32_t index = (uint32_t) pack.bindings.size();
+        for (size_t layer = 0; layer < members.size(); ++layer) {
+            binding.layers[layer] = FirstLevels(*sources[members[layer]].image, levels);
+            Gm::CompressImage(binding.layers[layer], CompressOptions(options, binding.format));
+            Gm::AtlasEntry &entry = pack.entries[members[layer]];
+            entry.binding = index;
+            entry.layer = (uint32_t) layer;
+        }
+        pack.bindings.push_back(std::move(binding));
+        pack.stats.arrayTextures += members.size();
+    }
+
+    // small textures of one format onto pages, the pages as the layers of an array binding
+    void PackAtlas(const std::vector<Gm::AtlasSource> &sources, const std::vector<size_t> &members,
+                   const Gm::AtlasOptions &options, Gm::TexturePack &pack) {
+        uint32_t align = 1u << (options.mipLevels - 1);
+        std::vector<Slot> slots;
+        uint64_t slotArea = 0;
+        uint32_t largest = align;
+        size_t levels = options.mipLevels;
+        for (size_t member : members) {
+            const Gm::Image &image = *sources[member].image;
+            Slot slot;
+            slot.source = member;
+            slot.inset = RoundUp(options.padding, align);
+            slot.width = RoundUp(slot.inset + image.width + options.padding, align);
+            slot.height = RoundUp(slot.inset + image.height + options.padding, align);
+            slot.page = 0;
+            slotArea += (uint64_t) slot.width * slot.height;
+            largest = std::max(largest, std::max(slot.width, slot.height));
+            levels = std::min(levels, image.LevelCount());
+            slots.push_back(slot);
+        }
+        // tallest first, which keeps the skyline flat and leaves MaxRects the small ones for the holes
+        std::sort(slots.begin(), slots.end(), [](const Slot &a, const Slot &b) {
+            return a.height != b.height ? a.height > b.height : a.width > b.width;
+        });
+
+        // the smallest square page all of them fit on, else as many full pages as it takes
+        uint32_t side = align;
+        while (side < options.pageSize && ((uint64_t) side * side < slotArea || side < largest)) {
+            side *= 2;
+        }
+        std::vector<uint32_t> usedHeights;
+        bool packed = false;
+        for (side = std::min(side, options.pageSize); side < options.pageSize && !packed; side *= 2) {
+            packed = PackSlots(options.packing, slots, side, side, 1, usedHeights);
+        }
+        if (!packed) {
+            side = options.pageSize;
+            packed = PackSlots(options.packing, slots, side, side, ~size_t(0), usedHeights);
+        } else {
+            side /= 2;
+        }
+        if (!packed) {
+            // some slot is larger than a page, maxAtlasedSize over pageSize
+            return;
+        }
+        uint32_t pageWidth = side, pageHeight = side;
+        if (usedHeights.size() == 1) {
+            // a single page only needs to be as high as what's on it
+            pageHeight = RoundUp(std::max(usedHeights[0], 1u), std::max(align, 4u));
+        }
+
+        Gm::AtlasBinding binding;
+        binding.format = Gm::SupportedTextureFormat(sources[members[0]].format, sources[members[0]].srgb);
+        binding.srgb = sources[members[0]].srgb;
+        binding.atlas = true;
+        binding.width = pageWidth;
+        binding.height = pageHeight;
+        binding.layers.resize(usedHeights.size());
+        for (Gm::Image &page : binding.layers) {
+            page.width = pageWidth;
+            page.height = pageHeight;
+            size_t bytes = 0;
+            for (size_t level = 0; level < levels; ++level) {
+                uint32_t width = std::max(pageWidth >> level, 1u), height = std::max(pageHeight >> level, 1u);
+                page.levels.push_back(Gm::ImageLevel{bytes, width, height});
+                bytes += (size_t) width * height * 4;
+            }
+            // what's between the slots stays transparent black
+            page.texels.assign(bytes, 0);
+        }
+        // slots don't overlap, every one is copied on its own
+        auto copy = [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; ++i) {
+                const Gm::Image &image = *sources[slots[i].source].image;
+                for (size_t level = 0; level < levels; ++level) {
+                    CopyToSlot(image, level, slots[i], (uint32_t) level, binding.layers[slots[i].page], level);
+                }
+            }
+        };
+        if (options.parallel && slots.size() > 16) {
+            Gm::TaskSystem::Instance().ParallelFor(0, slots.size(), 8, copy);
+        } else {
+            copy(0, slots.size());
+        }
+        for (Gm::Image &page : binding.layers) {
+            Gm::CompressImage(page, CompressOptions(options, binding.format));
+        }
+
+        uint32_t index = (uint32_t) pack.bindings.size();
+        uint64_t texels = 0;
+        for (const Slot &slot : slots) {
+            const Gm::Image &image = *sources[slot.source].image;
+            Gm::AtlasEntry &entry = pack.entries[slot.source];
+            entry.binding = index;
+            entry.layer = slot.page;
+            entry.rect = slot.rect;
+            entry.rect.x += slot.inset;
+            entry.rect.y += slot.inset;
+            entry.rect.width = image.width;
+            entry.rect.height = image.height;
+            entry.uvOffset[0] = (float) entry.rect.x / pageWidth;
+            entry.uvOffset[1] = (float) entry.rect.y / pageHeight;
+            entry.uvScale[0] = (float) image.width / pageWidth;
+            entry.uvScale[1] = (float) image.height / pageHeight;
+            texels += (uint64_t) image.width * image.height;
+        }
+        pack.bindings.push_back(std::move(binding));
+        pack.stats.atlasedTextures += slots.size();
+        pack.stats.pages += usedHeights.size();
+        // summed up over the atlases in PackTextures
+        pack.stats.packingEfficiency += (double) texels;
+    }
+}
+
+void Gm::PackTextures(const std::vector<AtlasSource> &sources, const AtlasOptions &options, TexturePack &pack) {
+    pack.bindings.clear();
+    pack.entries.assign(sources.size(), AtlasEntry());
+    pack.stats = AtlasStats();
+    pack.stats.textures = sources.size();
+
+    // one pass per format, the sources in their order
+    std::vector<char> grouped(sources.size(), 0);
+    for (size_t first = 0; first < sources.size(); ++first) {
+        if (grouped[first] || sources[first].image == nullptr || sources[first].image->LevelCount() == 0) {
+            continue;
+        }
+        std::vector<size_t> group;
+        for (size_t i = first; i < sources.size(); ++i) {
+            if (!grouped[i] && sources[i].image != nullptr && sources[i].image->LevelCount() != 0 &&
+                sources[i].format == sources[first].format && sources[i].srgb == sources[first].srgb) {
+                grouped[i] = 1;
+                group.push_back(i);
+            }
+        }
+        std::vector<char> arrayed(sources.size(), 0);
+        for (size_t i = 0; i < group.size(); ++i) {
+            const Image &image = *sources[group[i]].image;
+            if (arrayed[group[i]]) {
+                continue;
+            }
+            std::vector<size_t> same;
+            for (size_t j = i; j < group.size(); ++j) {
+                const Image &other = *sources[group[j]].image;
+                if (other.width == image.width && other.height == image.height) {
+                    same.push_back(group[j]);
+                }
+            }
+            if (same.size() >= std::max<size_t>(options.minArrayLayers, 1)) {
+                for (size_t member : same) {
+                    arrayed[member] = 1;
+                }
+                PackArray(sources, same, options, pack);
+            }
+        }
+        std::vector<size_t> atlased;
+        for (size_t member : group) {
+            const Image &image = *sources[member].image;
+            if (!arrayed[member] && image.width <= options.maxAtlasedSize && image.height <= options.maxAtlasedSize) {
+                atlased.push_back(member);
+            }
+        }
+        if (!atlased.empty()) {
+            PackAtlas(sources, atlased, options, pack);
+        }
+    }
+
+    uint64_t pageTexels = 0;
+    size_t unbound = 0;
+    for (const AtlasBinding &binding : pack.bindings) {
+        if (binding.atlas) {
+            pageTexels += (uint64_t) binding.width * binding.height * binding.layers.size();
+        }
+    }
+    for (const AtlasEntry &entry : pack.entries) {
+        unbound += entry.binding == AtlasEntry::NoBinding;
+    }
+    pack.stats.packingEfficiency = pageTexels != 0 ? pack.stats.packingEfficiency / pageTexels : 0.0;
+    pack.stats.bindsBefore = sources.size();
+    pack.stats.bindsAfter = pack.bindings.size() + unbound;
+}
+
+GLuint Gm::CreateAtlasTexture(const AtlasBinding &binding) {
+    GLuint name;
+    glGenTextures(1, &name);
+    GlState::Current().BindTexture(GL_TEXTURE_2D_ARRAY, name);
+    GLenum internalFormat = TextureInternalFormat(binding.format, binding.srgb);
+    const Image &first = binding.layers[0];
+    // every layer's level back to back, which is how glTexImage3D takes them
+    std::vector<uint8_t> level;
+    for (size_t i = 0; i < first.LevelCount(); ++i) {
+        size_t bytes = first.LevelBytes(i);
+        level.resize(bytes * binding.layers.size());
+        for (size_t layer = 0; layer < binding.layers.size(); ++layer) {
+            std::memcpy(level.data() + layer * bytes, binding.layers[layer].LevelTexels(i), bytes);
+        }
+        GLsizei width = first.levels[i].width, height = first.levels[i].height;
+        GLsizei layers = (GLsizei) binding.layers.size();
+        if (binding.format == TextureFormat::Rgba8) {
+            glTexImage3D(GL_TEXTURE_2D_ARRAY, (GLint) i, internalFormat, width, height, layers, 0, GL_RGBA,
+                         GL_UNSIGNED_BYTE, level.data());
+        } else {
+            glCompressedTexImage3D(GL_TEXTURE_2D_ARRAY, (GLint) i, internalFormat, width, height, layers, 0,
+                                   (GLsizei) level.size(), level.data());
+        }
+    }
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, (GLint) first.LevelCount() - 1);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    // the atlas pages' gutters take over from the edge clamp inside, arrays may repeat
+    GLint wrap = binding.atlas ? GL_CLAMP_TO_EDGE : GL_REPEAT;
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, wrap);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, wrap);
+    return name;
+}
+
+void Gm::RemapUvs(const AtlasEntry &entry, void *uvs, size_t count, size_t stride) {
+    uint8_t *bytes = (uint8_t *) uvs;
+    for (size_t i = 0; i < count; ++i, bytes += stride) {
+        float uv[2];
+        std::memcpy(uv, bytes, sizeof(uv));
+        uv[0] = entry.uvOffset[0] + uv[0] * entry.uvScale[0];
+        uv[1] = entry.uvOffset[1] + uv[1] * entry.uvScale[1];
+        std::memcpy(bytes, uv, sizeof(uv));
+    }
+}
@@ -0,0 +1,147 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "glad/glad.h"
+#include "ImageImport.h"
+
+namespace Gm {
+    struct AtlasRect {
+        uint32_t x = 0, y = 0;
+        uint32_t width = 0, height = 0;
+    };
+
+    // Bottom-left skyline: the page is the outline of what's placed so far, a rectangle goes where it sits
+    // lowest, the least space wasted under it breaking ties. Fast, but the holes under the outline are lost.
+    class SkylinePacker {
+    public:
+        void Reset(uint32_t width, uint32_t height);
+
+        // false if `width` x `height` no longer fits
+        bool Insert(uint32_t width, uint32_t height, AtlasRect &rect);
+
+        // rows from the top down to the lowest rectangle
+        uint32_t UsedHeight() const;
+
+    private:
+        struct Segment {
+            uint32_t x, y, width;
+        };
+
+        // the top of a `width` wide rectangle put at segment `index`, false if it doesn't fit there
+        bool Fit(size_t index, uint32_t width, uint32_t height, uint32_t &y, uint64_t &waste) const;
+
+        uint32_t m_width = 0, m_height = 0;
+        // left to right, adjacent segments never at the same height
+        std::vector<Segment> m_skyline;
+    };
+
+    // MaxRects: keeps every maximal free rectangle, a rectangle goes where its bottom is highest, the free one it
+    // leaves the least over in along its tighter side breaking ties. Slower than the skyline, but fills the holes.
+    class MaxRectsPacker {
+    public:
+        void Reset(uint32_t width, uint32_t height);
+
+        bool Insert(uint32_t width, uint32_t height, AtlasRect &rect);
+
+        uint32_t UsedHeight() const { return m_usedHeight; }
+
+    private:
+        void SplitFree(const AtlasRect &used);
+
+        void PruneFree();
+
+        uint32_t m_width = 0, m_height = 0;
+        uint32_t m_usedHeight = 0;
+        std::vector<AtlasRect> m_free;
+        std::vector<AtlasRect> m_split;
+    };
+
+    enum class AtlasPacking {
+        Skyline,
+        MaxRects,
+    };
+
+    struct AtlasOptions {
+        AtlasPacking packing = AtlasPacking::MaxRects;
+        // width and height of the atlas pages, a multiple of 4 << (mipLevels - 1)
+        uint32_t pageSize = 2048;
+        // textures larger than this along either side are never put in an atlas
+        uint32_t maxAtlasedSize = 256;
+        // at least this many textures of the same size and format make an array of their own instead
+        size_t minArrayLayers = 4;
+        // levels kept in the atlas pages. Every texture starts on a multiple of 1 << (mipLevels - 1) texels so
+        // its mips land on whole texels, 4x4 blocks stay within one texture down to the level where that
+        // multiple drops below 4.
+        uint32_t mipLevels = 4;
+        // texels of gutter on every side of a texture, filled with its nearest edge; the one left and above is
+        // rounded up to the alignment so the texture still starts on whole texels at every level. Bilinear
+        // filtering stays inside a texture down to the level the gutter shrinks to less than a texel.
+        uint32_t padding = 4;
+        CompressionQuality quality = CompressionQuality::Normal;
+        bool parallel = true;
+    };
+
+    struct AtlasSource {
+        // RGBA8 with its mips, see GenerateMips
+        const Image *image = nullptr;
+        // what the binding it lands in is compressed to
+        TextureFormat format = TextureFormat::Rgba8;
+        bool srgb = true;
+    };
+
+    // One texture object materials share: a GL_TEXTURE_2D_ARRAY of atlas pages, or of same sized textures
+    // whose layers need no remapping and can still repeat.
+    struct AtlasBinding {
+        TextureFormat format = TextureFormat::Rgba8;
+        bool srgb = true;
+        bool atlas = false;
+        uint32_t width = 0, height = 0;
+        // every layer in `format` with the same levels
+        std::vector<Image> layers;
+    };
+
+    // Where a source texture ended up: sample layer `layer` of binding `binding` at
+    // uvOffset + uv * uvScale. Sources too large for an atlas and without an array are left out,
+    // their binding is NoBinding and the caller keeps drawing them from their own texture.
+    struct AtlasEntry {
+        static const uint32_t NoBinding = ~0u;
+
+        uint32_t binding = NoBinding;
+        uint32_t layer = 0;
+        float uvOffset[2] = {0.0f, 0.0f};
+        float uvScale[2] = {1.0f, 1.0f};
+        // texels of the page, level 0, undefined for arrays
+        AtlasRect rect;
+    };
+
+    struct AtlasStats {
+        size_t textures = 0;
+        size_t atlasedTextures = 0;
+        size_t arrayTextures = 0;
+        size_t pages = 0;
+        // source texels over page texels, level 0 of every atlas page
+        double packingEfficiency = 0.0;
+        // a bind per source texture before, per binding plus per texture left out after
+        size_t bindsBefore = 0;
+        size_t bindsAfter = 0;
+    };
+
+    struct TexturePack {
+        std::vector<AtlasBinding> bindings;
+        // one per source, in their order: the lookup table
+        std::vector<AtlasEntry> entries;
+        AtlasStats stats;
+    };
+
+    // Groups the sources by format, packs the small ones into atlas pages, builds and compresses the pages and
+    // arrays. Atlased textures clamp at their edges, those that must repeat belong in an array.
+    void PackTextures(const std::vector<AtlasSource> &sources, const AtlasOptions &options, TexturePack &pack);
+
+    // the texture array of a binding, every level uploaded and bound to GL_TEXTURE_2D_ARRAY
+    GLuint CreateAtlasTexture(const AtlasBinding &binding);
+
+    // `count` texture coordinates `stride` bytes apart, u then v as floats, remapped in place into the entry
+    void RemapUvs(const AtlasEntry &entry, void *uvs, size_t count, size_t stride);
+}
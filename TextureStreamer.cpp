@@ -0,0 +1,294 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include "BlockCompression.h"
+#include "GlState.h"
+#include "TextureStreamer.h"
+
+void Gm::TextureStreamer::Initialize(size_t budgetBytes) {
+    m_budgetBytes = budgetBytes;
+    // what textures show until their mip tail is in, mid grey
+    const uint8_t grey[4] = {128, 128, 128, 255};
+    glGenTextures(1, &m_placeholder);
+    GlState::Current().BindTexture(GL_TEXTURE_2D, m_placeholder);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, grey);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+}
+
+void Gm::TextureStreamer::Finalize() {
+    TaskSystem::Instance().Wait(m_loads);
+    GlState &state = GlState::Current();
+    for (TextureEntry &texture : m_textures) {
+        state.DeleteTextures(1, &texture.name);
+    }
+    if (m_placeholder) {
+        state.DeleteTextures(1, &m_placeholder);
+    }
+    m_textures.clear();
+    m_finished.clear();
+    m_uploading.clear();
+    m_placeholder = 0;
+    m_frame = 1;
+    m_stats = TextureStreamingStats();
+}
+
+size_t Gm::TextureStreamer::LevelBytes(const TextureEntry &texture, uint32_t level) const {
+    uint32_t width = std::max(texture.width >> level, 1u), height = std::max(texture.height >> level, 1u);
+    size_t compressed = CompressedLevelBytes(texture.internalFormat, width, height);
+    return compressed != 0 ? compressed : (size_t) width * height * 4;
+}
+
+size_t Gm::TextureStreamer::LevelRangeBytes(const TextureEntry &texture, uint32_t firstLevel,
+                                            uint32_t endLevel) const {
+    size_t bytes = 0;
+    for (uint32_t level = firstLevel; level < endLevel; ++level) {
+        bytes += LevelBytes(texture, level);
+    }
+    return bytes;
+}
+
+Gm::TextureId Gm::TextureStreamer::AddTexture(uint32_t width, uint32_t height, MipLoader loader,
+                                              GLenum internalFormat) {
+    TextureEntry texture;
+    texture.internalFormat = internalFormat;
+    texture.width = width;
+    texture.height = height;
+    while ((std::max(width, height) >> texture.levels) > 0) {
+        ++texture.levels;
+    }
+    while (texture.tailLevel + 1 < texture.levels &&
+           std::max(width >> texture.tailLevel, height >> texture.tailLevel) > MipTailSize) {
+        ++texture.tailLevel;
+    }
+    texture.residentLevel = texture.levels;
+    texture.wantedLevel = texture.tailLevel;
+    texture.loader = std::move(loader);
+    if (!InternalFormatSupported(internalFormat)) {
+        fprintf(stderr, "TextureStreamer: internal format 0x%x is not supported by this context\n", internalFormat);
+    }
+    glGenTextures(1, &texture.name);
+    GlState::Current().BindTexture(GL_TEXTURE_2D, texture.name);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, texture.levels - 1);
+    m_textures.push_back(std::move(texture));
+
+    TextureId id = (TextureId) (m_textures.size() - 1);
+    // the tail goes first and regardless of the budget, a texture without it can't be drawn
+    StartLoad(id, m_textures[id].tailLevel, m_textures[id].levels);
+    m_stats.textures = m_textures.size();
+    return id;
+}
+
+uint32_t Gm::TextureStreamer::DesiredLevel(TextureId texture, float screenPixels) const {
+    const TextureEntry &t = m_textures[texture];
+    if (screenPixels <= 0.0f) {
+        return t.tailLevel;
+    }
+    // one texel per pixel: every halving of the screen size is one level down
+    float ratio = std::max(t.width, t.height) / screenPixels;
+    uint32_t level = ratio <= 1.0f ? 0 : (uint32_t) std::log2(ratio);
+    return std::min(level, t.tailLevel);
+}
+
+void Gm::TextureStreamer::Request(TextureId texture, float screenPixels) {
+    TextureEntry &t = m_textures[texture];
+    if (t.lastRequestFrame != m_frame) {
+        t.lastRequestFrame = m_frame;
+        t.requestedPixels = screenPixels;
+    } else {
+        t.requestedPixels = std::max(t.requestedPixels, screenPixels);
+    }
+}
+
+GLuint Gm::TextureStreamer::Texture(TextureId texture) const {
+    const TextureEntry &t = m_textures[texture];
+    return t.residentLevel <= t.tailLevel ? t.name : m_placeholder;
+}
+
+void Gm::TextureStreamer::StartLoad(TextureId texture, uint32_t firstLevel, uint32_t endLevel) {
+    TextureEntry &t = m_textures[texture];
+    t.loading = true;
+    m_stats.loadingBytes += LevelRangeBytes(t, firstLevel, endLevel);
+    ++m_stats.loadsInFlight;
+    // the worker gets copies, m_textures may grow while it runs
+    MipLoader loader = t.loader;
+    uint32_t width = t.width, height = t.height;
+    TaskSystem::Instance().Run(m_loads, [this, loader, texture, firstLevel, endLevel, width, height] {
+        Load load;
+        load.texture = texture;
+        load.firstLevel = firstLevel;
+        load.endLevel = endLevel;
+        load.succeeded = true;
+        load.texels.resize(endLevel - firstLevel);
+        for (uint32_t level = firstLevel; level < endLevel && load.succeeded; ++level) {
+            load.succeeded = loader(level, std::max(width >> level, 1u), std::max(height >> level, 1u),
+                                    load.texels[level - firstLevel]);
+        }
+        std::lock_guard<std::mutex> lock(m_finishedMutex);
+        m_finished.push_back(std::move(load));
+    });
+}
+
+void Gm::TextureStreamer::FinishLoad(Load &load) {
+    TextureEntry &t = m_textures[load.texture];
+    size_t bytes = LevelRangeBytes(t, load.firstLevel, load.endLevel);
+    t.loading = false;
+    m_stats.loadingBytes -= bytes;
+    --m_stats.loadsInFlight;
+    if (!load.succeeded) {
+        LoadFailed(t);
+        return;
+    }
+    // every level is checked before any is uploaded, a partial upload would hold memory the budget doesn't count
+    if (!InternalFormatSupported(t.internalFormat)) {
+        LoadFailed(t);
+        return;
+    }
+    for (uint32_t level = load.firstLevel; level < load.endLevel; ++level) {
+        if (load.texels[level - load.firstLevel].size() < LevelBytes(t, level)) {
+            LoadFailed(t);
+            return;
+        }
+    }
+    // errors of earlier calls, so that the check below only sees the uploads'; once per load, not per level
+    while (glGetError() != GL_NO_ERROR) {
+    }
+    GlState::Current().BindTexture(GL_TEXTURE_2D, t.name);
+    for (uint32_t level = load.firstLevel; level < load.endLevel; ++level) {
+        const std::vector<uint8_t> &texels = load.texels[level - load.firstLevel];
+        GLsizei width = std::max(t.width >> level, 1u), height = std::max(t.height >> level, 1u);
+        if (CompressedLevelBytes(t.internalFormat, width, height) != 0) {
+            glCompressedTexImage2D(GL_TEXTURE_2D, level, t.internalFormat, width, height, 0,
+                                   (GLsizei) LevelBytes(t, level), texels.data());
+        } else {
+            glTexImage2D(GL_TEXTURE_2D, level, t.internalFormat, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE,
+                         texels.data());
+        }
+    }
+    // e.g. out of memory: the levels that did go up are released again, nothing is resident or charged
+    if (glGetError() != GL_NO_ERROR) {
+        for (uint32_t level = load.firstLevel; level < load.endLevel; ++level) {
+            ReleaseLevel(t, level);
+        }
+        LoadFailed(t);
+        return;
+    }
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, load.firstLevel);
+    t.residentLevel = load.firstLevel;
+    t.failures = 0;
+    m_stats.residentBytes += bytes;
+    m_stats.uploadedBytes += bytes;
+    m_stats.loadedLevels += load.endLevel - load.firstLevel;
+}
+
+void Gm::TextureStreamer::LoadFailed(TextureEntry &t) {
+    // a loader error may be transient, the texture tries again later rather than never
+    uint32_t wait = RetryFrames << std::min(t.failures, 6u);
+    t.retryFrame = m_frame + (wait < MaxRetryFrames ? wait : MaxRetryFrames);
+    ++t.failures;
+}
+
+void Gm::TextureStreamer::ReleaseLevel(const TextureEntry &t, uint32_t level) {
+    if (CompressedLevelBytes(t.internalFormat, 1, 1) != 0) {
+        glCompressedTexImage2D(GL_TEXTURE_2D, level, t.internalFormat, 0, 0, 0, 0, nullptr);
+    } else {
+        glTexImage2D(GL_TEXTURE_2D, level, t.internalFormat, 0, 0, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+    }
+}
+
+void Gm::TextureStreamer::EvictLevel(TextureEntry &t) {
+    GlState::Current().BindTexture(GL_TEXTURE_2D, t.name);
+    // the base level keeps the texture complete without the level
+    ReleaseLevel(t, t.residentLevel);
+    m_stats.residentBytes -= LevelBytes(t, t.residentLevel);
+    ++t.residentLevel;
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, t.residentLevel);
+    ++m_stats.evictedLevels;
+}
+
+void Gm::TextureStreamer::Update() {
+    {
+        std::lock_guard<std::mutex> lock(m_finishedMutex);
+        m_uploading.swap(m_finished);
+    }
+    for (Load &load : m_uploading) {
+        FinishLoad(load);
+    }
+    m_uploading.clear();
+
+    // what this frame's requests want; textures nobody asked for only need their tail
+    m_loadOrder.clear();
+    m_evictOrder.clear();
+    m_stats.requestedBytes = 0;
+    for (TextureId id = 0; id < m_textures.size(); ++id) {
+        TextureEntry &t = m_textures[id];
+        t.wantedLevel = t.lastRequestFrame == m_frame ? DesiredLevel(id, t.requestedPixels) : t.tailLevel;
+        m_stats.requestedBytes += LevelRangeBytes(t, t.wantedLevel, t.levels);
+        if (t.loading) {
+            continue;
+        }
+        // a texture waiting out a failure loads nothing but can still give its levels back
+        bool canLoad = t.retryFrame <= m_frame;
+        if (t.residentLevel > t.tailLevel) {
+            // the tail failed before, retried regardless of the budget as in AddTexture
+            if (canLoad) {
+                StartLoad(id, t.tailLevel, t.levels);
+            }
+            continue;
+        }
+        if (t.wantedLevel < t.residentLevel) {
+            if (canLoad) {
+                m_loadOrder.push_back(id);
+            }
+        } else if (t.residentLevel < t.wantedLevel) {
+            m_evictOrder.push_back(id);
+        }
+    }
+    // the blurriest first, then the largest on screen
+    std::sort(m_loadOrder.begin(), m_loadOrder.end(), [this](TextureId a, TextureId b) {
+        const TextureEntry &ta = m_textures[a], &tb = m_textures[b];
+        uint32_t shortfallA = ta.residentLevel - ta.wantedLevel, shortfallB = tb.residentLevel - tb.wantedLevel;
+        if (shortfallA != shortfallB) {
+            return shortfallA > shortfallB;
+        }
+        return ta.requestedPixels > tb.requestedPixels;
+    });
+    // least recently requested first
+    std::sort(m_evictOrder.begin(), m_evictOrder.end(), [this](TextureId a, TextureId b) {
+        return m_textures[a].lastRequestFrame < m_textures[b].lastRequestFrame;
+    });
+
+    size_t evictNext = 0;
+    // frees one level no request needs, false when there is none left
+    auto evictOne = [&]() {
+        while (evictNext < m_evictOrder.size()) {
+            TextureEntry &t = m_textures[m_evictOrder[evictNext]];
+            if (t.residentLevel < t.wantedLevel) {
+                EvictLevel(t);
+                return true;
+            }
+            ++evictNext;
+        }
+        return false;
+    };
+    for (TextureId id : m_loadOrder) {
+        if (m_stats.loadsInFlight >= MaxLoadsInFlight) {
+            break;
+        }
+        TextureEntry &t = m_textures[id];
+        size_t bytes = LevelBytes(t, t.residentLevel - 1);
+        bool fits = true;
+        while (m_stats.residentBytes + m_stats.loadingBytes + bytes > m_budgetBytes && (fits = evictOne())) {
+        }
+        if (!fits) {
+            break;
+        }
+        StartLoad(id, t.residentLevel - 1, t.residentLevel);
+    }
+    // a lowered budget, or tails that arrived on top of a full one
+    while (m_stats.residentBytes + m_stats.loadingBytes > m_budgetBytes && evictOne()) {
+    }
+    m_stats.budgetBytes = m_budgetBytes;
+    ++m_frame;
+}
@@ -0,0 +1,147 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <vector>
+#include "glad/glad.h"
+#include "TaskSystem.h"
+
+namespace Gm {
+    typedef uint32_t TextureId;
+
+    // Fills `texels` with mip `level` of a texture, `width` x `height` RGBA8 texels row by row, or the blocks
+    // of a compressed internal format. Called on worker threads, returns false if the level can't be produced.
+    typedef std::function<bool(uint32_t level, uint32_t width, uint32_t height, std::vector<uint8_t> &texels)>
+            MipLoader;
+
+    struct TextureStreamingStats {
+        size_t textures = 0;
+        size_t budgetBytes = 0;
+        // GPU memory of the levels loaded, mip tails included
+        size_t residentBytes = 0;
+        // what every texture would take at the level its last request asked for
+        size_t requestedBytes = 0;
+        size_t loadingBytes = 0;
+        size_t loadsInFlight = 0;
+        // since Initialize
+        uint64_t loadedLevels = 0;
+        uint64_t evictedLevels = 0;
+        uint64_t uploadedBytes = 0;
+    };
+
+    // Textures whose higher mips come and go with demand, within a GPU memory budget.
+    //
+    // Every frame the renderer requests the textures it draws with the size they cover on screen. Update
+    // then streams in, one level at a time on the TaskSystem, the levels that size needs, the largest
+    // shortfall first. When the budget is full, levels finer than their texture's current request are
+    // evicted, least recently requested texture first. The mip tail, every level at most MipTailSize texels
+    // wide and high, is loaded as soon as a texture is added and never evicted.
+    //
+    // The GL textures are mutable with GL_TEXTURE_BASE_LEVEL at the finest resident level, evicting a level
+    // redefines it as empty. Only Update and Texture touch GL, both on the GL thread.
+    class TextureStreamer {
+    public:
+        static const uint32_t MipTailSize = 64;
+
+        // at most this many level loads are queued on the TaskSystem at a time
+        static const size_t MaxLoadsInFlight = 8;
+
+        // frames a texture waits before loading again after a failed load, doubling with every failure in a
+        // row up to MaxRetryFrames. Its resident levels stay evictable meanwhile.
+        static const uint32_t RetryFrames = 30;
+        static const uint32_t MaxRetryFrames = 30 * 64;
+
+        void Initialize(size_t budgetBytes);
+
+        // waits for the loads still running, which reference the streamer
+        void Finalize();
+
+        void SetBudget(size_t budgetBytes) { m_budgetBytes = budgetBytes; }
+
+        // compressed internal formats (see BlockCompression.h) are uploaded with glCompressedTexImage2D. One the
+        // context doesn't take (see SupportedTextureFormat) never becomes resident and keeps the placeholder.
+        TextureId AddTexture(uint32_t width, uint32_t height, MipLoader loader,
+                             GLenum internalFormat = GL_SRGB8_ALPHA8);
+
+        // the texture spans about `screenPixels` pixels along its larger side this frame;
+        // several requests in one frame keep the largest
+        void Request(TextureId texture, float screenPixels);
+
+        // uploads finished loads, evicts and starts new loads for the requests since the last Update
+        void Update();
+
+        // the GL texture to sample, a 1x1 placeholder until the mip tail arrived
+        GLuint Texture(TextureId texture) const;
+
+        // finest level that can be sampled, MipLevels() if nothing is resident yet
+        uint32_t ResidentLevel(TextureId texture) const { return m_textures[texture].residentLevel; }
+
+        uint32_t MipLevels(TextureId texture) const { return m_textures[texture].levels; }
+
+        // the level a request of `screenPixels` asks for, never coarser than the mip tail
+        uint32_t DesiredLevel(TextureId texture, float screenPixels) const;
+
+        size_t TextureCount() const { return m_textures.size(); }
+
+        const TextureStreamingStats &GetStats() const { return m_stats; }
+
+    private:
+        struct TextureEntry {
+            GLuint name = 0;
+            GLenum internalFormat = GL_SRGB8_ALPHA8;
+            uint32_t width = 0, height = 0;
+            uint32_t levels = 0;
+            // first level of the mip tail
+            uint32_t tailLevel = 0;
+            uint32_t residentLevel = 0;
+            // finest level wanted by the last Update
+            uint32_t wantedLevel = 0;
+            float requestedPixels = 0.0f;
+            uint64_t lastRequestFrame = 0;
+            bool loading = false;
+            // no loads before this frame, set by a failure
+            uint64_t retryFrame = 0;
+            uint32_t failures = 0;
+            MipLoader loader;
+        };
+
+        struct Load {
+            TextureId texture;
+            uint32_t firstLevel, endLevel;
+            bool succeeded;
+            std::vector<std::vector<uint8_t>> texels;
+        };
+
+        size_t LevelBytes(const TextureEntry &texture, uint32_t level) const;
+
+        size_t LevelRangeBytes(const TextureEntry &texture, uint32_t firstLevel, uint32_t endLevel) const;
+
+        void StartLoad(TextureId texture, uint32_t firstLevel, uint32_t endLevel);
+
+        void FinishLoad(Load &load);
+
+        void LoadFailed(TextureEntry &texture);
+
+        // defines `level` as an empty image, which releases its storage
+        void ReleaseLevel(const TextureEntry &texture, uint32_t level);
+
+        void EvictLevel(TextureEntry &texture);
+
+        std::vector<TextureEntry> m_textures;
+        GLuint m_placeholder = 0;
+        size_t m_budgetBytes = 0;
+        uint64_t m_frame = 1;
+
+        TaskSystem::TaskGroup m_loads;
+        // filled by the workers, drained by Update
+        std::mutex m_finishedMutex;
+        std::vector<Load> m_finished;
+        std::vector<Load> m_uploading;
+
+        std::vector<TextureId> m_loadOrder;
+        std::vector<TextureId> m_evictOrder;
+        TextureStreamingStats m_stats;
+    };
+}
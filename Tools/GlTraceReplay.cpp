@@ -0,0 +1,74 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include "Clock.h"
+#include "FrameStats.h"
+#include "GlState.h"
+#include "GlTrace.h"
+#include "HeadlessContext.h"
+
+namespace {
+    void PrintSummary(const char *label, const Gm::FrameTimeSummary &summary) {
+        printf("%-8s frames %6llu  mean %8.3f  p50 %8.3f  p95 %8.3f  p99 %8.3f  max %8.3f ms  hitches %llu\n",
+               label, (unsigned long long) summary.frames, summary.mean, summary.p50, summary.p95, summary.p99,
+               summary.max, (unsigned long long) summary.hitches);
+    }
+}
+
+// Replays a trace captured with GM_GL_TRACE on an offscreen context: the setup once, then every frame
+// --loops=N times, each waited for, with the percentiles of the frame times.
+int main(int argc, const char *argv[]) {
+    const char *path = nullptr;
+    int loops = 1;
+    for (int i = 1; i < argc; ++i) {
+        if (strncmp(argv[i], "--loops=", 8) == 0) {
+            loops = atoi(argv[i] + 8);
+        } else {
+            path = argv[i];
+        }
+    }
+    if (path == nullptr || loops < 1) {
+        fprintf(stderr, "usage: %s trace [--loops=N]\n", argv[0]);
+        return 1;
+    }
+
+    Gm::GlTraceReplayer replayer;
+    if (!replayer.Load(path)) {
+        fprintf(stderr, "%s\n", replayer.Error().c_str());
+        return 1;
+    }
+    Gm::HeadlessContext context;
+    int width = replayer.Width() > 0 ? replayer.Width() : 1280;
+    int height = replayer.Height() > 0 ? replayer.Height() : 720;
+    if (!context.Create(width, height)) {
+        fprintf(stderr, "no headless OpenGL context\n");
+        return 1;
+    }
+    printf("%s: %llu calls, %zu frames, %dx%d\n", path, (unsigned long long) replayer.CallCount(),
+           replayer.FrameCount(), width, height);
+
+    double start = Gm::Clock::Now();
+    replayer.ReplaySetup();
+    context.Finish();
+    printf("setup    %.3f ms\n", (Gm::Clock::Now() - start) * 1000.0);
+
+    Gm::FrameStatsOptions options;
+    options.windowFrames = replayer.FrameCount() > 0 ? replayer.FrameCount() : 1;
+    Gm::FrameStats stats(options);
+    for (int loop = 0; loop < loops; ++loop) {
+        for (size_t frame = 0; frame < replayer.FrameCount(); ++frame) {
+            start = Gm::Clock::Now();
+            replayer.ReplayFrame(frame);
+            context.Finish();
+            stats.Record(Gm::FrameSeries::Cpu, (Gm::Clock::Now() - start) * 1000.0);
+        }
+        if (loops > 1) {
+            char label[32];
+            snprintf(label, sizeof(label), "loop %d", loop + 1);
+            PrintSummary(label, stats.WindowSummary(Gm::FrameSeries::Cpu));
+        }
+    }
+    PrintSummary("total", stats.Summary(Gm::FrameSeries::Cpu));
+    context.Destroy();
+    return 0;
+}